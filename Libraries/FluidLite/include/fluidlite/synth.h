@@ -197,6 +197,28 @@ FLUIDSYNTH_API int fluid_synth_stop(fluid_synth_t* synth, unsigned int id);
 FLUIDSYNTH_API
 void fluid_synth_set_preset_callback(void* callback);
 
+  /** Set a directory to cache the decoded samples of SF3 soundfonts in.
+      The first time an SF3 soundfont is loaded, its samples are decoded
+      and written to this directory. After that, the decoded samples are
+      mapped from the cache instead of being decoded again.
+      Pass NULL to disable the cache, which is the default.
+
+      \param dir Path of an existing directory, or NULL
+  */
+FLUIDSYNTH_API
+void fluid_synth_set_sample_cache_dir(const char* dir);
+
+  /** Choose between the vectorised DSP kernels for interpolation and
+      mixing, and the plain C ones. By default, the fastest kernels that
+      the CPU supports are used. This applies to all synths.
+      The output of the two differs by rounding only, not bit for bit.
+
+      \param enabled 0 to use the plain C kernels, 1 to use SIMD
+      \return The previous setting
+  */
+FLUIDSYNTH_API
+int fluid_synth_set_simd(int enabled);
+
   /** Loads a SoundFont file and creates a new SoundFont. The newly
       loaded SoundFont will be put on top of the SoundFont
       stack. Presets are searched starting from the SoundFont on the
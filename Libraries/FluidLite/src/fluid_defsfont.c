@@ -27,24 +27,37 @@
 /* Todo: Get rid of that 'include' */
 #include "fluid_sys.h"
 
+#if SF3_SUPPORT
+#include <pthread.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
 #if SF3_SUPPORT == SF3_XIPH_VORBIS
 #include "vorbis/codec.h"
 #include "vorbis/vorbisenc.h"
 #include "vorbis/vorbisfile.h"
 
+/* Decoder state for a single sample. Every decode call has its own, so
+   samples can be decoded on several threads at once */
 struct VorbisData {
     int pos;          // current position in audio->data()
     char* data;
     int datasize;
 };
 
-static struct VorbisData vorbisData;
-
 static size_t ovRead(void* ptr, size_t size, size_t nmemb, void* datasource);
 static int ovSeek(void* datasource, ogg_int64_t offset, int whence);
 static long ovTell(void* datasource);
 
-static ov_callbacks ovCallbacks = { ovRead, ovSeek, 0, ovTell };
+static const ov_callbacks ovCallbacks = { ovRead, ovSeek, 0, ovTell };
 
 //---------------------------------------------------------
 //   ovRead
@@ -102,6 +115,535 @@ static long ovTell(void* datasource)
 #include "stb_vorbis.c"
 #endif
 
+#if SF3_SUPPORT
+
+/***************************************************************
+ *
+ *                    COMPRESSED SAMPLES (SF3)
+ */
+
+/* Directory for the decoded sample cache, or NULL if decoded samples
+   shouldn't be cached */
+static char* sample_cache_dir = NULL;
+
+void fluid_synth_set_sample_cache_dir(const char* dir)
+{
+  if (sample_cache_dir != NULL) {
+    FLUID_FREE(sample_cache_dir);
+    sample_cache_dir = NULL;
+  }
+  if (dir != NULL && dir[0] != 0) {
+    sample_cache_dir = FLUID_STRDUP(dir);
+  }
+}
+
+/*
+ * fluid_sample_decode_vorbis
+ *
+ * Decodes one compressed sample to 16 bit PCM. Returns the number of
+ * frames, and stores the decoded data in 'pcm'. This only uses local
+ * state, so it's safe to call from several threads at once.
+ */
+static int fluid_sample_decode_vorbis(const char* data, int datasize, short** pcm)
+{
+  short *sampledata = NULL;
+  int sampleframes = 0;
+
+#if SF3_SUPPORT == SF3_XIPH_VORBIS
+  struct VorbisData vorbisData;
+  OggVorbis_File vf;
+  int sampledata_size = 0;
+  int capacity = 0;
+
+  vorbisData.pos  = 0;
+  vorbisData.data = (char*)data;
+  vorbisData.datasize = datasize;
+
+  if (ov_open_callbacks(&vorbisData, &vf, 0, 0, ovCallbacks) == 0) {
+#define BUFFER_SIZE 4096
+    int bytes_read = 0;
+    int section = 0;
+    ogg_int64_t total = ov_pcm_total(&vf, -1);
+
+    /* SF3 samples are mono, so we can usually allocate the exact size up front */
+    capacity = (total > 0) ? (int)total * sizeof(short) : BUFFER_SIZE;
+    sampledata = FLUID_MALLOC(capacity);
+
+    while (sampledata != NULL) {
+      int space;
+      if (sampledata_size == capacity) {
+        // the length in the stream was wrong, allocate additional memory for samples
+        short* grown = realloc(sampledata, capacity + BUFFER_SIZE);
+        if (grown == NULL) {
+          break;
+        }
+        sampledata = grown;
+        capacity += BUFFER_SIZE;
+      }
+      space = capacity - sampledata_size;
+      bytes_read = ov_read(&vf, (char*)sampledata + sampledata_size, space < BUFFER_SIZE ? space : BUFFER_SIZE, 0, sizeof(short), 1, &section);
+      if (bytes_read <= 0) {
+        break;
+      }
+      sampledata_size += bytes_read;
+    }
+
+    // shrink sampledata to actual size
+    if (sampledata != NULL && sampledata_size > 0 && sampledata_size < capacity) {
+      short* shrunk = realloc(sampledata, sampledata_size);
+      if (shrunk != NULL) {
+        sampledata = shrunk;
+      }
+    }
+
+    ov_clear(&vf);
+  }
+
+  // because we actually need num of frames so we should divide num of bytes to frame size
+  sampleframes = sampledata_size / sizeof(short);
+#endif
+
+#if SF3_SUPPORT == SF3_STB_VORBIS
+  int channels;
+  sampleframes = stb_vorbis_decode_memory((const uint8*)data, datasize, &channels, NULL, &sampledata);
+#endif
+
+  if (sampleframes <= 0 && sampledata != NULL) {
+    FLUID_FREE(sampledata);
+    sampledata = NULL;
+    sampleframes = 0;
+  }
+
+  *pcm = sampledata;
+  return sampleframes;
+}
+
+/*
+ * fluid_sample_set_decoded
+ *
+ * Points a compressed sample to its decoded data. If 'mapped' is set,
+ * the data belongs to the soundfont's sample cache instead of the sample.
+ */
+static void fluid_sample_set_decoded(fluid_sample_t* sample, short* sampledata, int sampleframes, int mapped)
+{
+  // point sample data to uncompressed data stream
+  sample->data = sampledata;
+  sample->start = 0;
+  sample->end = sampleframes - 1;
+
+  /* loop is fowled?? (cluck cluck :) */
+  if (sample->loopend > sample->end ||
+      sample->loopstart >= sample->loopend ||
+      sample->loopstart <= sample->start) {
+    /* can pad loop by 8 samples and ensure at least 4 for loop (2*8+4) */
+    if ((sample->end - sample->start) >= 20) {
+      sample->loopstart = sample->start + 8;
+      sample->loopend = sample->end - 8;
+    } else { /* loop is fowled, sample is tiny (can't pad 8 samples) */
+      sample->loopstart = sample->start + 1;
+      sample->loopend = sample->end - 1;
+    }
+  }
+
+  if (sampleframes < 8) {
+    sample->valid = 0;
+    FLUID_LOG(FLUID_WARN, "Ignoring sample %s: couldn't decode compressed data", sample->name);
+  }
+
+  sample->sampletype &= ~FLUID_SAMPLETYPE_OGG_VORBIS;
+  sample->sampletype |= mapped ? FLUID_SAMPLETYPE_OGG_VORBIS_MAPPED : FLUID_SAMPLETYPE_OGG_VORBIS_UNPACKED;
+
+  fluid_voice_optimize_sample(sample);
+}
+
+/* Work shared by the decoder threads. Each thread takes the next sample
+   that nobody is working on yet, so one long sample doesn't hold up the rest */
+typedef struct {
+  fluid_sample_t** samples;
+  short** pcm;
+  int* frames;
+  int count;
+  int next;
+  pthread_mutex_t lock;
+} fluid_decode_job_t;
+
+static void* fluid_decode_worker(void* data)
+{
+  fluid_decode_job_t* job = (fluid_decode_job_t*) data;
+  fluid_sample_t* sample;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (i >= job->count) {
+      break;
+    }
+
+    sample = job->samples[i];
+    job->frames[i] = fluid_sample_decode_vorbis((char*)sample->data + sample->start,
+                                                sample->end + 1 - sample->start, &job->pcm[i]);
+  }
+
+  return NULL;
+}
+
+static int fluid_get_num_decode_threads(void)
+{
+  int count;
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  count = (int) info.dwNumberOfProcessors;
+#else
+  count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (count < 1) return 1;
+  if (count > 32) return 32;
+  return count;
+}
+
+/*
+ * Decoded sample cache
+ *
+ * The file holds a header, a table with the position and length of every
+ * compressed sample in the soundfont, and the decoded data of these samples.
+ * The file is mapped into memory as a whole, and the samples point straight
+ * into the mapping, so loading a cached soundfont doesn't copy any sample data.
+ */
+#define FLUID_SAMPLE_CACHE_MAGIC "FLSF3PCM"
+#define FLUID_SAMPLE_CACHE_VERSION 1
+#define FLUID_SAMPLE_CACHE_ALIGN 16
+
+typedef struct {
+  char magic[8];
+  unsigned long long key;
+  unsigned int version;
+  unsigned int count;
+} fluid_sample_cache_header_t;
+
+typedef struct {
+  unsigned long long offset;  /* position of the decoded data in the file, in bytes */
+  unsigned long long frames;
+} fluid_sample_cache_entry_t;
+
+/* FNV-1a, over the compressed sample data and the sample headers that point into it */
+static unsigned long long fluid_hash_bytes(unsigned long long hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = (const unsigned char*) data;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static unsigned long long fluid_sample_cache_key(fluid_defsfont_t* sfont, fluid_sample_t** samples, int count)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  unsigned int version = FLUID_SAMPLE_CACHE_VERSION;
+  int i;
+
+  hash = fluid_hash_bytes(hash, &version, sizeof(version));
+  hash = fluid_hash_bytes(hash, sfont->sampledata, sfont->samplesize);
+  for (i = 0; i < count; i++) {
+    hash = fluid_hash_bytes(hash, &samples[i]->start, sizeof(samples[i]->start));
+    hash = fluid_hash_bytes(hash, &samples[i]->end, sizeof(samples[i]->end));
+  }
+  return hash;
+}
+
+static char* fluid_sample_cache_path(unsigned long long key)
+{
+  size_t size = FLUID_STRLEN(sample_cache_dir) + 32;
+  char* path = FLUID_MALLOC(size);
+  if (path != NULL) {
+    snprintf(path, size, "%s/%016llx.sf3cache", sample_cache_dir, key);
+  }
+  return path;
+}
+
+static void* fluid_map_file(const char* path, size_t* size)
+{
+  void* data = NULL;
+#ifdef _WIN32
+  HANDLE file, mapping;
+  LARGE_INTEGER filesize;
+
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+  if (GetFileSizeEx(file, &filesize) && filesize.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL) {
+      /* The view keeps the mapping alive, so we don't need the handles anymore */
+      data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+      *size = (size_t) filesize.QuadPart;
+    }
+  }
+  CloseHandle(file);
+#else
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      data = NULL;
+    }
+    *size = (size_t) info.st_size;
+  }
+  close(fd);
+#endif
+  return data;
+}
+
+static void fluid_unmap_file(void* data, size_t size)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap(data, size);
+#endif
+}
+
+/*
+ * fluid_sample_cache_load
+ *
+ * Maps the cached samples of this soundfont, if they were cached before.
+ * Nothing is changed unless the whole cache file checks out.
+ */
+static int fluid_sample_cache_load(fluid_defsfont_t* sfont, fluid_sample_t** samples, int count, unsigned long long key)
+{
+  const fluid_sample_cache_header_t* header;
+  const fluid_sample_cache_entry_t* entries;
+  char* path;
+  char* data;
+  size_t size = 0;
+  int i;
+
+  path = fluid_sample_cache_path(key);
+  if (path == NULL) {
+    return FLUID_FAILED;
+  }
+  data = (char*) fluid_map_file(path, &size);
+  FLUID_FREE(path);
+  if (data == NULL) {
+    return FLUID_FAILED;
+  }
+
+  header = (const fluid_sample_cache_header_t*) data;
+  entries = (const fluid_sample_cache_entry_t*) (header + 1);
+
+  if (size < sizeof(*header) + count * sizeof(*entries)
+      || memcmp(header->magic, FLUID_SAMPLE_CACHE_MAGIC, 8) != 0
+      || header->key != key
+      || header->version != FLUID_SAMPLE_CACHE_VERSION
+      || header->count != (unsigned int) count) {
+    fluid_unmap_file(data, size);
+    return FLUID_FAILED;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (entries[i].offset % sizeof(short) != 0
+        || entries[i].frames > INT_MAX
+        || entries[i].offset > size
+        || entries[i].frames * sizeof(short) > size - entries[i].offset) {
+      fluid_unmap_file(data, size);
+      return FLUID_FAILED;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    fluid_sample_set_decoded(samples[i], (short*) (data + entries[i].offset), (int) entries[i].frames, 1);
+  }
+
+  sfont->samplecache = data;
+  sfont->samplecachesize = size;
+  return FLUID_OK;
+}
+
+/*
+ * fluid_sample_cache_save
+ *
+ * Writes the decoded samples to a temporary file first, and moves that into
+ * place when it's complete, so other processes never see a partial file.
+ */
+static void fluid_sample_cache_save(fluid_sample_t** samples, int count, unsigned long long key)
+{
+  fluid_sample_cache_header_t header;
+  fluid_sample_cache_entry_t entry;
+  static const char padding[FLUID_SAMPLE_CACHE_ALIGN] = { 0 };
+  unsigned long long offset;
+  size_t tmpsize;
+  char* path;
+  char* tmppath;
+  FILE* file;
+  int ok = 1;
+  int i;
+
+  path = fluid_sample_cache_path(key);
+  if (path == NULL) {
+    return;
+  }
+  tmpsize = FLUID_STRLEN(path) + 32;
+  tmppath = FLUID_MALLOC(tmpsize);
+  if (tmppath == NULL) {
+    FLUID_FREE(path);
+    return;
+  }
+  snprintf(tmppath, tmpsize, "%s.%p.tmp", path, (void*) samples);
+
+  file = FLUID_FOPEN(tmppath, "wb");
+  if (file == NULL) {
+    FLUID_FREE(tmppath);
+    FLUID_FREE(path);
+    return;
+  }
+
+  FLUID_MEMCPY(header.magic, FLUID_SAMPLE_CACHE_MAGIC, 8);
+  header.key = key;
+  header.version = FLUID_SAMPLE_CACHE_VERSION;
+  header.count = (unsigned int) count;
+  ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+
+  offset = sizeof(header) + count * sizeof(entry);
+  for (i = 0; i < count; i++) {
+    offset = (offset + FLUID_SAMPLE_CACHE_ALIGN - 1) & ~(unsigned long long)(FLUID_SAMPLE_CACHE_ALIGN - 1);
+    entry.offset = offset;
+    entry.frames = (unsigned long long) (samples[i]->end + 1);
+    ok = ok && fwrite(&entry, sizeof(entry), 1, file) == 1;
+    offset += entry.frames * sizeof(short);
+  }
+
+  offset = sizeof(header) + count * sizeof(entry);
+  for (i = 0; i < count && ok; i++) {
+    size_t frames = (size_t) (samples[i]->end + 1);
+    size_t pad = (size_t) ((FLUID_SAMPLE_CACHE_ALIGN - offset % FLUID_SAMPLE_CACHE_ALIGN) % FLUID_SAMPLE_CACHE_ALIGN);
+    ok = (pad == 0 || fwrite(padding, 1, pad, file) == pad)
+      && (frames == 0 || fwrite(samples[i]->data, sizeof(short), frames, file) == frames);
+    offset += pad + frames * sizeof(short);
+  }
+
+  ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+  ok = ok && MoveFileExA(tmppath, path, MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(tmppath, path) == 0;
+#endif
+  if (!ok) {
+    remove(tmppath);
+  }
+
+  FLUID_FREE(tmppath);
+  FLUID_FREE(path);
+}
+
+/*
+ * fluid_defsfont_unpack_samples
+ *
+ * Decodes all compressed samples of a soundfont while loading it, spread
+ * over as many threads as there are cores. If a cache directory is set, the
+ * decoded samples are taken from the cache when possible, and stored there
+ * otherwise.
+ */
+static int fluid_defsfont_unpack_samples(fluid_defsfont_t* sfont)
+{
+  fluid_decode_job_t job;
+  fluid_list_t* list;
+  fluid_sample_t* sample;
+  pthread_t* threads;
+  unsigned long long key = 0;
+  int numthreads, numstarted = 0;
+  int count = 0;
+  int failed = 0;
+  int i;
+
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = (fluid_sample_t*) fluid_list_get(list);
+    if (sample->valid && (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)) {
+      count++;
+    }
+  }
+  if (count == 0) {
+    return FLUID_OK;
+  }
+
+  FLUID_MEMSET(&job, 0, sizeof(job));
+  job.samples = FLUID_ARRAY(fluid_sample_t*, count);
+  job.pcm = FLUID_ARRAY(short*, count);
+  job.frames = FLUID_ARRAY(int, count);
+  if (job.samples == NULL || job.pcm == NULL || job.frames == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    failed = 1;
+    goto done;
+  }
+
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = (fluid_sample_t*) fluid_list_get(list);
+    if (sample->valid && (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)) {
+      job.samples[job.count] = sample;
+      job.pcm[job.count] = NULL;
+      job.frames[job.count] = 0;
+      job.count++;
+    }
+  }
+
+  if (sample_cache_dir != NULL) {
+    key = fluid_sample_cache_key(sfont, job.samples, count);
+    if (fluid_sample_cache_load(sfont, job.samples, count, key) == FLUID_OK) {
+      goto done;
+    }
+  }
+
+  /* The loading thread decodes as well, so we only need to start the other ones */
+  pthread_mutex_init(&job.lock, NULL);
+  numthreads = fluid_get_num_decode_threads();
+  if (numthreads > count) {
+    numthreads = count;
+  }
+  threads = FLUID_ARRAY(pthread_t, numthreads);
+  if (threads != NULL) {
+    for (i = 1; i < numthreads; i++) {
+      if (pthread_create(&threads[numstarted], NULL, fluid_decode_worker, &job) != 0) {
+        break;
+      }
+      numstarted++;
+    }
+  }
+  fluid_decode_worker(&job);
+  for (i = 0; i < numstarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (threads != NULL) {
+    FLUID_FREE(threads);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  for (i = 0; i < count; i++) {
+    fluid_sample_set_decoded(job.samples[i], job.pcm[i], job.frames[i], 0);
+  }
+
+  if (sample_cache_dir != NULL) {
+    fluid_sample_cache_save(job.samples, count, key);
+  }
+
+done:
+  if (job.samples != NULL) FLUID_FREE(job.samples);
+  if (job.pcm != NULL) FLUID_FREE(job.pcm);
+  if (job.frames != NULL) FLUID_FREE(job.frames);
+  return failed ? FLUID_FAILED : FLUID_OK;
+}
+
+#endif
+
 /***************************************************************
  *
  *                           SFONT LOADER
@@ -355,6 +897,8 @@ fluid_defsfont_t* new_fluid_defsfont()
   sfont->samplesize = 0;
   sfont->sample = NULL;
   sfont->sampledata = NULL;
+  sfont->samplecache = NULL;
+  sfont->samplecachesize = 0;
   sfont->preset = NULL;
 
   return sfont;
@@ -393,6 +937,13 @@ int delete_fluid_defsfont(fluid_defsfont_t* sfont)
     FLUID_FREE(sfont->sampledata);
   }
 
+#if SF3_SUPPORT
+  /* The samples are gone, so nothing points into the cache anymore */
+  if (sfont->samplecache != NULL) {
+    fluid_unmap_file(sfont->samplecache, sfont->samplecachesize);
+  }
+#endif
+
   preset = sfont->preset;
   while (preset != NULL) {
     sfont->preset = preset->next;
@@ -469,6 +1020,12 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const char* file, fluid_fileapi
     p = fluid_list_next(p);
   }
 
+#if SF3_SUPPORT
+  /* Decode all compressed samples now, rather than one by one as the presets ask for them */
+  if (fluid_defsfont_unpack_samples(sfont) != FLUID_OK)
+    goto err_exit;
+#endif
+
   /* Load all the presets */
   p = sfdata->preset;
   while (p != NULL) {
@@ -601,72 +1158,12 @@ fluid_sample_t* fluid_defsfont_get_sample(fluid_defsfont_t* sfont, char *s)
     if (FLUID_STRCMP(sample->name, s) == 0) {
 
 #if SF3_SUPPORT
+      /* Compressed samples are normally decoded while loading the soundfont */
       if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) {
         short *sampledata = NULL;
-        int sampleframes = 0;
-
-#if SF3_SUPPORT == SF3_XIPH_VORBIS
-        int sampledata_size = 0;
-        OggVorbis_File vf;
-
-        vorbisData.pos  = 0;
-        vorbisData.data = (char*)sample->data + sample->start;
-        vorbisData.datasize = sample->end + 1 - sample->start;
-
-        if (ov_open_callbacks(&vorbisData, &vf, 0, 0, ovCallbacks) == 0) {
-#define BUFFER_SIZE 4096
-          int bytes_read = 0;
-          int section = 0;
-          for (;;) {
-            // allocate additional memory for samples
-            sampledata = realloc(sampledata, sampledata_size + BUFFER_SIZE);
-            bytes_read = ov_read(&vf, (char*)sampledata + sampledata_size, BUFFER_SIZE, 0, sizeof(short), 1, &section);
-            if (bytes_read > 0) {
-              sampledata_size += bytes_read;
-            } else {
-              // shrink sampledata to actual size
-              sampledata = realloc(sampledata, sampledata_size);
-              break;
-            }
-          }
-
-          ov_clear(&vf);
-        }
-
-        // because we actually need num of frames so we should divide num of bytes to frame size
-        sampleframes = sampledata_size / sizeof(short);
-#endif
-
-#if SF3_SUPPORT == SF3_STB_VORBIS
-        const uint8 *data = (uint8*)sample->data + sample->start;
-        const int datasize = sample->end + 1 - sample->start;
-
-        int channels;
-        sampleframes = stb_vorbis_decode_memory(data, datasize, &channels, NULL, &sampledata);
-#endif
-        // point sample data to uncompressed data stream
-        sample->data = sampledata;
-        sample->start = 0;
-        sample->end = sampleframes - 1;
-
-        /* loop is fowled?? (cluck cluck :) */
-        if (sample->loopend > sample->end ||
-            sample->loopstart >= sample->loopend ||
-            sample->loopstart <= sample->start) {
-          /* can pad loop by 8 samples and ensure at least 4 for loop (2*8+4) */
-          if ((sample->end - sample->start) >= 20) {
-            sample->loopstart = sample->start + 8;
-            sample->loopend = sample->end - 8;
-          } else { /* loop is fowled, sample is tiny (can't pad 8 samples) */
-            sample->loopstart = sample->start + 1;
-            sample->loopend = sample->end - 1;
-          }
-        }
-
-        sample->sampletype &= ~FLUID_SAMPLETYPE_OGG_VORBIS;
-        sample->sampletype |= FLUID_SAMPLETYPE_OGG_VORBIS_UNPACKED;
-
-        fluid_voice_optimize_sample(sample);
+        int sampleframes = fluid_sample_decode_vorbis((char*)sample->data + sample->start,
+                                                      sample->end + 1 - sample->start, &sampledata);
+        fluid_sample_set_decoded(sample, sampledata, sampleframes, 0);
       }
 #endif
 
@@ -480,6 +480,8 @@ struct _fluid_defsfont_t
   unsigned int samplepos;   /* the position in the file at which the sample data starts */
   unsigned int samplesize;  /* the size of the sample data */
   short* sampledata;        /* the sample data, loaded in ram */
+  void* samplecache;        /* the decoded samples, mapped from the sample cache */
+  size_t samplecachesize;   /* the size of the mapped sample cache */
   fluid_list_t* sample;      /* the samples in this soundfont */
   fluid_defpreset_t* preset; /* the presets of this soundfont */
 
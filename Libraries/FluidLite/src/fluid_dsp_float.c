@@ -63,6 +63,453 @@ static fluid_real_t sinc_table7[FLUID_INTERP_MAX][7];
 #define SINC_INTERP_ORDER 7	/* 7th order constant */
 
 
+/* Vectorised kernels
+ *
+ * Most of the output of an interpolator comes from a run of samples for
+ * which all interpolation points lie inside the sample data. The
+ * interpolators work out the length of that run up front, and hand it to a
+ * kernel that doesn't have to check anything per sample. The same goes for
+ * mixing a voice into the output and effect buses.
+ *
+ * Each kernel has a plain C version, which is also the reference for the
+ * others. On x86, AVX2 versions are picked at runtime if the CPU supports
+ * them. On ARM64, NEON is always available, and is used for mixing.
+ */
+
+typedef void (*fluid_interp_kernel_t) (fluid_real_t *out, const short *data,
+                                       const fluid_real_t *table,
+                                       fluid_phase_t *phase, fluid_phase_t phase_incr,
+                                       fluid_real_t *amp, fluid_real_t amp_incr,
+                                       unsigned int count);
+
+typedef void (*fluid_mix_kernel_t) (fluid_real_t *dst, const fluid_real_t *src,
+                                    fluid_real_t gain, int count);
+
+typedef struct {
+  fluid_interp_kernel_t linear;
+  fluid_interp_kernel_t cubic;
+  fluid_interp_kernel_t sinc7;
+  fluid_mix_kernel_t mix;
+} fluid_dsp_kernels_t;
+
+#if !defined(WITH_FLOAT) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define FLUID_DSP_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define FLUID_TARGET_AVX2
+#else
+#define FLUID_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if !defined(WITH_FLOAT) && (defined(__aarch64__) || defined(_M_ARM64))
+#define FLUID_DSP_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Number of output samples, at most 'max', for which the phase index stays
+ * at or below 'end_index' */
+static unsigned int
+fluid_dsp_run_length (fluid_phase_t phase, fluid_phase_t phase_incr,
+                      unsigned int end_index, unsigned int max)
+{
+  fluid_phase_t end_phase = fluid_phase_from_index_fract (end_index, 0xFFFFFFFF);
+  fluid_phase_t count;
+
+  if (max == 0 || phase > end_phase) return 0;
+  if (phase_incr == 0) return max;
+
+  count = (end_phase - phase) / phase_incr + 1;
+  return (count < max) ? (unsigned int) count : max;
+}
+
+static void
+fluid_interp_linear_c (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                       fluid_phase_t *phase, fluid_phase_t phase_incr,
+                       fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  fluid_phase_t dsp_phase = *phase;
+  fluid_real_t dsp_amp = *amp;
+  const fluid_real_t *coeffs;
+  unsigned int dsp_phase_index;
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+    coeffs = table + 2 * fluid_phase_fract_to_tablerow (dsp_phase);
+    out[i] = dsp_amp * (coeffs[0] * data[dsp_phase_index]
+                        + coeffs[1] * data[dsp_phase_index+1]);
+
+    fluid_phase_incr (dsp_phase, phase_incr);
+    dsp_amp += amp_incr;
+  }
+
+  *phase = dsp_phase;
+  *amp = dsp_amp;
+}
+
+static void
+fluid_interp_cubic_c (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                      fluid_phase_t *phase, fluid_phase_t phase_incr,
+                      fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  fluid_phase_t dsp_phase = *phase;
+  fluid_real_t dsp_amp = *amp;
+  const fluid_real_t *coeffs;
+  unsigned int dsp_phase_index;
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+    coeffs = table + 4 * fluid_phase_fract_to_tablerow (dsp_phase);
+    out[i] = dsp_amp * (coeffs[0] * data[dsp_phase_index-1]
+                        + coeffs[1] * data[dsp_phase_index]
+                        + coeffs[2] * data[dsp_phase_index+1]
+                        + coeffs[3] * data[dsp_phase_index+2]);
+
+    fluid_phase_incr (dsp_phase, phase_incr);
+    dsp_amp += amp_incr;
+  }
+
+  *phase = dsp_phase;
+  *amp = dsp_amp;
+}
+
+static void
+fluid_interp_sinc7_c (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                      fluid_phase_t *phase, fluid_phase_t phase_incr,
+                      fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  fluid_phase_t dsp_phase = *phase;
+  fluid_real_t dsp_amp = *amp;
+  const fluid_real_t *coeffs;
+  unsigned int dsp_phase_index;
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+    coeffs = table + SINC_INTERP_ORDER * fluid_phase_fract_to_tablerow (dsp_phase);
+    out[i] = dsp_amp
+      * (coeffs[0] * (fluid_real_t)data[dsp_phase_index-3]
+         + coeffs[1] * (fluid_real_t)data[dsp_phase_index-2]
+         + coeffs[2] * (fluid_real_t)data[dsp_phase_index-1]
+         + coeffs[3] * (fluid_real_t)data[dsp_phase_index]
+         + coeffs[4] * (fluid_real_t)data[dsp_phase_index+1]
+         + coeffs[5] * (fluid_real_t)data[dsp_phase_index+2]
+         + coeffs[6] * (fluid_real_t)data[dsp_phase_index+3]);
+
+    fluid_phase_incr (dsp_phase, phase_incr);
+    dsp_amp += amp_incr;
+  }
+
+  *phase = dsp_phase;
+  *amp = dsp_amp;
+}
+
+static void
+fluid_mix_c (fluid_real_t *dst, const fluid_real_t *src, fluid_real_t gain, int count)
+{
+  int i;
+  for (i = 0; i < count; i++)
+    dst[i] += gain * src[i];
+}
+
+#ifdef FLUID_DSP_AVX2
+
+/* The AVX2 interpolators compute 4 output samples per iteration, each lane
+ * keeps its own 64 bit phase. The upper half of the phase is the sample
+ * index, bits 24-31 select the row in the coefficient table.
+ * Gather instructions are slow on many CPUs, so interpolation points are
+ * loaded per lane, in pairs of 16 bit samples. Coefficients are loaded a
+ * table row at a time, and transposed.
+ * Each lane gets its amplitude as the start plus a multiple of the
+ * increment, where the C version adds the increment once per sample. So the
+ * output is not bit-identical to the C version, it differs by rounding only. */
+
+FLUID_TARGET_AVX2 static inline __m128i
+fluid_avx2_phase_index (__m256i phase)
+{
+  const __m256i upper = _mm256_setr_epi32 (1, 3, 5, 7, 1, 3, 5, 7);
+  return _mm256_castsi256_si128 (_mm256_permutevar8x32_epi32 (phase, upper));
+}
+
+FLUID_TARGET_AVX2 static inline __m128i
+fluid_avx2_phase_row (__m256i phase, int stride)
+{
+  const __m256i lower = _mm256_setr_epi32 (0, 2, 4, 6, 0, 2, 4, 6);
+  __m128i row = _mm256_castsi256_si128 (_mm256_permutevar8x32_epi32 (_mm256_srli_epi64 (phase, FLUID_INTERP_BITS_SHIFT), lower));
+  row = _mm_and_si128 (row, _mm_set1_epi32 (FLUID_INTERP_MAX - 1));
+  return _mm_mullo_epi32 (row, _mm_set1_epi32 (stride));
+}
+
+/* Loads 4 consecutive coefficients from the table row of each lane, and
+ * transposes them so that coeffs[n] holds coefficient n for all lanes */
+FLUID_TARGET_AVX2 static inline void
+fluid_avx2_load_coeffs (const fluid_real_t *table, const int *rows, int offset, __m256d *coeffs)
+{
+  __m256d r0 = _mm256_loadu_pd (table + rows[0] + offset);
+  __m256d r1 = _mm256_loadu_pd (table + rows[1] + offset);
+  __m256d r2 = _mm256_loadu_pd (table + rows[2] + offset);
+  __m256d r3 = _mm256_loadu_pd (table + rows[3] + offset);
+  __m256d t0 = _mm256_unpacklo_pd (r0, r1);
+  __m256d t1 = _mm256_unpackhi_pd (r0, r1);
+  __m256d t2 = _mm256_unpacklo_pd (r2, r3);
+  __m256d t3 = _mm256_unpackhi_pd (r2, r3);
+
+  coeffs[0] = _mm256_permute2f128_pd (t0, t2, 0x20);
+  coeffs[1] = _mm256_permute2f128_pd (t1, t3, 0x20);
+  coeffs[2] = _mm256_permute2f128_pd (t0, t2, 0x31);
+  coeffs[3] = _mm256_permute2f128_pd (t1, t3, 0x31);
+}
+
+/* Loads data[index + offset] and data[index + offset + 1] for each lane */
+FLUID_TARGET_AVX2 static inline void
+fluid_avx2_load_pair (const short *data, const unsigned int *index, int offset, __m256d *first, __m256d *second)
+{
+  int p0, p1, p2, p3;
+  __m128i pair;
+
+  FLUID_MEMCPY (&p0, data + index[0] + offset, sizeof (int));
+  FLUID_MEMCPY (&p1, data + index[1] + offset, sizeof (int));
+  FLUID_MEMCPY (&p2, data + index[2] + offset, sizeof (int));
+  FLUID_MEMCPY (&p3, data + index[3] + offset, sizeof (int));
+  pair = _mm_setr_epi32 (p0, p1, p2, p3);
+  *first = _mm256_cvtepi32_pd (_mm_srai_epi32 (_mm_slli_epi32 (pair, 16), 16));
+  *second = _mm256_cvtepi32_pd (_mm_srai_epi32 (pair, 16));
+}
+
+#define FLUID_AVX2_SETUP \
+  fluid_phase_t dsp_phase = *phase; \
+  fluid_real_t dsp_amp = *amp; \
+  unsigned int i = 0; \
+  __m256i vphase = _mm256_setr_epi64x ((long long) dsp_phase, (long long) (dsp_phase + phase_incr), \
+                                       (long long) (dsp_phase + 2 * phase_incr), (long long) (dsp_phase + 3 * phase_incr)); \
+  __m256i vphase_incr = _mm256_set1_epi64x ((long long) (4 * phase_incr)); \
+  __m256d vamp = _mm256_setr_pd (dsp_amp, dsp_amp + amp_incr, dsp_amp + 2 * amp_incr, dsp_amp + 3 * amp_incr); \
+  __m256d vamp_incr = _mm256_set1_pd (4 * amp_incr)
+
+#define FLUID_AVX2_ADVANCE \
+  vphase = _mm256_add_epi64 (vphase, vphase_incr); \
+  vamp = _mm256_add_pd (vamp, vamp_incr)
+
+/* The last few samples are done by the C version. That isn't compiled for
+ * AVX, so the upper halves of the registers have to be cleared first to
+ * avoid the penalty for switching between AVX and SSE code */
+#define FLUID_AVX2_FINISH(_c_kernel, _table) \
+  _mm256_zeroupper (); \
+  dsp_phase += (fluid_phase_t) i * phase_incr; \
+  dsp_amp += (fluid_real_t) i * amp_incr; \
+  _c_kernel (out + i, data, _table, &dsp_phase, phase_incr, &dsp_amp, amp_incr, count - i); \
+  *phase = dsp_phase; \
+  *amp = dsp_amp
+
+FLUID_TARGET_AVX2 static void
+fluid_interp_linear_avx2 (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                          fluid_phase_t *phase, fluid_phase_t phase_incr,
+                          fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  FLUID_AVX2_SETUP;
+
+  for ( ; i + 4 <= count; i += 4)
+  {
+    unsigned int index[4];
+    int rows[4];
+    __m256d c0, c1, s0, s1, sum;
+
+    _mm_storeu_si128 ((__m128i *) index, fluid_avx2_phase_index (vphase));
+    _mm_storeu_si128 ((__m128i *) rows, fluid_avx2_phase_row (vphase, 2));
+
+    /* Rows of the linear table are only 2 wide, so load them as pairs */
+    c0 = _mm256_setr_pd (table[rows[0]], table[rows[1]], table[rows[2]], table[rows[3]]);
+    c1 = _mm256_setr_pd (table[rows[0] + 1], table[rows[1] + 1], table[rows[2] + 1], table[rows[3] + 1]);
+    fluid_avx2_load_pair (data, index, 0, &s0, &s1);
+    sum = _mm256_add_pd (_mm256_mul_pd (c0, s0), _mm256_mul_pd (c1, s1));
+    _mm256_storeu_pd (out + i, _mm256_mul_pd (vamp, sum));
+
+    FLUID_AVX2_ADVANCE;
+  }
+
+  FLUID_AVX2_FINISH (fluid_interp_linear_c, table);
+}
+
+FLUID_TARGET_AVX2 static void
+fluid_interp_cubic_avx2 (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                         fluid_phase_t *phase, fluid_phase_t phase_incr,
+                         fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  FLUID_AVX2_SETUP;
+
+  for ( ; i + 4 <= count; i += 4)
+  {
+    unsigned int index[4];
+    int rows[4];
+    __m256d c[4], s0, s1, s2, s3, sum;
+
+    _mm_storeu_si128 ((__m128i *) index, fluid_avx2_phase_index (vphase));
+    _mm_storeu_si128 ((__m128i *) rows, fluid_avx2_phase_row (vphase, 4));
+    fluid_avx2_load_coeffs (table, rows, 0, c);
+    fluid_avx2_load_pair (data, index, -1, &s0, &s1);
+    fluid_avx2_load_pair (data, index, 1, &s2, &s3);
+
+    sum = _mm256_mul_pd (c[0], s0);
+    sum = _mm256_add_pd (sum, _mm256_mul_pd (c[1], s1));
+    sum = _mm256_add_pd (sum, _mm256_mul_pd (c[2], s2));
+    sum = _mm256_add_pd (sum, _mm256_mul_pd (c[3], s3));
+    _mm256_storeu_pd (out + i, _mm256_mul_pd (vamp, sum));
+
+    FLUID_AVX2_ADVANCE;
+  }
+
+  FLUID_AVX2_FINISH (fluid_interp_cubic_c, table);
+}
+
+FLUID_TARGET_AVX2 static void
+fluid_interp_sinc7_avx2 (fluid_real_t *out, const short *data, const fluid_real_t *table,
+                         fluid_phase_t *phase, fluid_phase_t phase_incr,
+                         fluid_real_t *amp, fluid_real_t amp_incr, unsigned int count)
+{
+  FLUID_AVX2_SETUP;
+
+  for ( ; i + 4 <= count; i += 4)
+  {
+    unsigned int index[4];
+    int rows[4];
+    __m256d c[8], s[8], sum;
+    int n;
+
+    /* Coefficients 3 to 6 are loaded into c[4] to c[7], so coefficient n ends up in c[n + 1] from there on */
+    _mm_storeu_si128 ((__m128i *) index, fluid_avx2_phase_index (vphase));
+    _mm_storeu_si128 ((__m128i *) rows, fluid_avx2_phase_row (vphase, SINC_INTERP_ORDER));
+    fluid_avx2_load_coeffs (table, rows, 0, c);
+    fluid_avx2_load_coeffs (table, rows, 3, c + 4);
+
+    /* The last pair overlaps with the one before it, so we never read past data[index+3] */
+    fluid_avx2_load_pair (data, index, -3, &s[0], &s[1]);
+    fluid_avx2_load_pair (data, index, -1, &s[2], &s[3]);
+    fluid_avx2_load_pair (data, index, 1, &s[4], &s[5]);
+    fluid_avx2_load_pair (data, index, 2, &s[7], &s[6]);
+
+    sum = _mm256_mul_pd (c[0], s[0]);
+    for (n = 1; n < 3; n++)
+      sum = _mm256_add_pd (sum, _mm256_mul_pd (c[n], s[n]));
+    for (n = 3; n < SINC_INTERP_ORDER; n++)
+      sum = _mm256_add_pd (sum, _mm256_mul_pd (c[n + 1], s[n]));
+    _mm256_storeu_pd (out + i, _mm256_mul_pd (vamp, sum));
+
+    FLUID_AVX2_ADVANCE;
+  }
+
+  FLUID_AVX2_FINISH (fluid_interp_sinc7_c, table);
+}
+
+FLUID_TARGET_AVX2 static void
+fluid_mix_avx2 (fluid_real_t *dst, const fluid_real_t *src, fluid_real_t gain, int count)
+{
+  __m256d vgain = _mm256_set1_pd (gain);
+  int i = 0;
+
+  for ( ; i + 4 <= count; i += 4)
+    _mm256_storeu_pd (dst + i, _mm256_add_pd (_mm256_loadu_pd (dst + i),
+                                              _mm256_mul_pd (vgain, _mm256_loadu_pd (src + i))));
+
+  _mm256_zeroupper ();
+  fluid_mix_c (dst + i, src + i, gain, count - i);
+}
+
+static int
+fluid_cpu_has_avx2 (void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+
+  /* The CPU needs AVX and AVX2, and the OS has to save the AVX registers */
+  __cpuid (info, 0);
+  if (info[0] < 7) return 0;
+  __cpuid (info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return 0;
+  if ((_xgetbv (0) & 6) != 6) return 0;
+  __cpuidex (info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+#endif
+}
+
+#endif /* FLUID_DSP_AVX2 */
+
+#ifdef FLUID_DSP_NEON
+
+static void
+fluid_mix_neon (fluid_real_t *dst, const fluid_real_t *src, fluid_real_t gain, int count)
+{
+  float64x2_t vgain = vdupq_n_f64 (gain);
+  int i = 0;
+
+  for ( ; i + 4 <= count; i += 4)
+  {
+    vst1q_f64 (dst + i, vaddq_f64 (vld1q_f64 (dst + i), vmulq_f64 (vgain, vld1q_f64 (src + i))));
+    vst1q_f64 (dst + i + 2, vaddq_f64 (vld1q_f64 (dst + i + 2), vmulq_f64 (vgain, vld1q_f64 (src + i + 2))));
+  }
+
+  fluid_mix_c (dst + i, src + i, gain, count - i);
+}
+
+#endif /* FLUID_DSP_NEON */
+
+static const fluid_dsp_kernels_t fluid_dsp_kernels_c = {
+  fluid_interp_linear_c, fluid_interp_cubic_c, fluid_interp_sinc7_c, fluid_mix_c
+};
+
+static fluid_dsp_kernels_t fluid_dsp_kernels = {
+  fluid_interp_linear_c, fluid_interp_cubic_c, fluid_interp_sinc7_c, fluid_mix_c
+};
+
+static int fluid_dsp_simd_enabled = 1;
+
+/* Picks the fastest kernels the CPU supports, or the C kernels if SIMD is disabled */
+static void
+fluid_dsp_float_select_kernels (void)
+{
+  fluid_dsp_kernels = fluid_dsp_kernels_c;
+
+  if (!fluid_dsp_simd_enabled) return;
+
+#ifdef FLUID_DSP_AVX2
+  if (fluid_cpu_has_avx2 ())
+  {
+    fluid_dsp_kernels.linear = fluid_interp_linear_avx2;
+    fluid_dsp_kernels.cubic = fluid_interp_cubic_avx2;
+    fluid_dsp_kernels.sinc7 = fluid_interp_sinc7_avx2;
+    fluid_dsp_kernels.mix = fluid_mix_avx2;
+  }
+#endif
+
+#ifdef FLUID_DSP_NEON
+  fluid_dsp_kernels.mix = fluid_mix_neon;
+#endif
+}
+
+int fluid_synth_set_simd (int enabled)
+{
+  int previous = fluid_dsp_simd_enabled;
+  fluid_dsp_simd_enabled = enabled;
+  fluid_dsp_float_select_kernels ();
+  return previous;
+}
+
+/* Mixes a voice into an output or effect bus */
+void
+fluid_dsp_float_mix (fluid_real_t *dst, const fluid_real_t *src, fluid_real_t gain, int count)
+{
+  fluid_dsp_kernels.mix (dst, src, gain, count);
+}
+
+
 /* Initializes interpolation tables */
 void fluid_dsp_float_config (void)
 {
@@ -118,6 +565,8 @@ void fluid_dsp_float_config (void)
 	    sinc_table7[3][i], sinc_table7[4][i], sinc_table7[5][i], sinc_table7[6][i]);
   }
 #endif
+
+  fluid_dsp_float_select_kernels ();
 }
 
 
@@ -201,6 +650,7 @@ fluid_dsp_float_interpolate_linear (fluid_voice_t *voice)
   unsigned int end_index;
   short int point;
   fluid_real_t *coeffs;
+  unsigned int count;
   int looping;
 
   /* Convert playback "speed" floating point value to phase index/fract */
@@ -223,16 +673,13 @@ fluid_dsp_float_interpolate_linear (fluid_voice_t *voice)
     dsp_phase_index = fluid_phase_index (dsp_phase);
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    count = fluid_dsp_run_length (dsp_phase, dsp_phase_incr, end_index, FLUID_BUFSIZE - dsp_i);
+    if (count > 0)
     {
-      coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index]
-				  + coeffs[1] * dsp_data[dsp_phase_index+1]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      fluid_dsp_kernels.linear (dsp_buf + dsp_i, dsp_data, interp_coeff_linear[0],
+				&dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr, count);
+      dsp_i += count;
       dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
     }
 
     /* break out if buffer filled */
@@ -292,6 +739,7 @@ fluid_dsp_float_interpolate_4th_order (fluid_voice_t *voice)
   unsigned int start_index, end_index;
   short int start_point, end_point1, end_point2;
   fluid_real_t *coeffs;
+  unsigned int count;
   int looping;
 
   /* Convert playback "speed" floating point value to phase index/fract */
@@ -348,18 +796,13 @@ fluid_dsp_float_interpolate_4th_order (fluid_voice_t *voice)
     }
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    count = fluid_dsp_run_length (dsp_phase, dsp_phase_incr, end_index, FLUID_BUFSIZE - dsp_i);
+    if (count > 0)
     {
-      coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * dsp_data[dsp_phase_index+2]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      fluid_dsp_kernels.cubic (dsp_buf + dsp_i, dsp_data, interp_coeff[0],
+			       &dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr, count);
+      dsp_i += count;
       dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
     }
 
     /* break out if buffer filled */
@@ -445,6 +888,7 @@ fluid_dsp_float_interpolate_7th_order (fluid_voice_t *voice)
   short int start_points[3];
   short int end_points[3];
   fluid_real_t *coeffs;
+  unsigned int count;
   int looping;
 
   /* Convert playback "speed" floating point value to phase index/fract */
@@ -563,23 +1007,13 @@ fluid_dsp_float_interpolate_7th_order (fluid_voice_t *voice)
 
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    count = fluid_dsp_run_length (dsp_phase, dsp_phase_incr, end_index, FLUID_BUFSIZE - dsp_i);
+    if (count > 0)
     {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      fluid_dsp_kernels.sinc7 (dsp_buf + dsp_i, dsp_data, sinc_table7[0],
+			       &dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr, count);
+      dsp_i += count;
       dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
     }
 
     /* break out if buffer filled */
@@ -287,5 +287,6 @@ int fluid_dsp_float_interpolate_none (fluid_voice_t *voice);
 int fluid_dsp_float_interpolate_linear (fluid_voice_t *voice);
 int fluid_dsp_float_interpolate_4th_order (fluid_voice_t *voice);
 int fluid_dsp_float_interpolate_7th_order (fluid_voice_t *voice);
+void fluid_dsp_float_mix (fluid_real_t *dst, const fluid_real_t *src, fluid_real_t gain, int count);
 
 #endif /* _FLUID_VOICE_H */
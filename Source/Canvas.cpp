@@ -581,7 +581,7 @@ void Canvas::performSynchronise()
     editor->updateCommandStatus();
     repaint();
     
-    needsSearchUpdate = true;
+    pd->searchIndex.markChanged(patch.getPointer().get());
 
     pd->updateObjectImplementations();
 }
@@ -110,7 +110,7 @@ public:
         setAlwaysOnTop(true);
 
         auto offlineObjectRenderer = OfflineObjectRenderer::findParentOfflineObjectRendererFor(target);
-        // FIXME: we should only ask a new mask image when the theme has changed so it's the correct colour
+        // Cached by theme colour, so this is cheap when the palette has been prerendered
         dragImage = offlineObjectRenderer->patchToMaskedImage(target->getObjectString(), 3.0f).image;
         dragInvalidImage = offlineObjectRenderer->patchToMaskedImage(target->getObjectString(), 3.0f, true).image;
 
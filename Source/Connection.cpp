@@ -27,6 +27,7 @@ Connection::Connection(Canvas* parent, Iolet* s, Iolet* e, t_outconnect* oc)
     , ptr(parent->pd)
 {
     cnv->selectedComponents.addChangeListener(this);
+    cnv->pd->messageTracer.addChangeListener(this);
 
     locked.referTo(parent->locked);
     presentationMode.referTo(parent->presentationMode);
@@ -90,7 +91,11 @@ Connection::Connection(Canvas* parent, Iolet* s, Iolet* e, t_outconnect* oc)
 Connection::~Connection()
 {
     cnv->pd->unregisterMessageListener(ptr.getRawUnchecked<void>(), this);
+    cnv->pd->lockAudioThread();
+    cnv->pd->messageTracer.untrace(ptr.getRawUnchecked<void>());
+    cnv->pd->unlockAudioThread();
     cnv->selectedComponents.removeChangeListener(this);
+    cnv->pd->messageTracer.removeChangeListener(this);
 
     if (outlet) {
         outlet->repaint();
@@ -113,6 +118,26 @@ void Connection::changeListenerCallback(ChangeBroadcaster* source)
 {
     if (auto selectedItems = dynamic_cast<SelectedItemSet<WeakReference<Component>>*>(source))
         setSelected(selectedItems->isSelected(this));
+    else if (source == &cnv->pd->messageTracer)
+        updateTrafficLevel();
+}
+
+void Connection::updateTrafficLevel()
+{
+    if (!outlet || outlet->isSignal)
+        return;
+
+    // Logarithmic scale, where 1000 messages per second or more is the maximum
+    auto rate = cnv->pd->messageTracer.getMessageRate(ptr.getRawUnchecked<void>());
+    auto newLevel = std::clamp(std::log10(rate + 1.0f) / 3.0f, 0.0f, 1.0f);
+
+    // Quantise, so we don't repaint for every small change in rate
+    newLevel = std::round(newLevel * 16.0f) / 16.0f;
+
+    if (!approximatelyEqual(newLevel, trafficLevel)) {
+        trafficLevel = newLevel;
+        repaint();
+    }
 }
 
 void Connection::valueChanged(Value& v)
@@ -196,6 +221,11 @@ void Connection::setPointer(t_outconnect* newPtr)
 
         cnv->pd->unregisterMessageListener(originalPointer, this);
         cnv->pd->registerMessageListener(newPtr, this);
+
+        cnv->pd->lockAudioThread();
+        cnv->pd->messageTracer.untrace(originalPointer);
+        cnv->pd->messageTracer.trace(newPtr);
+        cnv->pd->unlockAudioThread();
     }
 }
 
@@ -282,7 +312,8 @@ void Connection::renderConnectionPath(Graphics& g,
     bool isHovering,
     int connectionCount,
     int multiConnectNumber,
-    int numSignalChannels)
+    int numSignalChannels,
+    float trafficLevel)
 {
     auto baseColour = cnv->findColour(PlugDataColour::connectionColourId);
     auto dataColour = cnv->findColour(PlugDataColour::dataColourId);
@@ -298,16 +329,22 @@ void Connection::renderConnectionPath(Graphics& g,
         baseColour = baseColour.brighter(0.6f);
     }
 
+    // When tracing messages, busy connections get thicker and shift towards red
+    if (trafficLevel > 0.0f) {
+        baseColour = baseColour.interpolatedWith(Colours::red, trafficLevel * 0.8f);
+    }
+
     bool useThinConnection = PlugDataLook::getUseThinConnections();
+    auto trafficThickness = trafficLevel * 2.0f;
 
     // outer stroke
     g.setColour(baseColour.darker(1.0f));
-    g.strokePath(connectionPath, PathStrokeType(useThinConnection ? 1.0f : 2.5f, PathStrokeType::mitered, PathStrokeType::rounded));
+    g.strokePath(connectionPath, PathStrokeType((useThinConnection ? 1.0f : 2.5f) + trafficThickness, PathStrokeType::mitered, PathStrokeType::rounded));
 
     // inner stroke
     g.setColour(baseColour);
     Path innerPath = connectionPath;
-    PathStrokeType innerStroke(useThinConnection ? 1.0f : 1.5f);
+    PathStrokeType innerStroke((useThinConnection ? 1.0f : 1.5f) + trafficThickness);
 
     if (PlugDataLook::getUseDashedConnections() && isSignal) {
         PathStrokeType dashedStroke(useThinConnection ? 0.5f : 0.8f);
@@ -424,7 +461,8 @@ void Connection::paint(Graphics& g)
         isHovering,
         getNumberOfConnections(),
         getMultiConnectNumber(),
-        numSignalChannels);
+        numSignalChannels,
+        trafficLevel);
 
     /* ENABLE_CONNECTION_GRAPHICS_DEBUGGING_REPAINT
         static Random rng;
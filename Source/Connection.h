@@ -57,7 +57,8 @@ public:
         bool isHovering = false,
         int connections = 0,
         int connectionNum = 0,
-        int numSignalChannels = 0);
+        int numSignalChannels = 0,
+        float trafficLevel = 0.0f);
 
     static Path getNonSegmentedPath(Point<float> start, Point<float> end);
 
@@ -128,6 +129,8 @@ private:
 
     void setSelected(bool shouldBeSelected);
 
+    void updateTrafficLevel();
+
     Array<SafePointer<Connection>> reconnecting;
     Rectangle<float> startReconnectHandle, endReconnectHandle, endCableOrderDisplay;
 
@@ -143,6 +146,9 @@ private:
     bool showConnectionOrder = false;
     bool showActiveState = false;
 
+    // Message rate measured by the message tracer, mapped to 0-1
+    float trafficLevel = 0.0f;
+
     Canvas* cnv;
 
     Point<float> previousPStart = Point<float>();
@@ -59,6 +59,9 @@ public:
         autoPatchingValue.referTo(settingsFile->getPropertyAsValue("autoconnect"));
         otherProperties.add(new PropertiesPanel::BoolComponent("Enable auto patching", autoPatchingValue, { "No", "Yes" }));
 
+        parallelVoicesValue.referTo(settingsFile->getPropertyAsValue("parallel_voices"));
+        otherProperties.add(new PropertiesPanel::BoolComponent("Render clone voices in parallel", parallelVoicesValue, { "No", "Yes" }));
+
         autosaveInterval.referTo(settingsFile->getPropertyAsValue("autosave_interval"));
         autosaveProperties.add(new PropertiesPanel::EditableComponent<int>("Autosave interval (seconds)", autosaveInterval, 15, 900));
 
@@ -186,6 +189,7 @@ public:
 
     Value showPalettesValue;
     Value autoPatchingValue;
+    Value parallelVoicesValue;
     Value showAllAudioDeviceValues;
     Value nativeDialogValue;
     Value autosaveInterval;
@@ -470,7 +470,7 @@ public:
 
         latencyValue.addListener(this);
 
-        latencyValue = proc->getLatencySamples();
+        latencyValue = proc->getLatencySamples() - proc->subpatchLatency;
 
         latencyNumberBox = new PropertiesPanel::EditableComponent<int>("Latency (samples)", latencyValue);
         tailLengthNumberBox = new PropertiesPanel::EditableComponent<float>("Tail length (seconds)", tailLengthValue);
@@ -495,7 +495,8 @@ public:
     void valueChanged(Value& v) override
     {
         if (v.refersToSameSourceAs(latencyValue)) {
-            processor->setLatencySamples(getValue<int>(latencyValue));
+            auto* proc = dynamic_cast<PluginProcessor*>(processor);
+            processor->setLatencySamples(getValue<int>(latencyValue) + proc->subpatchLatency);
         }
     }
 
@@ -31,6 +31,7 @@
 #include "ObjectBrowserDialog.h"
 #include "ObjectReferenceDialog.h"
 #include "Heavy/HeavyExportDialog.h"
+#include "Heavy/SubpatchCompiler.h"
 #include "MainMenu.h"
 #include "AddObjectMenu.h"
 #include "Canvas.h"
@@ -492,6 +493,63 @@ void Dialogs::showCanvasRightClickMenu(Canvas* cnv, Component* originalComponent
 
     popupMenu.addItem(Open, "Open", object && !multiple && canBeOpened); // for opening subpatches
 
+    // Subpatches can be compiled with Heavy, and run as native code
+    auto getSubpatchCanvas = [](Object* object) -> t_canvas* {
+        auto* ptr = object ? object->getPointer() : nullptr;
+        return ptr && pd_class(&ptr->g_pd) == canvas_class ? reinterpret_cast<t_canvas*>(ptr) : nullptr;
+    };
+
+    auto* subpatchCanvas = multiple ? nullptr : getSubpatchCanvas(object);
+    if (subpatchCanvas && editor->pd->compiledSubpatches.isCompiled(subpatchCanvas)) {
+        popupMenu.addItem("Run in Pd", [editor, object, getSubpatchCanvas]() {
+            if (auto* canvas = getSubpatchCanvas(object))
+                editor->pd->compiledSubpatches.unload(canvas);
+        });
+    } else {
+        popupMenu.addItem("Compile in Place", subpatchCanvas && SubpatchCompiler::isAvailable(), false, [editor, object, getSubpatchCanvas]() {
+            if (auto* canvas = getSubpatchCanvas(object))
+                editor->pd->subpatchCompiler->compile(canvas, object->gui ? object->gui->getText() : String("subpatch"));
+        });
+    }
+
+    // Subpatches can also run at a higher sample rate than the rest of the patch, for stages that would otherwise alias
+    PopupMenu oversampleMenu;
+    if (subpatchCanvas) {
+        using Quality = pd::OversampledSubpatches::Quality;
+        auto const currentFactor = editor->pd->oversampledSubpatches.getFactor(subpatchCanvas);
+        auto const currentQuality = editor->pd->oversampledSubpatches.getQuality(subpatchCanvas);
+
+        auto setOversampling = [editor, object, getSubpatchCanvas](int factor, Quality quality) {
+            auto* canvas = getSubpatchCanvas(object);
+            if (!canvas)
+                return;
+
+            editor->pd->oversampledSubpatches.setOversampling(canvas, factor, quality);
+
+            // The oversampling is saved with the patch
+            editor->pd->lockAudioThread();
+            canvas_dirty(canvas, 1);
+            editor->pd->unlockAudioThread();
+        };
+
+        for (int factor : { 1, 2, 4, 8, 16 }) {
+            oversampleMenu.addItem(factor == 1 ? String("Off") : String(factor) + "x", true, factor == currentFactor, [setOversampling, factor, currentQuality]() {
+                setOversampling(factor, currentQuality);
+            });
+        }
+
+        oversampleMenu.addSeparator();
+
+        StringArray const qualityNames = { "Low", "Medium", "High" };
+        for (int quality = Quality::Low; quality <= Quality::High; quality++) {
+            auto const text = qualityNames[quality] + " quality (" + String(pd::OversampledSubpatches::getLatency(static_cast<Quality>(quality))) + " samples latency)";
+            oversampleMenu.addItem(text, currentFactor > 1, currentFactor > 1 && quality == currentQuality, [setOversampling, currentFactor, quality]() {
+                setOversampling(currentFactor, static_cast<Quality>(quality));
+            });
+        }
+    }
+    popupMenu.addSubMenu("Oversample", oversampleMenu, subpatchCanvas != nullptr);
+
     popupMenu.addSeparator();
     popupMenu.addItem(Help, "Help", object != nullptr);
     popupMenu.addItem(Reference, "Reference", object != nullptr);
@@ -517,6 +575,32 @@ void Dialogs::showCanvasRightClickMenu(Canvas* cnv, Component* originalComponent
     });
     addCommandItem(popupMenu, CommandIDs::ConnectionPathfind);
 
+    popupMenu.addItem("Export Message Trace...", cnv->pd->messageTracer.isEnabled(), false, [editor]() {
+        Dialogs::showSaveDialog([editor](File& result) {
+            if (result.getFullPathName().isEmpty())
+                return;
+
+            auto getConnectionName = [editor](void* target) -> String {
+                for (auto* cnv : editor->canvases) {
+                    for (auto* connection : cnv->connections) {
+                        if (connection->getPointer() != target || !connection->outobj || !connection->inobj)
+                            continue;
+
+                        auto getObjectName = [](Object* object) {
+                            return object->gui ? object->gui->getText() : String();
+                        };
+                        return getObjectName(connection->outobj) + " " + String(connection->outIdx) + " -> " + getObjectName(connection->inobj) + " " + String(connection->inIdx);
+                    }
+                }
+
+                return String::toHexString(reinterpret_cast<pointer_sized_int>(target));
+            };
+
+            editor->pd->messageTracer.exportChromeTrace(result.withFileExtension(".json"), 10.0, getConnectionName);
+        },
+            "*.json", "MessageTrace");
+    });
+
     popupMenu.addSeparator();
     addCommandItem(popupMenu, CommandIDs::Encapsulate);
     popupMenu.addSeparator();
@@ -581,8 +581,9 @@ class ObjectSearchComponent : public Component
     , public KeyListener {
 
 public:
-    explicit ObjectSearchComponent(pd::Library& library)
-        : bouncer(listBox.getViewport())
+    explicit ObjectSearchComponent(pd::Library& objectLibrary)
+        : library(objectLibrary)
+        , bouncer(listBox.getViewport())
     {
         listBox.setModel(this);
         listBox.setRowHeight(28);
@@ -738,16 +739,8 @@ public:
         if (query.isEmpty())
             return;
 
-        for (auto& item : objectDescriptions) {
-            // Insert in front if the query matches a whole word
-            if (item.first.containsWholeWord(query) || item.second.containsWholeWord(query)) {
-                searchResult.insert(0, item.first);
-            }
-            // Insert in back if it contains the query
-            else if (item.first.containsIgnoreCase(query) || item.second.containsIgnoreCase(query)) {
-                searchResult.add(item.first);
-            }
-        }
+        // Results are already ranked by the library index
+        searchResult.addArray(library.searchObjects(query, 500));
 
         listBox.updateContent();
         listBox.repaint();
@@ -782,6 +775,8 @@ public:
     std::function<void(String const&)> changeCallback;
 
 private:
+    pd::Library& library;
+
     ListBox listBox;
     BouncingViewportAttachment bouncer;
 
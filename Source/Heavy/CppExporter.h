@@ -32,43 +32,17 @@ public:
     {
         exportingView->showState(ExportingProgressView::Busy);
 
-        StringArray args = { heavyExecutable.getFullPathName(), pdPatch, "-o" + outdir };
-
         name = name.replaceCharacter('-', '_');
-        args.add("-n" + name);
-
-        if (copyright.isNotEmpty()) {
-            args.add("--copyright");
-            args.add("\"" + copyright + "\"");
-        }
-
-        args.add("-v");
-
-        String paths = "-p";
-        for (auto& path : searchPaths) {
-            paths += " " + path;
-        }
-
-        args.add(paths);
-
-        if (shouldQuit)
-            return true;
-
-        start(args.joinIntoString(" "));
 
-        waitForProcessToFinish(-1);
-        exportingView->flushConsole();
+        auto outputFile = File(outdir);
+        auto exitCode = generateSources(pdPatch, outputFile, name, copyright, searchPaths);
 
         if (shouldQuit)
             return true;
 
-        auto outputFile = File(outdir);
         outputFile.getChildFile("ir").deleteRecursively();
         outputFile.getChildFile("hv").deleteRecursively();
 
-        // Delay to get correct exit code
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
-
-        return getExitCode();
+        return exitCode;
     }
 };
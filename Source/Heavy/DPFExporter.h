@@ -118,15 +118,7 @@ public:
     {
         exportingView->showState(ExportingProgressView::Busy);
 
-        StringArray args = { heavyExecutable.getFullPathName(), pdPatch, "-o" + outdir };
-
         name = name.replaceCharacter('-', '_');
-        args.add("-n" + name);
-
-        if (copyright.isNotEmpty()) {
-            args.add("--copyright");
-            args.add("\"" + copyright + "\"");
-        }
 
         int midiin = getValue<int>(midiinEnableValue);
         int midiout = getValue<int>(midioutEnableValue);
@@ -168,113 +160,103 @@ public:
 
         metaJson->setProperty("dpf", metaDPF);
 
-        args.add("-m" + createMetaJson(metaJson));
-
-        args.add("-v");
-        args.add("-gdpf");
+        auto outputFile = File(outdir);
+        auto compile = getValue<int>(exportTypeValue) == 2;
 
-        String paths = "-p";
-        for (auto& path : searchPaths) {
-            paths += " " + path;
-        }
+        // Binaries are built in a directory that we keep around, so the next build can reuse its object files
+        auto buildDir = HeavyCache::getBuildDirectory("dpf", name);
 
-        args.add(paths);
+        bool generationExitCode = generateSources(pdPatch, compile ? buildDir : outputFile, name, copyright, searchPaths, "dpf", metaJson, compile);
 
         if (shouldQuit)
             return true;
 
-        start(args.joinIntoString(" "));
-
-        waitForProcessToFinish(-1);
-        exportingView->flushConsole();
+        auto DPF = Toolchain::dir.getChildFile("lib").getChildFile("dpf");
 
-        if (shouldQuit)
-            return true;
+        if (!compile) {
+            outputFile.getChildFile("ir").deleteRecursively();
+            outputFile.getChildFile("hv").deleteRecursively();
+            outputFile.getChildFile("c").deleteRecursively();
 
-        auto outputFile = File(outdir);
-        outputFile.getChildFile("ir").deleteRecursively();
-        outputFile.getChildFile("hv").deleteRecursively();
-        outputFile.getChildFile("c").deleteRecursively();
+            DPF.copyDirectoryTo(outputFile.getChildFile("dpf"));
+        }
 
-        auto DPF = Toolchain::dir.getChildFile("lib").getChildFile("dpf");
-        DPF.copyDirectoryTo(outputFile.getChildFile("dpf"));
+        // Check if we need to compile
+        if (!generationExitCode && compile) {
+            auto const startTime = Time::getMillisecondCounterHiRes();
 
-        // Delay to get correct exit code
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
+            // Only copies the files that differ, so the objects that were built from it stay up to date
+            HeavyCache::syncDirectory(DPF, buildDir.getChildFile("dpf"));
 
-        bool generationExitCode = getExitCode();
-        // Check if we need to compile
-        if (!generationExitCode && getValue<int>(exportTypeValue) == 2) {
             auto workingDir = File::getCurrentWorkingDirectory();
 
-            outputFile.setAsCurrentWorkingDirectory();
+            buildDir.setAsCurrentWorkingDirectory();
 
             auto bin = Toolchain::dir.getChildFile("bin");
             auto make = bin.getChildFile("make" + exeSuffix);
-            auto makefile = outputFile.getChildFile("Makefile");
+            auto makefile = buildDir.getChildFile("Makefile");
 
 #if JUCE_MAC
-            Toolchain::startShellScript("make -j4 -f " + makefile.getFullPathName(), this);
+            Toolchain::startShellScript("make " + getParallelJobsFlag() + " -f " + makefile.getFullPathName(), this);
 #elif JUCE_WINDOWS
             auto path = "export PATH=\"$PATH:" + Toolchain::dir.getChildFile("bin").getFullPathName().replaceCharacter('\\', '/') + "\"\n";
             auto cc = "CC=" + Toolchain::dir.getChildFile("bin").getChildFile("gcc.exe").getFullPathName().replaceCharacter('\\', '/') + " ";
             auto cxx = "CXX=" + Toolchain::dir.getChildFile("bin").getChildFile("g++.exe").getFullPathName().replaceCharacter('\\', '/') + " ";
 
-            Toolchain::startShellScript(path + cc + cxx + make.getFullPathName().replaceCharacter('\\', '/') + " -j4 -f " + makefile.getFullPathName().replaceCharacter('\\', '/'), this);
+            Toolchain::startShellScript(path + cc + cxx + make.getFullPathName().replaceCharacter('\\', '/') + " " + getParallelJobsFlag() + " -f " + makefile.getFullPathName().replaceCharacter('\\', '/'), this);
 
 #else // Linux or BSD
             auto prepareEnvironmentScript = Toolchain::dir.getChildFile("scripts").getChildFile("anywhere-setup.sh").getFullPathName() + "\n";
 
             auto buildScript = prepareEnvironmentScript
                 + make.getFullPathName()
-                + " -j4 -f " + makefile.getFullPathName();
+                + " " + getParallelJobsFlag() + " -f " + makefile.getFullPathName();
 
             // For some reason we need to do this again
-            outputFile.getChildFile("dpf").getChildFile("utils").getChildFile("generate-ttl.sh").setExecutePermission(true);
+            buildDir.getChildFile("dpf").getChildFile("utils").getChildFile("generate-ttl.sh").setExecutePermission(true);
             Toolchain::dir.getChildFile("scripts").getChildFile("anywhere-setup.sh").getChildFile("generate-ttl.sh").setExecutePermission(true);
 
             Toolchain::startShellScript(buildScript, this);
 #endif
 
-            waitForProcessToFinish(-1);
-            exportingView->flushConsole();
-
-            // Delay to get correct exit code
-            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
+            bool compilationExitCode = waitForExitCode();
 
             workingDir.setAsCurrentWorkingDirectory();
+            addStageTime("Compiling", startTime);
+
+            if (compilationExitCode) {
+                exportingView->logToConsole("Build files are in " + buildDir.getFullPathName() + "\n");
+                return compilationExitCode;
+            }
+
+            // Copy output, plugins are either a single file or a bundle, depending on the format and platform
+            outputFile.createDirectory();
+            auto copyOutput = [buildDir, outputFile](String const& fileName) {
+                auto source = buildDir.getChildFile("bin").getChildFile(fileName);
+                if (source.isDirectory())
+                    source.copyDirectoryTo(outputFile.getChildFile(fileName));
+                else
+                    source.copyFileTo(outputFile.getChildFile(fileName));
+            };
 
-            // Copy output
             if (lv2)
-                outputFile.getChildFile("bin").getChildFile(name + ".lv2").copyDirectoryTo(outputFile.getChildFile(name + ".lv2"));
+                copyOutput(name + ".lv2");
             if (vst3)
-                outputFile.getChildFile("bin").getChildFile(name + ".vst3").copyDirectoryTo(outputFile.getChildFile(name + ".vst3"));
+                copyOutput(name + ".vst3");
 #if JUCE_WINDOWS
             if (vst2)
-                outputFile.getChildFile("bin").getChildFile(name + "-vst.dll").moveFileTo(outputFile.getChildFile(name + "-vst.dll"));
+                copyOutput(name + "-vst.dll");
 #elif JUCE_LINUX
             if (vst2)
-                outputFile.getChildFile("bin").getChildFile(name + "-vst.so").moveFileTo(outputFile.getChildFile(name + "-vst.so"));
+                copyOutput(name + "-vst.so");
 #elif JUCE_MAC
             if (vst2)
-                outputFile.getChildFile("bin").getChildFile(name + ".vst").copyDirectoryTo(outputFile.getChildFile(name + ".vst"));
+                copyOutput(name + ".vst");
 #endif
             if (clap)
-                outputFile.getChildFile("bin").getChildFile(name + ".clap").moveFileTo(outputFile.getChildFile(name + ".clap"));
+                copyOutput(name + ".clap");
             if (jack)
-                outputFile.getChildFile("bin").getChildFile(name).moveFileTo(outputFile.getChildFile(name));
-
-            bool compilationExitCode = getExitCode();
-
-            // Clean up if successful
-            if (!compilationExitCode) {
-                outputFile.getChildFile("dpf").deleteRecursively();
-                outputFile.getChildFile("build").deleteRecursively();
-                outputFile.getChildFile("plugin").deleteRecursively();
-                outputFile.getChildFile("bin").deleteRecursively();
-                outputFile.getChildFile("README.md").deleteFile();
-                outputFile.getChildFile("Makefile").deleteFile();
-            }
+                copyOutput(name);
 
             return compilationExitCode;
         }
@@ -172,15 +172,7 @@ public:
         auto size = getValue<int>(patchSizeValue);
         auto appType = getValue<int>(appTypeValue);
 
-        StringArray args = { heavyExecutable.getFullPathName(), pdPatch, "-o" + outdir };
-
         name = name.replaceCharacter('-', '_');
-        args.add("-n" + name);
-
-        if (copyright.isNotEmpty()) {
-            args.add("--copyright");
-            args.add("\"" + copyright + "\"");
-        }
 
         // set board definition
         auto boards = StringArray { "seed", "pod", "petal", "patch", "patch_init", "field", "simple", "custom" };
@@ -229,47 +221,33 @@ public:
         }
 
         metaJson->setProperty("daisy", metaDaisy);
-        args.add("-m" + createMetaJson(metaJson));
 
-        args.add("-v");
-        args.add("-gdaisy");
-
-        String paths = "-p";
-        for (auto& path : searchPaths) {
-            paths += " " + path;
-        }
+        auto outputFile = File(outdir);
 
-        args.add(paths);
+        // Binaries are built in a directory that we keep around, so the next build can reuse its object files, including the ones of libDaisy
+        auto buildDir = HeavyCache::getBuildDirectory("daisy", name);
+        auto sourceDir = buildDir.getChildFile("daisy").getChildFile("source");
 
-        start(args.joinIntoString(" "));
-        waitForProcessToFinish(-1);
-        exportingView->flushConsole();
+        bool heavyExitCode = generateSources(pdPatch, compile ? buildDir : outputFile, name, copyright, searchPaths, "daisy", metaJson, compile);
 
         exportingView->logToConsole("Compiling for " + board + "...\n");
 
         if (shouldQuit)
             return true;
 
-        // Delay to get correct exit code
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
-
-        auto outputFile = File(outdir);
-        auto sourceDir = outputFile.getChildFile("daisy").getChildFile("source");
-
-        bool heavyExitCode = getExitCode();
-
         if (compile) {
+            if (heavyExitCode)
+                return heavyExitCode;
+
+            auto const startTime = Time::getMillisecondCounterHiRes();
 
             auto bin = Toolchain::dir.getChildFile("bin");
             auto libDaisy = Toolchain::dir.getChildFile("lib").getChildFile("libdaisy");
             auto make = bin.getChildFile("make" + exeSuffix);
             auto compiler = bin.getChildFile("arm-none-eabi-gcc" + exeSuffix);
 
-            libDaisy.copyDirectoryTo(outputFile.getChildFile("libdaisy"));
-
-            outputFile.getChildFile("ir").deleteRecursively();
-            outputFile.getChildFile("hv").deleteRecursively();
-            outputFile.getChildFile("c").deleteRecursively();
+            // Only copies the files that differ, so the objects that were built from it stay up to date
+            HeavyCache::syncDirectory(libDaisy, buildDir.getChildFile("libdaisy"));
 
             auto workingDir = File::getCurrentWorkingDirectory();
 
@@ -280,7 +258,7 @@ public:
 
 #if JUCE_WINDOWS
             auto buildScript = make.getFullPathName().replaceCharacter('\\', '/')
-                + " -j4 -f "
+                + " " + getParallelJobsFlag() + " -f "
                 + sourceDir.getChildFile("Makefile").getFullPathName().replaceCharacter('\\', '/')
                 + " GCC_PATH="
                 + gccPath.replaceCharacter('\\', '/')
@@ -289,24 +267,22 @@ public:
             Toolchain::startShellScript(buildScript, this);
 #else
             String buildScript = make.getFullPathName()
-                + " -j4 -f " + sourceDir.getChildFile("Makefile").getFullPathName()
+                + " " + getParallelJobsFlag() + " -f " + sourceDir.getChildFile("Makefile").getFullPathName()
                 + " GCC_PATH=" + gccPath
                 + " PROJECT_NAME=" + name;
 
             Toolchain::startShellScript(buildScript, this);
 #endif
 
-            waitForProcessToFinish(-1);
-            exportingView->flushConsole();
+            auto compileExitCode = waitForExitCode();
 
             // Restore original working directory
             workingDir.setAsCurrentWorkingDirectory();
 
-            // Delay to get correct exit code
-            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
+            addStageTime("Compiling", startTime);
 
-            auto compileExitCode = getExitCode();
             if (flash && !compileExitCode) {
+                auto const flashStartTime = Time::getMillisecondCounterHiRes();
 
                 auto dfuUtil = bin.getChildFile("dfu-util" + exeSuffix);
 
@@ -384,27 +360,20 @@ public:
 
                 Toolchain::startShellScript(flashScript, this);
 
-                waitForProcessToFinish(-1);
-                exportingView->flushConsole();
-
-                // Delay to get correct exit code
-                Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
+                auto flashExitCode = waitForExitCode();
+                addStageTime("Flashing", flashStartTime);
 
-                auto flashExitCode = getExitCode();
-
-                return heavyExitCode && flashExitCode;
-            } else {
+                return flashExitCode;
+            } else if (!compileExitCode) {
                 auto binLocation = outputFile.getChildFile(name + ".bin");
-                sourceDir.getChildFile("build").getChildFile("HeavyDaisy_" + name + ".bin").moveFileTo(binLocation);
+                outputFile.createDirectory();
+                sourceDir.getChildFile("build").getChildFile("HeavyDaisy_" + name + ".bin").copyFileTo(binLocation);
+            } else {
+                exportingView->logToConsole("Build files are in " + buildDir.getFullPathName() + "\n");
             }
 
-            outputFile.getChildFile("daisy").deleteRecursively();
-            outputFile.getChildFile("libdaisy").deleteRecursively();
-
-            return heavyExitCode && compileExitCode;
+            return compileExitCode;
         } else {
-            auto outputFile = File(outdir);
-
             auto libDaisy = Toolchain::dir.getChildFile("lib").getChildFile("libdaisy");
             libDaisy.copyDirectoryTo(outputFile.getChildFile("libdaisy"));
 
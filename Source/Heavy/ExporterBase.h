@@ -38,8 +38,13 @@ struct ExporterBase : public Component
     int labelWidth = 180;
     bool shouldQuit = false;
 
+    // How long each part of the current export took, for the summary at the end
+    Array<std::pair<String, double>> stageTimes;
+
     PluginEditor* editor;
 
+    // One export at a time: the exporter is the ChildProcess that its export runs, and the progress view only follows one export
+    // Builds are still spread over all cores, make gets one job per core
     ExporterBase(PluginEditor* pluginEditor, ExportingProgressView* exportView)
         : ThreadPool(1)
         , exportingView(exportView)
@@ -156,11 +161,16 @@ struct ExporterBase : public Component
 
             exportingView->showState(ExportingProgressView::Busy);
 
+            stageTimes.clear();
+            auto const startTime = Time::getMillisecondCounterHiRes();
+
             auto result = performExport(patchPath, outPath, projectTitle, projectCopyright, searchPaths);
 
             if (shouldQuit)
                 return;
 
+            logStageTimes(startTime);
+
             exportingView->showState(result ? ExportingProgressView::Failure : ExportingProgressView::Success);
 
             exportingView->stopMonitoring();
@@ -203,6 +213,113 @@ struct ExporterBase : public Component
         exportButton.setBounds(getLocalBounds().removeFromBottom(23).removeFromRight(80).translated(-10, -10));
     }
 
+    // Runs Heavy and copies what it generated to outputDir. When the patch, the abstractions it uses and the settings are the same as for an earlier export, Heavy doesn't run at all
+    // Pass a build directory as outputDir to compile the result, sources that Heavy doesn't generate anymore are removed from it
+    // Returns the exit code of Heavy
+    int generateSources(String const& pdPatch, File const& outputDir, String const& name, String const& copyright, StringArray const& searchPaths, String const& generator = {}, DynamicObject::Ptr metaJson = nullptr, bool isBuildDirectory = false)
+    {
+        auto const startTime = Time::getMillisecondCounterHiRes();
+
+        auto const contentHash = HeavyCache::getContentHash(File(pdPatch), searchPaths, name + "\n" + copyright);
+        auto const entry = HeavyCache::getEntry(contentHash, generator.isEmpty() ? "c" : generator + "_" + HeavyCache::getSettingsHash(generator, var(metaJson.get())));
+
+        // Without a generator, Heavy only writes the C sources, which it also wrote for every other target
+        auto cached = entry.isDirectory() ? entry : (generator.isEmpty() ? HeavyCache::findAnyEntry(contentHash) : File());
+        if (cached.isDirectory()) {
+            exportingView->logToConsole("Patch didn't change since the last export, reusing the generated code\n");
+
+            if (cached == entry) {
+                HeavyCache::syncDirectory(entry, outputDir, isBuildDirectory);
+            } else {
+                for (auto const* child : { "ir", "hv", "c" })
+                    HeavyCache::syncDirectory(cached.getChildFile(child), outputDir.getChildFile(child), isBuildDirectory);
+            }
+
+            HeavyCache::touch(cached);
+            addStageTime("Generating code (cached)", startTime);
+            return 0;
+        }
+
+        auto staging = HeavyCache::createStagingDirectory();
+
+        StringArray args = { heavyExecutable.getFullPathName(), pdPatch, "-o" + staging.getFullPathName() };
+        args.add("-n" + name);
+
+        if (copyright.isNotEmpty()) {
+            args.add("--copyright");
+            args.add("\"" + copyright + "\"");
+        }
+
+        if (metaJson)
+            args.add("-m" + createMetaJson(metaJson));
+
+        args.add("-v");
+
+        if (generator.isNotEmpty())
+            args.add("-g" + generator);
+
+        String paths = "-p";
+        for (auto& path : searchPaths) {
+            paths += " " + path;
+        }
+
+        args.add(paths);
+
+        if (shouldQuit) {
+            staging.deleteRecursively();
+            return 1;
+        }
+
+        start(args.joinIntoString(" "));
+        auto const exitCode = waitForExitCode();
+
+        if (shouldQuit) {
+            staging.deleteRecursively();
+            return 1;
+        }
+
+        HeavyCache::syncDirectory(staging, outputDir, isBuildDirectory);
+
+        // Only keep what we can use again
+        if (exitCode == 0)
+            HeavyCache::store(staging, entry);
+        else
+            staging.deleteRecursively();
+
+        addStageTime("Generating code", startTime);
+        return exitCode;
+    }
+
+    // Waits for the process we started to finish. The exit code is stored as soon as JUCE sees that the process has ended, so there's no need to wait any longer
+    int waitForExitCode()
+    {
+        waitForProcessToFinish(-1);
+        exportingView->flushConsole();
+        return static_cast<int>(getExitCode());
+    }
+
+    // Let make use all cores, object files that are still up to date in the build directory are skipped anyway
+    static String getParallelJobsFlag()
+    {
+        return "-j" + String(SystemStats::getNumCpus());
+    }
+
+    void addStageTime(String const& stage, double startTime)
+    {
+        stageTimes.add({ stage, (Time::getMillisecondCounterHiRes() - startTime) / 1000.0 });
+    }
+
+    void logStageTimes(double startTime)
+    {
+        String summary = "\nSummary:\n";
+        for (auto const& [stage, seconds] : stageTimes) {
+            summary += "    " + stage + ": " + String(seconds, 2) + "s\n";
+        }
+        summary += "    Total: " + String((Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 2) + "s\n";
+
+        exportingView->logToConsole(summary);
+    }
+
     static String createMetaJson(DynamicObject::Ptr metaJson)
     {
         auto metadata = File::createTempFile(".json");
@@ -0,0 +1,195 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen and Wasted Audio
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+#include <juce_cryptography/juce_cryptography.h>
+#include "Utility/OSUtils.h"
+
+// Keeps what Heavy generated for earlier exports, so exporting a patch that didn't change doesn't have to run Heavy again
+// Entries are keyed by the contents of the patch and the abstractions it uses, and then by the generator and its settings
+// It also holds a build directory for every target, which stays around between exports, so make only compiles the files that changed
+// Lives inside the toolchain directory, so it's cleared when a new toolchain is installed
+struct HeavyCache {
+    static inline File const dir = ProjectInfo::appDataDir.getChildFile("Toolchain").getChildFile("cache");
+
+    // Hash of the patch, the abstractions it uses, the toolchain version and the settings that all targets share
+    static String getContentHash(File const& patch, StringArray const& searchPaths, String const& settings)
+    {
+        MemoryOutputStream contents;
+        contents << ProjectInfo::appDataDir.getChildFile("Toolchain").getChildFile("VERSION").loadFileAsString() << settings;
+
+        StringArray visited;
+        addPatchContents(patch, searchPaths, contents, visited);
+
+        return SHA256(contents.getData(), contents.getDataSize()).toHexString().substring(0, 16);
+    }
+
+    // Same as getContentHash, for a patch that only exists in memory. Abstractions are looked up in directory first, then in the search paths
+    static String getContentHash(String const& patch, File const& directory, StringArray const& searchPaths, String const& settings)
+    {
+        MemoryOutputStream contents;
+        contents << ProjectInfo::appDataDir.getChildFile("Toolchain").getChildFile("VERSION").loadFileAsString() << settings;
+
+        StringArray visited;
+        addPatchContents(patch, directory, searchPaths, contents, visited);
+
+        return SHA256(contents.getData(), contents.getDataSize()).toHexString().substring(0, 16);
+    }
+
+    // Hash of the generator settings. Files that the settings point to, like a custom board definition, are part of it as well
+    static String getSettingsHash(String const& generator, var const& metadata)
+    {
+        MemoryOutputStream contents;
+        contents << generator << JSON::toString(metadata);
+        addReferencedFiles(metadata, contents);
+
+        return SHA256(contents.getData(), contents.getDataSize()).toHexString().substring(0, 16);
+    }
+
+    // Where the output of Heavy for this patch and generator is stored. The directory only exists if Heavy ran successfully before
+    static File getEntry(String const& contentHash, String const& generatorKey)
+    {
+        return dir.getChildFile(contentHash).getChildFile(generatorKey);
+    }
+
+    // Any earlier output for this patch. The C sources are the same for every generator, only the generator's own files differ
+    static File findAnyEntry(String const& contentHash)
+    {
+        for (auto const& entry : OSUtils::iterateDirectory(dir.getChildFile(contentHash), false, false)) {
+            if (entry.isDirectory() && entry.getChildFile("c").isDirectory())
+                return entry;
+        }
+
+        return {};
+    }
+
+    // Heavy writes into a directory of its own, which is moved into the cache when it succeeded
+    // That way, two exports running at the same time never see each other's half written output
+    static File createStagingDirectory()
+    {
+        auto staging = dir.getChildFile("staging").getNonexistentChildFile("heavy", "", false);
+        staging.createDirectory();
+        return staging;
+    }
+
+    static void store(File const& staging, File const& entry)
+    {
+        entry.getParentDirectory().createDirectory();
+        if (entry.isDirectory() || !staging.moveFileTo(entry))
+            staging.deleteRecursively();
+
+        prune();
+    }
+
+    // Marks an entry as recently used, so it's not the first to go when the cache is pruned
+    static void touch(File const& entry)
+    {
+        entry.getParentDirectory().setLastModificationTime(Time::getCurrentTime());
+    }
+
+    static File getBuildDirectory(String const& target, String const& name)
+    {
+        return dir.getChildFile("build").getChildFile(target + "_" + name);
+    }
+
+    // Copies the files that are different, and leaves the others alone, so make can tell from the modification times what needs to be compiled again
+    // When removeOldSources is set, sources that Heavy doesn't generate anymore are removed from the directories that it writes to, so they don't end up in the build
+    static void syncDirectory(File const& source, File const& target, bool removeOldSources = false)
+    {
+        if (!source.isDirectory())
+            return;
+
+        target.createDirectory();
+
+        for (auto const& file : OSUtils::iterateDirectory(source, true, true)) {
+            auto const destination = target.getChildFile(file.getRelativePathFrom(source));
+            if (destination.existsAsFile() && destination.hasIdenticalContentTo(file))
+                continue;
+
+            destination.getParentDirectory().createDirectory();
+            file.copyFileTo(destination);
+        }
+
+        if (!removeOldSources)
+            return;
+
+        static StringArray const sourceExtensions = { ".c", ".cpp", ".h", ".hpp" };
+        for (auto const& child : OSUtils::iterateDirectory(source, false, false)) {
+            if (!child.isDirectory())
+                continue;
+
+            auto const targetChild = target.getChildFile(child.getFileName());
+            for (auto const& file : OSUtils::iterateDirectory(targetChild, true, true)) {
+                if (sourceExtensions.contains(file.getFileExtension()) && !child.getChildFile(file.getRelativePathFrom(targetChild)).existsAsFile())
+                    file.deleteFile();
+            }
+        }
+    }
+
+private:
+    // Abstractions are looked up the same way Heavy does it: next to the patch first, then in the search paths
+    static void addPatchContents(File const& patch, StringArray const& searchPaths, MemoryOutputStream& contents, StringArray& visited)
+    {
+        if (visited.contains(patch.getFullPathName()))
+            return;
+
+        visited.add(patch.getFullPathName());
+
+        contents << patch.getFileName();
+        addPatchContents(patch.loadFileAsString(), patch.getParentDirectory(), searchPaths, contents, visited);
+    }
+
+    static void addPatchContents(String const& text, File const& directory, StringArray const& searchPaths, MemoryOutputStream& contents, StringArray& visited)
+    {
+        contents << text;
+
+        StringArray directories = searchPaths;
+        directories.insert(0, directory.getFullPathName());
+
+        for (auto const& message : StringArray::fromTokens(text, ";", "")) {
+            auto tokens = StringArray::fromTokens(message, true);
+            if (tokens.size() < 5 || tokens[0] != "#X" || tokens[1] != "obj")
+                continue;
+
+            for (auto const& directory : directories) {
+                auto abstraction = File(directory).getChildFile(tokens[4] + ".pd");
+                if (abstraction.existsAsFile()) {
+                    addPatchContents(abstraction, searchPaths, contents, visited);
+                    break;
+                }
+            }
+        }
+    }
+
+    static void addReferencedFiles(var const& value, MemoryOutputStream& contents)
+    {
+        if (auto* object = value.getDynamicObject()) {
+            for (auto const& property : object->getProperties())
+                addReferencedFiles(property.value, contents);
+        } else if (value.isString() && File::isAbsolutePath(value.toString())) {
+            contents << File(value.toString()).loadFileAsString();
+        }
+    }
+
+    // Keeps the output of the most recently exported patches, build directories are kept one per target and project name
+    static void prune(int maxEntries = 16)
+    {
+        Array<File> entries;
+        for (auto const& entry : OSUtils::iterateDirectory(dir, false, false)) {
+            auto const name = entry.getFileName();
+            if (entry.isDirectory() && name != "build" && name != "staging")
+                entries.add(entry);
+        }
+
+        std::sort(entries.begin(), entries.end(), [](File const& a, File const& b) {
+            return a.getLastModificationTime() > b.getLastModificationTime();
+        });
+
+        for (int i = maxEntries; i < entries.size(); i++) {
+            entries[i].deleteRecursively();
+        }
+    }
+};
@@ -22,6 +22,7 @@
 #endif
 
 #include "Toolchain.h"
+#include "HeavyCache.h"
 #include "ExportingProgressView.h"
 #include "ExporterBase.h"
 #include "CppExporter.h"
@@ -64,57 +64,31 @@ public:
     {
         exportingView->showState(ExportingProgressView::Busy);
 
-        StringArray args = { heavyExecutable.getFullPathName(), pdPatch, "-o" + outdir };
-
         name = name.replaceCharacter('-', '_');
-        args.add("-n" + name);
-
-        if (copyright.isNotEmpty()) {
-            args.add("--copyright");
-            args.add("\"" + copyright + "\"");
-        }
-
-        args.add("-v");
-        args.add("-gpdext");
-
-        String paths = "-p";
-        for (auto& path : searchPaths) {
-            paths += " " + path;
-        }
 
-        args.add(paths);
-
-        if (shouldQuit)
-            return true;
+        auto outputFile = File(outdir);
+        auto compile = getValue<int>(exportTypeValue) == 2;
 
-        start(args.joinIntoString(" "));
+        // Binaries are built in a directory that we keep around, so the next build can reuse its object files
+        auto buildDir = HeavyCache::getBuildDirectory("pdext", name);
 
-        waitForProcessToFinish(-1);
-        exportingView->flushConsole();
+        bool generationExitCode = generateSources(pdPatch, compile ? buildDir : outputFile, name, copyright, searchPaths, "pdext", nullptr, compile);
 
         if (shouldQuit)
             return true;
 
-        auto outputFile = File(outdir);
-        outputFile.getChildFile("ir").deleteRecursively();
-        outputFile.getChildFile("hv").deleteRecursively();
-
-        // Delay to get correct exit code
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
-
-        bool generationExitCode = getExitCode();
         // Check if we need to compile
-        if (!generationExitCode && getValue<int>(exportTypeValue) == 2) {
+        if (!generationExitCode && compile) {
+            auto const startTime = Time::getMillisecondCounterHiRes();
             auto workingDir = File::getCurrentWorkingDirectory();
 
-            outputFile.setAsCurrentWorkingDirectory();
+            buildDir.setAsCurrentWorkingDirectory();
 
             auto bin = Toolchain::dir.getChildFile("bin");
             auto make = bin.getChildFile("make" + exeSuffix);
-            auto makefile = outputFile.getChildFile("Makefile");
 
 #if JUCE_MAC
-            Toolchain::startShellScript("make -j4", this);
+            Toolchain::startShellScript("make " + getParallelJobsFlag(), this);
 #elif JUCE_WINDOWS
             File pdDll;
             if (ProjectInfo::isStandalone) {
@@ -128,34 +102,39 @@ public:
             auto cxx = "CXX=" + Toolchain::dir.getChildFile("bin").getChildFile("g++.exe").getFullPathName().replaceCharacter('\\', '/') + " ";
             auto pdbindir = "PDBINDIR=" + pdDll.getFullPathName().replaceCharacter('\\', '/') + " ";
 
-            Toolchain::startShellScript(path + cc + cxx + pdbindir + make.getFullPathName().replaceCharacter('\\', '/') + " -j4", this);
+            Toolchain::startShellScript(path + cc + cxx + pdbindir + make.getFullPathName().replaceCharacter('\\', '/') + " " + getParallelJobsFlag(), this);
 
 #else // Linux or BSD
             auto prepareEnvironmentScript = Toolchain::dir.getChildFile("scripts").getChildFile("anywhere-setup.sh").getFullPathName() + "\n";
 
             auto buildScript = prepareEnvironmentScript
                 + make.getFullPathName()
-                + " -j4";
+                + " " + getParallelJobsFlag();
 
             Toolchain::startShellScript(buildScript, this);
 #endif
 
-            waitForProcessToFinish(-1);
-            exportingView->flushConsole();
-
-            // Delay to get correct exit code
-            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 300);
+            bool compilationExitCode = waitForExitCode();
 
             workingDir.setAsCurrentWorkingDirectory();
+            addStageTime("Compiling", startTime);
+
+            if (compilationExitCode) {
+                exportingView->logToConsole("Build files are in " + buildDir.getFullPathName() + "\n");
+                return compilationExitCode;
+            }
 
 #if JUCE_MAC
-            auto external = outputFile.getChildFile(name + "~.pd_darwin");
+            auto external = buildDir.getChildFile(name + "~.pd_darwin");
 #elif JUCE_WINDOWS
-            auto external = outputFile.getChildFile(name + "~.dll");
+            auto external = buildDir.getChildFile(name + "~.dll");
 #else
-            auto external = outputFile.getChildFile(name + "~.pd_linux");
+            auto external = buildDir.getChildFile(name + "~.pd_linux");
 #endif
 
+            outputFile.createDirectory();
+            external.copyFileTo(outputFile.getChildFile(external.getFileName()));
+
             if (getValue<bool>(copyToPath)) {
                 exportingView->logToConsole("Copying to Externals folder...\n");
                 auto copy_location = ProjectInfo::appDataDir.getChildFile("Externals").getChildFile(external.getFileName());
@@ -163,17 +142,12 @@ public:
                 copy_location.setExecutePermission(1);
             }
 
-            // Clean up
-            outputFile.getChildFile("c").deleteRecursively();
-            outputFile.getChildFile("pdext").deleteRecursively();
-            outputFile.getChildFile("Makefile").deleteFile();
-            outputFile.getChildFile("Makefile.pdlibbuilder").deleteFile();
-
-            bool compilationExitCode = getExitCode();
-
             return compilationExitCode;
         }
 
+        outputFile.getChildFile("ir").deleteRecursively();
+        outputFile.getChildFile("hv").deleteRecursively();
+
         return generationExitCode;
     }
 };
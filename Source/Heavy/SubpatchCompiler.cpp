@@ -0,0 +1,324 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen and Wasted Audio
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "Utility/Config.h"
+#include "Utility/Fonts.h"
+
+extern "C" {
+#include <m_pd.h>
+#include <g_canvas.h>
+#include <g_all_guis.h>
+}
+
+#include "PluginEditor.h"
+#include "PluginProcessor.h"
+#include "Pd/Interface.h"
+
+#include "Toolchain.h"
+#include "HeavyCache.h"
+#include "CompatibleObjects.h"
+#include "SubpatchCompiler.h"
+
+#if JUCE_WINDOWS
+static String const libraryExtension = ".dll";
+static String const executableExtension = ".exe";
+#elif JUCE_MAC
+static String const libraryExtension = ".dylib";
+static String const executableExtension = "";
+#else
+static String const libraryExtension = ".so";
+static String const executableExtension = "";
+#endif
+
+static File getHeavyExecutable()
+{
+    return Toolchain::dir.getChildFile("bin").getChildFile("Heavy").getChildFile("Heavy" + executableExtension);
+}
+
+// [array define] is a glist too, it holds its array the same way a graph does
+static bool isGlist(t_gobj* y)
+{
+    return pd_class(&y->g_pd) == canvas_class || !strcmp(pd::Interface::getObjectClassName(&y->g_pd), "array define");
+}
+
+// Names of the arrays that are defined inside the subpatch, with their dollar arguments expanded
+static void findArrays(t_glist* glist, std::set<t_symbol*>& arrays)
+{
+    for (t_gobj* y = glist->gl_list; y; y = y->g_next) {
+        if (isGlist(y)) {
+            findArrays(reinterpret_cast<t_glist*>(y), arrays);
+        } else if (!strcmp(pd::Interface::getObjectClassName(&y->g_pd), "array")) {
+            t_symbol* name;
+            garray_getname(reinterpret_cast<t_garray*>(y), &name);
+            arrays.insert(canvas_realizedollar(glist, name));
+        }
+    }
+}
+
+// Returns why the subpatch can't be compiled, or an empty string if it can
+// The compiled code can only talk to the rest of the patch through the signal inlets and outlets of the subpatch, so anything that reaches outside it is rejected
+static String findIncompatibleObject(t_glist* glist, std::set<t_symbol*> const& arrays, bool isOuterPatch)
+{
+    static auto const compatibleObjects = HeavyCompatibleObjects::getAllCompatibleObjects();
+    static StringArray const namedObjects = { "send", "receive", "send~", "receive~", "throw~", "catch~", "value" };
+    static StringArray const tableObjects = { "tabread", "tabread4", "tabwrite", "tabread~", "tabread4~", "tabwrite~", "tabplay~", "tabosc4~", "tabsend~", "tabreceive~" };
+    static StringArray const iemguis = { "bng", "tgl", "nbx", "hsl", "vsl", "hradio", "vradio", "vu", "cnv" };
+
+    for (t_gobj* y = glist->gl_list; y; y = y->g_next) {
+        if (isGlist(y)) {
+            auto incompatibleObject = findIncompatibleObject(reinterpret_cast<t_glist*>(y), arrays, false);
+            if (incompatibleObject.isNotEmpty())
+                return incompatibleObject;
+
+            continue;
+        }
+
+        String const type = pd::Interface::getObjectClassName(&y->g_pd);
+
+        if (isOuterPatch && (type == "inlet" || type == "outlet" || type == "adc~" || type == "dac~"))
+            return "\"" + type + "\" is not supported, only signal inlets and outlets can connect it to the rest of the patch";
+
+        if (namedObjects.contains(type))
+            return "\"" + type + "\" is not supported, because it can't reach objects outside of the compiled subpatch";
+
+        if (tableObjects.contains(type)) {
+            auto* object = pd_checkobject(&y->g_pd);
+            auto const* argument = object && binbuf_getnatom(object->te_binbuf) > 1 ? binbuf_getvec(object->te_binbuf) + 1 : nullptr;
+            auto* arrayName = argument && (argument->a_type == A_SYMBOL || argument->a_type == A_DOLLSYM) ? canvas_realizedollar(glist, argument->a_w.w_symbol) : nullptr;
+
+            if (!arrayName || !arrays.count(arrayName))
+                return "\"" + type + "\" can only use arrays that are defined inside the subpatch";
+        }
+
+        if (iemguis.contains(type)) {
+            auto* iemgui = reinterpret_cast<t_iemgui*>(y);
+            if (iemgui->x_fsf.x_snd_able || iemgui->x_fsf.x_rcv_able)
+                return "\"" + type + "\" is not supported with a send or receive name, because it can't reach objects outside of the compiled subpatch";
+        }
+
+        if (!compatibleObjects.contains(type))
+            return "\"" + type + "\" is not supported";
+    }
+
+    return {};
+}
+
+SubpatchCompiler::SubpatchCompiler(PluginProcessor* processor)
+    : ThreadPool(1)
+    , pd(processor)
+{
+}
+
+SubpatchCompiler::~SubpatchCompiler()
+{
+    shouldQuit = true;
+    if (process.isRunning())
+        process.kill();
+
+    removeAllJobs(true, -1);
+}
+
+bool SubpatchCompiler::isAvailable()
+{
+    return getHeavyExecutable().existsAsFile();
+}
+
+void SubpatchCompiler::compile(t_canvas* canvas, String const& name)
+{
+    String content, error;
+    File directory;
+    StringArray searchPaths;
+    int numInputs, numOutputs;
+
+    pd->lockAudioThread();
+
+    numInputs = obj_nsiginlets(&canvas->gl_obj);
+    numOutputs = obj_nsigoutlets(&canvas->gl_obj);
+
+    std::set<t_symbol*> arrays;
+    findArrays(canvas, arrays);
+
+    if (obj_ninlets(&canvas->gl_obj) != numInputs || obj_noutlets(&canvas->gl_obj) != numOutputs)
+        error = "only signal inlets and outlets are supported";
+    else if (!numOutputs)
+        error = "it has no signal outlets";
+    else
+        error = findIncompatibleObject(canvas, arrays, true);
+
+    char* buf;
+    int bufsize;
+    pd::Interface::getCanvasContent(canvas, &buf, &bufsize);
+    content = String::fromUTF8(buf, bufsize);
+    freebytes(static_cast<void*>(buf), static_cast<size_t>(bufsize) * sizeof(char));
+
+    char* paths[1024];
+    int numItems;
+    pd::Interface::getSearchPaths(paths, &numItems);
+    for (int i = 0; i < numItems; i++) {
+        searchPaths.add(paths[i]);
+    }
+
+    // Abstractions next to the patch that holds the subpatch come first, both for Pd and for Heavy
+    auto const patchDirectory = String::fromUTF8(canvas_getdir(canvas)->s_name);
+    if (File::isAbsolutePath(patchDirectory)) {
+        directory = File(patchDirectory);
+        searchPaths.insert(0, directory.getFullPathName());
+    }
+
+    pd->unlockAudioThread();
+
+    if (error.isNotEmpty()) {
+        pd->logError("Can't compile " + name + ": " + error);
+        return;
+    }
+
+    // Start timing the interpreted version while we compile
+    pd->compiledSubpatches.watch(canvas, name);
+
+    // Abstractions and the toolchain are part of the key, so changing either of them builds the subpatch again
+    auto patch = createWrapperPatch(content);
+    auto heavyName = "plugdata_" + HeavyCache::getContentHash(patch, directory, searchPaths, {});
+    auto library = ProjectInfo::appDataDir.getChildFile("Compiled").getChildFile(heavyName + libraryExtension);
+
+    pd->logMessage("Compiling " + name + "...");
+
+    addJob([this, instance = juce::WeakReference<pd::Instance>(pd), canvas, name, patch, heavyName, library, searchPaths, numInputs, numOutputs]() {
+        auto error = library.existsAsFile() ? String() : build(patch, heavyName, library, searchPaths);
+
+        if (shouldQuit)
+            return;
+
+        MessageManager::callAsync([instance, canvas, name, heavyName, library, numInputs, numOutputs, error]() mutable {
+            auto* pd = instance.get();
+            if (!pd)
+                return;
+
+            if (error.isEmpty())
+                error = pd->compiledSubpatches.load(canvas, library, heavyName, numInputs, numOutputs);
+
+            if (error.isEmpty()) {
+                pd->logMessage("Compiled " + name + ", it now runs as native code");
+            } else {
+                pd->logError("Failed to compile " + name + ", it will keep running in Pd: " + error);
+            }
+        });
+    });
+}
+
+String SubpatchCompiler::createWrapperPatch(String const& content)
+{
+    struct Iolet {
+        int line;
+        int x;
+    };
+
+    StringArray lines;
+    lines.addLines(content);
+    lines.removeEmptyStrings();
+
+    std::vector<Iolet> inlets, outlets;
+    int depth = 0;
+
+    for (int i = 0; i < lines.size(); i++) {
+        auto tokens = StringArray::fromTokens(lines[i].trimCharactersAtEnd(";"), " ", "");
+
+        if (tokens[0] == "#N" && tokens[1] == "canvas") {
+            // The subpatch becomes the main patch
+            if (depth++ == 0)
+                lines.set(i, "#N canvas 0 50 450 300 12;");
+        } else if (tokens[0] == "#X" && tokens[1] == "restore") {
+            depth--;
+        } else if (depth == 1 && tokens[0] == "#X" && tokens[1] == "obj") {
+            if (tokens[4] == "inlet~")
+                inlets.push_back({ i, tokens[2].getIntValue() });
+            else if (tokens[4] == "outlet~")
+                outlets.push_back({ i, tokens[2].getIntValue() });
+        }
+    }
+
+    // Pd sorts the inlets and outlets of a subpatch from left to right
+    auto replaceIolets = [&lines](std::vector<Iolet>& iolets, String const& replacement) {
+        std::stable_sort(iolets.begin(), iolets.end(), [](auto const& a, auto const& b) { return a.x < b.x; });
+
+        for (int channel = 0; channel < iolets.size(); channel++) {
+            auto tokens = StringArray::fromTokens(lines[iolets[channel].line], " ", "");
+            lines.set(iolets[channel].line, "#X obj " + tokens[2] + " " + tokens[3] + " " + replacement + " " + String(channel + 1) + ";");
+        }
+    };
+
+    replaceIolets(inlets, "adc~");
+    replaceIolets(outlets, "dac~");
+
+    return lines.joinIntoString("\n");
+}
+
+String SubpatchCompiler::build(String const& patch, String const& heavyName, File const& library, StringArray const& searchPaths)
+{
+    auto buildDir = File::createTempFile("");
+    buildDir.createDirectory();
+
+    auto patchFile = buildDir.getChildFile(heavyName + ".pd");
+    patchFile.replaceWithText(patch, false, false, "\n");
+
+    StringArray args = { getHeavyExecutable().getFullPathName(), patchFile.getFullPathName(), "-o", buildDir.getFullPathName(), "-n", heavyName };
+    if (!searchPaths.isEmpty()) {
+        args.add("-p");
+        args.addArray(searchPaths);
+    }
+
+    if (!process.start(args)) {
+        buildDir.deleteRecursively();
+        return "couldn't start Heavy";
+    }
+
+    auto output = process.readAllProcessOutput();
+    if (shouldQuit || process.getExitCode() != 0) {
+        buildDir.deleteRecursively();
+        return output.trim();
+    }
+
+    library.getParentDirectory().createDirectory();
+
+    auto toScriptPath = [](File const& file) {
+        return "\"" + file.getFullPathName().replaceCharacter('\\', '/') + "\"";
+    };
+
+#if JUCE_WINDOWS
+    auto bin = Toolchain::dir.getChildFile("bin");
+    String script = "export PATH=\"$PATH:" + bin.getFullPathName().replaceCharacter('\\', '/') + "\"\n"
+        + "CC=" + toScriptPath(bin.getChildFile("gcc.exe")) + "\n"
+        + "CXX=" + toScriptPath(bin.getChildFile("g++.exe")) + "\n"
+        + "LDFLAGS=\"-static-libgcc -static-libstdc++\"\n";
+#elif JUCE_MAC
+    String script = "CC=cc\nCXX=c++\nLDFLAGS=\"\"\n";
+#else // Linux or BSD
+    String script = Toolchain::dir.getChildFile("scripts").getChildFile("anywhere-setup.sh").getFullPathName() + "\n"
+        + "CC=${CC:-cc}\nCXX=${CXX:-c++}\nLDFLAGS=\"\"\n";
+#endif
+
+    script += "set -e\n"
+              "shopt -s nullglob\n"
+              "FLAGS=\"-O3 -ffast-math -fPIC -DNDEBUG\"\n"
+              "cd "
+        + toScriptPath(buildDir.getChildFile("c")) + "\n"
+        + "C_SOURCES=(*.c)\n"
+          "if [ ${#C_SOURCES[@]} -gt 0 ]; then \"$CC\" -std=c11 $FLAGS -c \"${C_SOURCES[@]}\"; fi\n"
+          "\"$CXX\" -std=c++11 $FLAGS -shared *.cpp *.o $LDFLAGS -o "
+        + toScriptPath(library) + "\n";
+
+    Toolchain::startShellScript(script, &process);
+    output = process.readAllProcessOutput();
+
+    auto exitCode = process.getExitCode();
+    buildDir.deleteRecursively();
+
+    if (shouldQuit || exitCode != 0 || !library.existsAsFile()) {
+        library.deleteFile();
+        return output.trim();
+    }
+
+    return {};
+}
@@ -0,0 +1,34 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen and Wasted Audio
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+class PluginProcessor;
+
+// Compiles a subpatch with Heavy and the local toolchain into a shared library, and has the Pd instance run that in place of the subpatch
+// Libraries are cached by the content of the subpatch, the abstractions it uses and the toolchain version, so a subpatch only gets built again after one of those changed
+class SubpatchCompiler : private ThreadPool {
+public:
+    explicit SubpatchCompiler(PluginProcessor* processor);
+
+    ~SubpatchCompiler();
+
+    // Whether the Heavy toolchain is installed
+    static bool isAvailable();
+
+    // Checks the subpatch, and starts building it in the background. The subpatch keeps running in Pd until the build is done. Message thread only
+    void compile(t_canvas* canvas, String const& name);
+
+    // Turns the content of a subpatch into a patch that Heavy can compile on its own
+    // inlet~ and outlet~ objects become adc~ and dac~ channels, numbered in the same order that Pd sorts the inlets and outlets of the subpatch
+    static String createWrapperPatch(String const& content);
+
+private:
+    String build(String const& patch, String const& heavyName, File const& library, StringArray const& searchPaths);
+
+    PluginProcessor* pd;
+    ChildProcess process;
+    std::atomic<bool> shouldQuit = false;
+};
@@ -424,8 +424,22 @@ Array<Rectangle<float>> Object::getCorners() const
     return corners;
 }
 
+void Object::setProfilerLoad(float load)
+{
+    if (approximatelyEqual(load, profilerLoad))
+        return;
+
+    profilerLoad = load;
+    repaint();
+}
+
 void Object::paintOverChildren(Graphics& g)
 {
+    if (profilerLoad > 0.0f) {
+        g.setColour(Colours::red.withAlpha(jmap(profilerLoad, 0.05f, 0.45f)));
+        g.fillRoundedRectangle(getLocalBounds().toFloat().reduced(Object::margin), Corners::objectCornerRadius);
+    }
+
     // If autoconnect is about to happen, draw a fake inlet with a dotted outline
     if (getValue<bool>(cnv->editor->autoconnect) && isInitialEditorShown() && cnv->lastSelectedObject && cnv->lastSelectedObject != this && cnv->lastSelectedObject->numOutputs) {
         auto outlet = cnv->lastSelectedObject->iolets[cnv->lastSelectedObject->numInputs];
@@ -927,7 +941,7 @@ void Object::mouseUp(MouseEvent const& e)
         cnv->patch.endUndoSequence("Drag");
     }
     
-    cnv->needsSearchUpdate = true;
+    cnv->pd->searchIndex.markChanged(cnv->patch.getPointer().get());
 }
 
 void Object::mouseDrag(MouseEvent const& e)
@@ -80,6 +80,9 @@ public:
 
     void triggerOverlayActiveState();
 
+    // Set by the DSP profiler, 0 means no load overlay is shown
+    void setProfilerLoad(float load);
+
     bool validResizeZone = false;
 
     Array<Rectangle<float>> getCorners() const;
@@ -130,6 +133,8 @@ private:
     bool showActiveState = false;
     float activeStateAlpha = 0.0f;
 
+    float profilerLoad = 0.0f;
+
     bool isObjectMouseActive = false;
     bool isInsideUndoSequence = false;
 
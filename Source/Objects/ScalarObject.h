@@ -5,6 +5,8 @@
  */
 
 #include "Utility/GlobalMouseListener.h"
+#include <list>
+#include <unordered_map>
 
 extern "C" {
 
@@ -28,21 +30,217 @@ int scalar_doclick(t_word* data, t_template* t, t_scalar* sc,
 // accidentally passing on mouse scroll events to the viewport.
 // This prevents that with a separation layer.
 
-class DrawableTemplate : public pd::MessageListener
-    , public AsyncUpdater {
+class DrawableTemplate;
+
+// Simple 64-bit FNV-style hash, to find out if the data that a scalar is drawn from has changed
+static uint64 hashScalarData(uint64 key, void const* data, size_t size)
+{
+    auto const* bytes = static_cast<uint8 const*>(data);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64) <= size; i += sizeof(uint64)) {
+        uint64 chunk;
+        memcpy(&chunk, bytes + i, sizeof(uint64));
+        key = (key ^ chunk) * 1099511628211ull;
+    }
+    for (; i < size; i++) {
+        key = (key ^ bytes[i]) * 1099511628211ull;
+    }
+
+    return key;
+}
+
+// Draws all scalars of a canvas in a single component, instead of having a component for every drawing instruction
+// Geometry is cached per drawable, and only recalculated when the scalar's data or the canvas coordinates change
+// Template field offsets are resolved once per locked pass, and drawing is culled to the area that is being repainted
+// Drawables are kept per scalar, and the layer is the only one that listens to the scalars for redraw messages
+class ScalarLayer : public Component
+    , public ReferenceCountedObject
+    , public pd::MessageListener {
+
+    struct Field {
+        int onset = 0;
+        int type = -1;
+        t_symbol* arrayTemplate = nullptr;
+    };
+
+public:
+    using Ptr = ReferenceCountedObjectPtr<ScalarLayer>;
+
+    // There is one layer per canvas, which gets deleted when the last scalar on it is deleted
+    static Ptr getOrCreate(Canvas* cnv)
+    {
+        if (auto it = layers.find(cnv); it != layers.end())
+            return it->second;
+
+        return new ScalarLayer(cnv);
+    }
+
+    explicit ScalarLayer(Canvas* cnv)
+        : canvas(cnv)
+        , mouseListener(cnv)
+    {
+        setInterceptsMouseClicks(false, false);
+        cnv->addAndMakeVisible(this);
+        setBounds(cnv->getLocalBounds());
+        toBack();
+        layers[cnv] = this;
+
+        mouseListener.globalMouseDown = [this](MouseEvent const& e) {
+            mouseTarget = canInteract() ? findDrawableAt(e.getMouseDownPosition().toFloat()) : nullptr;
+            if (mouseTarget)
+                handleMouseEvent(e, &DrawableTemplate::mouseDown);
+        };
+        mouseListener.globalMouseDrag = [this](MouseEvent const& e) {
+            if (mouseTarget && canInteract())
+                handleMouseEvent(e, &DrawableTemplate::mouseDrag);
+        };
+        mouseListener.globalMouseUp = [this](MouseEvent const& e) {
+            if (mouseTarget && canInteract())
+                handleMouseEvent(e, &DrawableTemplate::mouseUp);
+            mouseTarget = nullptr;
+        };
+        mouseListener.globalMouseMove = [this](MouseEvent const& e) {
+            if (!canInteract())
+                return;
+
+            mouseTarget = findDrawableAt(e.position);
+            if (mouseTarget)
+                handleMouseEvent(e, &DrawableTemplate::mouseMove);
+            mouseTarget = nullptr;
+        };
+    }
+
+    ~ScalarLayer() override
+    {
+        layers.erase(canvas);
+        canvas->removeChildComponent(this);
+    }
+
+    // Scalars are drawn in the order they were added, which is the order of the patch
+    void addDrawables(void* scalar, Array<DrawableTemplate*> const& toAdd)
+    {
+        if (auto it = scalarPositions.find(scalar); it != scalarPositions.end()) {
+            it->second->drawables.addArray(toAdd);
+        } else {
+            scalarPositions[scalar] = scalars.insert(scalars.end(), { scalar, toAdd });
+            canvas->pd->registerMessageListener(scalar, this);
+        }
+        requestUpdate();
+    }
+
+    void removeDrawables(void* scalar)
+    {
+        auto it = scalarPositions.find(scalar);
+        if (it == scalarPositions.end())
+            return;
+
+        canvas->pd->unregisterMessageListener(scalar, this);
+
+        if (it->second->drawables.contains(mouseTarget))
+            mouseTarget = nullptr;
+
+        scalars.erase(it->second);
+        scalarPositions.erase(it);
+        repaint();
+    }
+
+    void receiveMessage(t_symbol* symbol, pd::Atom const atoms[8], int numAtoms) override
+    {
+        if (hash(symbol->s_name) == hash("redraw"))
+            requestUpdate();
+    }
+
+    // Scalar data might have changed, check all drawables on the next repaint
+    void requestUpdate()
+    {
+        needsValidation = true;
+        repaint();
+    }
+
+    void parentSizeChanged() override
+    {
+        setBounds(getParentComponent()->getLocalBounds());
+    }
+
+    void paint(Graphics& g) override;
+
+    // Like template_find_field, but only searches the template once per locked pass
+    // Templates can be redefined or freed while the lock is released, so the cache is cleared before every pass
+    bool findField(t_template* templ, t_symbol* name, int* onset, int* type, t_symbol** arrayTemplate)
+    {
+        auto [it, inserted] = fields.try_emplace({ templ, name });
+        auto& field = it->second;
+        if (inserted && !template_find_field(templ, name, &field.onset, &field.type, &field.arrayTemplate))
+            field.type = -1;
+
+        if (field.type < 0)
+            return false;
+
+        *onset = field.onset;
+        *type = field.type;
+        *arrayTemplate = field.arrayTemplate;
+        return true;
+    }
+
+private:
+    bool canInteract() const
+    {
+        return getValue<bool>(canvas->locked) && canvas->isShowing();
+    }
+
+    DrawableTemplate* findDrawableAt(Point<float> position) const;
+
+    void handleMouseEvent(MouseEvent const& e, void (DrawableTemplate::*handler)(MouseEvent const&));
+
+    uint64 getCanvasKey() const;
+
+    static uint64 getScalarKey(t_scalar* scalar, uint64 canvasKey);
+
+    Canvas* canvas;
+    GlobalMouseListener mouseListener;
+    DrawableTemplate* mouseTarget = nullptr;
+
+    struct ScalarDrawables {
+        void* scalar;
+        Array<DrawableTemplate*> drawables;
+    };
+
+    std::list<ScalarDrawables> scalars;
+    std::unordered_map<void*, std::list<ScalarDrawables>::iterator> scalarPositions;
+    std::map<std::pair<t_template*, t_symbol*>, Field> fields;
+    bool needsValidation = true;
+
+    // Only used from the message thread
+    static inline std::unordered_map<Canvas*, ScalarLayer*> layers;
+};
+
+class DrawableTemplate {
 
 public:
     pd::Instance* pd;
     Canvas* canvas;
+    ScalarLayer* layer;
     t_float baseX, baseY;
     t_word* data;
     t_template* templ;
     t_template* parentTempl;
     pd::WeakReference scalar;
 
-    DrawableTemplate(t_scalar* object, t_word* scalarData, t_template* scalarTemplate, t_template* parentTemplate, Canvas* cnv, t_float x, t_float y)
+    // Geometry in canvas coordinates, drawn by the scalar layer
+    Path path;
+    FillType fill = Colours::transparentBlack;
+    FillType strokeFill = Colours::transparentBlack;
+    float strokeThickness = 0.0f;
+    String text;
+    Colour textColour;
+    float fontHeight = 15.0f;
+    Rectangle<float> bounds;
+
+    DrawableTemplate(t_scalar* object, t_word* scalarData, t_template* scalarTemplate, t_template* parentTemplate, Canvas* cnv, ScalarLayer* scalarLayer, t_float x, t_float y)
         : pd(cnv->pd)
         , canvas(cnv)
+        , layer(scalarLayer)
         , baseX(x)
         , baseY(y)
         , data(scalarData)
@@ -50,28 +248,82 @@ public:
         , parentTempl(parentTemplate ? parentTemplate : scalarTemplate)
         , scalar(object, cnv->pd)
     {
-        pd->registerMessageListener(scalar.getRawUnchecked<void>(), this);
-        triggerAsyncUpdate();
     }
 
-    ~DrawableTemplate()
+    virtual ~DrawableTemplate() = default;
+
+    // Called by the layer while holding the audio lock, recalculates the geometry if the scalar or canvas has changed
+    // The scalar key is hashed once per scalar by the layer, and shared between all of its drawables
+    void validate(uint64 scalarKey)
     {
-        pd->unregisterMessageListener(scalar.getRawUnchecked<void>(), this);
+        auto key = hashScalarData(scalarKey, &baseX, sizeof(t_float));
+        key = hashScalarData(key, &baseY, sizeof(t_float));
+        if (!needsUpdate && key == modificationKey)
+            return;
+
+        modificationKey = key;
+        needsUpdate = false;
+        update();
     }
 
-    void receiveMessage(t_symbol* symbol, pd::Atom const atoms[8], int numAtoms)
+    virtual void update() = 0;
+
+    virtual bool hitTest(Point<float> position)
     {
-        if (hash(symbol->s_name) == hash("redraw")) {
-            triggerAsyncUpdate();
+        return bounds.contains(position);
+    }
+
+    // Mouse events, relative to the canvas
+    virtual void mouseDown(MouseEvent const& e) { }
+    virtual void mouseDrag(MouseEvent const& e) { }
+    virtual void mouseUp(MouseEvent const& e) { }
+    virtual void mouseMove(MouseEvent const& e) { }
+
+    void paint(Graphics& g)
+    {
+        if (text.isNotEmpty()) {
+            g.setColour(textColour);
+            g.setFont(Font(fontHeight));
+            g.drawText(text, bounds, Justification::topLeft, false);
+            return;
+        }
+
+        if (!fill.isInvisible()) {
+            g.setFillType(fill);
+            g.fillPath(path);
+        }
+
+        if (strokeThickness > 0.0f && !strokeFill.isInvisible()) {
+            g.setFillType(strokeFill);
+            g.strokePath(path, PathStrokeType(strokeThickness));
         }
     }
 
-    void handleAsyncUpdate()
+    void setPath(Path const& newPath)
     {
-        update();
+        path = newPath;
+        bounds = path.isEmpty() ? Rectangle<float>() : path.getBounds().expanded(strokeThickness / 2.0f + 1.0f);
     }
 
-    virtual void update() = 0;
+    void setFill(FillType const& newFill)
+    {
+        fill = newFill;
+    }
+
+    void setStrokeFill(FillType const& newFill)
+    {
+        strokeFill = newFill;
+    }
+
+    FillType const& getStrokeFill() const
+    {
+        return strokeFill;
+    }
+
+    void setStrokeThickness(float thickness)
+    {
+        strokeThickness = thickness;
+    }
 
     t_float xToPixels(t_float xval)
     {
@@ -105,18 +357,31 @@ public:
 
     /* getting and setting values via fielddescs -- note confusing names;
      the above are setting up the fielddesc itself. */
-    static t_float fielddesc_getfloat(t_fake_fielddesc* f, t_template* templ, t_word* wp, int loud)
+    t_float fielddesc_getfloat(t_fake_fielddesc* f, t_template* templ, t_word* wp, int loud)
     {
         if (f->fd_type == A_FLOAT) {
-            if (f->fd_var)
-                return (template_getfloat(templ, f->fd_un.fd_varsym, wp, loud));
-            else
+            if (f->fd_var) {
+                int onset, type;
+                t_symbol* arraytype;
+                if (layer->findField(templ, f->fd_un.fd_varsym, &onset, &type, &arraytype) && type == DT_FLOAT)
+                    return ((t_word*)((char*)wp + onset))->w_float;
+                return (0);
+            } else
                 return (f->fd_un.fd_float);
         } else {
             return (0);
         }
     }
 
+    // Same as Pd's fielddesc_getcoord, but with cached field lookup
+    t_float fielddesc_getcoord(t_fake_fielddesc* f, t_template* templ, t_word* wp, int loud)
+    {
+        if (f->fd_type == A_FLOAT && f->fd_var)
+            return fielddesc_cvttocoord((t_fielddesc*)f, fielddesc_getfloat(f, templ, wp, loud));
+
+        return fielddesc_getfloat(f, templ, wp, loud);
+    }
+
     static int rangecolor(int n) /* 0 to 9 in 5 steps */
     {
         int n2 = (n == 9 ? 8 : n); /* 0 to 8 */
@@ -146,83 +411,75 @@ public:
 
         return Colour(red, green, blue);
     }
+
+private:
+    uint64 modificationKey = 0;
+    bool needsUpdate = true;
 };
 
-class DrawableCurve final : public DrawableTemplate
-    , public DrawablePath {
+class DrawableCurve final : public DrawableTemplate {
 
     t_fake_curve* object;
-    GlobalMouseListener globalMouseListener;
     Point<int> lastMouseDragPosition = { 0, 0 };
 
 public:
-    DrawableCurve(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, int x, int y, t_template* parent = nullptr)
-        : DrawableTemplate(s, data, templ, parent, cnv, x, y)
+    DrawableCurve(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, ScalarLayer* layer, int x, int y, t_template* parent = nullptr)
+        : DrawableTemplate(s, data, templ, parent, cnv, layer, x, y)
         , object(reinterpret_cast<t_fake_curve*>(obj))
-        , globalMouseListener(cnv)
     {
+    }
 
-        globalMouseListener.globalMouseDown = [this, cnv](MouseEvent const& e) {
-            auto localPos = e.getEventRelativeTo(this).getMouseDownPosition();
-            if (!getLocalBounds().contains(localPos) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-                return;
+    void mouseDown(MouseEvent const& e) override
+    {
+        if (auto gobj = scalar.get<t_gobj>()) {
+            auto glist = canvas->patch.getPointer();
+            auto pos = e.getPosition() - canvas->canvasOrigin;
+            gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), e.getNumberOfClicks() > 1, 1);
+            canvas->updateDrawables();
+            glist->gl_editor->e_xwas = pos.x;
+            glist->gl_editor->e_ywas = pos.y;
+        }
+    }
 
-            if (auto gobj = scalar.get<t_gobj>()) {
-                auto glist = cnv->patch.getPointer();
-                auto pos = e.getPosition() - cnv->canvasOrigin;
-                gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), e.getNumberOfClicks() > 1, 1);
-                cnv->updateDrawables();
-                glist->gl_editor->e_xwas = pos.x;
-                glist->gl_editor->e_ywas = pos.y;
-            }
-        };
-        globalMouseListener.globalMouseUp = [this, cnv](MouseEvent const& e) {
-            auto localPos = e.getEventRelativeTo(this).getMouseDownPosition();
-            if (!getLocalBounds().contains(localPos) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-                return;
+    void mouseUp(MouseEvent const& e) override
+    {
+        if (auto gobj = scalar.get<t_gobj>()) {
+            auto glist = canvas->patch.getPointer();
+            auto pos = e.getPosition() - canvas->canvasOrigin;
+            gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), 0, 0);
+            canvas->updateDrawables();
+            glist->gl_editor->e_xwas = pos.x;
+            glist->gl_editor->e_ywas = pos.y;
+        }
+    }
 
-            if (auto gobj = scalar.get<t_gobj>()) {
-                auto glist = cnv->patch.getPointer();
-                auto pos = e.getPosition() - cnv->canvasOrigin;
-                gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), 0, 0);
-                cnv->updateDrawables();
-                glist->gl_editor->e_xwas = pos.x;
-                glist->gl_editor->e_ywas = pos.y;
+    void mouseDrag(MouseEvent const& e) override
+    {
+        if (auto gobj = scalar.get<t_gobj>()) {
+            auto glist = canvas->patch.getPointer();
+            auto pos = e.getPosition() - canvas->canvasOrigin;
+            gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), e.getNumberOfClicks() > 1, 1);
+
+            auto* rootCanvas = glist_getcanvas(glist.get());
+            if (rootCanvas->gl_editor->e_motionfn) {
+                rootCanvas->gl_editor->e_motionfn(&rootCanvas->gl_editor->e_grab->g_pd, pos.x - glist->gl_editor->e_xwas, pos.y - glist->gl_editor->e_ywas, 0);
             }
-        };
-        globalMouseListener.globalMouseDrag = [this, cnv](MouseEvent const& e) {
-            auto localPos = e.getEventRelativeTo(this).getMouseDownPosition();
-            if (!getLocalBounds().contains(localPos) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-                return;
 
-            if (auto gobj = scalar.get<t_gobj>()) {
-                auto glist = cnv->patch.getPointer();
-                auto pos = e.getPosition() - cnv->canvasOrigin;
-                gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), e.getNumberOfClicks() > 1, 1);
-
-                auto* canvas = glist_getcanvas(glist.get());
-                if (canvas->gl_editor->e_motionfn) {
-                    canvas->gl_editor->e_motionfn(&canvas->gl_editor->e_grab->g_pd, pos.x - glist->gl_editor->e_xwas, pos.y - glist->gl_editor->e_ywas, 0);
-                }
-
-                cnv->updateDrawables();
-                glist->gl_editor->e_xwas = pos.x;
-                glist->gl_editor->e_ywas = pos.y;
-            }
-        };
-        globalMouseListener.globalMouseMove = [this, cnv](MouseEvent const& e) {
-            auto localPos = e.getEventRelativeTo(this).getMouseDownPosition();
-            if (!getLocalBounds().contains(localPos) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-                return;
+            canvas->updateDrawables();
+            glist->gl_editor->e_xwas = pos.x;
+            glist->gl_editor->e_ywas = pos.y;
+        }
+    }
 
-            if (auto gobj = scalar.get<t_gobj>()) {
-                auto glist = cnv->patch.getPointer();
-                auto pos = e.getPosition() - cnv->canvasOrigin;
-                gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), 0, 0);
-                glist->gl_editor->e_xwas = pos.x;
-                glist->gl_editor->e_ywas = pos.y;
-            }
-        };
+    void mouseMove(MouseEvent const& e) override
+    {
+        if (auto gobj = scalar.get<t_gobj>()) {
+            auto glist = canvas->patch.getPointer();
+            auto pos = e.getPosition() - canvas->canvasOrigin;
+            gobj_click(gobj.get(), glist.get(), pos.x, pos.y, e.mods.isShiftDown(), e.mods.isAltDown(), 0, 0);
+            glist->gl_editor->e_xwas = pos.x;
+            glist->gl_editor->e_ywas = pos.y;
+        }
     }
 
     void update() override
@@ -258,20 +515,16 @@ public:
             if (n > 100)
                 n = 100;
 
-            canvas->pd->lockAudioThread();
-
             for (int i = 0; i < n; i++) {
                 auto* f = x->x_vec + (i * 2);
 
-                float xCoord = xToPixels(baseX + fielddesc_getcoord((t_fielddesc*)f, templ, data, 1));
-                float yCoord = yToPixels(baseY + fielddesc_getcoord((t_fielddesc*)(f + 1), templ, data, 1));
+                float xCoord = xToPixels(baseX + fielddesc_getcoord(f, templ, data, 1));
+                float yCoord = yToPixels(baseY + fielddesc_getcoord(f + 1, templ, data, 1));
 
                 pix[2 * i] = xCoord + canvas->canvasOrigin.x;
                 pix[2 * i + 1] = yCoord + canvas->canvasOrigin.y;
             }
 
-            canvas->pd->unlockAudioThread();
-
             if (width < 1)
                 width = 1;
             if (glist->gl_isgraph)
@@ -344,37 +597,26 @@ public:
     }
 };
 
-class DrawableSymbol final : public DrawableTemplate
-    , public DrawableText {
+class DrawableSymbol final : public DrawableTemplate {
 
     t_fake_drawnumber* object;
-    GlobalMouseListener mouseListener;
 
     float mouseDownValue;
 
 public:
-    DrawableSymbol(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, int x, int y, t_template* parent = nullptr)
-        : DrawableTemplate(s, data, templ, parent, cnv, x, y)
+    DrawableSymbol(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, ScalarLayer* layer, int x, int y, t_template* parent = nullptr)
+        : DrawableTemplate(s, data, templ, parent, cnv, layer, x, y)
         , object(reinterpret_cast<t_fake_drawnumber*>(obj))
     {
-        mouseListener.globalMouseDown = [this](MouseEvent const& e) {
-            handleMouseDown(e.getEventRelativeTo(this));
-        };
-        mouseListener.globalMouseDrag = [this](MouseEvent const& e) {
-            handleMouseDrag(e.getEventRelativeTo(this));
-        };
     }
 
-    void handleMouseDown(MouseEvent const& e)
+    void mouseDown(MouseEvent const& e) override
     {
-        if (!getLocalBounds().contains(e.getMouseDownPosition()) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-            return;
-
         if (auto s = scalar.get<t_scalar>()) {
             int type, onset;
             t_symbol* arraytype;
 
-            if (!s->sc_template || !template_find_field(templ, object->x_fieldname, &onset, &type, &arraytype) || type != DT_FLOAT) {
+            if (!s->sc_template || !layer->findField(templ, object->x_fieldname, &onset, &type, &arraytype) || type != DT_FLOAT) {
                 return;
             }
 
@@ -382,16 +624,13 @@ public:
         }
     }
 
-    void handleMouseDrag(MouseEvent const& e)
+    void mouseDrag(MouseEvent const& e) override
     {
-        if (!getLocalBounds().contains(e.getMouseDownPosition()) || !getValue<bool>(canvas->locked) || !canvas->isShowing())
-            return;
-
         if (auto s = scalar.get<t_scalar>()) {
             int type, onset;
             t_symbol* arraytype;
 
-            if (!s->sc_template || !template_find_field(templ, object->x_fieldname, &onset, &type, &arraytype) || type != DT_FLOAT) {
+            if (!s->sc_template || !layer->findField(templ, object->x_fieldname, &onset, &type, &arraytype) || type != DT_FLOAT) {
                 return;
             }
 
@@ -410,21 +649,22 @@ public:
         auto* x = reinterpret_cast<t_fake_drawnumber*>(object);
 
         if (!fielddesc_getfloat(&x->x_vis, templ, data, 0)) {
-            setText("");
+            text.clear();
+            bounds = {};
             return;
         }
 
         int xloc = 0, yloc = 0;
         if (auto glist = canvas->patch.getPointer()) {
-            xloc = xToPixels(baseX + fielddesc_getcoord((t_fielddesc*)&x->x_xloc, templ, data, 0)) + canvas->canvasOrigin.x;
-            yloc = yToPixels(baseY + fielddesc_getcoord((t_fielddesc*)&x->x_yloc, templ, data, 0)) + canvas->canvasOrigin.y;
+            xloc = xToPixels(baseX + fielddesc_getcoord(&x->x_xloc, templ, data, 0)) + canvas->canvasOrigin.x;
+            yloc = yToPixels(baseY + fielddesc_getcoord(&x->x_yloc, templ, data, 0)) + canvas->canvasOrigin.y;
         }
 
         char buf[DRAWNUMBER_BUFSIZE];
         int type, onset;
         t_symbol* arraytype;
 
-        if (!template_find_field(templ, x->x_fieldname, &onset, &type, &arraytype) || type == DT_ARRAY) {
+        if (!layer->findField(templ, x->x_fieldname, &onset, &type, &arraytype) || type == DT_ARRAY) {
             type = -1;
         }
 
@@ -456,32 +696,26 @@ public:
             }
         }
 
-        auto symbolColour = numberToColour(fielddesc_getfloat(&x->x_color, templ, data, 1));
-        setColour(symbolColour);
-        auto text = String::fromUTF8(buf);
-        auto font = getFont();
+        textColour = numberToColour(fielddesc_getfloat(&x->x_color, templ, data, 1));
+        text = String::fromUTF8(buf);
 
-        setBoundingBox(Parallelogram<float>(Rectangle<float>(xloc, yloc, font.getStringWidthFloat(text) + 4.0f, font.getHeight() + 4.0f)));
         if (auto glist = canvas->patch.getPointer()) {
-            setFontHeight(sys_hostfontsize(glist_getfont(glist.get()), glist_getzoom(glist.get())));
+            fontHeight = sys_hostfontsize(glist_getfont(glist.get()), glist_getzoom(glist.get()));
         }
-        setJustification(Justification::topLeft);
-        setText(text);
+
+        bounds = Rectangle<float>(xloc, yloc, Font(fontHeight).getStringWidthFloat(text) + 4.0f, fontHeight + 4.0f);
     }
 };
 
-class DrawablePlot final : public DrawableTemplate
-    , public DrawablePath {
+class DrawablePlot final : public DrawableTemplate {
 
     Point<int> lastMouseDragPosition = { 0, 0 };
     t_fake_curve* object;
-    GlobalMouseListener globalMouseListener;
 
 public:
-    DrawablePlot(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, int x, int y, t_template* parent = nullptr)
-        : DrawableTemplate(s, data, templ, parent, cnv, x, y)
+    DrawablePlot(t_scalar* s, t_gobj* obj, t_word* data, t_template* templ, Canvas* cnv, ScalarLayer* layer, int x, int y, t_template* parent = nullptr)
+        : DrawableTemplate(s, data, templ, parent, cnv, layer, x, y)
         , object(reinterpret_cast<t_fake_curve*>(obj))
-        , globalMouseListener(cnv)
     {
         /* TODO: finish this and enable it!
         globalMouseListener.globalMouseDown = [this, cnv](const MouseEvent& e){
@@ -547,7 +781,13 @@ public:
         }; */
     }
 
-    static int readOwnerTemplate(t_fake_plot* x,
+    // Plots can't be edited with the mouse yet
+    bool hitTest(Point<float> position) override
+    {
+        return false;
+    }
+
+    int readOwnerTemplate(t_fake_plot* x,
         t_word* data, t_template* ownertemplate,
         t_symbol** elemtemplatesymp, t_array** arrayp,
         t_float* linewidthp, t_float* xlocp, t_float* xincp, t_float* ylocp,
@@ -563,7 +803,7 @@ public:
             pd_error(0, "plot: needs an array field");
             return (-1);
         }
-        if (!template_find_field(ownertemplate, x->x_data.fd_un.fd_varsym,
+        if (!layer->findField(ownertemplate, x->x_data.fd_un.fd_varsym,
                 &arrayonset, &type, &elemtemplatesym)) {
             pd_error(0, "plot: %s: no such field", x->x_data.fd_un.fd_varsym->s_name);
             return (-1);
@@ -589,7 +829,7 @@ public:
         return (0);
     }
 
-    Array<Component*> getSubPlots()
+    Array<DrawableTemplate*> getSubPlots()
     {
         auto* s = scalar.getRaw<t_scalar>();
 
@@ -622,7 +862,7 @@ public:
         int nelem = array->a_n;
         auto* elem = (char*)array->a_vec;
 
-        Array<Component*> drawables;
+        Array<DrawableTemplate*> drawables;
 
         for (xsum = xloc, i = 0; i < nelem; i++) {
             t_float usexloc, useyloc;
@@ -645,11 +885,11 @@ public:
 
                 auto name = String::fromUTF8(y->g_pd->c_name->s_name);
                 if (name == "drawtext" || name == "drawnumber" || name == "drawsymbol") {
-                    drawables.add(new DrawableSymbol(s, y, subData, elemtemplate, canvas, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
+                    drawables.add(new DrawableSymbol(s, y, subData, elemtemplate, canvas, layer, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
                 } else if (name == "drawpolygon" || name == "drawcurve" || name == "filledpolygon" || name == "filledcurve") {
-                    drawables.add(new DrawableCurve(s, y, subData, elemtemplate, canvas, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
+                    drawables.add(new DrawableCurve(s, y, subData, elemtemplate, canvas, layer, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
                 } else if (name == "plot") {
-                    drawables.add(new DrawablePlot(s, y, subData, elemtemplate, canvas, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
+                    drawables.add(new DrawablePlot(s, y, subData, elemtemplate, canvas, layer, static_cast<int>(usexloc), static_cast<int>(useyloc), templ));
                 }
             }
         }
@@ -918,11 +1158,122 @@ public:
     }
 };
 
+inline DrawableTemplate* ScalarLayer::findDrawableAt(Point<float> position) const
+{
+    // Drawables that are drawn last are on top
+    for (auto it = scalars.rbegin(); it != scalars.rend(); ++it) {
+        auto const& drawables = it->drawables;
+        for (int i = drawables.size() - 1; i >= 0; i--) {
+            if (drawables[i]->hitTest(position))
+                return drawables[i];
+        }
+    }
+
+    return nullptr;
+}
+
+inline void ScalarLayer::handleMouseEvent(MouseEvent const& e, void (DrawableTemplate::*handler)(MouseEvent const&))
+{
+    fields.clear();
+    (mouseTarget->*handler)(e);
+}
+
+inline uint64 ScalarLayer::getCanvasKey() const
+{
+    auto glist = canvas->patch.getPointer();
+    if (!glist)
+        return 0;
+
+    t_float const state[] = {
+        glist->gl_x1, glist->gl_x2, glist->gl_y1, glist->gl_y2,
+        static_cast<t_float>(glist->gl_pixwidth), static_cast<t_float>(glist->gl_pixheight),
+        static_cast<t_float>(glist->gl_screenx1), static_cast<t_float>(glist->gl_screenx2),
+        static_cast<t_float>(glist->gl_screeny1), static_cast<t_float>(glist->gl_screeny2),
+        static_cast<t_float>(glist->gl_xmargin), static_cast<t_float>(glist->gl_ymargin),
+        static_cast<t_float>(glist_getzoom(glist.get())), static_cast<t_float>(glist_getfont(glist.get())),
+        static_cast<t_float>(glist->gl_isgraph), getValue<bool>(canvas->isGraphChild) ? 1.0f : 0.0f, canvas->isGraph ? 1.0f : 0.0f
+    };
+
+    return hashScalarData(1469598103934665603ull, state, sizeof(state));
+}
+
+// Hash of everything the geometry of a scalar depends on, which works as a modification counter for the scalar
+// Array elements are hashed as part of their array, so this also covers the drawables of plotted arrays
+inline uint64 ScalarLayer::getScalarKey(t_scalar* scalar, uint64 canvasKey)
+{
+    auto key = canvasKey;
+    if (!scalar)
+        return key;
+
+    auto* templ = template_findbyname(scalar->sc_template);
+    if (!templ)
+        return key;
+
+    t_float position[2];
+    scalar_getbasexy(scalar, position, position + 1);
+    key = hashScalarData(key, position, sizeof(position));
+
+    for (int i = 0; i < templ->t_n; i++) {
+        auto* word = scalar->sc_vec + i;
+        switch (templ->t_vec[i].ds_type) {
+        case DT_ARRAY: {
+            auto* array = word->w_array;
+            key = hashScalarData(key, &array->a_n, sizeof(int));
+            key = hashScalarData(key, array->a_vec, static_cast<size_t>(array->a_n) * array->a_elemsize);
+            break;
+        }
+        case DT_TEXT: {
+            auto* binbuf = word->w_binbuf;
+            key = hashScalarData(key, binbuf_getvec(binbuf), static_cast<size_t>(binbuf_getnatom(binbuf)) * sizeof(t_atom));
+            break;
+        }
+        default:
+            key = hashScalarData(key, word, sizeof(t_word));
+            break;
+        }
+    }
+
+    return key;
+}
+
+inline void ScalarLayer::paint(Graphics& g)
+{
+    // Check all drawables under a single lock, only the ones that have changed will recalculate their geometry
+    // Each scalar's data only gets hashed once, for all of its drawables
+    if (needsValidation) {
+        needsValidation = false;
+        fields.clear();
+
+        canvas->pd->lockAudioThread();
+        auto canvasKey = getCanvasKey();
+        for (auto const& [scalar, drawables] : scalars) {
+            if (drawables.isEmpty())
+                continue;
+
+            auto scalarKey = getScalarKey(drawables.getFirst()->scalar.getRaw<t_scalar>(), canvasKey);
+            for (auto* drawable : drawables) {
+                drawable->validate(scalarKey);
+            }
+        }
+        canvas->pd->unlockAudioThread();
+    }
+
+    auto clip = g.getClipBounds().toFloat();
+    for (auto const& [scalar, drawables] : scalars) {
+        for (auto* drawable : drawables) {
+            if (drawable->bounds.intersects(clip))
+                drawable->paint(g);
+        }
+    }
+}
+
 struct ScalarObject final : public ObjectBase {
-    OwnedArray<Component> templates;
+    OwnedArray<DrawableTemplate> templates;
+    ScalarLayer::Ptr layer;
 
     ScalarObject(pd::WeakReference obj, Object* object)
         : ObjectBase(obj, object)
+        , layer(ScalarLayer::getOrCreate(object->cnv))
     {
 
         // Make object invisible
@@ -942,44 +1293,40 @@ struct ScalarObject final : public ObjectBase {
                 auto name = String::fromUTF8(y->g_pd->c_name->s_name);
 
                 if (name == "drawtext" || name == "drawnumber" || name == "drawsymbol") {
-                    cnv->addAndMakeVisible(templates.add(new DrawableSymbol(scalar.get(), y, data, templ, cnv, static_cast<int>(baseX), static_cast<int>(baseY))));
+                    templates.add(new DrawableSymbol(scalar.get(), y, data, templ, cnv, layer.get(), static_cast<int>(baseX), static_cast<int>(baseY)));
                 } else if (name == "drawpolygon" || name == "drawcurve" || name == "filledpolygon" || name == "filledcurve") {
-                    cnv->addAndMakeVisible(templates.add(new DrawableCurve(scalar.get(), y, data, templ, cnv, static_cast<int>(baseX), static_cast<int>(baseY))));
+                    templates.add(new DrawableCurve(scalar.get(), y, data, templ, cnv, layer.get(), static_cast<int>(baseX), static_cast<int>(baseY)));
                 } else if (name == "plot") {
-                    auto* plot = new DrawablePlot(scalar.get(), y, data, templ, cnv, static_cast<int>(baseX), static_cast<int>(baseY));
-                    cnv->addAndMakeVisible(templates.add(plot));
-
-                    for (auto* subplot : plot->getSubPlots()) {
-                        cnv->addAndMakeVisible(templates.add(subplot));
-                    }
+                    auto* plot = templates.add(new DrawablePlot(scalar.get(), y, data, templ, cnv, layer.get(), static_cast<int>(baseX), static_cast<int>(baseY)));
+                    templates.addArray(plot->getSubPlots());
                 }
             }
-
-            for (int i = templates.size() - 1; i >= 0; i--) {
-                templates[i]->toBack();
-            }
         }
 
-        updateDrawables();
+        layer->addDrawables(ptr.getRawUnchecked<void>(), getDrawables());
     }
 
     ~ScalarObject() override
     {
-        for (auto* drawable : templates) {
-            cnv->removeChildComponent(drawable);
-        }
+        layer->removeDrawables(ptr.getRawUnchecked<void>());
     }
 
     void updateDrawables() override
     {
-        pd->setThis();
-
-        for (auto* drawable : templates) {
-            dynamic_cast<DrawableTemplate*>(drawable)->triggerAsyncUpdate();
-        }
+        layer->requestUpdate();
     }
 
     Rectangle<int> getPdBounds() override { return { 0, 0, 0, 0 }; }
 
     void setPdBounds(Rectangle<int> b) override { }
+
+private:
+    Array<DrawableTemplate*> getDrawables() const
+    {
+        Array<DrawableTemplate*> drawables;
+        for (auto* drawable : templates) {
+            drawables.add(drawable);
+        }
+        return drawables;
+    }
 };
@@ -0,0 +1,331 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+#include <source_location>
+
+namespace pd {
+
+// The lock that protects the Pd instance, with instrumentation to find out who is blocking the audio thread
+// Every call site that takes the lock gets its own statistics slot, which records how often and how long it held the lock,
+// and how long the audio thread had to wait while it did
+// All statistics are written by the thread that holds the lock, so recording doesn't need any extra synchronisation. Readers may see slightly torn values, which is fine for this purpose
+class AudioLock {
+public:
+    // Hold and wait durations are bucketed by powers of two microseconds: <1us, <2us, <4us, ... , >=16ms
+    static constexpr int numBuckets = 16;
+    static constexpr int maxCallSites = 256;
+
+    struct CallSiteStatistics {
+        String location;
+        uint64 numLocks = 0;
+        double totalHoldMs = 0.0;
+        double maxHoldMs = 0.0;
+        double audioWaitMs = 0.0;
+        std::array<uint32, numBuckets> holdHistogram = {};
+    };
+
+    AudioLock()
+    {
+        // The first slots are reserved for Pd locking itself, from the audio thread or from anywhere else
+        callSites[audioThreadSlot].file = "Pd (audio thread)";
+        callSites[audioThreadSlot].used.store(true);
+        callSites[otherThreadSlot].file = "Pd (other threads)";
+        callSites[otherThreadSlot].used.store(true);
+    }
+
+    // Called at the start of every audio callback, so we can tell Pd's own locks on the audio thread apart from the ones on other threads
+    void setAudioThread()
+    {
+        audioThread.store(Thread::getCurrentThreadId(), std::memory_order_relaxed);
+    }
+
+    void enter(std::source_location const& location = std::source_location::current()) const
+    {
+        lock.enter();
+        startHolding(location.file_name(), location.line(), location.function_name());
+    }
+
+    bool tryEnter(std::source_location const& location = std::source_location::current()) const
+    {
+        if (!lock.tryEnter())
+            return false;
+
+        startHolding(location.file_name(), location.line(), location.function_name());
+        return true;
+    }
+
+    void exit() const
+    {
+        stopHolding();
+        lock.exit();
+    }
+
+    // Used by Pd's lock hooks. sys_lock is also called from the message thread, those locks get a slot of their own
+    void enterFromPd() const
+    {
+        if (Thread::getCurrentThreadId() != audioThread.load(std::memory_order_relaxed)) {
+            lock.enter();
+            startHolding(otherThreadSlot);
+            return;
+        }
+
+        // This is where we measure how long the audio thread is blocked
+        if (lock.tryEnter()) {
+            audioWaitHistogram[0].fetch_add(1, std::memory_order_relaxed);
+            startHolding(audioThreadSlot);
+            return;
+        }
+
+        auto blockingSlot = currentHolder.load(std::memory_order_relaxed);
+        auto waitStart = Time::getHighResolutionTicks();
+
+        lock.enter();
+
+        auto waited = Time::getHighResolutionTicks() - waitStart;
+        audioWaitHistogram[getBucket(waited)].fetch_add(1, std::memory_order_relaxed);
+        maxAudioWaitTicks.store(std::max(maxAudioWaitTicks.load(std::memory_order_relaxed), waited), std::memory_order_relaxed);
+
+        if (isPositiveAndBelow(blockingSlot, maxCallSites)) {
+            auto& blocker = callSites[blockingSlot];
+            blocker.audioWaitTicks.store(blocker.audioWaitTicks.load(std::memory_order_relaxed) + waited, std::memory_order_relaxed);
+        }
+
+        startHolding(audioThreadSlot);
+    }
+
+    void exitFromPd() const
+    {
+        exit();
+    }
+
+    std::vector<CallSiteStatistics> getStatistics() const
+    {
+        std::vector<CallSiteStatistics> result;
+        for (auto& callSite : callSites) {
+            if (!callSite.used.load(std::memory_order_acquire))
+                continue;
+
+            CallSiteStatistics statistics;
+            statistics.location = callSite.line ? File(callSite.file).getFileName() + ":" + String(callSite.line) + " (" + String(callSite.function) + ")" : String(callSite.file);
+            statistics.numLocks = callSite.numLocks.load(std::memory_order_relaxed);
+            statistics.totalHoldMs = ticksToMs(callSite.totalHoldTicks.load(std::memory_order_relaxed));
+            statistics.maxHoldMs = ticksToMs(callSite.maxHoldTicks.load(std::memory_order_relaxed));
+            statistics.audioWaitMs = ticksToMs(callSite.audioWaitTicks.load(std::memory_order_relaxed));
+            for (int i = 0; i < numBuckets; i++) {
+                statistics.holdHistogram[i] = callSite.holdHistogram[i].load(std::memory_order_relaxed);
+            }
+            result.push_back(statistics);
+        }
+
+        return result;
+    }
+
+    std::array<uint32, numBuckets> getAudioWaitHistogram() const
+    {
+        std::array<uint32, numBuckets> result;
+        for (int i = 0; i < numBuckets; i++) {
+            result[i] = audioWaitHistogram[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    double getMaxAudioWaitMs() const
+    {
+        return ticksToMs(maxAudioWaitTicks.load(std::memory_order_relaxed));
+    }
+
+    // Clearing the statistics needs the lock, because the holder is the only one allowed to write them
+    void resetStatistics() const
+    {
+        enter();
+        for (auto& callSite : callSites) {
+            callSite.numLocks = 0;
+            callSite.totalHoldTicks = 0;
+            callSite.maxHoldTicks = 0;
+            callSite.audioWaitTicks = 0;
+            for (auto& bucket : callSite.holdHistogram)
+                bucket = 0;
+        }
+        for (auto& bucket : audioWaitHistogram)
+            bucket = 0;
+        maxAudioWaitTicks = 0;
+        exit();
+    }
+
+    bool dumpToFile(File const& file) const
+    {
+        auto statistics = getStatistics();
+        std::sort(statistics.begin(), statistics.end(), [](auto const& a, auto const& b) {
+            return a.audioWaitMs > b.audioWaitMs;
+        });
+
+        String report;
+        report << "Audio thread wait histogram (max " << String(getMaxAudioWaitMs(), 3) << " ms)\n";
+
+        auto waitHistogram = getAudioWaitHistogram();
+        for (int i = 0; i < numBuckets; i++) {
+            report << "  " << getBucketName(i).paddedRight(' ', 10) << waitHistogram[i] << "\n";
+        }
+
+        report << "\nCall sites, sorted by time the audio thread spent waiting on them\n";
+        for (auto& callSite : statistics) {
+            report << "\n"
+                   << callSite.location << "\n";
+            report << "  locks: " << String(callSite.numLocks)
+                   << ", total hold: " << String(callSite.totalHoldMs, 3) << " ms"
+                   << ", max hold: " << String(callSite.maxHoldMs, 3) << " ms"
+                   << ", audio thread waited: " << String(callSite.audioWaitMs, 3) << " ms\n";
+            report << "  hold histogram:";
+            for (int i = 0; i < numBuckets; i++) {
+                if (callSite.holdHistogram[i])
+                    report << " " << getBucketName(i) << ": " << String(callSite.holdHistogram[i]);
+            }
+            report << "\n";
+        }
+
+        return file.replaceWithText(report);
+    }
+
+    static String getBucketName(int bucket)
+    {
+        if (bucket == numBuckets - 1)
+            return ">=" + String(1 << (bucket - 1)) + "us";
+
+        return "<" + String(1 << bucket) + "us";
+    }
+
+    // Like JUCE's ScopedLock, but keeps track of where the lock was taken
+    class ScopedLock {
+    public:
+        explicit ScopedLock(AudioLock const& lockToUse, std::source_location const& location = std::source_location::current())
+            : audioLock(lockToUse)
+        {
+            audioLock.enter(location);
+        }
+
+        ~ScopedLock()
+        {
+            audioLock.exit();
+        }
+
+    private:
+        AudioLock const& audioLock;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedLock)
+    };
+
+private:
+    struct CallSite {
+        std::atomic<bool> used = false;
+        char const* file = nullptr;
+        char const* function = nullptr;
+        uint32 line = 0; // 0 for the reserved slots, which use file as their name
+
+        std::atomic<uint64> numLocks = 0;
+        std::atomic<int64> totalHoldTicks = 0;
+        std::atomic<int64> maxHoldTicks = 0;
+        std::atomic<int64> audioWaitTicks = 0;
+        std::array<std::atomic<uint32>, numBuckets> holdHistogram = {};
+    };
+
+    static constexpr int audioThreadSlot = 0;
+    static constexpr int otherThreadSlot = 1;
+    static constexpr int firstCallSiteSlot = 2;
+
+    static double ticksToMs(int64 ticks)
+    {
+        return Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    }
+
+    static int getBucket(int64 ticks)
+    {
+        auto microseconds = static_cast<uint64>(Time::highResolutionTicksToSeconds(ticks) * 1000000.0);
+        int bucket = 0;
+        while (microseconds && bucket < numBuckets - 1) {
+            microseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    // Called while holding the lock
+    int findCallSite(char const* file, uint32 line, char const* function) const
+    {
+        auto hash = (reinterpret_cast<pointer_sized_uint>(file) >> 3) * 31 + line;
+        for (int probe = 0; probe < maxCallSites - firstCallSiteSlot; probe++) {
+            auto index = firstCallSiteSlot + static_cast<int>((hash + probe) % (maxCallSites - firstCallSiteSlot));
+            auto& callSite = callSites[index];
+
+            if (!callSite.used.load(std::memory_order_relaxed)) {
+                // Source locations are static strings, so we only keep the pointers. The name is put together when the statistics are read
+                callSite.file = file;
+                callSite.function = function;
+                callSite.line = line;
+                callSite.used.store(true, std::memory_order_release);
+                return index;
+            }
+
+            if (callSite.file == file && callSite.line == line)
+                return index;
+        }
+
+        return -1;
+    }
+
+    void startHolding(char const* file, uint32 line, char const* function) const
+    {
+        if (holdDepth++ == 0)
+            beginHold(findCallSite(file, line, function));
+    }
+
+    void startHolding(int slot) const
+    {
+        if (holdDepth++ == 0)
+            beginHold(slot);
+    }
+
+    void beginHold(int slot) const
+    {
+        currentHolder.store(slot, std::memory_order_relaxed);
+        holdStart = Time::getHighResolutionTicks();
+    }
+
+    void stopHolding() const
+    {
+        if (--holdDepth != 0)
+            return;
+
+        auto slot = currentHolder.load(std::memory_order_relaxed);
+        currentHolder.store(-1, std::memory_order_relaxed);
+
+        if (!isPositiveAndBelow(slot, maxCallSites))
+            return;
+
+        auto held = Time::getHighResolutionTicks() - holdStart;
+        auto& callSite = callSites[slot];
+        callSite.numLocks.store(callSite.numLocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        callSite.totalHoldTicks.store(callSite.totalHoldTicks.load(std::memory_order_relaxed) + held, std::memory_order_relaxed);
+        callSite.maxHoldTicks.store(std::max(callSite.maxHoldTicks.load(std::memory_order_relaxed), held), std::memory_order_relaxed);
+
+        auto& bucket = callSite.holdHistogram[getBucket(held)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    CriticalSection lock;
+
+    // Only accessed by the thread that holds the lock
+    mutable int holdDepth = 0;
+    mutable int64 holdStart = 0;
+
+    mutable std::atomic<int> currentHolder = -1;
+    std::atomic<Thread::ThreadID> audioThread = nullptr;
+    mutable std::array<CallSite, maxCallSites> callSites;
+    mutable std::array<std::atomic<uint32>, numBuckets> audioWaitHistogram = {};
+    mutable std::atomic<int64> maxAudioWaitTicks = 0;
+};
+
+}
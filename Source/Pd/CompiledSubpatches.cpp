@@ -0,0 +1,310 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "Utility/Config.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+
+extern "C" {
+#include <m_pd.h>
+#include <m_imp.h>
+#include <g_canvas.h>
+}
+
+#include "Instance.h"
+#include "CompiledSubpatches.h"
+
+namespace pd {
+
+struct CompiledSubpatches::Subpatch {
+    // The parts of Heavy's C API that we need
+    using CreateFunction = void* (*)(double);
+    using ProcessFunction = int (*)(void*, float**, float**, int);
+    using DeleteFunction = void (*)(void*);
+
+    Subpatch(t_canvas* cnv, Instance* instance, String subpatchName)
+        : canvas(cnv, instance)
+        , name(std::move(subpatchName))
+    {
+    }
+
+    ~Subpatch()
+    {
+        if (context)
+            destroy(context);
+    }
+
+    // Called by Pd while building the DSP chain. Returns false if the compiled code can't be used in this chain
+    bool prepare(t_canvas* cnv, t_signal** sp)
+    {
+        if (!process || obj_nsiginlets(&cnv->gl_obj) != numInputs || obj_nsigoutlets(&cnv->gl_obj) != numOutputs)
+            return false;
+
+        // Heavy doesn't know about multichannel signals
+        for (int i = 0; i < numInputs; i++) {
+            if (sp[i]->s_nchans != 1)
+                return false;
+        }
+
+        if (!context || contextSampleRate != sampleRate) {
+            if (context)
+                destroy(context);
+
+            context = create(sampleRate);
+            contextSampleRate = sampleRate;
+        }
+
+        if (!context)
+            return false;
+
+        inputs.resize(numInputs);
+        outputs.resize(numOutputs);
+
+        for (int i = 0; i < numInputs; i++) {
+            inputs[i] = sp[i]->s_vec;
+        }
+
+        // Pd leaves the outputs of a subpatch for its outlet~ objects to fill in, so we have to lend them a buffer ourselves
+        // Same as the signal that an outlet~ lends: the borrowing signal holds the only reference to it, and hands it back to Pd once it's released
+        for (int i = 0; i < numOutputs; i++) {
+            auto* buffer = signal_new(blockSize, 1, sampleRate, nullptr);
+            buffer->s_refcount = 1;
+            signal_setborrowed(sp[numInputs + i], buffer);
+            outputs[i] = buffer->s_vec;
+        }
+
+        return true;
+    }
+
+    void setBlock(t_canvas* cnv, t_signal** sp)
+    {
+        // Without signal inlets, we have no way to find out if the parent is reblocked
+        blockSize = obj_nsiginlets(&cnv->gl_obj) ? sp[0]->s_n : DEFDACBLKSIZE;
+        sampleRate = sp[0]->s_sr;
+    }
+
+    void updateLoad(std::atomic<float>& load, int64 ticks) const
+    {
+        auto const percentage = static_cast<float>(Time::highResolutionTicksToSeconds(ticks) * sampleRate / blockSize * 100.0);
+
+        // Smooth over a few hundred blocks, so the number is readable
+        load.store(load.load(std::memory_order_relaxed) * 0.99f + percentage * 0.01f, std::memory_order_relaxed);
+    }
+
+    WeakReference canvas;
+    String name;
+
+    std::unique_ptr<DynamicLibrary> library;
+    CreateFunction create = nullptr;
+    ProcessFunction process = nullptr;
+    DeleteFunction destroy = nullptr;
+    void* context = nullptr;
+    double contextSampleRate = 0.0;
+
+    int numInputs = 0;
+    int numOutputs = 0;
+    int blockSize = DEFDACBLKSIZE;
+    double sampleRate = 44100.0;
+
+    // Only touched while building the DSP chain
+    std::vector<float*> inputs;
+    std::vector<float*> outputs;
+
+    int64 blockStart = 0;
+    std::atomic<float> interpretedLoad = 0.0f;
+    std::atomic<float> compiledLoad = 0.0f;
+    std::atomic<bool> usesCompiledCode = false;
+};
+
+// Multiple instances can be building a DSP chain at the same time, so the lookup table gets its own lock
+// The subpatches themselves are only used while holding the lock of the instance they belong to
+static CriticalSection registryLock;
+static std::unordered_map<t_canvas*, CompiledSubpatches::Subpatch*> registry;
+
+static t_int* compiled_perform(t_int* w)
+{
+    auto* subpatch = reinterpret_cast<CompiledSubpatches::Subpatch*>(w[1]);
+
+    auto const start = Time::getHighResolutionTicks();
+    subpatch->process(subpatch->context, subpatch->inputs.data(), subpatch->outputs.data(), subpatch->blockSize);
+    subpatch->updateLoad(subpatch->compiledLoad, Time::getHighResolutionTicks() - start);
+
+    return w + 2;
+}
+
+static t_int* interpreted_start(t_int* w)
+{
+    auto* subpatch = reinterpret_cast<CompiledSubpatches::Subpatch*>(w[1]);
+    subpatch->blockStart = Time::getHighResolutionTicks();
+    return w + 2;
+}
+
+static t_int* interpreted_end(t_int* w)
+{
+    auto* subpatch = reinterpret_cast<CompiledSubpatches::Subpatch*>(w[1]);
+    subpatch->updateLoad(subpatch->interpretedLoad, Time::getHighResolutionTicks() - subpatch->blockStart);
+    return w + 2;
+}
+
+void CompiledSubpatches::buildDSP(t_canvas* x, t_signal** sp, CanvasDSPMethod next)
+{
+    CompiledSubpatches::Subpatch* subpatch = nullptr;
+    {
+        ScopedLock lock(registryLock);
+        if (auto it = registry.find(x); it != registry.end() && it->second->canvas.isValid())
+            subpatch = it->second;
+    }
+
+    // Subpatches without signal inlets or outlets don't take part in the DSP chain themselves
+    if (!subpatch || !(obj_nsiginlets(&x->gl_obj) + obj_nsigoutlets(&x->gl_obj))) {
+        next(x, sp);
+        return;
+    }
+
+    subpatch->setBlock(x, sp);
+    subpatch->usesCompiledCode = subpatch->prepare(x, sp);
+
+    if (subpatch->usesCompiledCode) {
+        dsp_add(compiled_perform, 1, subpatch);
+        return;
+    }
+
+    dsp_add(interpreted_start, 1, subpatch);
+    next(x, sp);
+    dsp_add(interpreted_end, 1, subpatch);
+}
+
+CompiledSubpatches::CompiledSubpatches(Instance* instance)
+    : pd(instance)
+{
+}
+
+CompiledSubpatches::~CompiledSubpatches()
+{
+    ScopedLock lock(registryLock);
+    for (auto& subpatch : subpatches) {
+        if (auto it = registry.find(subpatch->canvas.getRawUnchecked<t_canvas>()); it != registry.end() && it->second == subpatch.get())
+            registry.erase(it);
+    }
+}
+
+void CompiledSubpatches::watch(t_canvas* canvas, String const& name)
+{
+    if (find(canvas))
+        return;
+
+    // Forget about subpatches that were deleted. Pd has already removed them from the DSP chain
+    for (auto& subpatch : subpatches) {
+        if (subpatch->canvas.isValid())
+            continue;
+
+        ScopedLock lock(registryLock);
+        if (auto it = registry.find(subpatch->canvas.getRawUnchecked<t_canvas>()); it != registry.end() && it->second == subpatch.get())
+            registry.erase(it);
+    }
+    subpatches.erase(std::remove_if(subpatches.begin(), subpatches.end(), [](auto const& subpatch) { return !subpatch->canvas.isValid(); }), subpatches.end());
+
+    auto subpatch = std::make_unique<Subpatch>(canvas, pd, name);
+
+    pd->lockAudioThread();
+    {
+        ScopedLock lock(registryLock);
+        registry[canvas] = subpatch.get();
+    }
+    canvas_update_dsp();
+    pd->unlockAudioThread();
+
+    subpatches.push_back(std::move(subpatch));
+}
+
+String CompiledSubpatches::load(t_canvas* canvas, File const& libraryFile, String const& heavyName, int numInputs, int numOutputs)
+{
+    auto* subpatch = find(canvas);
+    if (!subpatch)
+        return "the subpatch was deleted";
+
+    auto library = std::make_unique<DynamicLibrary>();
+    if (!library->open(libraryFile.getFullPathName()))
+        return "couldn't open " + libraryFile.getFileName();
+
+    auto create = reinterpret_cast<Subpatch::CreateFunction>(library->getFunction("hv_" + heavyName + "_new"));
+    auto process = reinterpret_cast<Subpatch::ProcessFunction>(library->getFunction("hv_process"));
+    auto destroy = reinterpret_cast<Subpatch::DeleteFunction>(library->getFunction("hv_delete"));
+
+    if (!create || !process || !destroy)
+        return libraryFile.getFileName() + " doesn't contain a Heavy patch";
+
+    pd->lockAudioThread();
+
+    // A context from a previously loaded library has to be deleted by that library
+    if (subpatch->context) {
+        subpatch->destroy(subpatch->context);
+        subpatch->context = nullptr;
+    }
+
+    std::swap(subpatch->library, library);
+    subpatch->create = create;
+    subpatch->process = process;
+    subpatch->destroy = destroy;
+    subpatch->numInputs = numInputs;
+    subpatch->numOutputs = numOutputs;
+
+    canvas_update_dsp();
+    pd->unlockAudioThread();
+
+    return {};
+}
+
+void CompiledSubpatches::unload(t_canvas* canvas)
+{
+    if (auto* subpatch = find(canvas))
+        remove(subpatch);
+}
+
+bool CompiledSubpatches::isCompiled(t_canvas* canvas) const
+{
+    auto* subpatch = find(canvas);
+    return subpatch && subpatch->library;
+}
+
+std::vector<CompiledSubpatches::Load> CompiledSubpatches::getLoads() const
+{
+    std::vector<Load> loads;
+    for (auto& subpatch : subpatches) {
+        if (!subpatch->canvas.isValid())
+            continue;
+
+        loads.push_back({ subpatch->name, subpatch->interpretedLoad.load(std::memory_order_relaxed), subpatch->compiledLoad.load(std::memory_order_relaxed), subpatch->usesCompiledCode.load() });
+    }
+
+    return loads;
+}
+
+CompiledSubpatches::Subpatch* CompiledSubpatches::find(t_canvas* canvas) const
+{
+    for (auto& subpatch : subpatches) {
+        if (subpatch->canvas == canvas && subpatch->canvas.isValid())
+            return subpatch.get();
+    }
+
+    return nullptr;
+}
+
+void CompiledSubpatches::remove(Subpatch* subpatch)
+{
+    pd->lockAudioThread();
+    {
+        ScopedLock lock(registryLock);
+        if (auto it = registry.find(subpatch->canvas.getRawUnchecked<t_canvas>()); it != registry.end() && it->second == subpatch)
+            registry.erase(it);
+    }
+    canvas_update_dsp();
+    pd->unlockAudioThread();
+
+    // The new chain doesn't refer to the subpatch anymore, so it's safe to delete it
+    subpatches.erase(std::remove_if(subpatches.begin(), subpatches.end(), [subpatch](auto const& other) { return other.get() == subpatch; }), subpatches.end());
+}
+
+}
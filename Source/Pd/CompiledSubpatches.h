@@ -0,0 +1,58 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+namespace pd {
+
+class Instance;
+
+using CanvasDSPMethod = void (*)(t_canvas*, t_signal**);
+
+// Runs subpatches as native code, generated by Heavy and built with the local toolchain
+// We take over the "dsp" method of canvases: a compiled subpatch adds a single perform routine to the DSP chain, which hands the signals of its inlet~ and outlet~ objects straight to the compiled code
+// The patch itself is never changed, so saving, editing and undo behave as if the subpatch was interpreted. Until the compiled version is loaded, or whenever it can't be used, the subpatch keeps running in Pd
+// Both versions are timed, so the user can see what compiling gained them
+class CompiledSubpatches {
+public:
+    struct Load {
+        String name;
+        float interpreted = 0.0f; // Percentage of the time available for a block
+        float compiled = 0.0f;
+        bool isCompiled = false;
+    };
+
+    explicit CompiledSubpatches(Instance* instance);
+
+    ~CompiledSubpatches();
+
+    // Builds the DSP chain of a canvas, where next is how Pd would build it
+    static void buildDSP(t_canvas* canvas, t_signal** sp, CanvasDSPMethod next);
+
+    // Starts timing the interpreted subpatch, so we have something to compare the compiled version to. Message thread only
+    void watch(t_canvas* canvas, String const& name);
+
+    // Loads a subpatch that was compiled into a shared library by Heavy, under the name heavyName. Message thread only
+    // Returns an error message if the library can't be used, in which case the subpatch keeps running in Pd
+    String load(t_canvas* canvas, File const& library, String const& heavyName, int numInputs, int numOutputs);
+
+    // Go back to running the subpatch in Pd. Message thread only
+    void unload(t_canvas* canvas);
+
+    bool isCompiled(t_canvas* canvas) const;
+
+    std::vector<Load> getLoads() const;
+
+    struct Subpatch;
+
+private:
+    Subpatch* find(t_canvas* canvas) const;
+    void remove(Subpatch* subpatch);
+
+    Instance* pd;
+    std::vector<std::unique_ptr<Subpatch>> subpatches;
+};
+
+}
@@ -0,0 +1,205 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+#include <unordered_set>
+
+namespace pd {
+
+// Lines printed by Pd, on their way from the thread that holds the Pd lock to the message thread
+// Lines are copied into a fixed-size byte ring, so printing never allocates. If the message thread can't keep up, lines are dropped
+class PrintQueue {
+    struct Header {
+        void* object;
+        int type;
+        int length;
+    };
+
+public:
+    static constexpr int ringSize = 1 << 18;
+
+    PrintQueue()
+        : fifo(ringSize)
+    {
+        buffer.resize(ringSize);
+    }
+
+    // Called while holding the Pd lock. The header and the text are published together, so the reader never sees one without the other
+    void push(void* object, int type, char const* text, int length)
+    {
+        Header header { object, type, length };
+        auto const size = static_cast<int>(sizeof(Header)) + length;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(size, start1, size1, start2, size2);
+        if (size1 + size2 < size) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        copyIn(&header, 0, sizeof(Header), start1, size1, start2);
+        copyIn(text, sizeof(Header), length, start1, size1, start2);
+        fifo.finishedWrite(size);
+    }
+
+    // Message thread only
+    template<typename Callback>
+    int pop(Callback&& callback)
+    {
+        int numPopped = 0;
+        std::vector<char> text;
+
+        while (fifo.getNumReady() >= static_cast<int>(sizeof(Header))) {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+            Header header;
+            copyOut(&header, 0, sizeof(Header), start1, size1, start2);
+
+            auto const size = static_cast<int>(sizeof(Header)) + header.length;
+            if (size1 + size2 < size)
+                break;
+
+            text.resize(header.length);
+            copyOut(text.data(), sizeof(Header), header.length, start1, size1, start2);
+            fifo.finishedRead(size);
+
+            callback(header.object, header.type, String::fromUTF8(text.data(), header.length));
+            numPopped++;
+        }
+
+        return numPopped;
+    }
+
+    int getAndResetNumDropped()
+    {
+        return numDropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    // Copies data to or from the bytes at offset..offset+size of a reserved range, which may wrap around the end of the ring
+    void copyIn(void const* data, int offset, int size, int start1, int size1, int start2)
+    {
+        auto const* bytes = static_cast<char const*>(data);
+        auto const first = std::clamp(size1 - offset, 0, size);
+        if (first > 0)
+            memcpy(buffer.data() + start1 + offset, bytes, first);
+        if (size - first > 0)
+            memcpy(buffer.data() + start2 + std::max(offset - size1, 0), bytes + first, size - first);
+    }
+
+    void copyOut(void* data, int offset, int size, int start1, int size1, int start2) const
+    {
+        auto* bytes = static_cast<char*>(data);
+        auto const first = std::clamp(size1 - offset, 0, size);
+        if (first > 0)
+            memcpy(bytes, buffer.data() + start1 + offset, first);
+        if (size - first > 0)
+            memcpy(bytes + first, buffer.data() + start2 + std::max(offset - size1, 0), size - first);
+    }
+
+    AbstractFifo fifo;
+    std::vector<char> buffer;
+    std::atomic<int> numDropped = 0;
+};
+
+// Console history, kept in a fixed-capacity ring so memory use and the cost of adding a message stay constant
+// Messages are addressed by a sequence number that keeps increasing, so the console can find out which messages are new
+// Clearing the console only moves the start of the visible range, so the messages can be restored later
+class ConsoleStore {
+public:
+    struct Message {
+        void* object = nullptr;
+        String text;
+        int type = 0; // 0: message, 1: warning or error
+        int width = 0;
+        int repeats = 1;
+    };
+
+    static constexpr uint64 capacity = 100000;
+
+    ConsoleStore()
+        : fastStringWidth(Font(14))
+    {
+    }
+
+    // Message thread only. Returns true if a new message was added, false if the last one got repeated
+    bool add(void* object, String const& text, int type)
+    {
+        if (end > visibleStart) {
+            auto& last = (*this)[end - 1];
+            if (last.object == object && last.type == type && last.text == text) {
+                last.repeats++;
+                return false;
+            }
+        }
+
+        Message message { object, intern(text), type, static_cast<int>(fastStringWidth.getStringWidth(text)) + 8, 1 };
+
+        if (messages.size() < capacity)
+            messages.push_back(message);
+        else
+            messages[end % capacity] = message;
+
+        end++;
+        first = end > capacity ? end - capacity : 0;
+        visibleStart = std::max(visibleStart, first);
+
+        return true;
+    }
+
+    Message& operator[](uint64 index)
+    {
+        return messages[index % capacity];
+    }
+
+    Message const& operator[](uint64 index) const
+    {
+        return messages[index % capacity];
+    }
+
+    // First visible message
+    uint64 getStart() const
+    {
+        return visibleStart;
+    }
+
+    // One past the last message
+    uint64 getEnd() const
+    {
+        return end;
+    }
+
+    void clear()
+    {
+        visibleStart = end;
+    }
+
+    void restore()
+    {
+        visibleStart = first;
+    }
+
+private:
+    // Patches that print at control rate tend to print the same few lines over and over, let those share their string data
+    String intern(String const& text)
+    {
+        if (internedStrings.size() > 4096)
+            internedStrings.clear();
+
+        return *internedStrings.insert(text).first;
+    }
+
+    std::vector<Message> messages;
+    uint64 first = 0;
+    uint64 visibleStart = 0;
+    uint64 end = 0;
+
+    std::unordered_set<String> internedStrings;
+    StringUtils fastStringWidth; // For formatting console messages more quickly
+};
+
+}
@@ -0,0 +1,212 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+extern "C" {
+#include <m_pd.h>
+#include <m_imp.h>
+#include <z_libpd.h>
+
+// Pd keeps the DSP chain in a private struct, we only need access to the first few members
+// The DSP chain is used by the profiler, the lists of reusable signals are used to give clone voices their own buffers
+struct _instanceugen {
+    t_int* u_dspchain;
+    int u_dspchainsize;
+    t_signal* u_signals;
+    int u_sortno;
+    t_signal* u_freelist[32 + 1]; // One list per power of two buffer size, up to MAXLOGSIG in d_ugen.c
+    t_signal* u_freeborrowed;
+};
+}
+
+namespace pd {
+
+// Opt-in profiler for the Pd DSP chain
+// On every Nth block, we temporarily swap the DSP chain for a single trampoline routine, that runs the real chain while timing every perform routine
+// Perform routines are later attributed to a t_object on the message thread, by checking which of their arguments point to a known object
+// This means that this will never allocate or lock on the audio thread, and will cost almost nothing when it's disabled
+class DSPProfiler {
+public:
+    // A single perform routine in the DSP chain, and the first few arguments it got
+    struct Entry {
+        t_int routine = 0;
+        t_int args[4] = { 0 };
+        int numArgs = 0;
+        int64 ticks = 0;
+    };
+
+    static constexpr int maxEntries = 8192;
+
+    DSPProfiler()
+    {
+        entries.resize(maxEntries);
+        trampoline = createTrampoline();
+    }
+
+    ~DSPProfiler()
+    {
+        if (trampoline)
+            freebytes(trampoline, trampolineSize * sizeof(t_int));
+    }
+
+    void setEnabled(bool shouldBeEnabled)
+    {
+        enabled = shouldBeEnabled;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    // Only measure one out of every N blocks, to keep the overhead low
+    void setSampleInterval(int interval)
+    {
+        sampleInterval = std::max(interval, 1);
+    }
+
+    // Called from the audio thread with the instance set, runs one pd tick
+    template<typename ProcessFunction>
+    void process(ProcessFunction&& processBlock)
+    {
+        if (!enabled || ++blockCounter < sampleInterval || !trampoline) {
+            processBlock();
+            return;
+        }
+
+        blockCounter = 0;
+
+        auto* ugen = libpd_this_instance()->pd_ugen;
+        if (!ugen || !ugen->u_dspchain) {
+            processBlock();
+            return;
+        }
+
+        realChain = ugen->u_dspchain;
+        realChainSize = ugen->u_dspchainsize;
+
+        ugen->u_dspchain = trampoline;
+        ugen->u_dspchainsize = trampolineSize;
+
+        processBlock();
+
+        if (ugen->u_dspchain == trampoline) {
+            ugen->u_dspchain = realChain;
+            ugen->u_dspchainsize = realChainSize;
+        } else {
+            // Pd rebuilt the DSP chain during this tick, which freed our trampoline instead of the real chain
+            // Free the old chain in its place, a new trampoline will be allocated on the message thread
+            freebytes(realChain, realChainSize * sizeof(t_int));
+            trampoline = nullptr;
+        }
+
+        realChain = nullptr;
+    }
+
+    // Called from the message thread: copies all measurements since the last call, and resets them
+    // Returns the number of measured blocks
+    int getMeasurements(std::vector<Entry>& result)
+    {
+        if (!trampoline)
+            trampoline = createTrampoline();
+
+        SpinLock::ScopedLockType lock(entryLock);
+
+        result.assign(entries.begin(), entries.begin() + numEntries);
+        auto blocks = numMeasuredBlocks;
+
+        for (int i = 0; i < numEntries; i++) {
+            entries[i].ticks = 0;
+        }
+        numMeasuredBlocks = 0;
+
+        return blocks;
+    }
+
+    static double ticksToMicroseconds(int64 ticks)
+    {
+        return Time::highResolutionTicksToSeconds(ticks) * 1000000.0;
+    }
+
+private:
+    t_int* createTrampoline()
+    {
+        auto* chain = static_cast<t_int*>(getbytes(trampolineSize * sizeof(t_int)));
+        chain[0] = reinterpret_cast<t_int>(&DSPProfiler::perform);
+        chain[1] = reinterpret_cast<t_int>(this);
+        chain[2] = 0;
+        return chain;
+    }
+
+    static t_int* perform(t_int* w)
+    {
+        reinterpret_cast<DSPProfiler*>(w[1])->runChain();
+        return nullptr;
+    }
+
+    void runChain()
+    {
+        auto* chain = realChain;
+        auto* end = chain + realChainSize;
+
+        // If the GUI is currently reading our results, skip the measurement but still run the chain
+        if (!entryLock.tryEnter()) {
+            for (auto* ip = chain; ip;)
+                ip = (*reinterpret_cast<t_perfroutine>(*ip))(ip);
+            return;
+        }
+
+        int index = 0;
+        for (auto* ip = chain; ip;) {
+            auto start = Time::getHighResolutionTicks();
+            auto* next = (*reinterpret_cast<t_perfroutine>(*ip))(ip);
+            auto elapsed = Time::getHighResolutionTicks() - start;
+
+            if (index < maxEntries) {
+                auto& entry = entries[index];
+                auto routine = *ip;
+                auto numArgs = next ? static_cast<int>(std::min<t_int>(next - ip - 1, 4)) : static_cast<int>(std::min<t_int>(end - ip - 1, 4));
+
+                // The chain has changed since the last measurement, reset this slot
+                if (entry.routine != routine || (numArgs > 0 && entry.args[0] != ip[1])) {
+                    entry.routine = routine;
+                    entry.ticks = 0;
+                    entry.numArgs = numArgs;
+                    for (int i = 0; i < numArgs; i++) {
+                        entry.args[i] = ip[i + 1];
+                    }
+                }
+
+                entry.ticks += elapsed;
+            }
+
+            index++;
+            ip = next;
+        }
+
+        numEntries = std::min(index, maxEntries);
+        numMeasuredBlocks++;
+
+        entryLock.exit();
+    }
+
+    static constexpr int trampolineSize = 3;
+
+    std::atomic<bool> enabled = false;
+    std::atomic<int> sampleInterval = 8;
+    int blockCounter = 0;
+
+    std::atomic<t_int*> trampoline = nullptr;
+    t_int* realChain = nullptr;
+    int realChainSize = 0;
+
+    SpinLock entryLock;
+    std::vector<Entry> entries;
+    int numEntries = 0;
+    int numMeasuredBlocks = 0;
+};
+
+}
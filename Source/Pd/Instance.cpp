@@ -128,6 +128,17 @@ struct pd::Instance::internal {
 
 namespace pd {
 
+static CanvasDSPMethod interpretedCanvasDSP = nullptr;
+
+// Compiled and oversampled subpatches both change how a canvas builds its DSP chain, while Pd only has one "dsp" method per class
+// So this is the only method we install, and it chains them explicitly: an oversampled subpatch gets its block~ first, then either the compiled code or Pd builds the chain
+static void subpatch_canvas_dsp(t_canvas* x, t_signal** sp)
+{
+    OversampledSubpatches::buildDSP(x, sp, [](t_canvas* x, t_signal** sp) {
+        CompiledSubpatches::buildDSP(x, sp, interpretedCanvasDSP);
+    });
+}
+
 Instance::Instance(String const& symbol)
     : messageDispatcher(std::make_unique<MessageDispatcher>())
     , consoleHandler(this)
@@ -143,6 +154,7 @@ Instance::~Instance()
     pd_free(static_cast<t_pd*>(printReceiver));
     pd_free(static_cast<t_pd*>(parameterReceiver));
     pd_free(static_cast<t_pd*>(parameterChangeReceiver));
+    pd_free(static_cast<t_pd*>(voiceActivityReceiver));
 
     // JYG added this
     pd_free(static_cast<t_pd*>(dataBufferReceiver));
@@ -161,10 +173,10 @@ void Instance::initialisePd(String& pdlua_version)
     setup_lock(
         static_cast<void const*>(&audioLock),
         [](void* lock) {
-            static_cast<CriticalSection*>(lock)->enter();
+            static_cast<AudioLock*>(lock)->enterFromPd();
         },
         [](void* lock) {
-            static_cast<CriticalSection*>(lock)->exit();
+            static_cast<AudioLock*>(lock)->exitFromPd();
         });
 
     setup_weakreferences(
@@ -202,6 +214,10 @@ void Instance::initialisePd(String& pdlua_version)
     parameterChangeReceiver = pd::Setup::createReceiver(this, "param_change", reinterpret_cast<t_plugdata_banghook>(internal::instance_multi_bang), reinterpret_cast<t_plugdata_floathook>(internal::instance_multi_float), reinterpret_cast<t_plugdata_symbolhook>(internal::instance_multi_symbol),
         reinterpret_cast<t_plugdata_listhook>(internal::instance_multi_list), reinterpret_cast<t_plugdata_messagehook>(internal::instance_multi_message));
 
+    voiceActivityReceiver = pd::Setup::createReceiver(&voiceActivity, VoiceActivity::receiverName, nullptr, nullptr, nullptr, reinterpret_cast<t_plugdata_listhook>(VoiceActivity::receiveActivity), nullptr);
+    voiceActivity.initialise();
+    oversampledSubpatches.initialise();
+
     atoms = malloc(sizeof(t_atom) * 512);
 
     // Register callback when pd's gui changes
@@ -265,6 +281,7 @@ void Instance::initialisePd(String& pdlua_version)
 
     auto message_trigger = [](void* instance, void* target, t_symbol* symbol, int argc, t_atom* argv) {
         auto* pd = reinterpret_cast<pd::Instance*>(instance);
+        pd->messageTracer.record(target, symbol);
         pd->messageDispatcher->enqueueMessage(target, symbol, argc, argv);
     };
 
@@ -278,14 +295,8 @@ void Instance::initialisePd(String& pdlua_version)
     if (!initialised) {
         auto extra = ProjectInfo::appDataDir.getChildFile("Extra");
 
-        set_class_prefix(gensym("else"));
-        class_set_extern_dir(gensym("9.else"));
-        pd::Setup::initialiseELSE();
-        set_class_prefix(gensym("cyclone"));
-        class_set_extern_dir(gensym("10.cyclone"));
-        pd::Setup::initialiseCyclone();
-
-        set_class_prefix(nullptr);
+        auto classRegistry = ProjectInfo::versionDataDir.getChildFile(".class_registry");
+        pd::Setup::initialiseExternalLibraries(classRegistry.getFullPathName().toRawUTF8());
 
         // Class prefix doesn't seem to work for pdlua
         char vers[1000];
@@ -294,6 +305,13 @@ void Instance::initialisePd(String& pdlua_version)
         if (*vers)
             pdlua_version = vers;
 
+        // Installed before any instance can build a DSP chain, because the classes are shared between all instances
+        OversampledSubpatches::setup();
+        VoiceActivity::setup();
+        interpretedCanvasDSP = reinterpret_cast<CanvasDSPMethod>(zgetfn(&canvas_class, gensym("dsp")));
+        if (interpretedCanvasDSP)
+            class_addmethod(canvas_class, reinterpret_cast<t_method>(subpatch_canvas_dsp), gensym("dsp"), A_CANT, 0);
+
         initialised = true;
     }
 
@@ -340,7 +358,9 @@ void Instance::releaseDSP()
 void Instance::performDSP(float const* inputs, float* outputs)
 {
     libpd_set_instance(static_cast<t_pdinstance*>(instance));
-    libpd_process_raw(inputs, outputs);
+    dspProfiler.process([inputs, outputs]() {
+        libpd_process_raw(inputs, outputs);
+    });
 }
 
 void Instance::sendNoteOn(int const channel, int const pitch, int const velocity) const
@@ -666,16 +686,11 @@ void Instance::muteConsole(bool shouldMute)
     consoleMute = shouldMute;
 }
 
-std::deque<std::tuple<void*, String, int, int, int>>& Instance::getConsoleMessages()
+ConsoleStore& Instance::getConsoleMessages()
 {
     return consoleHandler.consoleMessages;
 }
 
-std::deque<std::tuple<void*, String, int, int, int>>& Instance::getConsoleHistory()
-{
-    return consoleHandler.consoleHistory;
-}
-
 void Instance::createPanel(int type, char const* snd, char const* location, char const* callbackName, int openMode)
 {
     auto* obj = generateSymbol(snd)->s_thing;
@@ -754,14 +769,14 @@ bool Instance::loadLibrary(String const& libraryToLoad)
     return sys_load_lib(nullptr, libraryToLoad.toRawUTF8());
 }
 
-void Instance::lockAudioThread()
+void Instance::lockAudioThread(std::source_location const& location)
 {
-    audioLock.enter();
+    audioLock.enter(location);
 }
 
-bool Instance::tryLockAudioThread()
+bool Instance::tryLockAudioThread(std::source_location const& location)
 {
-    if (audioLock.tryEnter()) {
+    if (audioLock.tryEnter(location)) {
         return true;
     }
 
@@ -16,6 +16,13 @@ extern "C" {
 #include "Utility/StringUtils.h"
 #include "Patch.h"
 #include "Ofelia.h"
+#include "DSPProfiler.h"
+#include "VoiceActivity.h"
+#include "CompiledSubpatches.h"
+#include "OversampledSubpatches.h"
+#include "MessageTracer.h"
+#include "ConsoleStore.h"
+#include "AudioLock.h"
 
 class ObjectImplementationManager;
 
@@ -228,6 +235,9 @@ public:
 
     virtual void receiveDSPState(bool dsp) { }
 
+    // Called on the message thread with the worst case latency of the oversampled subpatches, in samples
+    virtual void oversamplingLatencyChanged(int latency) { }
+
     virtual void updateConsole(int numMessages, bool newWarning) { }
 
     virtual void titleChanged() { }
@@ -266,8 +276,7 @@ public:
     void logWarning(String const& message);
     void muteConsole(bool shouldMute);
 
-    std::deque<std::tuple<void*, String, int, int, int>>& getConsoleMessages();
-    std::deque<std::tuple<void*, String, int, int, int>>& getConsoleHistory();
+    ConsoleStore& getConsoleMessages();
 
     void sendMessagesFromQueue();
     void processMessage(Message mess);
@@ -287,8 +296,9 @@ public:
     t_symbol* generateSymbol(String const& symbol) const;
     t_symbol* generateSymbol(char const* symbol) const;
 
-    void lockAudioThread();
-    bool tryLockAudioThread();
+    // The call site is recorded, so we can see who is holding up the audio thread
+    void lockAudioThread(std::source_location const& location = std::source_location::current());
+    bool tryLockAudioThread(std::source_location const& location = std::source_location::current());
     void unlockAudioThread();
 
     bool loadLibrary(String const& library);
@@ -301,6 +311,7 @@ public:
     void* parameterChangeReceiver = nullptr;
     void* midiReceiver = nullptr;
     void* printReceiver = nullptr;
+    void* voiceActivityReceiver = nullptr;
 
     // JYG added this
     void* dataBufferReceiver = nullptr;
@@ -308,7 +319,13 @@ public:
     inline static String const defaultPatch = "#N canvas 827 239 527 327 12;";
 
     bool isPerformingGlobalSync = false;
-    CriticalSection const audioLock;
+    AudioLock const audioLock;
+
+    DSPProfiler dspProfiler;
+    VoiceActivity voiceActivity { this };
+    CompiledSubpatches compiledSubpatches { this };
+    OversampledSubpatches oversampledSubpatches { this };
+    MessageTracer messageTracer;
     std::recursive_mutex weakReferenceMutex;
 
 private:
@@ -326,21 +343,26 @@ protected:
 
     std::unique_ptr<pd::MessageDispatcher> messageDispatcher;
 
-    struct ConsoleHandler : public Timer {
+    struct ConsoleHandler : public AsyncUpdater {
         Instance* instance;
 
         ConsoleHandler(Instance* parent)
             : instance(parent)
-            , fastStringWidth(Font(14))
         {
         }
 
-        void timerCallback() override
+        // Drains everything that was printed since the last update, so a burst of prints results in one console update
+        void handleAsyncUpdate() override
         {
             auto item = std::tuple<void*, String, bool>();
             int numReceived = 0;
             bool newWarning = false;
 
+            numReceived += printQueue.pop([this, &newWarning](void* object, int type, String const& message) {
+                addMessage(object, message, type);
+                newWarning = newWarning || type;
+            });
+
             while (pendingMessages.try_dequeue(item)) {
                 auto& [object, message, type] = item;
                 addMessage(object, message, type);
@@ -349,29 +371,21 @@ protected:
                 newWarning = newWarning || type;
             }
 
+            if (auto numDropped = printQueue.getAndResetNumDropped()) {
+                addMessage(nullptr, String(numDropped) + " lines were not shown, because Pd printed faster than the console could keep up", true);
+                numReceived++;
+                newWarning = true;
+            }
+
             // Check if any item got assigned
             if (numReceived) {
                 instance->updateConsole(numReceived, newWarning);
             }
-
-            stopTimer();
         }
 
         void addMessage(void* object, String const& message, bool type)
         {
-            if (consoleMessages.size()) {
-                auto& [lastObject, lastMessage, lastType, lastLength, numMessages] = consoleMessages.back();
-                if (object == lastObject && message == lastMessage && type == lastType) {
-                    numMessages++;
-                } else {
-                    consoleMessages.emplace_back(object, message, type, fastStringWidth.getStringWidth(message) + 8, 1);
-                }
-            } else {
-                consoleMessages.emplace_back(object, message, type, fastStringWidth.getStringWidth(message) + 8, 1);
-            }
-
-            if (consoleMessages.size() > 800)
-                consoleMessages.pop_front();
+            consoleMessages.add(object, message, type);
         }
 
         void logMessage(void* object, String const& message)
@@ -381,7 +395,7 @@ protected:
                 instance->updateConsole(1, false);
             } else {
                 pendingMessages.enqueue({ object, message, false });
-                startTimer(10);
+                triggerAsyncUpdate();
             }
         }
 
@@ -392,7 +406,7 @@ protected:
                 instance->updateConsole(1, true);
             } else {
                 pendingMessages.enqueue({ object, warning, true });
-                startTimer(10);
+                triggerAsyncUpdate();
             }
         }
 
@@ -403,65 +417,72 @@ protected:
                 instance->updateConsole(1, true);
             } else {
                 pendingMessages.enqueue({ object, error, true });
-                startTimer(10);
+                triggerAsyncUpdate();
             }
         }
 
+        // Called by Pd while holding the Pd lock, possibly on the audio thread, so this doesn't allocate
         void processPrint(void* object, char const* message)
         {
-            std::function<void(String const)> forwardMessage =
-                [this, object](String const& message) {
-                    if (message.startsWith("error")) {
-                        logError(object, message.substring(7));
-                    } else if (message.startsWith("verbose(0):") || message.startsWith("verbose(1):")) {
-                        logError(object, message.substring(12));
-                    } else {
-                        if (message.startsWith("verbose(")) {
-                            logMessage(object, message.substring(12));
-                        } else {
-                            logMessage(object, message);
-                        }
-                    }
+            auto forwardMessage = [this, object](char const* line, int length) {
+                auto startsWith = [line, length](char const* prefix) {
+                    auto prefixLength = static_cast<int>(strlen(prefix));
+                    return length >= prefixLength && !strncmp(line, prefix, prefixLength);
                 };
 
-            static int length = 0;
-            printConcatBuffer[length] = '\0';
+                if (startsWith("error")) {
+                    auto skip = std::min(length, 7);
+                    printQueue.push(object, true, line + skip, length - skip);
+                } else if (startsWith("verbose(0):") || startsWith("verbose(1):")) {
+                    auto skip = std::min(length, 12);
+                    printQueue.push(object, true, line + skip, length - skip);
+                } else if (startsWith("verbose(")) {
+                    auto skip = std::min(length, 12);
+                    printQueue.push(object, false, line + skip, length - skip);
+                } else {
+                    printQueue.push(object, false, line, length);
+                }
+
+                // Same as the message dispatcher: this only posts a message when no update is pending yet
+                triggerAsyncUpdate();
+            };
+
+            printConcatBuffer[printConcatLength] = '\0';
 
             int len = (int)strlen(message);
-            while (length + len >= 2048) {
-                int d = 2048 - 1 - length;
+            while (printConcatLength + len >= 2048) {
+                int d = 2048 - 1 - printConcatLength;
                 strncat(printConcatBuffer, message, d);
 
                 // Send concatenated line to plugdata!
-                forwardMessage(String::fromUTF8(printConcatBuffer));
+                forwardMessage(printConcatBuffer, 2048 - 1);
 
                 message += d;
                 len -= d;
-                length = 0;
+                printConcatLength = 0;
                 printConcatBuffer[0] = '\0';
             }
 
             strncat(printConcatBuffer, message, len);
-            length += len;
+            printConcatLength += len;
 
-            if (length > 0 && printConcatBuffer[length - 1] == '\n') {
-                printConcatBuffer[length - 1] = '\0';
+            if (printConcatLength > 0 && printConcatBuffer[printConcatLength - 1] == '\n') {
+                printConcatBuffer[printConcatLength - 1] = '\0';
 
                 // Send concatenated line to plugdata!
-                forwardMessage(String::fromUTF8(printConcatBuffer));
+                forwardMessage(printConcatBuffer, printConcatLength - 1);
 
-                length = 0;
+                printConcatLength = 0;
             }
         }
 
-        std::deque<std::tuple<void*, String, int, int, int>> consoleMessages;
-        std::deque<std::tuple<void*, String, int, int, int>> consoleHistory;
+        ConsoleStore consoleMessages;
 
         char printConcatBuffer[2048];
+        int printConcatLength = 0;
 
-        moodycamel::ReaderWriterQueue<std::tuple<void*, String, bool>> pendingMessages;
-
-        StringUtils fastStringWidth; // For formatting console messages more quickly
+        PrintQueue printQueue;
+        moodycamel::ConcurrentQueue<std::tuple<void*, String, bool>> pendingMessages;
     };
 
     std::unique_ptr<Ofelia> ofelia;
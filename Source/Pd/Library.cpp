@@ -37,81 +37,395 @@ struct _canvasenvironment {
 
 namespace pd {
 
-void Library::updateLibrary()
+SharedLibraryData::SharedLibraryData()
+{
+    MemoryInputStream instream(BinaryData::Documentation_bin, BinaryData::Documentation_binSize, false);
+    documentationTree = ValueTree::readFromStream(instream);
+
+    for (auto object : documentationTree) {
+        documentationByName[object.getProperty("name").toString()] = object;
+
+        auto categories = object.getChildWithName("categories");
+        if (!categories.isValid())
+            continue;
+
+        for (auto category : categories) {
+            allCategories.addIfNotAlreadyThere(category.getProperty("name").toString());
+        }
+    }
+
+    watcher.addFolder(ProjectInfo::appDataDir);
+    watcher.addListener(this);
+
+    // Queued before any rebuild, so the rebuild can reuse the documentation of everything that was already indexed
+    indexThread.addJob([this]() {
+        loadPersistedIndex();
+    });
+}
+
+void SharedLibraryData::loadPersistedIndex()
+{
+    auto objectNames = StringArray::fromLines(persistedIndexFile.loadFileAsString());
+    objectNames.removeEmptyStrings();
+    if (objectNames.isEmpty())
+        return;
+
+    auto newIndex = std::make_shared<LibraryIndex const>(objectNames, [this](String const& name) {
+        return getObjectInfo(name);
+    });
+
+    std::lock_guard<std::mutex> lock(indexLock);
+    index = newIndex;
+}
+
+void SharedLibraryData::updateIndex(Library const* instance, StringArray const& classNames, bool force)
 {
     auto settingsTree = ValueTree::fromXml(ProjectInfo::appDataDir.getChildFile(".settings").loadFileAsString());
     auto pathTree = settingsTree.getChildWithName("Paths");
 
-    sys_lock();
+    Array<File> searchPaths;
+    for (auto path : pathTree) {
+        searchPaths.add(File(path.getProperty("Path").toString()));
+    }
 
-    // Get available objects directly from pd
-    t_class* o = pd_objectmaker;
+    // Every instance calls this when it starts, only an instance with new classes or new search paths should cause a rebuild
+    // The classes are compared per instance, so instances with different classes don't keep invalidating each other
+    auto const classesHash = classNames.joinIntoString(" ").hashCode64();
+    int64 searchPathsHash = 0;
+    for (auto const& path : searchPaths) {
+        searchPathsHash = searchPathsHash * 31 + path.getFullPathName().hashCode64();
+    }
 
-    auto* mlist = static_cast<t_methodentry*>(libpd_get_class_methods(o));
-    t_methodentry* m;
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
 
-    allObjects.clear();
+        auto& classes = instanceClasses[instance];
+        auto const classesChanged = classes.classNames.isEmpty() || classes.hash != classesHash;
+        auto const searchPathsChanged = searchPathsHash != lastSearchPathsHash;
 
-    int i;
-    for (i = o->c_nmethod, m = mlist; i--; m++) {
-        if (!m || !m->me_name)
-            continue;
+        if (!force && !classesChanged && !searchPathsChanged)
+            return;
 
-        auto newName = String::fromUTF8(m->me_name->s_name);
-        if (!(newName.startsWith("else/") || newName.startsWith("cyclone/") || newName.endsWith("_aliased"))) {
-            allObjects.add(newName);
+        classes.classNames = classNames;
+        classes.hash = classesHash;
+        lastSearchPathsHash = searchPathsHash;
+        pendingSearchPaths = searchPaths;
+
+        // A different set of classes doesn't need the search paths to be checked again
+        needsFullCheck = needsFullCheck || force || searchPathsChanged;
+    }
+
+    // We already watch the app directory, but search paths can be anywhere. Only the top of each search path is watched, deeper changes are found by the next full check
+    for (auto const& path : watchedSearchPaths) {
+        if (!searchPaths.contains(path) || !path.isDirectory())
+            watcher.removeFolder(path);
+    }
+
+    watchedSearchPaths.clear();
+    for (auto const& path : searchPaths) {
+        if (path.isDirectory() && path != ProjectInfo::appDataDir) {
+            watcher.addFolder(path);
+            watchedSearchPaths.add(path);
         }
     }
 
-    // Find patches in our search tree
-    for (auto path : pathTree) {
-        auto filePath = path.getProperty("Path").toString();
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
+        if (rebuildQueued)
+            return;
+
+        rebuildQueued = true;
+    }
+
+    indexThread.addJob([this]() {
+        rebuildIndex();
+    });
+}
+
+void SharedLibraryData::removeInstance(Library const* instance)
+{
+    std::lock_guard<std::mutex> lock(indexLock);
+    instanceClasses.erase(instance);
+}
+
+void SharedLibraryData::rebuildIndex()
+{
+    StringArray classNames;
+    StringArray instanceSpecificNames;
+    Array<File> newSearchPaths;
+    std::set<String> changed;
+    bool fullCheck;
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
+
+        // Until an instance has told us its classes, we can only build an index without them, which would replace the persisted one
+        // The changed directories are kept, and get listed again by the full check that the first instance requests
+        if (instanceClasses.empty()) {
+            rebuildQueued = false;
+            return;
+        }
+
+        // The index contains the classes of all instances, the ones that not every instance has are marked as instance specific
+        std::map<String, int> numInstancesWithClass;
+        for (auto const& [instance, classes] : instanceClasses) {
+            for (auto const& name : classes.classNames) {
+                numInstancesWithClass[name]++;
+            }
+        }
+
+        for (auto const& [name, numInstances] : numInstancesWithClass) {
+            classNames.add(name);
+            if (numInstances < static_cast<int>(instanceClasses.size()))
+                instanceSpecificNames.add(name);
+        }
+
+        newSearchPaths = pendingSearchPaths;
+        std::swap(changed, changedDirectories);
+        fullCheck = needsFullCheck;
+        needsFullCheck = false;
+        rebuildQueued = false;
+    }
+
+    auto modified = classNames != indexedClassNames || instanceSpecificNames != indexedInstanceSpecificNames || newSearchPaths != searchPaths;
+
+    std::set<String> visited;
+    Array<File> parents;
+    if (fullCheck) {
+        for (auto const& path : newSearchPaths) {
+            modified = updateDirectory(path, changed, true, visited, parents) || modified;
+        }
+
+        // Whatever we didn't come across anymore was deleted, or isn't in the search paths anymore
+        for (auto it = searchDirectories.begin(); it != searchDirectories.end();) {
+            if (!visited.count(it->first)) {
+                it = searchDirectories.erase(it);
+                modified = true;
+            } else {
+                ++it;
+            }
+        }
+    } else {
+        // Only list the directories that the watcher told us about, and new directories inside of them
+        for (auto const& path : changed) {
+            auto const directory = File(path);
+            if (searchDirectories.count(path) || searchDirectories.count(directory.getParentDirectory().getFullPathName()))
+                modified = updateDirectory(directory, changed, false, visited, parents) || modified;
+        }
+    }
+
+    searchPaths = newSearchPaths;
+    if (!modified)
+        return;
+
+    indexedClassNames = classNames;
+    indexedInstanceSpecificNames = instanceSpecificNames;
 
-        auto file = File(filePath);
-        if (!file.exists() || !file.isDirectory())
+    // Subdirectories are listed so we notice when they change, but Pd only finds abstractions by name at the top of a search path
+    auto objectNames = classNames;
+    for (auto const& searchPath : searchPaths) {
+        auto it = searchDirectories.find(searchPath.getFullPathName());
+        if (it == searchDirectories.end())
             continue;
 
-        for (auto const& file : OSUtils::iterateDirectory(file, false, true)) {
-            if (file.hasFileExtension("pd")) {
+        auto const& directory = it->second;
+        objectNames.addArray(directory.abstractions);
+
+        // Abstractions can be created in every instance, even if they have the same name as a class that some instances have
+        instanceSpecificNames.removeValuesIn(directory.abstractions);
+    }
+
+    // These can't be created by name in Pd, but plugdata allows it
+    objectNames.add("graph");
+    objectNames.add("garray");
+
+    // These aren't in there but should be
+    objectNames.add("float");
+    objectNames.add("symbol");
+    objectNames.add("list");
+
+    // Until the new index is swapped in, queries keep using the previous one
+    auto newIndex = std::make_shared<LibraryIndex const>(
+        objectNames, [this](String const& name) {
+            return getObjectInfo(name);
+        },
+        getIndex().get(), instanceSpecificNames);
+
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
+        index = newIndex;
+    }
+
+    persistedIndexFile.replaceWithText(newIndex->getAllObjects().joinIntoString("\n"));
+}
+
+// Lists the directory again if it changed, and returns true if the abstractions inside of it changed
+bool SharedLibraryData::updateDirectory(File const& directory, std::set<String> const& changed, bool checkSubdirectories, std::set<String>& visited, Array<File>& parents)
+{
+    auto const path = directory.getFullPathName();
+    if (!directory.isDirectory()) {
+        auto const existed = searchDirectories.count(path) > 0;
+        removeDirectory(path);
+        return existed;
+    }
+
+    // Search paths can be inside of other search paths
+    if (visited.count(path))
+        return false;
+
+    // Protect against symlink loops!
+    auto target = directory.isSymbolicLink() ? directory.getLinkedTarget() : directory;
+    if (parents.contains(target))
+        return false;
+
+    visited.insert(path);
+
+    auto modified = false;
+    auto const lastModified = directory.getLastModificationTime().toMilliseconds();
+    auto it = searchDirectories.find(path);
+
+    if (it == searchDirectories.end() || it->second.modified != lastModified || changed.count(path)) {
+        SearchDirectory listing;
+        listing.modified = lastModified;
+
+        for (auto const& file : OSUtils::iterateDirectory(directory, false, false)) {
+            if (file.isDirectory()) {
+                listing.subdirectories.add(file.getFileName());
+            } else if (file.hasFileExtension("pd")) {
                 auto filename = file.getFileNameWithoutExtension();
                 if (!filename.startsWith("help-") || filename.endsWith("-help")) {
-                    allObjects.add(filename);
+                    listing.abstractions.add(filename);
                 }
             }
         }
+
+        if (it != searchDirectories.end()) {
+            for (auto const& subdirectory : it->second.subdirectories) {
+                if (!listing.subdirectories.contains(subdirectory))
+                    removeDirectory(directory.getChildFile(subdirectory).getFullPathName());
+            }
+
+            modified = it->second.abstractions != listing.abstractions;
+            it->second = std::move(listing);
+        } else {
+            modified = true;
+            searchDirectories[path] = std::move(listing);
+        }
     }
 
-    // These can't be created by name in Pd, but plugdata allows it
-    allObjects.add("graph");
-    allObjects.add("garray");
-    
+    parents.add(target);
+    for (auto const& subdirectory : StringArray(searchDirectories[path].subdirectories)) {
+        auto const child = directory.getChildFile(subdirectory);
+        if (checkSubdirectories || !searchDirectories.count(child.getFullPathName()))
+            modified = updateDirectory(child, changed, checkSubdirectories, visited, parents) || modified;
+    }
+    parents.removeLast();
 
-    // These aren't in there but should be
-    allObjects.add("float");
-    allObjects.add("symbol");
-    allObjects.add("list");
+    return modified;
+}
 
-    sys_unlock();
+void SharedLibraryData::removeDirectory(String const& path)
+{
+    auto const prefix = path + File::getSeparatorString();
+    for (auto it = searchDirectories.begin(); it != searchDirectories.end();) {
+        if (it->first == path || it->first.startsWith(prefix)) {
+            it = searchDirectories.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
-Library::Library(pd::Instance* instance)
+std::shared_ptr<LibraryIndex const> SharedLibraryData::getIndex() const
 {
-    MemoryInputStream instream(BinaryData::Documentation_bin, BinaryData::Documentation_binSize, false);
-    documentationTree = ValueTree::readFromStream(instream);
+    std::lock_guard<std::mutex> lock(indexLock);
+    return index;
+}
 
-    for (auto object : documentationTree) {
-        auto categories = object.getChildWithName("categories");
-        if (!categories.isValid())
+ValueTree SharedLibraryData::getObjectInfo(String const& name) const
+{
+    auto it = documentationByName.find(name);
+    return it != documentationByName.end() ? it->second : ValueTree();
+}
+
+void SharedLibraryData::fileChanged(File const file, FileSystemWatcher::FileSystemEvent event)
+{
+    if (file.isHidden() || file.getFileName().startsWith("."))
+        return;
+
+    // A file that's gone can't tell us anymore whether it was a directory
+    auto const isRemoved = event == FileSystemWatcher::fileDeleted || event == FileSystemWatcher::fileRenamedOldName;
+    if (!isRemoved && !file.isDirectory() && !file.hasFileExtension("pd"))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
+        changedDirectories.insert(file.getParentDirectory().getFullPathName());
+        changedDirectories.insert(file.getFullPathName());
+    }
+
+    triggerAsyncUpdate();
+}
+
+void SharedLibraryData::filesystemChanged()
+{
+    {
+        std::lock_guard<std::mutex> lock(indexLock);
+        if (changedDirectories.empty() || instanceClasses.empty() || rebuildQueued)
+            return;
+
+        rebuildQueued = true;
+    }
+
+    indexThread.addJob([this]() {
+        rebuildIndex();
+    });
+}
+
+void Library::updateLibrary()
+{
+    StringArray newClassNames;
+
+    // Only reading the class list needs the lock, scanning the search paths and building the index happens in the background
+    sys_lock();
+
+    // Get available objects directly from pd
+    t_class* o = pd_objectmaker;
+
+    auto* mlist = static_cast<t_methodentry*>(libpd_get_class_methods(o));
+    t_methodentry* m;
+
+    int i;
+    for (i = o->c_nmethod, m = mlist; i--; m++) {
+        if (!m || !m->me_name)
             continue;
 
-        for (auto category : categories) {
-            allCategories.addIfNotAlreadyThere(category.getProperty("name").toString());
+        auto newName = String::fromUTF8(m->me_name->s_name);
+        if (!(newName.startsWith("else/") || newName.startsWith("cyclone/") || newName.endsWith("_aliased"))) {
+            newClassNames.add(newName);
         }
     }
 
-    watcher.addFolder(ProjectInfo::appDataDir);
-    watcher.addListener(this);
+    sys_unlock();
+
+    {
+        std::lock_guard<std::mutex> lock(classNamesLock);
+        classNames = std::set<String>(newClassNames.begin(), newClassNames.end());
+    }
 
+    sharedData->updateIndex(this, newClassNames);
+}
+
+bool Library::isAvailable(LibraryIndex const& index, String const& name) const
+{
+    if (!index.isInstanceSpecific(name))
+        return true;
+
+    std::lock_guard<std::mutex> lock(classNamesLock);
+    return classNames.count(name) > 0;
+}
+
+Library::Library(pd::Instance* instance)
+{
     // Paths to search
     // First, only search vanilla, then search all documentation
     // Lastly, check the deken folder
@@ -142,21 +456,38 @@ StringArray Library::autocomplete(String const& query, File const& patchDirector
     result.ensureStorageAllocated(20);
 
     if (patchDirectory.isDirectory()) {
-        for (auto const& file : OSUtils::iterateDirectory(patchDirectory, false, true, 20)) {
-            auto filename = file.getFileNameWithoutExtension();
-            if (file.hasFileExtension("pd") && filename.startsWith(query) && !filename.startsWith("help-") && !filename.endsWith("-help")) {
-                result.add(filename);
+        std::lock_guard<std::mutex> lock(patchDirectoryLock);
+
+        // Rescan when the directory changed, or when the listing is more than a few seconds old
+        auto now = Time::getMillisecondCounter();
+        if (patchDirectory != lastPatchDirectory || now - lastPatchDirectoryScanTime > 3000) {
+            lastPatchDirectory = patchDirectory;
+            lastPatchDirectoryScanTime = now;
+            lastPatchDirectoryFiles.clear();
+
+            for (auto const& file : OSUtils::iterateDirectory(patchDirectory, false, true, 256)) {
+                auto filename = file.getFileNameWithoutExtension();
+                if (file.hasFileExtension("pd") && !filename.startsWith("help-") && !filename.endsWith("-help")) {
+                    lastPatchDirectoryFiles.add(filename);
+                }
             }
         }
+
+        for (auto const& filename : lastPatchDirectoryFiles) {
+            if (result.size() >= 20)
+                break;
+
+            if (filename.startsWith(query))
+                result.add(filename);
+        }
     }
 
-    for (auto const& str : allObjects) {
+    auto const index = sharedData->getIndex();
+    for (auto const& name : index->findByPrefix(query, 20, [this, &index](String const& name) { return isAvailable(*index, name); })) {
         if (result.size() >= 20)
             break;
 
-        if (str.startsWith(query)) {
-            result.addIfNotAlreadyThere(str);
-        }
+        result.addIfNotAlreadyThere(name);
     }
 
     return result;
@@ -164,55 +495,25 @@ StringArray Library::autocomplete(String const& query, File const& patchDirector
 
 void Library::getExtraSuggestions(int currentNumSuggestions, String const& query, std::function<void(StringArray)> const& callback)
 {
-
     int const maxSuggestions = 20;
     if (currentNumSuggestions > maxSuggestions)
         return;
 
-    objectSearchThread.addJob([this, callback, query]() mutable {
-        StringArray result;
-        StringArray matches;
-
-        for (const auto& object : getAllObjects()) {
-            auto info = getObjectInfo(object);
-
-            auto description = info.getProperty("description").toString();
-
-            auto iolets = info.getChildWithName("iolets");
-            auto arguments = info.getChildWithName("arguments");
-
-            if (description.contains(query) || object.contains(query)) {
-                matches.addIfNotAlreadyThere(object);
-            }
-
-            for (auto arg : arguments) {
-                auto argDescription = arg.getProperty("description").toString();
-                if (argDescription.contains(query)) {
-                    matches.addIfNotAlreadyThere(object);
-                }
-            }
-
-            for (auto iolet : iolets) {
-                auto ioletDescription = iolet.getProperty("description").toString();
-                if (description.contains(query)) {
-                    matches.addIfNotAlreadyThere(object);
-                }
-            }
-        }
-
-        matches.sort(true);
-        result.addArray(matches);
-        matches.clear();
-
-        MessageManager::callAsync([callback, result]() {
-            callback(result);
-        });
+    // The index is fast enough to query directly, but callers expect the result to arrive asynchronously
+    MessageManager::callAsync([callback, result = searchObjects(query, maxSuggestions)]() {
+        callback(result);
     });
 }
 
+StringArray Library::searchObjects(String const& query, int maxResults) const
+{
+    auto const index = sharedData->getIndex();
+    return index->search(query, maxResults, [this, &index](String const& name) { return isAvailable(*index, name); });
+}
+
 ValueTree Library::getObjectInfo(String const& name)
 {
-    return documentationTree.getChildWithProperty("name", name);
+    return sharedData->getObjectInfo(name);
 }
 
 std::array<StringArray, 2> Library::parseIoletTooltips(ValueTree const& iolets, String const& name, int numIn, int numOut)
@@ -270,17 +571,13 @@ std::array<StringArray, 2> Library::parseIoletTooltips(ValueTree const& iolets,
 
 StringArray Library::getAllObjects()
 {
-    return allObjects;
+    auto const index = sharedData->getIndex();
+    return index->getAllObjects([this, &index](String const& name) { return isAvailable(*index, name); });
 }
 
 StringArray Library::getAllCategories()
 {
-    return allCategories;
-}
-
-void Library::filesystemChanged()
-{
-    updateLibrary();
+    return sharedData->getAllCategories();
 }
 
 File Library::findHelpfile(t_gobj* obj, File const& parentPatchFile) const
@@ -9,19 +9,109 @@
 #include <m_pd.h>
 #include "Utility/FileSystemWatcher.h"
 #include "Utility/Config.h"
+#include "LibraryIndex.h"
 
 namespace pd {
 
 class Instance;
-class Library : public FileSystemWatcher::Listener {
+class Library;
+
+// Library data that is identical for every plugin instance: the documentation tree, the object search index and the filesystem watcher
+// With many plugdata instances in one session, we only want to parse the documentation and scan the search paths once
+// Shared through a SharedResourcePointer, so it's created with the first Library and freed with the last one
+// Everything in here is read-only after construction, except for the index, which is swapped out as a whole
+// The abstractions in the search paths are cached per directory. When the watcher reports a change, only the directories it happened in are listed again
+// The object names of the last index are saved to disk, so that autocomplete works while the first rebuild of a session is still running
+// Every instance registers its own list of Pd classes. The index is built from all of them, and each Library only shows the classes it has
+class SharedLibraryData : public FileSystemWatcher::Listener {
+public:
+    SharedLibraryData();
+
+    ~SharedLibraryData() override
+    {
+        watcher.removeListener(this);
+        indexThread.removeAllJobs(true, -1);
+    }
+
+    // Rebuilds the index in the background if the Pd classes of this instance or the search paths have changed
+    // Checks the modification times of all directories in the search paths, but only lists the ones that changed
+    void updateIndex(Library const* instance, StringArray const& classNames, bool force = false);
+
+    // Forgets the classes of an instance. Its classes stay in the index until the next rebuild, but other instances don't show them
+    void removeInstance(Library const* instance);
+
+    std::shared_ptr<LibraryIndex const> getIndex() const;
+
+    ValueTree getObjectInfo(String const& name) const;
+
+    StringArray const& getAllCategories() const
+    {
+        return allCategories;
+    }
+
+    // Remembers which directories to list again, the rebuild happens once the watcher is done reporting changes
+    void fileChanged(File const file, FileSystemWatcher::FileSystemEvent event) override;
+    void filesystemChanged() override;
+
+private:
+    struct SearchDirectory {
+        int64 modified = 0;
+        StringArray abstractions;
+        StringArray subdirectories;
+    };
+
+    // Everything below is only called from the index thread
+    void loadPersistedIndex();
+    void rebuildIndex();
+    bool updateDirectory(File const& directory, std::set<String> const& changed, bool checkSubdirectories, std::set<String>& visited, Array<File>& parents);
+    void removeDirectory(String const& path);
+
+    ValueTree documentationTree;
+    std::unordered_map<String, ValueTree> documentationByName;
+    StringArray allCategories;
+
+    // The index gets replaced as a whole when it's rebuilt, the lock only protects swapping the pointer
+    std::shared_ptr<LibraryIndex const> index = std::make_shared<LibraryIndex>();
+    mutable std::mutex indexLock;
+
+    struct InstanceClasses {
+        StringArray classNames;
+        int64 hash = 0;
+    };
+
+    // Requests that come in while a rebuild is queued get merged into that rebuild
+    std::map<Library const*, InstanceClasses> instanceClasses;
+    Array<File> pendingSearchPaths;
+    std::set<String> changedDirectories;
+    int64 lastSearchPathsHash = 0;
+    bool rebuildQueued = false;
+    bool needsFullCheck = false;
+
+    // Owned by the index thread
+    static inline File const persistedIndexFile = ProjectInfo::versionDataDir.getChildFile(".object_index");
+    std::map<String, SearchDirectory> searchDirectories;
+    Array<File> searchPaths;
+    StringArray indexedClassNames;
+    StringArray indexedInstanceSpecificNames;
+
+    // Search paths outside of the app directory that we asked the watcher to look at
+    Array<File> watchedSearchPaths;
+
+    FileSystemWatcher watcher;
+    ThreadPool indexThread = ThreadPool(1);
+
+    JUCE_DECLARE_NON_COPYABLE(SharedLibraryData)
+};
+
+class Library {
 
 public:
     Library(pd::Instance* instance);
 
-    ~Library() override
+    ~Library()
     {
         appDirChanged = nullptr;
-        objectSearchThread.removeAllJobs(true, -1);
+        sharedData->removeInstance(this);
     }
 
     void updateLibrary();
@@ -29,9 +119,10 @@ public:
     StringArray autocomplete(String const& query, File const& patchDirectory) const;
     void getExtraSuggestions(int currentNumSuggestions, String const& query, std::function<void(StringArray)> const& callback);
 
-    static std::array<StringArray, 2> parseIoletTooltips(ValueTree const& iolets, String const& name, int numIn, int numOut);
+    // Ranked search over object names and documentation
+    StringArray searchObjects(String const& query, int maxResults) const;
 
-    void filesystemChanged() override;
+    static std::array<StringArray, 2> parseIoletTooltips(ValueTree const& iolets, String const& name, int numIn, int numOut);
 
     File findHelpfile(t_gobj* obj, File const& parentPatchFile) const;
 
@@ -57,15 +148,21 @@ public:
     static inline StringArray objectOrigins = { "vanilla", "ELSE", "cyclone", "heavylib", "pdlua" };
 
 private:
-    StringArray allObjects;
-    StringArray allCategories;
+    // Whether the object exists in this instance, objects from the shared index might be classes that only other instances have
+    bool isAvailable(LibraryIndex const& index, String const& name) const;
 
-    std::recursive_mutex libraryLock;
+    SharedResourcePointer<SharedLibraryData> sharedData;
 
-    FileSystemWatcher watcher;
-    ThreadPool objectSearchThread = ThreadPool(1);
+    // The Pd classes registered in this instance
+    mutable std::mutex classNamesLock;
+    std::set<String> classNames;
 
-    ValueTree documentationTree;
+    // Per-instance overlay: the .pd files in the directory of the current patch
+    // Cached, so we don't have to list it for every keystroke
+    mutable std::mutex patchDirectoryLock;
+    mutable File lastPatchDirectory;
+    mutable StringArray lastPatchDirectoryFiles;
+    mutable uint32 lastPatchDirectoryScanTime = 0;
 };
 
 } // namespace pd
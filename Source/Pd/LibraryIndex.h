@@ -0,0 +1,297 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#pragma once
+
+namespace pd {
+
+// Immutable search index over all object names and their documentation
+// Building it takes a while, so the library builds it on a background thread and swaps in the new index when it's done
+// Because it's never modified after construction, it can be queried from any thread without locking
+// When a previous index is passed in, only objects that weren't in it have their documentation tokenised, the rest is copied over
+// Pd classes that are only registered in some of the plugin instances are marked, so every instance can filter out the ones it doesn't have
+class LibraryIndex {
+
+    // Where a word was found, matches in the name rank higher than matches in the documentation
+    enum Weight {
+        IoletWeight = 1,
+        ArgumentWeight = 1,
+        DescriptionWeight = 2,
+        NameWeight = 4
+    };
+
+    struct Posting {
+        int object;
+        int weight;
+    };
+
+public:
+    using Filter = std::function<bool(String const&)>;
+
+    LibraryIndex() = default;
+
+    LibraryIndex(StringArray const& objectNames, std::function<ValueTree(String const&)> const& getObjectInfo, LibraryIndex const* previous = nullptr, StringArray const& instanceSpecificNames = {})
+    {
+        for (auto const& name : instanceSpecificNames) {
+            instanceSpecific.push_back(name);
+        }
+        std::sort(instanceSpecific.begin(), instanceSpecific.end());
+
+        names.reserve(objectNames.size());
+        for (auto const& name : objectNames) {
+            names.push_back(name);
+        }
+
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        lowerCaseNames.reserve(names.size());
+        descriptions.resize(names.size());
+
+        // Map the objects of the previous index to their position in this one, or -1 if they're gone
+        std::vector<int> previousToCurrent;
+        std::vector<bool> isIndexed(names.size(), false);
+        if (previous) {
+            previousToCurrent.resize(previous->names.size(), -1);
+            for (int i = 0; i < previous->names.size(); i++) {
+                auto it = std::lower_bound(names.begin(), names.end(), previous->names[i]);
+                if (it != names.end() && *it == previous->names[i]) {
+                    auto const current = static_cast<int>(std::distance(names.begin(), it));
+                    previousToCurrent[i] = current;
+                    isIndexed[current] = true;
+                    descriptions[current] = previous->descriptions[i];
+                }
+            }
+        }
+
+        std::map<String, std::vector<Posting>> invertedIndex;
+        if (previous) {
+            for (auto const& [word, postings] : previous->words) {
+                std::vector<Posting> remapped;
+                for (auto const& posting : postings) {
+                    if (previousToCurrent[posting.object] >= 0)
+                        remapped.push_back({ previousToCurrent[posting.object], posting.weight });
+                }
+
+                if (!remapped.empty())
+                    invertedIndex.emplace_hint(invertedIndex.end(), word, std::move(remapped));
+            }
+        }
+
+        auto addWords = [&invertedIndex](String const& text, int object, int weight) {
+            for (auto const& word : tokenise(text)) {
+                auto& postings = invertedIndex[word];
+                // Words often occur multiple times in one description, only keep the highest weight
+                if (!postings.empty() && postings.back().object == object) {
+                    postings.back().weight = std::max(postings.back().weight, weight);
+                } else {
+                    postings.push_back({ object, weight });
+                }
+            }
+        };
+
+        for (int i = 0; i < names.size(); i++) {
+            auto const& name = names[i];
+            lowerCaseNames.push_back(name.toLowerCase());
+
+            if (isIndexed[i])
+                continue;
+
+            addWords(name, i, NameWeight);
+
+            auto info = getObjectInfo(name);
+            auto description = info.getProperty("description").toString();
+            descriptions[i] = description;
+
+            if (!info.isValid())
+                continue;
+
+            addWords(description, i, DescriptionWeight);
+
+            for (auto argument : info.getChildWithName("arguments")) {
+                addWords(argument.getProperty("description").toString(), i, ArgumentWeight);
+            }
+
+            for (auto iolet : info.getChildWithName("iolets")) {
+                addWords(iolet.getProperty("description").toString(), i, IoletWeight);
+                addWords(iolet.getProperty("tooltip").toString(), i, IoletWeight);
+            }
+        }
+
+        // std::map is already sorted, flatten it so we can binary search with good cache locality
+        words.reserve(invertedIndex.size());
+        for (auto& [word, postings] : invertedIndex) {
+            words.emplace_back(word, std::move(postings));
+        }
+    }
+
+    // True if the object is a Pd class that not every instance has registered
+    bool isInstanceSpecific(String const& name) const
+    {
+        return std::binary_search(instanceSpecific.begin(), instanceSpecific.end(), name);
+    }
+
+    // All object names that start with prefix, in alphabetical order
+    StringArray findByPrefix(String const& prefix, int maxResults, Filter const& isAvailable = nullptr) const
+    {
+        StringArray result;
+        for (auto it = std::lower_bound(names.begin(), names.end(), prefix); it != names.end() && result.size() < maxResults; ++it) {
+            if (!it->startsWith(prefix))
+                break;
+
+            if (isAvailable && !isAvailable(*it))
+                continue;
+
+            result.add(*it);
+        }
+
+        return result;
+    }
+
+    // Ranked search over object names and documentation
+    // Every word in the query has to match the start of a word in the name or documentation, and the name itself is fuzzy-matched against the whole query
+    StringArray search(String const& query, int maxResults, Filter const& isAvailable = nullptr) const
+    {
+        auto const lowerCaseQuery = query.toLowerCase().trim();
+        auto const queryWords = tokenise(lowerCaseQuery);
+
+        if (lowerCaseQuery.isEmpty())
+            return {};
+
+        std::unordered_map<int, std::pair<int, float>> matches; // object -> number of matched query words, score
+
+        for (int w = 0; w < queryWords.size(); w++) {
+            auto const& queryWord = queryWords[w];
+
+            for (auto it = std::lower_bound(words.begin(), words.end(), queryWord, [](auto const& entry, String const& value) { return entry.first < value; });
+                 it != words.end() && it->first.startsWith(queryWord); ++it) {
+                auto const exactWord = it->first.length() == queryWord.length();
+                for (auto const& posting : it->second) {
+                    auto& [numMatched, score] = matches[posting.object];
+
+                    // Count every query word once per object
+                    if (numMatched == w)
+                        numMatched++;
+
+                    score += posting.weight * (exactWord ? 2.0f : 1.0f);
+                }
+            }
+        }
+
+        std::vector<std::pair<int, float>> ranked;
+        ranked.reserve(matches.size());
+
+        for (int i = 0; i < lowerCaseNames.size(); i++) {
+            auto nameScore = getNameScore(lowerCaseQuery, lowerCaseNames[i]);
+            auto match = matches.find(i);
+            auto matchedAllWords = match != matches.end() && match->second.first == queryWords.size();
+
+            if ((nameScore > 0.0f || matchedAllWords) && (!isAvailable || isAvailable(names[i]))) {
+                ranked.emplace_back(i, nameScore + (matchedAllWords ? match->second.second : 0.0f));
+            }
+        }
+
+        auto numResults = std::min<size_t>(maxResults, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + numResults, ranked.end(), [this](auto const& a, auto const& b) {
+            if (a.second != b.second)
+                return a.second > b.second;
+            if (names[a.first].length() != names[b.first].length())
+                return names[a.first].length() < names[b.first].length();
+            return names[a.first] < names[b.first];
+        });
+
+        StringArray result;
+        result.ensureStorageAllocated(static_cast<int>(numResults));
+        for (int i = 0; i < numResults; i++) {
+            result.add(names[ranked[i].first]);
+        }
+
+        return result;
+    }
+
+    String getDescription(String const& name) const
+    {
+        auto it = std::lower_bound(names.begin(), names.end(), name);
+        if (it != names.end() && *it == name)
+            return descriptions[std::distance(names.begin(), it)];
+
+        return {};
+    }
+
+    StringArray getAllObjects(Filter const& isAvailable = nullptr) const
+    {
+        StringArray result;
+        result.ensureStorageAllocated(static_cast<int>(names.size()));
+        for (auto const& name : names) {
+            if (!isAvailable || isAvailable(name))
+                result.add(name);
+        }
+        return result;
+    }
+
+    // Splits text into lower case words, without punctuation
+    static StringArray tokenise(String const& text)
+    {
+        StringArray result;
+        String currentWord;
+
+        for (auto c : text.toLowerCase()) {
+            if (CharacterFunctions::isLetterOrDigit(c)) {
+                currentWord += c;
+            } else if (currentWord.isNotEmpty()) {
+                result.add(currentWord);
+                currentWord.clear();
+            }
+        }
+
+        if (currentWord.isNotEmpty())
+            result.add(currentWord);
+
+        return result;
+    }
+
+private:
+    // Scores how well the query matches the object name: exact matches first, then prefixes, substrings and finally characters in the right order
+    static float getNameScore(String const& query, String const& name)
+    {
+        if (name == query)
+            return 1000.0f;
+
+        if (name.startsWith(query))
+            return 500.0f - (name.length() - query.length());
+
+        if (name.contains(query))
+            return 200.0f - (name.length() - query.length());
+
+        // Only do fuzzy matching for queries that are long enough to mean something
+        if (query.length() < 3)
+            return 0.0f;
+
+        int queryIndex = 0;
+        int gaps = 0;
+        for (int i = 0; i < name.length() && queryIndex < query.length(); i++) {
+            if (name[i] == query[queryIndex]) {
+                queryIndex++;
+            } else if (queryIndex > 0) {
+                gaps++;
+            }
+        }
+
+        if (queryIndex < query.length())
+            return 0.0f;
+
+        return std::max(1.0f, 50.0f - gaps * 5.0f);
+    }
+
+    std::vector<String> names; // Sorted, so we can use binary search for prefixes
+    std::vector<String> lowerCaseNames;
+    std::vector<String> descriptions;
+    std::vector<String> instanceSpecific; // Sorted, usually empty
+
+    std::vector<std::pair<String, std::vector<Posting>>> words; // Sorted inverted index
+};
+
+} // namespace pd
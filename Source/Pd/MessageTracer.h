@@ -0,0 +1,232 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+namespace pd {
+
+// Records the control messages that flow through connections, to find message storms
+// Pd writes timestamped events into a fixed-size ring, which the message thread periodically drains to update per-connection message rates
+// Recording never allocates or locks: if the message thread can't keep up, the oldest events are dropped
+// The history that can be exported is a fixed-size ring as well, so a message storm can't make it grow without bounds
+class MessageTracer : public ChangeBroadcaster
+    , private Timer {
+public:
+    struct Event {
+        void* target = nullptr;
+        t_symbol* symbol = nullptr;
+        int64 ticks = 0;
+    };
+
+    static constexpr int ringSize = 1 << 16;
+    static constexpr int historySize = 1 << 17;
+    static constexpr double historyLength = 30.0;
+
+    ~MessageTracer() override
+    {
+        stopTimer();
+    }
+
+    // Message thread only
+    void setEnabled(bool shouldBeEnabled)
+    {
+        if (shouldBeEnabled == enabled)
+            return;
+
+        if (shouldBeEnabled) {
+            // Allocate the ring before Pd is allowed to write into it, and keep it around afterwards
+            if (ring.empty()) {
+                ring.resize(ringSize);
+                history.resize(historySize);
+            }
+
+            readIndex = writeIndex.load();
+            lastUpdateTicks = Time::getHighResolutionTicks();
+            startTimerHz(10);
+        } else {
+            stopTimer();
+            counters.clear();
+            historyEnd = 0;
+            sendChangeMessage();
+        }
+
+        enabled = shouldBeEnabled;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    // Only messages to traced targets are recorded, other GUI targets get messages through the same hook
+    // The caller needs to hold the Pd lock, which is what keeps record from seeing the set change
+    void trace(void* target)
+    {
+        tracedTargets.insert(target);
+    }
+
+    void untrace(void* target)
+    {
+        if (auto it = tracedTargets.find(target); it != tracedTargets.end())
+            tracedTargets.erase(it);
+    }
+
+    // Called by Pd for every message that gets sent to a GUI target, while holding the Pd lock
+    void record(void* target, t_symbol* symbol)
+    {
+        if (!enabled || !tracedTargets.count(target))
+            return;
+
+        auto index = writeIndex.load(std::memory_order_relaxed);
+        ring[index & (ringSize - 1)] = { target, symbol, Time::getHighResolutionTicks() };
+        writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    // Smoothed number of messages per second sent to target
+    float getMessageRate(void* target) const
+    {
+        auto it = counters.find(target);
+        return it != counters.end() ? it->second.rate : 0.0f;
+    }
+
+    // Returns the number of events that got dropped because the ring overflowed
+    uint64 getNumDroppedEvents() const
+    {
+        return numDroppedEvents;
+    }
+
+    // Writes the messages of the last few seconds as Chrome trace event JSON, which can be opened in chrome://tracing or Perfetto
+    // Every connection gets its own track, getName is used to label them
+    bool exportChromeTrace(File const& file, double windowSeconds, std::function<String(void*)> const& getName)
+    {
+        update();
+
+        auto endTicks = Time::getHighResolutionTicks();
+        auto startTicks = endTicks - Time::secondsToHighResolutionTicks(windowSeconds);
+
+        std::unordered_map<void*, int> trackIndices;
+        Array<var> traceEvents;
+
+        for (auto i = historyEnd - std::min<uint64>(historyEnd, historySize); i < historyEnd; i++) {
+            auto const& event = history[i & (historySize - 1)];
+            if (event.ticks < startTicks)
+                continue;
+
+            if (!trackIndices.count(event.target)) {
+                auto track = static_cast<int>(trackIndices.size()) + 1;
+                trackIndices[event.target] = track;
+
+                auto* metadata = new DynamicObject();
+                metadata->setProperty("name", "thread_name");
+                metadata->setProperty("ph", "M");
+                metadata->setProperty("pid", 1);
+                metadata->setProperty("tid", track);
+
+                auto* args = new DynamicObject();
+                args->setProperty("name", getName(event.target));
+                metadata->setProperty("args", var(args));
+
+                traceEvents.add(var(metadata));
+            }
+
+            auto* traceEvent = new DynamicObject();
+            traceEvent->setProperty("name", String::fromUTF8(event.symbol ? event.symbol->s_name : ""));
+            traceEvent->setProperty("cat", "message");
+            traceEvent->setProperty("ph", "i");
+            traceEvent->setProperty("s", "t");
+            traceEvent->setProperty("pid", 1);
+            traceEvent->setProperty("tid", trackIndices[event.target]);
+            traceEvent->setProperty("ts", Time::highResolutionTicksToSeconds(event.ticks - startTicks) * 1000000.0);
+            traceEvents.add(var(traceEvent));
+        }
+
+        auto* root = new DynamicObject();
+        root->setProperty("traceEvents", traceEvents);
+        root->setProperty("displayTimeUnit", "ms");
+
+        return file.replaceWithText(JSON::toString(var(root), true));
+    }
+
+private:
+    struct Counter {
+        int count = 0;
+        float rate = 0.0f;
+    };
+
+    void timerCallback() override
+    {
+        update();
+        sendChangeMessage();
+    }
+
+    void update()
+    {
+        if (!enabled)
+            return;
+
+        auto end = writeIndex.load(std::memory_order_acquire);
+
+        // Skip events that were already overwritten
+        if (end - readIndex > ringSize) {
+            numDroppedEvents += (end - readIndex) - ringSize;
+            readIndex = end - ringSize;
+        }
+
+        auto historyStart = Time::getHighResolutionTicks() - Time::secondsToHighResolutionTicks(historyLength);
+
+        for (; readIndex < end; readIndex++) {
+            auto event = ring[readIndex & (ringSize - 1)];
+
+            // Pd might have lapped us while we were reading
+            if (writeIndex.load(std::memory_order_acquire) - readIndex > ringSize) {
+                numDroppedEvents++;
+                continue;
+            }
+
+            counters[event.target].count++;
+
+            // Overwrites the oldest event once the history is full
+            if (event.ticks >= historyStart)
+                history[historyEnd++ & (historySize - 1)] = event;
+        }
+
+        auto now = Time::getHighResolutionTicks();
+        auto elapsed = Time::highResolutionTicksToSeconds(now - lastUpdateTicks);
+        lastUpdateTicks = now;
+
+        if (elapsed <= 0.0)
+            return;
+
+        for (auto it = counters.begin(); it != counters.end();) {
+            auto& counter = it->second;
+            auto instantRate = static_cast<float>(counter.count / elapsed);
+            counter.rate = counter.rate * 0.7f + instantRate * 0.3f;
+            counter.count = 0;
+
+            // Forget about connections that went quiet
+            if (counter.rate < 0.01f)
+                it = counters.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    std::atomic<bool> enabled = false;
+
+    std::vector<Event> ring;
+    std::atomic<uint64> writeIndex = 0;
+    uint64 readIndex = 0;
+    uint64 numDroppedEvents = 0;
+
+    // Connections can be shown in more than one view at the same time, each of which traces it
+    std::unordered_multiset<void*> tracedTargets;
+
+    std::unordered_map<void*, Counter> counters;
+    std::vector<Event> history;
+    uint64 historyEnd = 0;
+    int64 lastUpdateTicks = 0;
+};
+
+}
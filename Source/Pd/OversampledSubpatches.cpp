@@ -0,0 +1,507 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "Utility/Config.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+
+extern "C" {
+#include <m_pd.h>
+#include <m_imp.h>
+#include <g_canvas.h>
+
+// Not in any header, but g_canvas.c refers to them the same way
+extern t_class* vinlet_class;
+extern t_class* voutlet_class;
+}
+
+#include "Instance.h"
+#include "Interface.h"
+#include "OversampledSubpatches.h"
+
+namespace pd {
+
+struct FilterDesign {
+    int length; // In samples at the parent's rate
+    double beta;
+    double cutoff; // Relative to the parent's sample rate
+};
+
+// Higher qualities have a steeper slope, and let less of the imaged and aliased signal through
+static FilterDesign getFilterDesign(OversampledSubpatches::Quality quality)
+{
+    switch (quality) {
+    case OversampledSubpatches::Low:
+        return { 16, 5.0, 0.45 };
+    case OversampledSubpatches::High:
+        return { 64, 9.0, 0.485 };
+    default:
+        return { 32, 7.0, 0.47 };
+    }
+}
+
+// Kaiser windowed sinc lowpass at the oversampled rate, with its cutoff just below the parent's Nyquist frequency
+// The filter is a whole number of parent samples long, so the delay of going up and back down again is a whole number of parent samples too
+struct Filter {
+    Filter(int oversamplingFactor, OversampledSubpatches::Quality quality)
+        : factor(oversamplingFactor)
+    {
+        auto const design = getFilterDesign(quality);
+        auto const length = factor * design.length + 1;
+        auto const centre = (length - 1) / 2.0;
+        auto const cutoff = design.cutoff / factor;
+
+        // Zeroth order modified Bessel function of the first kind
+        auto const bessel = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 32; k++) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        std::vector<double> response(length);
+        double sum = 0.0;
+        for (int i = 0; i < length; i++) {
+            auto const t = i - centre;
+            auto const sinc = t == 0.0 ? 2.0 * cutoff : std::sin(2.0 * MathConstants<double>::pi * cutoff * t) / (MathConstants<double>::pi * t);
+            auto const r = 2.0 * i / (length - 1) - 1.0;
+            response[i] = sinc * bessel(design.beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel(design.beta);
+            sum += response[i];
+        }
+
+        taps.resize(length);
+        for (int i = 0; i < length; i++)
+            taps[i] = static_cast<float>(response[i] / sum);
+
+        // Upsampling is the same as filtering the input with zeros stuffed in between, and only every factor-th tap ever meets a sample that isn't zero
+        // Each phase also makes up for the energy lost to the zeros
+        tapsPerPhase = design.length + 1;
+        phases.assign(factor * tapsPerPhase, 0.0f);
+        for (int phase = 0; phase < factor; phase++) {
+            for (int j = 0; j < tapsPerPhase && phase + j * factor < length; j++)
+                phases[phase * tapsPerPhase + j] = taps[phase + j * factor] * static_cast<float>(factor);
+        }
+    }
+
+    int factor;
+    int tapsPerPhase;
+    std::vector<float> taps;
+    std::vector<float> phases;
+};
+
+// Runs behind an inlet~. However inlet~ upsampled the signal, every factor-th sample is still a sample from the parent, so we only read those and work out the rest ourselves
+struct Interpolator {
+    Interpolator(Filter const& upsamplingFilter, int length, int channels)
+        : filter(upsamplingFilter)
+        , blockSize(length / upsamplingFilter.factor)
+        , numChannels(channels)
+        , historySize(upsamplingFilter.tapsPerPhase - 1 + blockSize)
+        , history(channels * historySize, 0.0f)
+    {
+    }
+
+    void process(t_sample* signal)
+    {
+        auto const factor = filter.factor;
+        auto const numTaps = filter.tapsPerPhase;
+
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto* samples = signal + ch * blockSize * factor;
+            auto* input = history.data() + ch * historySize;
+
+            for (int i = 0; i < blockSize; i++)
+                input[numTaps - 1 + i] = samples[i * factor];
+
+            for (int i = 0; i < blockSize; i++) {
+                auto const* newest = input + numTaps - 1 + i;
+                for (int phase = 0; phase < factor; phase++) {
+                    auto const* coefficients = filter.phases.data() + phase * numTaps;
+                    float sum = 0.0f;
+                    for (int j = 0; j < numTaps; j++)
+                        sum += coefficients[j] * newest[-j];
+
+                    samples[i * factor + phase] = sum;
+                }
+            }
+
+            std::copy(input + blockSize, input + historySize, input);
+        }
+    }
+
+    Filter const& filter;
+    int blockSize; // In samples at the parent's rate
+    int numChannels;
+    int historySize;
+    std::vector<float> history;
+};
+
+// Runs in front of an outlet~, which only keeps every factor-th sample. We only work out the samples that are kept, and repeat them so it doesn't matter which one outlet~ picks
+struct Decimator {
+    Decimator(Filter const& downsamplingFilter, int length, int channels)
+        : filter(downsamplingFilter)
+        , blockSize(length)
+        , numChannels(channels)
+        , historySize(static_cast<int>(downsamplingFilter.taps.size()) - 1 + length)
+        , history(channels * historySize, 0.0f)
+    {
+    }
+
+    void process(t_sample const* in, t_sample* out)
+    {
+        auto const factor = filter.factor;
+        auto const numTaps = static_cast<int>(filter.taps.size());
+        auto const* coefficients = filter.taps.data();
+
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto* input = history.data() + ch * historySize;
+            auto* output = out + ch * blockSize;
+            std::copy(in + ch * blockSize, in + (ch + 1) * blockSize, input + numTaps - 1);
+
+            for (int i = 0; i < blockSize; i += factor) {
+                auto const* newest = input + numTaps - 1 + i;
+                float sum = 0.0f;
+                for (int j = 0; j < numTaps; j++)
+                    sum += coefficients[j] * newest[-j];
+
+                std::fill(output + i, output + i + factor, sum);
+            }
+
+            std::copy(input + blockSize, input + historySize, input);
+        }
+    }
+
+    Filter const& filter;
+    int blockSize; // In samples at the oversampled rate
+    int numChannels;
+    int historySize;
+    std::vector<float> history;
+};
+
+struct OversampledSubpatches::Subpatch {
+    Subpatch(t_canvas* cnv, Instance* instance)
+        : canvas(cnv, instance)
+    {
+    }
+
+    ~Subpatch()
+    {
+        if (block)
+            pd_free(&block->ob_pd);
+    }
+
+    WeakReference canvas;
+    int factor = 1;
+    Quality quality = Medium;
+
+    // Never part of the patch, we only hand it to Pd while it builds the DSP chain of the subpatch
+    t_object* block = nullptr;
+    std::unique_ptr<Filter> filter;
+
+    // Only touched while building the DSP chain
+    std::vector<std::unique_ptr<Interpolator>> interpolators;
+    std::vector<std::unique_ptr<Decimator>> decimators;
+};
+
+using ObjectDSPMethod = void (*)(t_object*, t_signal**);
+using CanvasSaveMethod = void (*)(t_gobj*, t_binbuf*);
+static ObjectDSPMethod inletDSP = nullptr;
+static ObjectDSPMethod outletDSP = nullptr;
+static CanvasSaveMethod canvasSave = nullptr;
+
+// Same arrangement as CompiledSubpatches: the lookup table is shared between instances, the subpatches are only used while holding their instance's lock
+static CriticalSection registryLock;
+static std::unordered_map<t_canvas*, OversampledSubpatches::Subpatch*> registry;
+
+// Lets a patch that is being loaded find the instance it is loaded into
+static std::unordered_map<t_pdinstance*, OversampledSubpatches*> instances;
+
+// The subpatch whose DSP chain is being built right now, if it's oversampled. Pd builds subpatches inside their parent, so this is what tells our inlet~ and outlet~ methods which subpatch they are directly in
+static thread_local OversampledSubpatches::Subpatch* subpatchBeingBuilt = nullptr;
+
+static t_int* interpolator_perform(t_int* w)
+{
+    reinterpret_cast<Interpolator*>(w[1])->process(reinterpret_cast<t_sample*>(w[2]));
+    return w + 3;
+}
+
+static t_int* decimator_perform(t_int* w)
+{
+    reinterpret_cast<Decimator*>(w[1])->process(reinterpret_cast<t_sample*>(w[2]), reinterpret_cast<t_sample*>(w[3]));
+    return w + 4;
+}
+
+static void oversampled_inlet_dsp(t_object* x, t_signal** sp)
+{
+    inletDSP(x, sp);
+
+    auto* subpatch = subpatchBeingBuilt;
+    if (!subpatch || !obj_issignaloutlet(x, 0) || sp[0]->s_n % subpatch->factor)
+        return;
+
+    // inlet~ wrote the upsampled signal to its output, which we filter in place
+    auto* signal = sp[0];
+    auto& interpolator = subpatch->interpolators.emplace_back(std::make_unique<Interpolator>(*subpatch->filter, signal->s_n, signal->s_nchans));
+    dsp_add(interpolator_perform, 2, interpolator.get(), signal->s_vec);
+}
+
+static void oversampled_outlet_dsp(t_object* x, t_signal** sp)
+{
+    auto* subpatch = subpatchBeingBuilt;
+    if (!subpatch || !obj_issignalinlet(x, 0) || sp[0]->s_n % subpatch->factor) {
+        outletDSP(x, sp);
+        return;
+    }
+
+    // The input of outlet~ might also go elsewhere in the subpatch, so the filtered signal gets its own buffer
+    auto* signal = sp[0];
+    auto* filtered = signal_new(signal->s_n, signal->s_nchans, signal->s_sr, nullptr);
+    auto& decimator = subpatch->decimators.emplace_back(std::make_unique<Decimator>(*subpatch->filter, signal->s_n, signal->s_nchans));
+    dsp_add(decimator_perform, 3, decimator.get(), signal->s_vec, filtered->s_vec);
+
+    t_signal* filteredSignals[] = { filtered };
+    outletDSP(x, filteredSignals);
+}
+
+// Saves the oversampling of a subpatch right behind it, as "#X oversample <factor> <quality>"
+// Like "#X f", Pd sends that line to the canvas the subpatch was loaded into, which applies it to its newest object
+static void oversampled_canvas_save(t_gobj* x, t_binbuf* b)
+{
+    canvasSave(x, b);
+
+    ScopedLock lock(registryLock);
+    if (auto it = registry.find(reinterpret_cast<t_canvas*>(x)); it != registry.end() && it->second->factor > 1)
+        binbuf_addv(b, "ssii;", gensym("#X"), gensym("oversample"), it->second->factor, static_cast<int>(it->second->quality));
+}
+
+static void oversampled_canvas_oversample(t_canvas* x, t_floatarg factor, t_floatarg quality)
+{
+    t_gobj* newest = x->gl_list;
+    while (newest && newest->g_next)
+        newest = newest->g_next;
+
+    if (!newest || pd_class(&newest->g_pd) != canvas_class)
+        return;
+
+    OversampledSubpatches* oversampledSubpatches;
+    {
+        ScopedLock lock(registryLock);
+        auto it = instances.find(pd_this);
+        if (it == instances.end())
+            return;
+        oversampledSubpatches = it->second;
+    }
+
+    // Patches are loaded while the audio thread is locked, so we oversample the subpatch once loading is done
+    oversampledSubpatches->setOversamplingAsync(reinterpret_cast<t_canvas*>(newest), static_cast<int>(factor), static_cast<OversampledSubpatches::Quality>(jlimit<int>(OversampledSubpatches::Low, OversampledSubpatches::High, static_cast<int>(quality))));
+}
+
+// block~ and switch~ are the same class
+static bool hasBlockObject(t_canvas* x)
+{
+    for (t_gobj* y = x->gl_list; y; y = y->g_next) {
+        if (!strcmp(Interface::getObjectClassName(&y->g_pd), "block~"))
+            return true;
+    }
+
+    return false;
+}
+
+void OversampledSubpatches::buildDSP(t_canvas* x, t_signal** sp, CanvasDSPMethod next)
+{
+    OversampledSubpatches::Subpatch* subpatch = nullptr;
+    {
+        ScopedLock lock(registryLock);
+        if (auto it = registry.find(x); it != registry.end() && it->second->canvas.isValid())
+            subpatch = it->second;
+    }
+
+    // Without our inlet~ and outlet~ methods, the subpatch would alias, so we leave it to Pd
+    if (!subpatch || !subpatch->block || !inletDSP || !outletDSP || !(obj_nsiginlets(&x->gl_obj) + obj_nsigoutlets(&x->gl_obj)) || hasBlockObject(x)) {
+        // Subpatches inside an oversampled subpatch have inlets and outlets of their own, which we should leave alone
+        auto* parentSubpatch = std::exchange(subpatchBeingBuilt, nullptr);
+        next(x, sp);
+        subpatchBeingBuilt = parentSubpatch;
+        return;
+    }
+
+    subpatch->interpolators.clear();
+    subpatch->decimators.clear();
+
+    // Pd looks for block~ objects among the objects of the subpatch, so that's where ours has to be until the chain is built
+    t_gobj** last = &x->gl_list;
+    while (*last)
+        last = &(*last)->g_next;
+
+    *last = &subpatch->block->te_g;
+    subpatch->block->te_g.g_next = nullptr;
+
+    auto* parentSubpatch = std::exchange(subpatchBeingBuilt, subpatch);
+    next(x, sp);
+    subpatchBeingBuilt = parentSubpatch;
+
+    *last = nullptr;
+}
+
+OversampledSubpatches::OversampledSubpatches(Instance* instance)
+    : pd(instance)
+{
+}
+
+OversampledSubpatches::~OversampledSubpatches()
+{
+    ScopedLock lock(registryLock);
+    if (auto it = instances.find(static_cast<t_pdinstance*>(pd->instance)); it != instances.end() && it->second == this)
+        instances.erase(it);
+
+    for (auto& subpatch : subpatches) {
+        if (auto it = registry.find(subpatch->canvas.getRawUnchecked<t_canvas>()); it != registry.end() && it->second == subpatch.get())
+            registry.erase(it);
+    }
+}
+
+void OversampledSubpatches::setup()
+{
+    // inlet~ is the same class as inlet, and outlet~ the same as outlet
+    inletDSP = reinterpret_cast<ObjectDSPMethod>(zgetfn(&vinlet_class, gensym("dsp")));
+    if (inletDSP)
+        class_addmethod(vinlet_class, reinterpret_cast<t_method>(oversampled_inlet_dsp), gensym("dsp"), A_CANT, 0);
+
+    outletDSP = reinterpret_cast<ObjectDSPMethod>(zgetfn(&voutlet_class, gensym("dsp")));
+    if (outletDSP)
+        class_addmethod(voutlet_class, reinterpret_cast<t_method>(oversampled_outlet_dsp), gensym("dsp"), A_CANT, 0);
+
+    canvasSave = reinterpret_cast<CanvasSaveMethod>(class_getsavefn(canvas_class));
+    if (canvasSave)
+        class_setsavefn(canvas_class, reinterpret_cast<t_savefn>(oversampled_canvas_save));
+
+    class_addmethod(canvas_class, reinterpret_cast<t_method>(oversampled_canvas_oversample), gensym("oversample"), A_FLOAT, A_FLOAT, 0);
+}
+
+void OversampledSubpatches::initialise()
+{
+    ScopedLock lock(registryLock);
+    instances[static_cast<t_pdinstance*>(pd->instance)] = this;
+}
+
+void OversampledSubpatches::setOversamplingAsync(t_canvas* canvas, int factor, Quality quality)
+{
+    MessageManager::callAsync([instance = juce::WeakReference(pd), canvas = WeakReference(canvas, pd), factor, quality]() {
+        if (!instance.get() || !canvas.isValid())
+            return;
+
+        instance->oversampledSubpatches.setOversampling(canvas.getRawUnchecked<t_canvas>(), factor, quality);
+    });
+}
+
+void OversampledSubpatches::setOversampling(t_canvas* canvas, int factor, Quality quality)
+{
+    factor = jlimit(1, 16, nextPowerOfTwo(factor));
+    auto* subpatch = find(canvas);
+
+    if (factor == 1) {
+        if (subpatch) {
+            pd->lockAudioThread();
+            {
+                ScopedLock lock(registryLock);
+                if (auto it = registry.find(canvas); it != registry.end() && it->second == subpatch)
+                    registry.erase(it);
+            }
+            canvas_update_dsp();
+            pd->unlockAudioThread();
+
+            // The new chain doesn't refer to the subpatch anymore, so it's safe to delete it
+            subpatches.erase(std::remove_if(subpatches.begin(), subpatches.end(), [subpatch](auto const& other) { return other.get() == subpatch; }), subpatches.end());
+            pd->oversamplingLatencyChanged(getTotalLatency());
+        }
+        return;
+    }
+
+    if (!subpatch) {
+        // Forget about subpatches that were deleted. Pd has already removed them from the DSP chain
+        for (auto& other : subpatches) {
+            if (other->canvas.isValid())
+                continue;
+
+            ScopedLock lock(registryLock);
+            if (auto it = registry.find(other->canvas.getRawUnchecked<t_canvas>()); it != registry.end() && it->second == other.get())
+                registry.erase(it);
+        }
+        subpatches.erase(std::remove_if(subpatches.begin(), subpatches.end(), [](auto const& other) { return !other->canvas.isValid(); }), subpatches.end());
+
+        subpatch = subpatches.emplace_back(std::make_unique<Subpatch>(canvas, pd)).get();
+    }
+
+    pd->lockAudioThread();
+
+    // Creating a block~ object restarts DSP, so we can't do it while the chain is being built. A block size of 0 means it follows the parent's block size
+    // The chain built during that restart still uses the previous block~ and filter, so those have to stay around until we've built the next one
+    t_atom args[3];
+    SETFLOAT(args, 0);
+    SETFLOAT(args + 1, 1);
+    SETFLOAT(args + 2, factor);
+    typedmess(&pd_objectmaker, gensym("block~"), 3, args);
+    auto* block = pd_checkobject(pd_newest());
+
+    auto filter = std::make_unique<Filter>(factor, quality);
+    std::swap(subpatch->filter, filter);
+    std::swap(subpatch->block, block);
+    subpatch->factor = factor;
+    subpatch->quality = quality;
+
+    {
+        ScopedLock lock(registryLock);
+        registry[canvas] = subpatch;
+    }
+    canvas_update_dsp();
+    pd->unlockAudioThread();
+
+    if (block)
+        pd_free(&block->ob_pd);
+
+    pd->oversamplingLatencyChanged(getTotalLatency());
+}
+
+int OversampledSubpatches::getFactor(t_canvas* canvas) const
+{
+    auto* subpatch = find(canvas);
+    return subpatch ? subpatch->factor : 1;
+}
+
+OversampledSubpatches::Quality OversampledSubpatches::getQuality(t_canvas* canvas) const
+{
+    auto* subpatch = find(canvas);
+    return subpatch ? subpatch->quality : Medium;
+}
+
+int OversampledSubpatches::getLatency(Quality quality)
+{
+    // Both filters are symmetric, and each delays the signal by half its length
+    return getFilterDesign(quality).length;
+}
+
+int OversampledSubpatches::getTotalLatency() const
+{
+    int latency = 0;
+    for (auto& subpatch : subpatches) {
+        if (subpatch->canvas.isValid() && subpatch->factor > 1)
+            latency += getLatency(subpatch->quality);
+    }
+
+    return latency;
+}
+
+OversampledSubpatches::Subpatch* OversampledSubpatches::find(t_canvas* canvas) const
+{
+    for (auto& subpatch : subpatches) {
+        if (subpatch->canvas == canvas && subpatch->canvas.isValid())
+            return subpatch.get();
+    }
+
+    return nullptr;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+namespace pd {
+
+class Instance;
+
+// Runs single subpatches at a multiple of the sample rate, so a nonlinear stage doesn't force the whole patch to be oversampled
+// While Pd builds the DSP chain, we slip a block~ object with an upsampling factor into the subpatch, which makes Pd run it at the higher rate
+// Pd itself only holds samples on the way in and drops samples on the way out, which aliases. We add polyphase FIR filters behind every inlet~ and in front of every outlet~ instead
+// The subpatch itself is never changed, its factor and quality are saved as an "#X oversample" line behind it. Subpatches that already contain a block~ or switch~ object are left to Pd
+class OversampledSubpatches {
+public:
+    enum Quality {
+        Low,
+        Medium,
+        High
+    };
+
+    explicit OversampledSubpatches(Instance* instance);
+
+    ~OversampledSubpatches();
+
+    // Installs our dsp methods for inlet~ and outlet~, and the canvas methods that save and load the oversampling. Called once while setting up Pd, before any instance can build a DSP chain
+    static void setup();
+
+    // Lets patches that are loaded into this instance find us, once the Pd instance exists
+    void initialise();
+
+    // Builds the DSP chain of a canvas, where next builds it the way it would be built without oversampling
+    static void buildDSP(t_canvas* canvas, t_signal** sp, CanvasDSPMethod next);
+
+    // Oversamples a subpatch by a power of two, or goes back to the parent's rate when the factor is 1. Message thread only
+    void setOversampling(t_canvas* canvas, int factor, Quality quality);
+
+    // Same as setOversampling, but can be called from any thread. It happens on the message thread later
+    void setOversamplingAsync(t_canvas* canvas, int factor, Quality quality);
+
+    // Returns 1 if the subpatch isn't oversampled
+    int getFactor(t_canvas* canvas) const;
+
+    Quality getQuality(t_canvas* canvas) const;
+
+    // The delay that the filters add to signals that go through an oversampled subpatch, in samples at the parent's rate
+    static int getLatency(Quality quality);
+
+    // Signals that don't go through an oversampled subpatch aren't delayed to match, so we report the worst case to the host: a signal that goes through all of them
+    // The instance is told whenever this changes
+    int getTotalLatency() const;
+
+    struct Subpatch;
+
+private:
+    Subpatch* find(t_canvas* canvas) const;
+
+    Instance* pd;
+    std::vector<std::unique_ptr<Subpatch>> subpatches;
+};
+
+}
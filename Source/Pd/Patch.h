@@ -141,6 +141,7 @@ private:
     friend class Instance;
     friend class Gui;
     friend class Object;
+    friend class SearchIndex;
 
     int undoQueueSize = 0;
 
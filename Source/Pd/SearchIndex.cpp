@@ -0,0 +1,284 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "Utility/Config.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+
+extern "C" {
+#include <m_pd.h>
+#include <m_imp.h>
+#include <g_canvas.h>
+#include <g_all_guis.h>
+}
+
+#include "Constants.h"
+#include "Instance.h"
+#include "Interface.h"
+#include "SearchIndex.h"
+
+namespace pd {
+
+// The name an object listens to, if it has one
+static String getReceiveName(t_object* object, String const& className)
+{
+    static StringArray const receivers = { "receive", "receive~", "catch~", "value" };
+    static StringArray const iemguis = { "bng", "tgl", "nbx", "hsl", "vsl", "hradio", "vradio", "vu", "cnv" };
+
+    if (iemguis.contains(className)) {
+        auto* iemgui = reinterpret_cast<t_iemgui*>(object);
+        t_symbol* srlsym[3];
+        iemgui_all_sym2dollararg(iemgui, srlsym);
+
+        if (srlsym[1] && srlsym[1] != gensym("") && iemgui->x_rcv_unexpanded)
+            return String::fromUTF8(iemgui->x_rcv_unexpanded->s_name);
+
+        return {};
+    }
+
+    if (receivers.contains(className) && binbuf_getnatom(object->te_binbuf) > 1) {
+        auto const* argument = binbuf_getvec(object->te_binbuf) + 1;
+        if (argument->a_type == A_SYMBOL)
+            return String::fromUTF8(argument->a_w.w_symbol->s_name);
+    }
+
+    return {};
+}
+
+SearchIndex::Query::Query(String const& query)
+{
+    auto const text = query.trim();
+    if (text.startsWithIgnoreCase("class:")) {
+        field = Class;
+        term = text.fromFirstOccurrenceOf(":", false, false).trim();
+    } else if (text.startsWithIgnoreCase("receive:")) {
+        field = Receive;
+        term = text.fromFirstOccurrenceOf(":", false, false).trim();
+    } else {
+        term = text;
+    }
+}
+
+bool SearchIndex::Query::matches(Entry const& entry) const
+{
+    switch (field) {
+    case Class:
+        return entry.className.equalsIgnoreCase(term);
+    case Receive:
+        return entry.receiveName.containsIgnoreCase(term);
+    default:
+        return entry.text.containsIgnoreCase(term);
+    }
+}
+
+SearchIndex::SearchIndex(Instance* instance)
+    : pd(instance)
+{
+}
+
+void SearchIndex::markChanged(t_glist* glist)
+{
+    needsCheck = true;
+
+    if (auto it = glists.find(glist); it != glists.end())
+        it->second->needsUpdate = true;
+}
+
+bool SearchIndex::update(Array<Patch*> const& patches)
+{
+    if (!needsCheck && patches == lastPatches)
+        return false;
+
+    needsCheck = false;
+    lastPatches = patches;
+
+    // Everything below reads Pd state, including whether our canvases still exist, so it all happens under one lock
+    AudioLock::ScopedLock audioLock(pd->audioLock);
+    pd->setThis();
+
+    Array<t_glist*> mainPatches;
+    for (auto* patch : patches) {
+        if (!patch->ptr.isValid())
+            continue;
+
+        auto* glist = patch->ptr.getRawUnchecked<t_glist>();
+        if (!glist->gl_owner)
+            mainPatches.addIfNotAlreadyThere(glist);
+    }
+
+    auto changed = false;
+
+    for (int i = indexedPatches.size(); --i >= 0;) {
+        if (!mainPatches.contains(indexedPatches[i])) {
+            remove(indexedPatches[i]);
+            indexedPatches.remove(i);
+            changed = true;
+        }
+    }
+
+    for (auto* patch : mainPatches) {
+        if (!indexedPatches.contains(patch)) {
+            glists[patch] = std::make_unique<Glist>(patch, pd);
+            indexedPatches.add(patch);
+        }
+    }
+
+    // Canvases that were deleted are also dropped from the index when their parent is read again, but the parent isn't always edited at the same time
+    for (auto it = glists.begin(); it != glists.end();) {
+        if (!it->second->pointer.isValid()) {
+            it = glists.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+
+    // Parents go first, so we never read a subpatch that was deleted from its parent in the same edit
+    for (auto* glist : getSearchOrder()) {
+        auto it = glists.find(glist);
+        if (it != glists.end() && it->second->needsUpdate) {
+            index(*it->second);
+            changed = true;
+        }
+    }
+
+    if (changed)
+        version++;
+
+    return changed;
+}
+
+void SearchIndex::index(Glist& record)
+{
+    auto* glist = record.pointer.getRawUnchecked<t_glist>();
+    record.needsUpdate = false;
+
+    if (!record.parent)
+        record.location = String::fromUTF8(glist->gl_name->s_name);
+
+    std::set<t_glist*> previousSubpatches;
+    for (auto const& entry : record.entries) {
+        if (entry.subpatch)
+            previousSubpatches.insert(entry.subpatch);
+    }
+
+    record.entries.clear();
+    for (t_gobj* y = glist->gl_list; y; y = y->g_next) {
+        auto* object = Interface::checkObject(y);
+        if (!object)
+            continue;
+
+        char* text;
+        int size;
+        Interface::getObjectText(object, &text, &size);
+
+        Entry entry;
+        entry.object = y;
+        entry.topLevel = record.topLevel ? record.topLevel : y;
+        entry.text = String::fromUTF8(text, size);
+        entry.className = String::fromUTF8(Interface::getObjectClassName(&y->g_pd));
+        entry.receiveName = getReceiveName(object, entry.className);
+        entry.position = { object->te_xpix, object->te_ypix };
+        entry.subpatch = pd_class(&y->g_pd) == canvas_class ? reinterpret_cast<t_glist*>(y) : nullptr;
+        entry.isAbstraction = entry.subpatch && canvas_isabstraction(entry.subpatch);
+
+        freebytes(static_cast<void*>(text), static_cast<size_t>(size) * sizeof(char));
+
+        if (entry.subpatch) {
+            // New subpatches get read along with their parent, the ones we already had only when they were edited themselves
+            auto& subpatch = glists[entry.subpatch];
+            if (!subpatch || !previousSubpatches.count(entry.subpatch))
+                subpatch = std::make_unique<Glist>(entry.subpatch, pd);
+
+            subpatch->parent = glist;
+            subpatch->topLevel = entry.topLevel;
+            subpatch->location = record.location + " > " + entry.text.upToFirstOccurrenceOf(" ", false, false);
+
+            previousSubpatches.erase(entry.subpatch);
+            if (subpatch->needsUpdate)
+                index(*subpatch);
+        }
+
+        record.entries.push_back(std::move(entry));
+    }
+
+    // Whatever is left was removed from this canvas
+    for (auto* subpatch : previousSubpatches)
+        remove(subpatch);
+}
+
+void SearchIndex::remove(t_glist* glist)
+{
+    auto it = glists.find(glist);
+    if (it == glists.end())
+        return;
+
+    auto record = std::move(it->second);
+    glists.erase(it);
+
+    for (auto const& entry : record->entries) {
+        if (entry.subpatch)
+            remove(entry.subpatch);
+    }
+}
+
+SearchIndex::Glist const* SearchIndex::find(t_glist* glist) const
+{
+    auto it = glists.find(glist);
+    return it != glists.end() ? it->second.get() : nullptr;
+}
+
+Array<t_glist*> SearchIndex::getSearchOrder() const
+{
+    Array<t_glist*> order;
+    std::function<void(t_glist*)> addGlist = [this, &order, &addGlist](t_glist* glist) {
+        auto* record = find(glist);
+        if (!record)
+            return;
+
+        order.add(glist);
+        for (auto const& entry : record->entries) {
+            if (entry.subpatch)
+                addGlist(entry.subpatch);
+        }
+    };
+
+    for (auto* patch : indexedPatches)
+        addGlist(patch);
+
+    return order;
+}
+
+ValueTree SearchIndex::createTree(t_glist* glist) const
+{
+    ValueTree tree("Patch");
+
+    auto* record = find(glist);
+    if (!record)
+        return tree;
+
+    for (auto const& entry : record->entries) {
+        auto positionText = " (" + String(entry.position.x) + ":" + String(entry.position.y) + ")";
+
+        ValueTree element("Object");
+        if (entry.subpatch) {
+            element.copyPropertiesAndChildrenFrom(createTree(entry.subpatch), nullptr);
+            element.setProperty("Name", entry.text, nullptr);
+            element.setProperty("Icon", entry.isAbstraction ? Icons::File : Icons::Object, nullptr);
+        } else {
+            element.setProperty("Name", entry.text.upToFirstOccurrenceOf(" ", false, false), nullptr);
+            element.setProperty("Icon", Icons::Object, nullptr);
+        }
+
+        element.setProperty("RightText", positionText, nullptr);
+        element.setProperty("Object", reinterpret_cast<int64>(entry.object), nullptr);
+        element.setProperty("TopLevel", reinterpret_cast<int64>(entry.topLevel), nullptr);
+        tree.appendChild(element, nullptr);
+    }
+
+    return tree;
+}
+
+}
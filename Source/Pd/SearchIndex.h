@@ -0,0 +1,102 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#pragma once
+
+namespace pd {
+
+class Instance;
+class Patch;
+
+// Everything the search panel can find, across all open patches and the subpatches and abstractions inside them
+// Canvases are only read again after they were edited, and each one is read in a single pass while holding the audio lock
+// Nothing is locked unless a canvas was edited or the list of patches changed, so updating an idle index is free
+// Searching only looks at the index, so typing a query never has to wait for Pd. Message thread only
+class SearchIndex {
+public:
+    struct Entry {
+        void* object;
+        void* topLevel; // The object in the main patch that this object is in, or the object itself
+        String text;
+        String className;
+        String receiveName;
+        Point<int> position;
+        t_glist* subpatch; // Set for subpatches, graphs and abstractions
+        bool isAbstraction;
+    };
+
+    struct Glist {
+        Glist(t_glist* glist, Instance* instance)
+            : pointer(glist, instance)
+        {
+        }
+
+        WeakReference pointer;
+        t_glist* parent = nullptr; // nullptr for main patches
+        void* topLevel = nullptr;
+        String location; // Names of the patch and subpatches it's in, for showing with search results
+        std::vector<Entry> entries;
+        bool needsUpdate = true;
+    };
+
+    // Supports "class:" and "receive:" prefixes, anything else is matched against the object text
+    struct Query {
+        enum Field {
+            Text,
+            Class,
+            Receive
+        };
+
+        explicit Query(String const& query);
+
+        bool matches(Entry const& entry) const;
+
+        bool isEmpty() const
+        {
+            return term.isEmpty();
+        }
+
+        Field field = Text;
+        String term;
+    };
+
+    explicit SearchIndex(Instance* instance);
+
+    // Called after a canvas was edited, so it gets read again on the next update
+    // Canvases that aren't indexed yet also call this when they're opened, which makes the next update look for new patches
+    void markChanged(t_glist* glist);
+
+    // Indexes the patches that were opened, drops the ones that were closed, and reads edited canvases again
+    // Returns true if the index changed
+    bool update(Array<Patch*> const& patches);
+
+    Glist const* find(t_glist* glist) const;
+
+    // All indexed canvases, with every canvas listed before the subpatches inside it
+    Array<t_glist*> getSearchOrder() const;
+
+    // The same layout as the search panel's patch tree
+    ValueTree createTree(t_glist* glist) const;
+
+    // Goes up every time the index changes, so searches know when to start over
+    int getVersion() const
+    {
+        return version;
+    }
+
+private:
+    void index(Glist& glist);
+    void remove(t_glist* glist);
+
+    Instance* pd;
+    std::unordered_map<t_glist*, std::unique_ptr<Glist>> glists;
+    Array<t_glist*> indexedPatches;
+    Array<Patch*> lastPatches;
+    bool needsCheck = true;
+    int version = 0;
+};
+
+}
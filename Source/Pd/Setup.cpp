@@ -6,12 +6,19 @@
 
 extern "C" {
 #include <m_pd.h>
+#include <m_imp.h>
 #include <z_hooks.h>
 }
 
+#include <algorithm>
 #include <clocale>
+#include <iterator>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <cstring>
+#include <unordered_map>
+#include <vector>
 #include "Setup.h"
 
 static t_class* plugdata_receiver_class;
@@ -817,511 +824,712 @@ void Setup::initialisePdLua(char const* datadir, char* vers, int vers_len)
     pdlua_setup(datadir, vers, vers_len);
 }
 
-void Setup::initialiseELSE()
-{
-    knob_setup();
-    above_tilde_setup();
-    add_tilde_setup();
-    adsr_tilde_setup();
-    setup_allpass0x2e2nd_tilde();
-    setup_allpass0x2erev_tilde();
-    args_setup();
-    asr_tilde_setup();
-    autofade_tilde_setup();
-    autofade2_tilde_setup();
-    balance_tilde_setup();
-    bandpass_tilde_setup();
-    bandstop_tilde_setup();
-    setup_bend0x2ein();
-    setup_bend0x2eout();
-    setup_bl0x2esaw_tilde();
-    setup_bl0x2esaw2_tilde();
-    setup_bl0x2eimp_tilde();
-    setup_bl0x2eimp2_tilde();
-    setup_bl0x2esquare_tilde();
-    setup_bl0x2etri_tilde();
-    setup_bl0x2evsaw_tilde();
-    setup_osc0x2eformat();
-    setup_osc0x2eparse();
-    setup_osc0x2eroute();
-    beat_tilde_setup();
-    bicoeff_setup();
-    bicoeff2_setup();
-    bitnormal_tilde_setup();
-    biquads_tilde_setup();
-    blocksize_tilde_setup();
-    break_setup();
-    brown_tilde_setup();
-    buffer_setup();
-    button_setup();
-    setup_canvas0x2eactive();
-    setup_canvas0x2ebounds();
-    setup_canvas0x2eedit();
-    setup_canvas0x2egop();
-    setup_canvas0x2emouse();
-    setup_canvas0x2ename();
-    setup_canvas0x2epos();
-    setup_canvas0x2esetname();
-    setup_canvas0x2evis();
-    setup_canvas0x2ezoom();
-    setup_canvas0x2efile();
-    ceil_setup();
-    ceil_tilde_setup();
-    cents2ratio_setup();
-    cents2ratio_tilde_setup();
-    chance_setup();
-    chance_tilde_setup();
-    changed_setup();
-    changed_tilde_setup();
-    changed2_tilde_setup();
-    click_setup();
-    white_tilde_setup();
-    cmul_tilde_setup();
-    colors_setup();
-    setup_comb0x2efilt_tilde();
-    setup_comb0x2erev_tilde();
-    cosine_tilde_setup();
-    crackle_tilde_setup();
-    crossover_tilde_setup();
-    setup_ctl0x2ein();
-    setup_ctl0x2eout();
-    cusp_tilde_setup();
-    datetime_setup();
-    db2lin_tilde_setup();
-    decay_tilde_setup();
-    decay2_tilde_setup();
-    default_setup();
-    del_tilde_setup();
-    detect_tilde_setup();
-    dir_setup();
-    dollsym_setup();
-    downsample_tilde_setup();
-    drive_tilde_setup();
-    dust_tilde_setup();
-    dust2_tilde_setup();
-    else_setup();
-    envgen_tilde_setup();
-    eq_tilde_setup();
-    factor_setup();
-    fader_tilde_setup();
-    fbdelay_tilde_setup();
-    fbsine_tilde_setup();
-    fbsine2_tilde_setup();
-    setup_fdn0x2erev_tilde();
-    ffdelay_tilde_setup();
-    float2bits_setup();
-    floor_setup();
-    floor_tilde_setup();
-    fold_setup();
-    fold_tilde_setup();
-    fontsize_setup();
-    format_setup();
-    filterdelay_tilde_setup();
-    setup_freq0x2eshift_tilde();
-    function_setup();
-    function_tilde_setup();
-    gate2imp_tilde_setup();
-    gaussian_tilde_setup();
-    gbman_tilde_setup();
-    gcd_setup();
-    gendyn_tilde_setup();
-    setup_giga0x2erev_tilde();
-    glide_tilde_setup();
-    glide2_tilde_setup();
-    gray_tilde_setup();
-    henon_tilde_setup();
-    highpass_tilde_setup();
-    highshelf_tilde_setup();
-    hot_setup();
-    hz2rad_setup();
-    ikeda_tilde_setup();
-    imp_tilde_setup();
-    imp2_tilde_setup();
-    impseq_tilde_setup();
-    impulse_tilde_setup();
-    impulse2_tilde_setup();
-    initmess_setup();
-    keyboard_setup();
-    keycode_setup();
-    lag_tilde_setup();
-    lag2_tilde_setup();
-    lastvalue_tilde_setup();
-    latoocarfian_tilde_setup();
-    lb_setup();
-    lfnoise_tilde_setup();
-    limit_setup();
-    lincong_tilde_setup();
-    loadbanger_setup();
-    logistic_tilde_setup();
-    loop_setup();
-    lop2_tilde_setup();
-    lorenz_tilde_setup();
-    lowpass_tilde_setup();
-    lowshelf_tilde_setup();
-    match_tilde_setup();
-    median_tilde_setup();
-    merge_setup();
-    message_setup();
-    messbox_setup();
-    metronome_setup();
-    midi_setup();
-    mouse_setup();
-    setup_mov0x2eavg_tilde();
-    setup_mov0x2erms_tilde();
-    mtx_tilde_setup();
-    note_setup();
-    setup_note0x2ein();
-    setup_note0x2eout();
-    noteinfo_setup();
-    nyquist_tilde_setup();
-    op_tilde_setup();
-    openfile_setup();
-    oscope_tilde_setup();
-    pack2_setup();
-    pad_setup();
-    pan2_tilde_setup();
-    pan4_tilde_setup();
-    panic_setup();
-    parabolic_tilde_setup();
-    peak_tilde_setup();
-    setup_pgm0x2ein();
-    setup_pgm0x2eout();
-    pic_setup();
-    pimp_tilde_setup();
-    pink_tilde_setup();
-    pimpmul_tilde_setup();
-    plaits_tilde_setup();
-    pluck_tilde_setup();
-    power_tilde_setup();
-    properties_setup();
-    pulse_tilde_setup();
-    pulsecount_tilde_setup();
-    pulsediv_tilde_setup();
-    quad_tilde_setup();
-    quantizer_setup();
-    quantizer_tilde_setup();
-    rad2hz_setup();
-    ramp_tilde_setup();
-    rampnoise_tilde_setup();
-    setup_rand0x2ef();
-    setup_rand0x2eu();
-    setup_rand0x2ef_tilde();
-    setup_rand0x2ehist();
-    s2f_tilde_setup();
-    sfont_tilde_setup();
-    setup_rand0x2ei();
-    setup_rand0x2ei_tilde();
-    numbox_tilde_setup();
-    route2_setup();
-    randpulse_tilde_setup();
-    randpulse2_tilde_setup();
-    range_tilde_setup();
-    ratio2cents_setup();
-    ratio2cents_tilde_setup();
-    rec_setup();
-    receiver_setup();
-    rescale_setup();
-    rescale_tilde_setup();
-    resonant_tilde_setup();
-    resonant2_tilde_setup();
-    retrieve_setup();
-    rint_setup();
-    rint_tilde_setup();
-    rms_tilde_setup();
-    rotate_tilde_setup();
-    routeall_setup();
-    router_setup();
-    routetype_setup();
-    saw_tilde_setup();
-    saw2_tilde_setup();
-    schmitt_tilde_setup();
-    selector_setup();
-    separate_setup();
-    sequencer_tilde_setup();
-    sh_tilde_setup();
-    shaper_tilde_setup();
-    sig2float_tilde_setup();
-    sin_tilde_setup();
-    sine_tilde_setup();
-    slew_tilde_setup();
-    slew2_tilde_setup();
-    slice_setup();
-    sort_setup();
-    spread_setup();
-    spread_tilde_setup();
-    square_tilde_setup();
-    sr_tilde_setup();
-    standard_tilde_setup();
-    status_tilde_setup();
-    stepnoise_tilde_setup();
-    susloop_tilde_setup();
-    suspedal_setup();
-    svfilter_tilde_setup();
-    symbol2any_setup();
+// ELSE and cyclone have almost 900 classes, running all of their setup functions is a big part of our startup time
+// Most patches only use a few of them. So when we know which names a setup function registers, we only add a placeholder creator for those names,
+// and run the real setup function the first time one of them gets instantiated
+// To find out which names every setup function registers, we set everything up eagerly the first time a version of plugdata runs, and store the names in a registry file
+struct ClassSetup {
+    char const* name;
+    void (*setup)();
+};
+
+#define CLASS_SETUP(function) { #function, function }
+
+static ClassSetup const elseSetups[] = {
+    CLASS_SETUP(knob_setup),
+    CLASS_SETUP(above_tilde_setup),
+    CLASS_SETUP(add_tilde_setup),
+    CLASS_SETUP(adsr_tilde_setup),
+    CLASS_SETUP(setup_allpass0x2e2nd_tilde),
+    CLASS_SETUP(setup_allpass0x2erev_tilde),
+    CLASS_SETUP(args_setup),
+    CLASS_SETUP(asr_tilde_setup),
+    CLASS_SETUP(autofade_tilde_setup),
+    CLASS_SETUP(autofade2_tilde_setup),
+    CLASS_SETUP(balance_tilde_setup),
+    CLASS_SETUP(bandpass_tilde_setup),
+    CLASS_SETUP(bandstop_tilde_setup),
+    CLASS_SETUP(setup_bend0x2ein),
+    CLASS_SETUP(setup_bend0x2eout),
+    CLASS_SETUP(setup_bl0x2esaw_tilde),
+    CLASS_SETUP(setup_bl0x2esaw2_tilde),
+    CLASS_SETUP(setup_bl0x2eimp_tilde),
+    CLASS_SETUP(setup_bl0x2eimp2_tilde),
+    CLASS_SETUP(setup_bl0x2esquare_tilde),
+    CLASS_SETUP(setup_bl0x2etri_tilde),
+    CLASS_SETUP(setup_bl0x2evsaw_tilde),
+    CLASS_SETUP(setup_osc0x2eformat),
+    CLASS_SETUP(setup_osc0x2eparse),
+    CLASS_SETUP(setup_osc0x2eroute),
+    CLASS_SETUP(beat_tilde_setup),
+    CLASS_SETUP(bicoeff_setup),
+    CLASS_SETUP(bicoeff2_setup),
+    CLASS_SETUP(bitnormal_tilde_setup),
+    CLASS_SETUP(biquads_tilde_setup),
+    CLASS_SETUP(blocksize_tilde_setup),
+    CLASS_SETUP(break_setup),
+    CLASS_SETUP(brown_tilde_setup),
+    CLASS_SETUP(buffer_setup),
+    CLASS_SETUP(button_setup),
+    CLASS_SETUP(setup_canvas0x2eactive),
+    CLASS_SETUP(setup_canvas0x2ebounds),
+    CLASS_SETUP(setup_canvas0x2eedit),
+    CLASS_SETUP(setup_canvas0x2egop),
+    CLASS_SETUP(setup_canvas0x2emouse),
+    CLASS_SETUP(setup_canvas0x2ename),
+    CLASS_SETUP(setup_canvas0x2epos),
+    CLASS_SETUP(setup_canvas0x2esetname),
+    CLASS_SETUP(setup_canvas0x2evis),
+    CLASS_SETUP(setup_canvas0x2ezoom),
+    CLASS_SETUP(setup_canvas0x2efile),
+    CLASS_SETUP(ceil_setup),
+    CLASS_SETUP(ceil_tilde_setup),
+    CLASS_SETUP(cents2ratio_setup),
+    CLASS_SETUP(cents2ratio_tilde_setup),
+    CLASS_SETUP(chance_setup),
+    CLASS_SETUP(chance_tilde_setup),
+    CLASS_SETUP(changed_setup),
+    CLASS_SETUP(changed_tilde_setup),
+    CLASS_SETUP(changed2_tilde_setup),
+    CLASS_SETUP(click_setup),
+    CLASS_SETUP(white_tilde_setup),
+    CLASS_SETUP(cmul_tilde_setup),
+    CLASS_SETUP(colors_setup),
+    CLASS_SETUP(setup_comb0x2efilt_tilde),
+    CLASS_SETUP(setup_comb0x2erev_tilde),
+    CLASS_SETUP(cosine_tilde_setup),
+    CLASS_SETUP(crackle_tilde_setup),
+    CLASS_SETUP(crossover_tilde_setup),
+    CLASS_SETUP(setup_ctl0x2ein),
+    CLASS_SETUP(setup_ctl0x2eout),
+    CLASS_SETUP(cusp_tilde_setup),
+    CLASS_SETUP(datetime_setup),
+    CLASS_SETUP(db2lin_tilde_setup),
+    CLASS_SETUP(decay_tilde_setup),
+    CLASS_SETUP(decay2_tilde_setup),
+    CLASS_SETUP(default_setup),
+    CLASS_SETUP(del_tilde_setup),
+    CLASS_SETUP(detect_tilde_setup),
+    CLASS_SETUP(dir_setup),
+    CLASS_SETUP(dollsym_setup),
+    CLASS_SETUP(downsample_tilde_setup),
+    CLASS_SETUP(drive_tilde_setup),
+    CLASS_SETUP(dust_tilde_setup),
+    CLASS_SETUP(dust2_tilde_setup),
+    CLASS_SETUP(else_setup),
+    CLASS_SETUP(envgen_tilde_setup),
+    CLASS_SETUP(eq_tilde_setup),
+    CLASS_SETUP(factor_setup),
+    CLASS_SETUP(fader_tilde_setup),
+    CLASS_SETUP(fbdelay_tilde_setup),
+    CLASS_SETUP(fbsine_tilde_setup),
+    CLASS_SETUP(fbsine2_tilde_setup),
+    CLASS_SETUP(setup_fdn0x2erev_tilde),
+    CLASS_SETUP(ffdelay_tilde_setup),
+    CLASS_SETUP(float2bits_setup),
+    CLASS_SETUP(floor_setup),
+    CLASS_SETUP(floor_tilde_setup),
+    CLASS_SETUP(fold_setup),
+    CLASS_SETUP(fold_tilde_setup),
+    CLASS_SETUP(fontsize_setup),
+    CLASS_SETUP(format_setup),
+    CLASS_SETUP(filterdelay_tilde_setup),
+    CLASS_SETUP(setup_freq0x2eshift_tilde),
+    CLASS_SETUP(function_setup),
+    CLASS_SETUP(function_tilde_setup),
+    CLASS_SETUP(gate2imp_tilde_setup),
+    CLASS_SETUP(gaussian_tilde_setup),
+    CLASS_SETUP(gbman_tilde_setup),
+    CLASS_SETUP(gcd_setup),
+    CLASS_SETUP(gendyn_tilde_setup),
+    CLASS_SETUP(setup_giga0x2erev_tilde),
+    CLASS_SETUP(glide_tilde_setup),
+    CLASS_SETUP(glide2_tilde_setup),
+    CLASS_SETUP(gray_tilde_setup),
+    CLASS_SETUP(henon_tilde_setup),
+    CLASS_SETUP(highpass_tilde_setup),
+    CLASS_SETUP(highshelf_tilde_setup),
+    CLASS_SETUP(hot_setup),
+    CLASS_SETUP(hz2rad_setup),
+    CLASS_SETUP(ikeda_tilde_setup),
+    CLASS_SETUP(imp_tilde_setup),
+    CLASS_SETUP(imp2_tilde_setup),
+    CLASS_SETUP(impseq_tilde_setup),
+    CLASS_SETUP(impulse_tilde_setup),
+    CLASS_SETUP(impulse2_tilde_setup),
+    CLASS_SETUP(initmess_setup),
+    CLASS_SETUP(keyboard_setup),
+    CLASS_SETUP(keycode_setup),
+    CLASS_SETUP(lag_tilde_setup),
+    CLASS_SETUP(lag2_tilde_setup),
+    CLASS_SETUP(lastvalue_tilde_setup),
+    CLASS_SETUP(latoocarfian_tilde_setup),
+    CLASS_SETUP(lb_setup),
+    CLASS_SETUP(lfnoise_tilde_setup),
+    CLASS_SETUP(limit_setup),
+    CLASS_SETUP(lincong_tilde_setup),
+    CLASS_SETUP(loadbanger_setup),
+    CLASS_SETUP(logistic_tilde_setup),
+    CLASS_SETUP(loop_setup),
+    CLASS_SETUP(lop2_tilde_setup),
+    CLASS_SETUP(lorenz_tilde_setup),
+    CLASS_SETUP(lowpass_tilde_setup),
+    CLASS_SETUP(lowshelf_tilde_setup),
+    CLASS_SETUP(match_tilde_setup),
+    CLASS_SETUP(median_tilde_setup),
+    CLASS_SETUP(merge_setup),
+    CLASS_SETUP(message_setup),
+    CLASS_SETUP(messbox_setup),
+    CLASS_SETUP(metronome_setup),
+    CLASS_SETUP(midi_setup),
+    CLASS_SETUP(mouse_setup),
+    CLASS_SETUP(setup_mov0x2eavg_tilde),
+    CLASS_SETUP(setup_mov0x2erms_tilde),
+    CLASS_SETUP(mtx_tilde_setup),
+    CLASS_SETUP(note_setup),
+    CLASS_SETUP(setup_note0x2ein),
+    CLASS_SETUP(setup_note0x2eout),
+    CLASS_SETUP(noteinfo_setup),
+    CLASS_SETUP(nyquist_tilde_setup),
+    CLASS_SETUP(op_tilde_setup),
+    CLASS_SETUP(openfile_setup),
+    CLASS_SETUP(oscope_tilde_setup),
+    CLASS_SETUP(pack2_setup),
+    CLASS_SETUP(pad_setup),
+    CLASS_SETUP(pan2_tilde_setup),
+    CLASS_SETUP(pan4_tilde_setup),
+    CLASS_SETUP(panic_setup),
+    CLASS_SETUP(parabolic_tilde_setup),
+    CLASS_SETUP(peak_tilde_setup),
+    CLASS_SETUP(setup_pgm0x2ein),
+    CLASS_SETUP(setup_pgm0x2eout),
+    CLASS_SETUP(pic_setup),
+    CLASS_SETUP(pimp_tilde_setup),
+    CLASS_SETUP(pink_tilde_setup),
+    CLASS_SETUP(pimpmul_tilde_setup),
+    CLASS_SETUP(plaits_tilde_setup),
+    CLASS_SETUP(pluck_tilde_setup),
+    CLASS_SETUP(power_tilde_setup),
+    CLASS_SETUP(properties_setup),
+    CLASS_SETUP(pulse_tilde_setup),
+    CLASS_SETUP(pulsecount_tilde_setup),
+    CLASS_SETUP(pulsediv_tilde_setup),
+    CLASS_SETUP(quad_tilde_setup),
+    CLASS_SETUP(quantizer_setup),
+    CLASS_SETUP(quantizer_tilde_setup),
+    CLASS_SETUP(rad2hz_setup),
+    CLASS_SETUP(ramp_tilde_setup),
+    CLASS_SETUP(rampnoise_tilde_setup),
+    CLASS_SETUP(setup_rand0x2ef),
+    CLASS_SETUP(setup_rand0x2eu),
+    CLASS_SETUP(setup_rand0x2ef_tilde),
+    CLASS_SETUP(setup_rand0x2ehist),
+    CLASS_SETUP(s2f_tilde_setup),
+    CLASS_SETUP(sfont_tilde_setup),
+    CLASS_SETUP(setup_rand0x2ei),
+    CLASS_SETUP(setup_rand0x2ei_tilde),
+    CLASS_SETUP(numbox_tilde_setup),
+    CLASS_SETUP(route2_setup),
+    CLASS_SETUP(randpulse_tilde_setup),
+    CLASS_SETUP(randpulse2_tilde_setup),
+    CLASS_SETUP(range_tilde_setup),
+    CLASS_SETUP(ratio2cents_setup),
+    CLASS_SETUP(ratio2cents_tilde_setup),
+    CLASS_SETUP(rec_setup),
+    CLASS_SETUP(receiver_setup),
+    CLASS_SETUP(rescale_setup),
+    CLASS_SETUP(rescale_tilde_setup),
+    CLASS_SETUP(resonant_tilde_setup),
+    CLASS_SETUP(resonant2_tilde_setup),
+    CLASS_SETUP(retrieve_setup),
+    CLASS_SETUP(rint_setup),
+    CLASS_SETUP(rint_tilde_setup),
+    CLASS_SETUP(rms_tilde_setup),
+    CLASS_SETUP(rotate_tilde_setup),
+    CLASS_SETUP(routeall_setup),
+    CLASS_SETUP(router_setup),
+    CLASS_SETUP(routetype_setup),
+    CLASS_SETUP(saw_tilde_setup),
+    CLASS_SETUP(saw2_tilde_setup),
+    CLASS_SETUP(schmitt_tilde_setup),
+    CLASS_SETUP(selector_setup),
+    CLASS_SETUP(separate_setup),
+    CLASS_SETUP(sequencer_tilde_setup),
+    CLASS_SETUP(sh_tilde_setup),
+    CLASS_SETUP(shaper_tilde_setup),
+    CLASS_SETUP(sig2float_tilde_setup),
+    CLASS_SETUP(sin_tilde_setup),
+    CLASS_SETUP(sine_tilde_setup),
+    CLASS_SETUP(slew_tilde_setup),
+    CLASS_SETUP(slew2_tilde_setup),
+    CLASS_SETUP(slice_setup),
+    CLASS_SETUP(sort_setup),
+    CLASS_SETUP(spread_setup),
+    CLASS_SETUP(spread_tilde_setup),
+    CLASS_SETUP(square_tilde_setup),
+    CLASS_SETUP(sr_tilde_setup),
+    CLASS_SETUP(standard_tilde_setup),
+    CLASS_SETUP(status_tilde_setup),
+    CLASS_SETUP(stepnoise_tilde_setup),
+    CLASS_SETUP(susloop_tilde_setup),
+    CLASS_SETUP(suspedal_setup),
+    CLASS_SETUP(svfilter_tilde_setup),
+    CLASS_SETUP(symbol2any_setup),
     // table_tilde_setup();
-    tabplayer_tilde_setup();
-    tabreader_setup();
-    tabreader_tilde_setup();
-    tabwriter_tilde_setup();
-    tempo_tilde_setup();
-    setup_timed0x2egate_tilde();
-    toggleff_tilde_setup();
-    setup_touch0x2ein();
-    setup_touch0x2eout();
-    tri_tilde_setup();
-    setup_trig0x2edelay_tilde();
-    setup_trig0x2edelay2_tilde();
-    trighold_tilde_setup();
-    trunc_setup();
-    trunc_tilde_setup();
-    unmerge_setup();
-    voices_setup();
-    vsaw_tilde_setup();
-    vu_tilde_setup();
-    wt_tilde_setup();
-    wavetable_tilde_setup();
-    wrap2_setup();
-    wrap2_tilde_setup();
-    xfade_tilde_setup();
-    xgate_tilde_setup();
-    xgate2_tilde_setup();
-    xmod_tilde_setup();
-    xmod2_tilde_setup();
-    xselect_tilde_setup();
-    xselect2_tilde_setup();
-    zerocross_tilde_setup();
-    nchs_tilde_setup();
-    get_tilde_setup();
-    pick_tilde_setup();
-    sigs_tilde_setup();
-    select_tilde_setup();
-    setup_xselect0x2emc_tilde();
-    merge_tilde_setup();
-    unmerge_tilde_setup();
-    phaseseq_tilde_setup();
-    pol2car_tilde_setup();
-    car2pol_tilde_setup();
-    lin2db_tilde_setup();
-    sum_tilde_setup();
-    slice_tilde_setup();
-    order_setup();
-    repeat_tilde_setup();
-    setup_xgate0x2emc_tilde();
-    setup_xfade0x2emc_tilde();
+    CLASS_SETUP(tabplayer_tilde_setup),
+    CLASS_SETUP(tabreader_setup),
+    CLASS_SETUP(tabreader_tilde_setup),
+    CLASS_SETUP(tabwriter_tilde_setup),
+    CLASS_SETUP(tempo_tilde_setup),
+    CLASS_SETUP(setup_timed0x2egate_tilde),
+    CLASS_SETUP(toggleff_tilde_setup),
+    CLASS_SETUP(setup_touch0x2ein),
+    CLASS_SETUP(setup_touch0x2eout),
+    CLASS_SETUP(tri_tilde_setup),
+    CLASS_SETUP(setup_trig0x2edelay_tilde),
+    CLASS_SETUP(setup_trig0x2edelay2_tilde),
+    CLASS_SETUP(trighold_tilde_setup),
+    CLASS_SETUP(trunc_setup),
+    CLASS_SETUP(trunc_tilde_setup),
+    CLASS_SETUP(unmerge_setup),
+    CLASS_SETUP(voices_setup),
+    CLASS_SETUP(vsaw_tilde_setup),
+    CLASS_SETUP(vu_tilde_setup),
+    CLASS_SETUP(wt_tilde_setup),
+    CLASS_SETUP(wavetable_tilde_setup),
+    CLASS_SETUP(wrap2_setup),
+    CLASS_SETUP(wrap2_tilde_setup),
+    CLASS_SETUP(xfade_tilde_setup),
+    CLASS_SETUP(xgate_tilde_setup),
+    CLASS_SETUP(xgate2_tilde_setup),
+    CLASS_SETUP(xmod_tilde_setup),
+    CLASS_SETUP(xmod2_tilde_setup),
+    CLASS_SETUP(xselect_tilde_setup),
+    CLASS_SETUP(xselect2_tilde_setup),
+    CLASS_SETUP(zerocross_tilde_setup),
+    CLASS_SETUP(nchs_tilde_setup),
+    CLASS_SETUP(get_tilde_setup),
+    CLASS_SETUP(pick_tilde_setup),
+    CLASS_SETUP(sigs_tilde_setup),
+    CLASS_SETUP(select_tilde_setup),
+    CLASS_SETUP(setup_xselect0x2emc_tilde),
+    CLASS_SETUP(merge_tilde_setup),
+    CLASS_SETUP(unmerge_tilde_setup),
+    CLASS_SETUP(phaseseq_tilde_setup),
+    CLASS_SETUP(pol2car_tilde_setup),
+    CLASS_SETUP(car2pol_tilde_setup),
+    CLASS_SETUP(lin2db_tilde_setup),
+    CLASS_SETUP(sum_tilde_setup),
+    CLASS_SETUP(slice_tilde_setup),
+    CLASS_SETUP(order_setup),
+    CLASS_SETUP(repeat_tilde_setup),
+    CLASS_SETUP(setup_xgate0x2emc_tilde),
+    CLASS_SETUP(setup_xfade0x2emc_tilde),
 #ifdef ENABLE_SFIZZ
     // sfz_tilde_setup();
 #endif
-    sender_setup();
-    setup_ptouch0x2ein();
-    setup_ptouch0x2eout();
-    setup_spread0x2emc_tilde();
-    setup_rotate0x2emc_tilde();
-    pipe2_setup();
-    circuit_tilde_setup();
-
-    pm_tilde_setup();
-    pm2_tilde_setup();
-    pm4_tilde_setup();
-    pm6_tilde_setup();
-
-    var_setup();
-    conv_tilde_setup();
-    fm_tilde_setup();
+    CLASS_SETUP(sender_setup),
+    CLASS_SETUP(setup_ptouch0x2ein),
+    CLASS_SETUP(setup_ptouch0x2eout),
+    CLASS_SETUP(setup_spread0x2emc_tilde),
+    CLASS_SETUP(setup_rotate0x2emc_tilde),
+    CLASS_SETUP(pipe2_setup),
+    CLASS_SETUP(circuit_tilde_setup),
+
+    CLASS_SETUP(pm_tilde_setup),
+    CLASS_SETUP(pm2_tilde_setup),
+    CLASS_SETUP(pm4_tilde_setup),
+    CLASS_SETUP(pm6_tilde_setup),
+
+    CLASS_SETUP(var_setup),
+    CLASS_SETUP(conv_tilde_setup),
+    CLASS_SETUP(fm_tilde_setup),
+};
+
+static ClassSetup const cycloneSetups[] = {
+    CLASS_SETUP(cyclone_setup),
+    CLASS_SETUP(accum_setup),
+    CLASS_SETUP(acos_setup),
+    CLASS_SETUP(acosh_setup),
+    CLASS_SETUP(active_setup),
+    CLASS_SETUP(anal_setup),
+    CLASS_SETUP(append_setup),
+    CLASS_SETUP(asin_setup),
+    CLASS_SETUP(asinh_setup),
+    CLASS_SETUP(atanh_setup),
+    CLASS_SETUP(atodb_setup),
+    CLASS_SETUP(bangbang_setup),
+    CLASS_SETUP(bondo_setup),
+    CLASS_SETUP(borax_setup),
+    CLASS_SETUP(bucket_setup),
+    CLASS_SETUP(buddy_setup),
+    CLASS_SETUP(capture_setup),
+    CLASS_SETUP(cartopol_setup),
+    CLASS_SETUP(clip_setup),
+    CLASS_SETUP(coll_setup),
+    CLASS_SETUP(cosh_setup),
+    CLASS_SETUP(counter_setup),
+    CLASS_SETUP(cycle_setup),
+    CLASS_SETUP(dbtoa_setup),
+    CLASS_SETUP(decide_setup),
+    CLASS_SETUP(decode_setup),
+    CLASS_SETUP(drunk_setup),
+    CLASS_SETUP(flush_setup),
+    CLASS_SETUP(forward_setup),
+    CLASS_SETUP(fromsymbol_setup),
+    CLASS_SETUP(funnel_setup),
+    CLASS_SETUP(funbuff_setup),
+    CLASS_SETUP(gate_setup),
+    CLASS_SETUP(grab_setup),
+    CLASS_SETUP(histo_setup),
+    CLASS_SETUP(iter_setup),
+    CLASS_SETUP(join_setup),
+    CLASS_SETUP(linedrive_setup),
+    CLASS_SETUP(listfunnel_setup),
+    CLASS_SETUP(loadmess_setup),
+    CLASS_SETUP(match_setup),
+    CLASS_SETUP(maximum_setup),
+    CLASS_SETUP(mean_setup),
+    CLASS_SETUP(midiflush_setup),
+    CLASS_SETUP(midiformat_setup),
+    CLASS_SETUP(midiparse_setup),
+    CLASS_SETUP(minimum_setup),
+    CLASS_SETUP(mousefilter_setup),
+    CLASS_SETUP(mousestate_setup),
+    CLASS_SETUP(mtr_setup),
+    CLASS_SETUP(next_setup),
+    CLASS_SETUP(offer_setup),
+    CLASS_SETUP(onebang_setup),
+    CLASS_SETUP(pak_setup),
+    CLASS_SETUP(past_setup),
+    CLASS_SETUP(peak_setup),
+    CLASS_SETUP(poltocar_setup),
+    CLASS_SETUP(pong_setup),
+    CLASS_SETUP(prepend_setup),
+    CLASS_SETUP(prob_setup),
+    CLASS_SETUP(pv_setup),
+    CLASS_SETUP(rdiv_setup),
+    CLASS_SETUP(rminus_setup),
+    CLASS_SETUP(round_setup),
+    CLASS_SETUP(scale_setup),
+    CLASS_SETUP(seq_setup),
+    CLASS_SETUP(sinh_setup),
+    CLASS_SETUP(speedlim_setup),
+    CLASS_SETUP(spell_setup),
+    CLASS_SETUP(split_setup),
+    CLASS_SETUP(spray_setup),
+    CLASS_SETUP(sprintf_setup),
+    CLASS_SETUP(substitute_setup),
+    CLASS_SETUP(sustain_setup),
+    CLASS_SETUP(switch_setup),
+    CLASS_SETUP(table_setup),
+    CLASS_SETUP(tanh_setup),
+    CLASS_SETUP(thresh_setup),
+    CLASS_SETUP(togedge_setup),
+    CLASS_SETUP(tosymbol_setup),
+    CLASS_SETUP(trough_setup),
+    CLASS_SETUP(universal_setup),
+    CLASS_SETUP(unjoin_setup),
+    CLASS_SETUP(urn_setup),
+    CLASS_SETUP(uzi_setup),
+    CLASS_SETUP(xbendin_setup),
+    CLASS_SETUP(xbendin2_setup),
+    CLASS_SETUP(xbendout_setup),
+    CLASS_SETUP(xbendout2_setup),
+    CLASS_SETUP(xnotein_setup),
+    CLASS_SETUP(xnoteout_setup),
+    CLASS_SETUP(zl_setup),
+
+    CLASS_SETUP(acos_tilde_setup),
+    CLASS_SETUP(acosh_tilde_setup),
+    CLASS_SETUP(allpass_tilde_setup),
+    CLASS_SETUP(asin_tilde_setup),
+    CLASS_SETUP(asinh_tilde_setup),
+    CLASS_SETUP(atan_tilde_setup),
+    CLASS_SETUP(atan2_tilde_setup),
+    CLASS_SETUP(atanh_tilde_setup),
+    CLASS_SETUP(atodb_tilde_setup),
+    CLASS_SETUP(average_tilde_setup),
+    CLASS_SETUP(avg_tilde_setup),
+    CLASS_SETUP(bitand_tilde_setup),
+    CLASS_SETUP(bitnot_tilde_setup),
+    CLASS_SETUP(bitor_tilde_setup),
+    CLASS_SETUP(bitsafe_tilde_setup),
+    CLASS_SETUP(bitshift_tilde_setup),
+    CLASS_SETUP(bitxor_tilde_setup),
+    CLASS_SETUP(buffir_tilde_setup),
+    CLASS_SETUP(capture_tilde_setup),
+    CLASS_SETUP(cartopol_tilde_setup),
+    CLASS_SETUP(change_tilde_setup),
+    CLASS_SETUP(click_tilde_setup),
+    CLASS_SETUP(clip_tilde_setup),
+    CLASS_SETUP(comb_tilde_setup),
+    CLASS_SETUP(comment_setup),
+    CLASS_SETUP(cosh_tilde_setup),
+    CLASS_SETUP(cosx_tilde_setup),
+    CLASS_SETUP(count_tilde_setup),
+    CLASS_SETUP(cross_tilde_setup),
+    CLASS_SETUP(curve_tilde_setup),
+    CLASS_SETUP(cycle_tilde_setup),
+    CLASS_SETUP(dbtoa_tilde_setup),
+    CLASS_SETUP(degrade_tilde_setup),
+    CLASS_SETUP(delay_tilde_setup),
+    CLASS_SETUP(delta_tilde_setup),
+    CLASS_SETUP(deltaclip_tilde_setup),
+    CLASS_SETUP(downsamp_tilde_setup),
+    CLASS_SETUP(edge_tilde_setup),
+    CLASS_SETUP(equals_tilde_setup),
+    CLASS_SETUP(frameaccum_tilde_setup),
+    CLASS_SETUP(framedelta_tilde_setup),
+    CLASS_SETUP(gate_tilde_setup),
+    CLASS_SETUP(greaterthan_tilde_setup),
+    CLASS_SETUP(greaterthaneq_tilde_setup),
+    CLASS_SETUP(index_tilde_setup),
+    CLASS_SETUP(kink_tilde_setup),
+    CLASS_SETUP(lessthan_tilde_setup),
+    CLASS_SETUP(lessthaneq_tilde_setup),
+    CLASS_SETUP(line_tilde_setup),
+    CLASS_SETUP(lookup_tilde_setup),
+    CLASS_SETUP(lores_tilde_setup),
+    CLASS_SETUP(matrix_tilde_setup),
+    CLASS_SETUP(maximum_tilde_setup),
+    CLASS_SETUP(minimum_tilde_setup),
+    CLASS_SETUP(minmax_tilde_setup),
+    CLASS_SETUP(modulo_tilde_setup),
+    CLASS_SETUP(mstosamps_tilde_setup),
+    CLASS_SETUP(notequals_tilde_setup),
+    CLASS_SETUP(onepole_tilde_setup),
+    CLASS_SETUP(overdrive_tilde_setup),
+    CLASS_SETUP(peakamp_tilde_setup),
+    CLASS_SETUP(peek_tilde_setup),
+    CLASS_SETUP(phaseshift_tilde_setup),
+    CLASS_SETUP(phasewrap_tilde_setup),
+    CLASS_SETUP(play_tilde_setup),
+    CLASS_SETUP(plusequals_tilde_setup),
+    CLASS_SETUP(poke_tilde_setup),
+    CLASS_SETUP(poltocar_tilde_setup),
+    CLASS_SETUP(pong_tilde_setup),
+    CLASS_SETUP(pow_tilde_setup),
+    CLASS_SETUP(rampsmooth_tilde_setup),
+    CLASS_SETUP(rand_tilde_setup),
+    CLASS_SETUP(rdiv_tilde_setup),
+    CLASS_SETUP(record_tilde_setup),
+    CLASS_SETUP(reson_tilde_setup),
+    CLASS_SETUP(rminus_tilde_setup),
+    CLASS_SETUP(round_tilde_setup),
+    CLASS_SETUP(sah_tilde_setup),
+    CLASS_SETUP(sampstoms_tilde_setup),
+    CLASS_SETUP(scale_tilde_setup),
+    CLASS_SETUP(scope_tilde_setup),
+    CLASS_SETUP(selector_tilde_setup),
+    CLASS_SETUP(sinh_tilde_setup),
+    CLASS_SETUP(sinx_tilde_setup),
+    CLASS_SETUP(slide_tilde_setup),
+    CLASS_SETUP(snapshot_tilde_setup),
+    CLASS_SETUP(spike_tilde_setup),
+    CLASS_SETUP(svf_tilde_setup),
+    CLASS_SETUP(tanh_tilde_setup),
+    CLASS_SETUP(tanx_tilde_setup),
+    CLASS_SETUP(teeth_tilde_setup),
+    CLASS_SETUP(thresh_tilde_setup),
+    CLASS_SETUP(train_tilde_setup),
+    CLASS_SETUP(trapezoid_tilde_setup),
+    CLASS_SETUP(triangle_tilde_setup),
+    CLASS_SETUP(vectral_tilde_setup),
+    CLASS_SETUP(wave_tilde_setup),
+    CLASS_SETUP(zerox_tilde_setup),
+};
+
+struct ExternalLibrary {
+    char const* prefix;
+    char const* externDir;
+    ClassSetup const* setups;
+    size_t numSetups;
+};
+
+static ExternalLibrary const externalLibraries[] = {
+    { "else", "9.else", elseSetups, std::size(elseSetups) },
+    { "cyclone", "10.cyclone", cycloneSetups, std::size(cycloneSetups) }
+};
+
+struct LazyClass {
+    ExternalLibrary const* library;
+    ClassSetup const* classSetup;
+    std::vector<std::string> names; // All names that the setup function adds to pd_objectmaker, including aliases
+    std::vector<size_t> conflicts;  // Other setup functions that register one of the same names
+    bool isSetUp = false;
+};
+
+static std::vector<LazyClass> lazyClasses;
+static std::unordered_map<std::string, size_t> lazyClassNames;
+
+static void runClassSetup(ExternalLibrary const& library, ClassSetup const& classSetup)
+{
+    set_class_prefix(gensym(library.prefix));
+    class_set_extern_dir(gensym(library.externDir));
+    classSetup.setup();
+    set_class_prefix(nullptr);
+    class_set_extern_dir(&s_);
+}
+
+// Called from object creation, while holding the lock of the instance that creates the object
+static void setupLazyClass(size_t index)
+{
+    // Setting up a class adds it to the class tables of every instance, so no other instance may touch them meanwhile
+    // Like when ofelia is set up, we upgrade to Pd's global lock, which waits until all other instances have released theirs
+    pd_globallock();
+
+    // Another instance might have set up this class while we were waiting for the lock
+    if (lazyClasses[index].isSetUp) {
+        pd_globalunlock();
+        return;
+    }
+
+    // When names are shared, the last setup function that registered them wins. Set up the whole group in the original order, so we get the same result as eager setup
+    auto group = lazyClasses[index].conflicts;
+    group.push_back(index);
+    std::sort(group.begin(), group.end());
+
+    // Classes have to be set up from the main instance, Pd will add them to all other instances
+    auto* currentInstance = libpd_this_instance();
+    libpd_set_instance(libpd_get_instance(0));
+
+    for (auto classIndex : group) {
+        auto& lazyClass = lazyClasses[classIndex];
+        if (lazyClass.isSetUp)
+            continue;
+
+        lazyClass.isSetUp = true;
+        runClassSetup(*lazyClass.library, *lazyClass.classSetup);
+    }
+
+    libpd_set_instance(currentInstance);
+    pd_globalunlock();
+}
+
+// Placeholder creator for classes that haven't been set up yet
+static void* lazy_class_new(t_symbol* s, int argc, t_atom* argv)
+{
+    auto it = lazyClassNames.find(s->s_name);
+    if (it == lazyClassNames.end() || lazyClasses[it->second].isSetUp)
+        return nullptr;
+
+    setupLazyClass(it->second);
+
+    // The real creator has replaced this placeholder now, so we can pass the message on
+    typedmess(&pd_objectmaker, s, argc, argv);
+    return pd_newest();
+}
+
+static std::vector<std::string> getObjectMakerNames(int startIndex)
+{
+    t_class* o = pd_objectmaker;
+    auto* methods = static_cast<t_methodentry*>(libpd_get_class_methods(o));
+
+    std::vector<std::string> names;
+    for (int i = startIndex; i < o->c_nmethod; i++) {
+        if (methods[i].me_name)
+            names.emplace_back(methods[i].me_name->s_name);
+    }
+    return names;
+}
+
+// Returns false if the registry doesn't exist, or was written by a build with different setup functions
+static bool readClassRegistry(char const* registryFile)
+{
+    std::ifstream file(registryFile);
+    if (!file)
+        return false;
+
+    std::unordered_map<std::string, std::pair<ExternalLibrary const*, ClassSetup const*>> remainingSetups;
+    for (auto& library : externalLibraries) {
+        for (size_t i = 0; i < library.numSetups; i++) {
+            remainingSetups[std::string(library.prefix) + "/" + library.setups[i].name] = { &library, &library.setups[i] };
+        }
+    }
+
+    std::vector<LazyClass> classes;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string prefix, setupName;
+        if (!(tokens >> prefix >> setupName))
+            continue;
+
+        auto setup = remainingSetups.find(prefix + "/" + setupName);
+        if (setup == remainingSetups.end())
+            return false;
+
+        LazyClass lazyClass { setup->second.first, setup->second.second };
+        std::string name;
+        while (tokens >> name) {
+            lazyClass.names.push_back(name);
+        }
+
+        classes.push_back(lazyClass);
+        remainingSetups.erase(setup);
+    }
+
+    if (!remainingSetups.empty())
+        return false;
+
+    lazyClasses = std::move(classes);
+    return true;
 }
 
-void Setup::initialiseCyclone()
+static void writeClassRegistry(char const* registryFile)
 {
-    cyclone_setup();
-    accum_setup();
-    acos_setup();
-    acosh_setup();
-    active_setup();
-    anal_setup();
-    append_setup();
-    asin_setup();
-    asinh_setup();
-    atanh_setup();
-    atodb_setup();
-    bangbang_setup();
-    bondo_setup();
-    borax_setup();
-    bucket_setup();
-    buddy_setup();
-    capture_setup();
-    cartopol_setup();
-    clip_setup();
-    coll_setup();
-    cosh_setup();
-    counter_setup();
-    cycle_setup();
-    dbtoa_setup();
-    decide_setup();
-    decode_setup();
-    drunk_setup();
-    flush_setup();
-    forward_setup();
-    fromsymbol_setup();
-    funnel_setup();
-    funbuff_setup();
-    gate_setup();
-    grab_setup();
-    histo_setup();
-    iter_setup();
-    join_setup();
-    linedrive_setup();
-    listfunnel_setup();
-    loadmess_setup();
-    match_setup();
-    maximum_setup();
-    mean_setup();
-    midiflush_setup();
-    midiformat_setup();
-    midiparse_setup();
-    minimum_setup();
-    mousefilter_setup();
-    mousestate_setup();
-    mtr_setup();
-    next_setup();
-    offer_setup();
-    onebang_setup();
-    pak_setup();
-    past_setup();
-    peak_setup();
-    poltocar_setup();
-    pong_setup();
-    prepend_setup();
-    prob_setup();
-    pv_setup();
-    rdiv_setup();
-    rminus_setup();
-    round_setup();
-    scale_setup();
-    seq_setup();
-    sinh_setup();
-    speedlim_setup();
-    spell_setup();
-    split_setup();
-    spray_setup();
-    sprintf_setup();
-    substitute_setup();
-    sustain_setup();
-    switch_setup();
-    table_setup();
-    tanh_setup();
-    thresh_setup();
-    togedge_setup();
-    tosymbol_setup();
-    trough_setup();
-    universal_setup();
-    unjoin_setup();
-    urn_setup();
-    uzi_setup();
-    xbendin_setup();
-    xbendin2_setup();
-    xbendout_setup();
-    xbendout2_setup();
-    xnotein_setup();
-    xnoteout_setup();
-    zl_setup();
-
-    acos_tilde_setup();
-    acosh_tilde_setup();
-    allpass_tilde_setup();
-    asin_tilde_setup();
-    asinh_tilde_setup();
-    atan_tilde_setup();
-    atan2_tilde_setup();
-    atanh_tilde_setup();
-    atodb_tilde_setup();
-    average_tilde_setup();
-    avg_tilde_setup();
-    bitand_tilde_setup();
-    bitnot_tilde_setup();
-    bitor_tilde_setup();
-    bitsafe_tilde_setup();
-    bitshift_tilde_setup();
-    bitxor_tilde_setup();
-    buffir_tilde_setup();
-    capture_tilde_setup();
-    cartopol_tilde_setup();
-    change_tilde_setup();
-    click_tilde_setup();
-    clip_tilde_setup();
-    comb_tilde_setup();
-    comment_setup();
-    cosh_tilde_setup();
-    cosx_tilde_setup();
-    count_tilde_setup();
-    cross_tilde_setup();
-    curve_tilde_setup();
-    cycle_tilde_setup();
-    dbtoa_tilde_setup();
-    degrade_tilde_setup();
-    delay_tilde_setup();
-    delta_tilde_setup();
-    deltaclip_tilde_setup();
-    downsamp_tilde_setup();
-    edge_tilde_setup();
-    equals_tilde_setup();
-    frameaccum_tilde_setup();
-    framedelta_tilde_setup();
-    gate_tilde_setup();
-    greaterthan_tilde_setup();
-    greaterthaneq_tilde_setup();
-    index_tilde_setup();
-    kink_tilde_setup();
-    lessthan_tilde_setup();
-    lessthaneq_tilde_setup();
-    line_tilde_setup();
-    lookup_tilde_setup();
-    lores_tilde_setup();
-    matrix_tilde_setup();
-    maximum_tilde_setup();
-    minimum_tilde_setup();
-    minmax_tilde_setup();
-    modulo_tilde_setup();
-    mstosamps_tilde_setup();
-    notequals_tilde_setup();
-    onepole_tilde_setup();
-    overdrive_tilde_setup();
-    peakamp_tilde_setup();
-    peek_tilde_setup();
-    phaseshift_tilde_setup();
-    phasewrap_tilde_setup();
-    play_tilde_setup();
-    plusequals_tilde_setup();
-    poke_tilde_setup();
-    poltocar_tilde_setup();
-    pong_tilde_setup();
-    pow_tilde_setup();
-    rampsmooth_tilde_setup();
-    rand_tilde_setup();
-    rdiv_tilde_setup();
-    record_tilde_setup();
-    reson_tilde_setup();
-    rminus_tilde_setup();
-    round_tilde_setup();
-    sah_tilde_setup();
-    sampstoms_tilde_setup();
-    scale_tilde_setup();
-    scope_tilde_setup();
-    selector_tilde_setup();
-    sinh_tilde_setup();
-    sinx_tilde_setup();
-    slide_tilde_setup();
-    snapshot_tilde_setup();
-    spike_tilde_setup();
-    svf_tilde_setup();
-    tanh_tilde_setup();
-    tanx_tilde_setup();
-    teeth_tilde_setup();
-    thresh_tilde_setup();
-    train_tilde_setup();
-    trapezoid_tilde_setup();
-    triangle_tilde_setup();
-    vectral_tilde_setup();
-    wave_tilde_setup();
-    zerox_tilde_setup();
+    std::ofstream file(registryFile);
+    for (auto& lazyClass : lazyClasses) {
+        file << lazyClass.library->prefix << " " << lazyClass.classSetup->name;
+        for (auto& name : lazyClass.names) {
+            file << " " << name;
+        }
+        file << "\n";
+    }
+}
+
+void Setup::initialiseExternalLibraries(char const* registryFile)
+{
+    if (readClassRegistry(registryFile)) {
+        for (size_t i = 0; i < lazyClasses.size(); i++) {
+            auto& lazyClass = lazyClasses[i];
+
+            // Setup functions that don't add any objects probably set up something that other classes share, so we run them straight away
+            if (lazyClass.names.empty()) {
+                lazyClass.isSetUp = true;
+                runClassSetup(*lazyClass.library, *lazyClass.classSetup);
+                continue;
+            }
+
+            for (auto& name : lazyClass.names) {
+                auto [existing, inserted] = lazyClassNames.try_emplace(name, i);
+                if (!inserted) {
+                    lazyClasses[existing->second].conflicts.push_back(i);
+                    lazyClass.conflicts.push_back(existing->second);
+                    existing->second = i;
+                }
+
+                class_addcreator(reinterpret_cast<t_newmethod>(lazy_class_new), gensym(name.c_str()), A_GIMME, 0);
+            }
+        }
+        return;
+    }
+
+    // We don't have a valid registry yet, so set everything up and record which names every setup function adds
+    lazyClasses.clear();
+
+    for (auto& library : externalLibraries) {
+        for (size_t i = 0; i < library.numSetups; i++) {
+            t_class* o = pd_objectmaker;
+            auto numMethods = o->c_nmethod;
+
+            runClassSetup(library, library.setups[i]);
+            lazyClasses.push_back({ &library, &library.setups[i], getObjectMakerNames(numMethods), {}, true });
+        }
+    }
+
+    writeClassRegistry(registryFile);
 }
 
 }
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <utility>
+
 extern "C" {
 #include <z_libpd.h>
 #include <s_stuff.h>
@@ -33,8 +35,10 @@ struct Setup {
     void parseArguments(char const** args, size_t argc, t_namelist** sys_openlist, t_namelist** sys_messagelist);
 
     static void initialisePdLua(char const* datadir, char* vers, int vers_len);
-    static void initialiseELSE();
-    static void initialiseCyclone();
+
+    // Registers the ELSE and cyclone classes. If the registry file lists the names that every setup function adds, the classes are only set up when they're first used
+    // Otherwise, everything is set up straight away, and the registry file is written for next time
+    static void initialiseExternalLibraries(char const* registryFile);
 
     static void* createMIDIHook(void* ptr,
         t_plugdata_noteonhook hook_noteon,
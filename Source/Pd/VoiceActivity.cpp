@@ -0,0 +1,574 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "Utility/Config.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+
+extern "C" {
+#include <m_pd.h>
+#include <m_imp.h>
+#include <g_canvas.h>
+
+t_glist* clone_get_instance(t_gobj*, int);
+int clone_get_n(t_gobj*);
+void canvas_dodsp(t_canvas* x, int toplevel, t_signal** sp);
+}
+
+#include "Instance.h"
+#include "Interface.h"
+
+namespace pd {
+
+using CloneDSPMethod = void (*)(t_object*, t_signal**);
+static CloneDSPMethod pdCloneDSP = nullptr;
+
+// Every instance builds its own DSP chain, but they share the clone class, so we need to find the VoiceActivity of the instance that is building
+static CriticalSection registryLock;
+static std::unordered_map<t_pdinstance*, VoiceActivity*> registry;
+
+// Nested clones are built while their parent voice is being built. Those always render their voices serially, on whatever thread the parent voice runs on
+static thread_local int buildDepth = 0;
+
+// Objects that don't touch anything but their own state and their signals while running, so voices that only contain these can run on any thread
+// Anything that sends, receives, writes to arrays, posts, schedules clocks or talks to the audio device has to stay on the audio thread
+static StringArray const threadSafeClasses {
+    "inlet~", "outlet~", "osc~", "phasor~", "cos~", "noise~", "sig~", "line~", "vline~",
+    "+~", "-~", "*~", "/~", "max~", "min~", "wrap~", "clip~", "abs~", "sqrt~", "rsqrt~", "exp~", "log~", "pow~",
+    "mtof~", "ftom~", "dbtorms~", "rmstodb~", "dbtopow~", "powtodb~",
+    "lop~", "hip~", "bp~", "vcf~", "biquad~", "rpole~", "rzero~", "rzero_rev~", "cpole~", "czero~", "czero_rev~", "slop~",
+    "samphold~", "snapshot~", "tabread~", "tabread4~", "tabosc4~", "fft~", "ifft~", "rfft~", "rifft~", "framp~"
+};
+
+struct VoiceActivity::Voice {
+    std::vector<t_int> chain;
+    std::vector<t_sample*> outputs;
+    int dollarZero = 0;
+
+    std::atomic<bool> active = true;
+    std::atomic<int64> ticks = 0;
+    std::atomic<int> blocks = 0;
+};
+
+struct VoiceActivity::Clone {
+    Clone(void* object, VoiceActivity* voiceActivity, Instance* instance)
+        : clone(object, instance)
+        , owner(voiceActivity)
+    {
+    }
+
+    WeakReference clone;
+    VoiceActivity* owner;
+
+    // Voices are kept when the chain is rebuilt, so they remember whether they are active
+    std::vector<std::unique_ptr<Voice>> voices;
+
+    // Only changed while building the DSP chain
+    std::vector<t_sample*> outputs;
+    std::vector<Voice*> activeVoices;
+    int blockSize = DEFDACBLKSIZE;
+    bool usesOwnChain = false;
+    bool canRenderInParallel = false;
+
+    // Only used on the audio thread and the render threads
+    int numActiveVoices = 0;
+    std::atomic<int> nextVoice = 0;
+    std::atomic<int> remainingVoices = 0;
+};
+
+static void runVoice(VoiceActivity::Voice& voice)
+{
+    auto const start = Time::getHighResolutionTicks();
+
+    for (auto* ip = voice.chain.data(); ip;)
+        ip = (*reinterpret_cast<t_perfroutine>(*ip))(ip);
+
+    voice.ticks.fetch_add(Time::getHighResolutionTicks() - start, std::memory_order_relaxed);
+}
+
+// Called by the audio thread and the render threads at the same time, every thread takes voices until there are none left
+static void renderVoices(VoiceActivity::Clone& clone)
+{
+    for (int index = clone.nextVoice.fetch_add(1); index < clone.numActiveVoices; index = clone.nextVoice.fetch_add(1)) {
+        runVoice(*clone.activeVoices[index]);
+        clone.remainingVoices.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// A few threads that help the audio thread render voices. They never allocate or lock while rendering
+// The audio thread takes voices too, and waits for the last one to finish before it sums them
+class VoiceActivity::RenderThreads {
+    struct RenderThread : public Thread {
+        RenderThread(RenderThreads& parent)
+            : Thread("Voice Renderer")
+            , threads(parent)
+        {
+        }
+
+        void run() override
+        {
+            libpd_set_instance(threads.instance);
+
+            bool denormalsDisabled = false;
+            FloatVectorOperations::disableDenormalisedNumberSupport(denormalsDisabled);
+
+            while (!threadShouldExit()) {
+                wakeUp.wait(-1);
+
+                threads.busyThreads.fetch_add(1);
+                if (auto* clone = threads.currentClone.load()) {
+                    // Round exactly like the audio thread does, so the output doesn't depend on which thread rendered a voice
+                    auto const shouldDisableDenormals = threads.denormalsDisabled.load(std::memory_order_relaxed);
+                    if (shouldDisableDenormals != denormalsDisabled) {
+                        FloatVectorOperations::disableDenormalisedNumberSupport(shouldDisableDenormals);
+                        denormalsDisabled = shouldDisableDenormals;
+                    }
+
+                    renderVoices(*clone);
+                }
+                threads.busyThreads.fetch_sub(1);
+            }
+        }
+
+        RenderThreads& threads;
+        WaitableEvent wakeUp;
+    };
+
+public:
+    explicit RenderThreads(t_pdinstance* pdInstance)
+        : instance(pdInstance)
+    {
+        auto const numThreads = jlimit(1, 7, SystemStats::getNumCpus() - 1);
+        for (int i = 0; i < numThreads; i++) {
+            auto& thread = threads.emplace_back(std::make_unique<RenderThread>(*this));
+            thread->startThread(Thread::Priority::highest);
+        }
+    }
+
+    ~RenderThreads()
+    {
+        for (auto& thread : threads) {
+            thread->signalThreadShouldExit();
+            thread->wakeUp.signal();
+        }
+        for (auto& thread : threads) {
+            thread->stopThread(-1);
+        }
+    }
+
+    void render(Clone& clone)
+    {
+        clone.nextVoice.store(0);
+        clone.remainingVoices.store(clone.numActiveVoices);
+        denormalsDisabled.store(FloatVectorOperations::areDenormalsDisabled(), std::memory_order_relaxed);
+        currentClone.store(&clone);
+
+        for (auto& thread : threads) {
+            thread->wakeUp.signal();
+        }
+
+        renderVoices(clone);
+
+        while (clone.remainingVoices.load(std::memory_order_acquire) > 0)
+            std::this_thread::yield();
+
+        // A thread that woke up late could still be looking at this clone, which may be freed once we return
+        currentClone.store(nullptr);
+        while (busyThreads.load() > 0)
+            std::this_thread::yield();
+    }
+
+private:
+    t_pdinstance* instance;
+    std::vector<std::unique_ptr<RenderThread>> threads;
+
+    std::atomic<Clone*> currentClone = nullptr;
+    std::atomic<int> busyThreads = 0;
+    std::atomic<bool> denormalsDisabled = false;
+};
+
+// Looks at everything a voice contains, including subpatches and the voices of nested clones
+// Voices with block~ or switch~ can't run on their own chain, because switch~ runs its part of Pd's chain by position
+static void inspectVoice(t_glist* glist, bool& canUseOwnChain, bool& isThreadSafe)
+{
+    for (t_gobj* y = glist->gl_list; y; y = y->g_next) {
+        if (pd_class(&y->g_pd) == canvas_class) {
+            inspectVoice(reinterpret_cast<t_glist*>(y), canUseOwnChain, isThreadSafe);
+            continue;
+        }
+        if (pd_class(&y->g_pd) == clone_class) {
+            for (int i = 0; i < clone_get_n(y); i++) {
+                inspectVoice(clone_get_instance(y, i), canUseOwnChain, isThreadSafe);
+            }
+            continue;
+        }
+
+        auto const* name = pd::Interface::getObjectClassName(&y->g_pd);
+        if (!strcmp(name, "block~") || !strcmp(name, "switch~"))
+            canUseOwnChain = false;
+
+        if (zgetfn(&y->g_pd, gensym("dsp")) && !threadSafeClasses.contains(name))
+            isThreadSafe = false;
+    }
+}
+
+static void findClones(t_glist* glist, std::vector<t_gobj*>& clones)
+{
+    for (t_gobj* y = glist->gl_list; y; y = y->g_next) {
+        if (pd_class(&y->g_pd) == canvas_class) {
+            findClones(reinterpret_cast<t_glist*>(y), clones);
+        } else if (pd_class(&y->g_pd) == clone_class) {
+            clones.push_back(y);
+            for (int i = 0; i < clone_get_n(y); i++) {
+                findClones(clone_get_instance(y, i), clones);
+            }
+        }
+    }
+}
+
+// Distributing inputs or outputs over the voices turns them into multichannel signals, which Pd sums differently
+static bool distributesSignals(t_object* clone)
+{
+    auto* binbuf = clone->te_binbuf;
+    auto* argv = binbuf_getvec(binbuf);
+    for (int i = 0; i < binbuf_getnatom(binbuf); i++) {
+        if (argv[i].a_type == A_SYMBOL && !strncmp(argv[i].a_w.w_symbol->s_name, "-d", 2))
+            return true;
+    }
+
+    return false;
+}
+
+// Matches the voices to the clone's current instances, must be called while holding the Pd lock
+static void updateVoices(VoiceActivity::Clone& clone)
+{
+    auto* object = clone.clone.getRawUnchecked<t_gobj>();
+    auto const numVoices = clone_get_n(object);
+
+    while (clone.voices.size() < numVoices)
+        clone.voices.push_back(std::make_unique<VoiceActivity::Voice>());
+    while (clone.voices.size() > numVoices)
+        clone.voices.pop_back();
+
+    for (int i = 0; i < numVoices; i++) {
+        clone.voices[i]->dollarZero = atoi(canvas_realizedollar(clone_get_instance(object, i), gensym("$0"))->s_name);
+    }
+
+    clone.activeVoices.resize(numVoices);
+}
+
+VoiceActivity::VoiceActivity(Instance* instance)
+    : pd(instance)
+{
+}
+
+VoiceActivity::~VoiceActivity()
+{
+    ScopedLock lock(registryLock);
+    for (auto it = registry.begin(); it != registry.end();) {
+        if (it->second == this)
+            it = registry.erase(it);
+        else
+            ++it;
+    }
+}
+
+void VoiceActivity::setup()
+{
+    pdCloneDSP = reinterpret_cast<CloneDSPMethod>(zgetfn(&clone_class, gensym("dsp")));
+    if (pdCloneDSP)
+        class_addmethod(clone_class, reinterpret_cast<t_method>(buildDSP), gensym("dsp"), A_CANT, 0);
+}
+
+void VoiceActivity::initialise()
+{
+    ScopedLock lock(registryLock);
+    registry[static_cast<t_pdinstance*>(pd->instance)] = this;
+}
+
+VoiceActivity::Clone* VoiceActivity::getClone(void* clone, bool create)
+{
+    if (auto it = clones.find(clone); it != clones.end() && it->second->clone.isValid())
+        return it->second.get();
+
+    if (!create)
+        return nullptr;
+
+    // Forget about clones that were deleted, Pd has already taken them out of the DSP chain
+    for (auto it = clones.begin(); it != clones.end();) {
+        if (!it->second->clone.isValid())
+            it = clones.erase(it);
+        else
+            ++it;
+    }
+
+    auto& result = clones[clone];
+    result = std::make_unique<Clone>(clone, this, pd);
+    updateVoices(*result);
+    return result.get();
+}
+
+void VoiceActivity::buildDSP(t_object* x, t_signal** sp)
+{
+    VoiceActivity* voiceActivity = nullptr;
+    {
+        ScopedLock lock(registryLock);
+        if (auto it = registry.find(libpd_this_instance()); it != registry.end())
+            voiceActivity = it->second;
+    }
+
+    auto const numInputs = obj_nsiginlets(x);
+    auto const numOutputs = obj_nsigoutlets(x);
+
+    bool canUseOwnChain = voiceActivity && numOutputs > 0 && clone_get_n(&x->te_g) > 0 && !distributesSignals(x);
+    for (int i = 0; i < numInputs; i++) {
+        canUseOwnChain = canUseOwnChain && sp[i]->s_nchans == 1;
+    }
+
+    bool isThreadSafe = true;
+    for (int i = 0; canUseOwnChain && i < clone_get_n(&x->te_g); i++) {
+        inspectVoice(clone_get_instance(&x->te_g, i), canUseOwnChain, isThreadSafe);
+    }
+
+    Clone* clone = nullptr;
+    if (voiceActivity) {
+        ScopedLock lock(voiceActivity->cloneLock);
+        clone = voiceActivity->getClone(x, true);
+        updateVoices(*clone);
+        clone->usesOwnChain = false;
+        clone->canRenderInParallel = isThreadSafe && buildDepth == 0;
+    }
+
+    if (canUseOwnChain) {
+        buildDepth++;
+        voiceActivity->buildVoices(*clone, sp);
+        buildDepth--;
+    }
+
+    if (!clone || !clone->usesOwnChain) {
+        pdCloneDSP(x, sp);
+        return;
+    }
+
+    dsp_add(perform, 2, clone, x);
+}
+
+void VoiceActivity::buildVoices(Clone& clone, t_signal** sp)
+{
+    auto* object = clone.clone.getRawUnchecked<t_object>();
+    auto* ugen = libpd_this_instance()->pd_ugen;
+
+    auto const numInputs = obj_nsiginlets(object);
+    auto const numOutputs = obj_nsigoutlets(object);
+    auto const numVoices = static_cast<int>(clone.voices.size());
+    auto const sampleRate = sp[0]->s_sr;
+    auto const numFreeLists = static_cast<int>(std::size(ugen->u_freelist));
+
+    // Voices only read the clone's inputs. An extra reference for every voice makes sure none of them hands an input back to Pd while other voices still read it
+    for (int i = 0; i < numInputs; i++) {
+        sp[i]->s_refcount += numVoices;
+    }
+
+    // Buffers that Pd can reuse now could still be in use by other parts of the chain, and buffers that one voice is done with could be in use by another voice when they run in parallel
+    // So every voice starts with empty lists of reusable signals, and the buffers each voice releases are only handed back to Pd after the last voice is built
+    std::vector<t_signal*> pdFreeLists(ugen->u_freelist, ugen->u_freelist + numFreeLists);
+    std::vector<std::pair<int, t_signal*>> releasedSignals;
+    std::fill_n(ugen->u_freelist, numFreeLists, nullptr);
+
+    bool singleChannelOutputs = true;
+    std::vector<t_signal*> signals(numInputs + numOutputs);
+
+    for (int voiceIndex = 0; voiceIndex < numVoices; voiceIndex++) {
+        auto& voice = *clone.voices[voiceIndex];
+
+        std::copy_n(sp, numInputs, signals.begin());
+        for (int i = 0; i < numOutputs; i++) {
+            signals[numInputs + i] = signal_new(0, 1, sampleRate, nullptr);
+        }
+
+        auto const start = ugen->u_dspchainsize;
+        canvas_dodsp(clone_get_instance(&object->te_g, voiceIndex), 0, signals.data());
+        auto const end = ugen->u_dspchainsize;
+
+        // dsp_add() writes over the routine that ends the chain and adds it again at the end, so the voice starts where that routine was
+        // We move the voice, including that last routine, to a chain of its own, and end Pd's chain where it ended before
+        voice.chain.assign(ugen->u_dspchain + start - 1, ugen->u_dspchain + end);
+        ugen->u_dspchain[start - 1] = ugen->u_dspchain[end - 1];
+        ugen->u_dspchainsize = start;
+
+        // The outlet~ objects of the voice lend their buffers to our placeholders. We never release those, so nothing else can write into them
+        voice.outputs.resize(numOutputs);
+        for (int i = 0; i < numOutputs; i++) {
+            auto* output = signals[numInputs + i];
+            singleChannelOutputs = singleChannelOutputs && output->s_vec && output->s_nchans == 1 && output->s_n == signals[numInputs]->s_n;
+            voice.outputs[i] = output->s_vec;
+        }
+
+        for (int i = 0; i < numFreeLists; i++) {
+            for (auto* signal = ugen->u_freelist[i]; signal; signal = signal->s_nextfree) {
+                releasedSignals.emplace_back(i, signal);
+            }
+            ugen->u_freelist[i] = nullptr;
+        }
+    }
+
+    std::copy(pdFreeLists.begin(), pdFreeLists.end(), ugen->u_freelist);
+    for (auto [list, signal] : releasedSignals) {
+        signal->s_nextfree = ugen->u_freelist[list];
+        ugen->u_freelist[list] = signal;
+    }
+
+    for (int i = 0; i < numInputs; i++) {
+        sp[i]->s_refcount -= numVoices;
+    }
+
+    // Voices with multichannel outlets are summed into multichannel outputs, we leave those to Pd
+    // The voices we built are no longer in Pd's chain, so Pd can simply build them again
+    if (!singleChannelOutputs) {
+        for (auto& voice : clone.voices) {
+            voice->chain.clear();
+        }
+        return;
+    }
+
+    clone.outputs.resize(numOutputs);
+    for (int i = 0; i < numOutputs; i++) {
+        signal_setmultiout(&sp[numInputs + i], 1);
+        clone.outputs[i] = sp[numInputs + i]->s_vec;
+    }
+
+    clone.blockSize = sp[numInputs]->s_n;
+    clone.usesOwnChain = true;
+}
+
+t_int* VoiceActivity::perform(t_int* w)
+{
+    auto* clone = reinterpret_cast<Clone*>(w[1]);
+    clone->owner->render(*clone);
+    return w + 3;
+}
+
+void VoiceActivity::render(Clone& clone)
+{
+    clone.numActiveVoices = 0;
+    for (auto& voice : clone.voices) {
+        voice->blocks.fetch_add(1, std::memory_order_relaxed);
+        if (voice->active.load(std::memory_order_relaxed))
+            clone.activeVoices[clone.numActiveVoices++] = voice.get();
+    }
+
+    if (clone.canRenderInParallel && clone.numActiveVoices > 1 && parallelRendering.load(std::memory_order_relaxed) && renderThreads) {
+        renderThreads->render(clone);
+    } else {
+        for (int i = 0; i < clone.numActiveVoices; i++) {
+            runVoice(*clone.activeVoices[i]);
+        }
+    }
+
+    // The same operations in the same order as Pd's clone: the first voice is copied to the output, the others are added one by one
+    // A voice that is skipped would have added silence, which doesn't change the result
+    auto const blockSize = clone.blockSize;
+    for (int i = 0; i < clone.outputs.size(); i++) {
+        auto* output = clone.outputs[i];
+        if (!clone.numActiveVoices) {
+            std::fill_n(output, blockSize, 0.0f);
+            continue;
+        }
+
+        std::copy_n(clone.activeVoices[0]->outputs[i], blockSize, output);
+        for (int voice = 1; voice < clone.numActiveVoices; voice++) {
+            auto const* input = clone.activeVoices[voice]->outputs[i];
+            for (int n = 0; n < blockSize; n++) {
+                output[n] += input[n];
+            }
+        }
+    }
+}
+
+void VoiceActivity::receiveActivity(VoiceActivity* voiceActivity, char const* recv, int argc, t_atom* argv)
+{
+    if (argc < 2 || argv[0].a_type != A_FLOAT || argv[1].a_type != A_FLOAT)
+        return;
+
+    auto const dollarZero = static_cast<int>(atom_getfloat(argv));
+    auto const active = atom_getfloat(argv + 1) != 0.0f;
+
+    auto setActive = [voiceActivity, dollarZero, active]() {
+        for (auto& [object, clone] : voiceActivity->clones) {
+            for (auto& voice : clone->voices) {
+                if (voice->dollarZero == dollarZero) {
+                    voice->active = active;
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+
+    ScopedLock lock(voiceActivity->cloneLock);
+    if (setActive())
+        return;
+
+    // Voices usually report their state from a loadbang, before DSP is running. Receivers are only called on Pd's thread, so we can look at the patch
+    std::vector<t_gobj*> clones;
+    for (auto* cnv = pd_getcanvaslist(); cnv; cnv = cnv->gl_next) {
+        findClones(cnv, clones);
+    }
+    for (auto* clone : clones) {
+        updateVoices(*voiceActivity->getClone(clone, true));
+    }
+
+    setActive();
+}
+
+void VoiceActivity::setVoiceActive(void* clone, int voice, bool active)
+{
+    pd->lockAudioThread();
+    {
+        ScopedLock lock(cloneLock);
+        if (auto* record = getClone(clone, true); isPositiveAndBelow(voice, record->voices.size()))
+            record->voices[voice]->active = active;
+    }
+    pd->unlockAudioThread();
+}
+
+bool VoiceActivity::isVoiceActive(void* clone, int voice) const
+{
+    ScopedLock lock(cloneLock);
+    auto it = clones.find(clone);
+    if (it == clones.end() || !isPositiveAndBelow(voice, it->second->voices.size()))
+        return true;
+
+    return it->second->voices[voice]->active.load();
+}
+
+bool VoiceActivity::getVoiceTicks(void* clone, int voice, int64& ticksPerBlock)
+{
+    ScopedLock lock(cloneLock);
+    auto it = clones.find(clone);
+    if (it == clones.end() || !it->second->usesOwnChain || !isPositiveAndBelow(voice, it->second->voices.size()))
+        return false;
+
+    auto& record = *it->second->voices[voice];
+    auto const ticks = record.ticks.exchange(0);
+    auto const blocks = record.blocks.exchange(0);
+    ticksPerBlock = blocks > 0 ? ticks / blocks : 0;
+    return true;
+}
+
+void VoiceActivity::setParallelRendering(bool shouldRenderInParallel)
+{
+    if (shouldRenderInParallel && !renderThreads) {
+        auto threads = std::make_unique<RenderThreads>(static_cast<t_pdinstance*>(pd->instance));
+
+        pd->lockAudioThread();
+        renderThreads = std::move(threads);
+        pd->unlockAudioThread();
+    }
+
+    parallelRendering = shouldRenderInParallel;
+}
+
+}
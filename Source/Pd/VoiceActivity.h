@@ -0,0 +1,71 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+#include <map>
+
+namespace pd {
+
+class Instance;
+
+// Builds the DSP chain of [clone] objects ourselves, so every voice gets a private chain and private signal buffers
+// That lets us skip voices that aren't playing, and optionally render the voices of a clone on multiple threads
+// Voices are summed in order, exactly like Pd does it, so neither of those changes the output of the clone
+// Clones with voices that we can't safely take out of Pd's chain (block~, switch~, multichannel signals, -di or -do) are left to Pd
+//
+// A voice marks itself inactive by sending "list <$0 of the voice> 0" to "plugdata-voice-activity", and active again with 1
+// Voices can also be skipped from the profiler panel
+class VoiceActivity {
+public:
+    static constexpr char const* receiverName = "plugdata-voice-activity";
+
+    explicit VoiceActivity(Instance* instance);
+
+    ~VoiceActivity();
+
+    // Installs our dsp method for clone. Called once while setting up Pd, before any instance can build a DSP chain
+    static void setup();
+
+    // Lets buildDSP find us while this instance builds its DSP chain, once the Pd instance exists
+    void initialise();
+
+    // List hook for the receiver that the instance binds to receiverName
+    static void receiveActivity(VoiceActivity* voiceActivity, char const* recv, int argc, t_atom* argv);
+
+    // Thread-safe. Takes effect on the next block, without rebuilding the DSP chain
+    void setVoiceActive(void* clone, int voice, bool active);
+    bool isVoiceActive(void* clone, int voice) const;
+
+    // Average time a voice took per block since the last call, in high resolution ticks
+    // Returns false if the voice doesn't run on a chain of its own, in which case its objects are in the main chain
+    bool getVoiceTicks(void* clone, int voice, int64& ticksPerBlock);
+
+    // Off by default. Only clones that contain nothing but objects that keep to themselves are rendered in parallel
+    void setParallelRendering(bool shouldRenderInParallel);
+
+    struct Voice;
+    struct Clone;
+    class RenderThreads;
+
+private:
+    Clone* getClone(void* clone, bool create);
+
+    static void buildDSP(t_object* clone, t_signal** sp);
+    void buildVoices(Clone& clone, t_signal** sp);
+    void render(Clone& clone);
+
+    static t_int* perform(t_int* w);
+
+    Instance* pd;
+
+    CriticalSection cloneLock;
+    std::map<void*, std::unique_ptr<Clone>> clones;
+
+    std::unique_ptr<RenderThreads> renderThreads;
+    std::atomic<bool> parallelRendering = false;
+};
+
+}
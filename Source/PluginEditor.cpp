@@ -1754,7 +1754,7 @@ bool PluginEditor::highlightSearchTarget(void* target, bool openNewTabIfNeeded)
         return nullptr;
     };
     
-    ScopedLock audioLock(pd->audioLock);
+    pd::AudioLock::ScopedLock audioLock(pd->audioLock);
 
     t_glist* targetCanvas = nullptr;
     for (auto* glist = pd_getcanvaslist(); glist; glist = glist->gl_next) {
@@ -4,7 +4,9 @@
  // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
  */
 #include <clocale>
+#include <future>
 #include <memory>
+#include <set>
 
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <juce_audio_basics/juce_audio_basics.h>
@@ -17,8 +19,9 @@
 #include "Utility/Fonts.h"
 #include "Utility/SettingsFile.h"
 #include "Utility/PluginParameter.h"
+#include "Utility/SessionState.h"
 #include "Utility/OSUtils.h"
-#include "Utility/AudioSampleRingBuffer.h"
+#include "Utility/AudioLevelRingBuffer.h"
 #include "Utility/MidiDeviceManager.h"
 #include "Dialogs/ConnectionMessageDisplay.h"
 
@@ -33,6 +36,10 @@
 
 #include "Dialogs/Dialogs.h"
 #include "Sidebar/Sidebar.h"
+#include "Heavy/SubpatchCompiler.h"
+#include "Utility/Autosave.h"
+
+#include <FluidLite/include/fluidlite.h>
 
 extern "C" {
 #include "../Libraries/cyclone/shared/common/file.h"
@@ -149,9 +156,12 @@ PluginProcessor::PluginProcessor()
     initialisePd(pdlua_version);
     logMessage(pdlua_version);
 
+    voiceActivity.setParallelRendering(settingsFile->getProperty<bool>("parallel_voices"));
+
     updateSearchPaths();
 
     objectLibrary = std::make_unique<pd::Library>(this);
+    subpatchCompiler = std::make_unique<SubpatchCompiler>(this);
 
     setLatencySamples(pd::Instance::getBlockSize());
 }
@@ -162,6 +172,99 @@ PluginProcessor::~PluginProcessor()
     patches.clear();
 }
 
+// The filesystem zip is split into multiple BinaryData chunks, because the compiler runs out of memory on very large files
+// This reads them as one continuous stream, without copying them together first
+class FilesystemZipSource : public InputSource {
+    struct Stream : public InputStream {
+        explicit Stream(std::vector<std::pair<char const*, int64>> const& chunksToRead)
+            : chunks(chunksToRead)
+        {
+            for (auto& [data, size] : chunks)
+                totalLength += size;
+        }
+
+        int64 getTotalLength() override
+        {
+            return totalLength;
+        }
+
+        bool isExhausted() override
+        {
+            return position >= totalLength;
+        }
+
+        int64 getPosition() override
+        {
+            return position;
+        }
+
+        bool setPosition(int64 newPosition) override
+        {
+            position = jlimit<int64>(0, totalLength, newPosition);
+            return true;
+        }
+
+        int read(void* destBuffer, int maxBytesToRead) override
+        {
+            auto* dest = static_cast<char*>(destBuffer);
+            int numRead = 0;
+            int64 chunkStart = 0;
+
+            for (auto& [data, size] : chunks) {
+                if (numRead >= maxBytesToRead)
+                    break;
+
+                if (position < chunkStart + size) {
+                    auto offset = position - chunkStart;
+                    auto numToCopy = static_cast<int>(std::min<int64>(size - offset, maxBytesToRead - numRead));
+                    memcpy(dest + numRead, data + offset, numToCopy);
+                    numRead += numToCopy;
+                    position += numToCopy;
+                }
+
+                chunkStart += size;
+            }
+
+            return numRead;
+        }
+
+        std::vector<std::pair<char const*, int64>> const& chunks;
+        int64 totalLength = 0;
+        int64 position = 0;
+    };
+
+public:
+    FilesystemZipSource()
+    {
+        for (int i = 0;; i++) {
+            int size;
+            auto* resource = BinaryData::getNamedResource((String("Filesystem_") + String(i) + "_zip").toRawUTF8(), size);
+            if (!resource)
+                break;
+
+            chunks.emplace_back(resource, size);
+        }
+    }
+
+    InputStream* createInputStream() override
+    {
+        return new Stream(chunks);
+    }
+
+    InputStream* createInputStreamFor(String const&) override
+    {
+        return nullptr;
+    }
+
+    int64 hashCode() const override
+    {
+        return chunks.empty() ? 0 : reinterpret_cast<pointer_sized_int>(chunks.front().first);
+    }
+
+private:
+    std::vector<std::pair<char const*, int64>> chunks;
+};
+
 void PluginProcessor::initialiseFilesystem()
 {
     auto const& homeDir = ProjectInfo::appDataDir;
@@ -172,28 +275,29 @@ void PluginProcessor::initialiseFilesystem()
     // Check if the abstractions directory exists, if not, unzip it from binaryData
     if (!homeDir.exists() || !versionDataDir.exists()) {
 
-        // Binary data shouldn't be too big, then the compiler will run out of memory
-        // To prevent this, we split the binarydata into multiple files, and add them back together here
-        std::vector<char> allData;
-        int i = 0;
-        while (true) {
-            int size;
-            auto* resource = BinaryData::getNamedResource((String("Filesystem_") + String(i) + "_zip").toRawUTF8(), size);
+        homeDir.createDirectory();
 
-            if (!resource) {
-                break;
-            }
+        // Every entry reads from its own stream over the BinaryData chunks, so we can decompress them in parallel
+        auto zip = ZipFile(new FilesystemZipSource());
+        auto numThreads = std::max(SystemStats::getNumCpus(), 1);
 
-            allData.insert(allData.end(), resource, resource + size);
-            i++;
+        // Create the directory tree up front, so the threads won't race to create the same directories
+        for (int i = 0; i < zip.getNumEntries(); i++) {
+            homeDir.getChildFile(zip.getEntry(i)->filename).getParentDirectory().createDirectory();
         }
 
-        MemoryInputStream memstream(allData.data(), allData.size(), false);
-
-        homeDir.createDirectory();
+        std::vector<std::future<void>> jobs;
+        for (int thread = 0; thread < numThreads; thread++) {
+            jobs.push_back(std::async(std::launch::async, [&zip, &homeDir, thread, numThreads]() {
+                for (int i = thread; i < zip.getNumEntries(); i += numThreads) {
+                    zip.uncompressEntry(i, homeDir);
+                }
+            }));
+        }
 
-        auto file = ZipFile(memstream);
-        file.uncompressTo(homeDir);
+        for (auto& job : jobs) {
+            job.wait();
+        }
 
         // Create filesystem for this specific version
         versionDataDir.getParentDirectory().createDirectory();
@@ -210,43 +314,71 @@ void PluginProcessor::initialiseFilesystem()
     auto testTonePatch = homeDir.getChildFile("testtone.pd");
     auto cpuTestPatch = homeDir.getChildFile("load-meter.pd");
 
-    if (testTonePatch.exists())
+    // Only copy the test patches if they changed, since this happens on every launch
+    auto testToneSource = versionDataDir.getChildFile("./Documentation/7.stuff/tools/testtone.pd");
+    auto cpuTestSource = versionDataDir.getChildFile("./Documentation/7.stuff/tools/load-meter.pd");
+
+    if (!testTonePatch.hasIdenticalContentTo(testToneSource)) {
         testTonePatch.deleteFile();
-    if (cpuTestPatch.exists())
+        testToneSource.copyFileTo(testTonePatch);
+    }
+    if (!cpuTestPatch.hasIdenticalContentTo(cpuTestSource)) {
         cpuTestPatch.deleteFile();
-
-    File(versionDataDir.getChildFile("./Documentation/7.stuff/tools/testtone.pd")).copyFileTo(testTonePatch);
-    File(versionDataDir.getChildFile("./Documentation/7.stuff/tools/load-meter.pd")).copyFileTo(cpuTestPatch);
+        cpuTestSource.copyFileTo(cpuTestPatch);
+    }
 
     // We want to recreate these symlinks so that they link to the abstractions/docs for the current plugdata version
-    homeDir.getChildFile("Abstractions").deleteFile();
-    homeDir.getChildFile("Documentation").deleteFile();
-    homeDir.getChildFile("Extra").deleteFile();
+    // This is only needed if a different version of plugdata was used last
+    auto linksAreUpToDate = false;
+#if !JUCE_WINDOWS && !JUCE_IOS
+    linksAreUpToDate = true;
+    for (auto name : { "Abstractions", "Documentation", "Extra" }) {
+        auto link = homeDir.getChildFile(name);
+        linksAreUpToDate = linksAreUpToDate && link.isSymbolicLink() && link.getLinkedTarget() == versionDataDir.getChildFile(name);
+    }
+#endif
+
+    if (!linksAreUpToDate) {
+        homeDir.getChildFile("Abstractions").deleteFile();
+        homeDir.getChildFile("Documentation").deleteFile();
+        homeDir.getChildFile("Extra").deleteFile();
 
-    // We always want to update the symlinks in case an older version of plugdata was used
 #if JUCE_WINDOWS
-    // Get paths that need symlinks
-    auto abstractionsPath = versionDataDir.getChildFile("Abstractions").getFullPathName().replaceCharacters("/", "\\");
-    auto documentationPath = versionDataDir.getChildFile("Documentation").getFullPathName().replaceCharacters("/", "\\");
-    auto extraPath = versionDataDir.getChildFile("Extra").getFullPathName().replaceCharacters("/", "\\");
-    auto dekenPath = deken.getFullPathName();
-    auto patchesPath = patches.getFullPathName();
-
-    // Create NTFS directory junctions
-    OSUtils::createJunction(homeDir.getChildFile("Abstractions").getFullPathName().replaceCharacters("/", "\\").toStdString(), abstractionsPath.toStdString());
-    OSUtils::createJunction(homeDir.getChildFile("Documentation").getFullPathName().replaceCharacters("/", "\\").toStdString(), documentationPath.toStdString());
-    OSUtils::createJunction(homeDir.getChildFile("Extra").getFullPathName().replaceCharacters("/", "\\").toStdString(), extraPath.toStdString());
+        // Get paths that need symlinks
+        auto abstractionsPath = versionDataDir.getChildFile("Abstractions").getFullPathName().replaceCharacters("/", "\\");
+        auto documentationPath = versionDataDir.getChildFile("Documentation").getFullPathName().replaceCharacters("/", "\\");
+        auto extraPath = versionDataDir.getChildFile("Extra").getFullPathName().replaceCharacters("/", "\\");
+        auto dekenPath = deken.getFullPathName();
+        auto patchesPath = patches.getFullPathName();
+
+        // Create NTFS directory junctions
+        OSUtils::createJunction(homeDir.getChildFile("Abstractions").getFullPathName().replaceCharacters("/", "\\").toStdString(), abstractionsPath.toStdString());
+        OSUtils::createJunction(homeDir.getChildFile("Documentation").getFullPathName().replaceCharacters("/", "\\").toStdString(), documentationPath.toStdString());
+        OSUtils::createJunction(homeDir.getChildFile("Extra").getFullPathName().replaceCharacters("/", "\\").toStdString(), extraPath.toStdString());
 
 #elif JUCE_IOS
-    // This is not ideal but on iOS, it seems to be the only way to make it work...
-    versionDataDir.getChildFile("Abstractions").copyDirectoryTo(homeDir.getChildFile("Abstractions"));
-    versionDataDir.getChildFile("Documentation").copyDirectoryTo(homeDir.getChildFile("Documentation"));
-    versionDataDir.getChildFile("Extra").copyDirectoryTo(homeDir.getChildFile("Extra"));
+        // This is not ideal but on iOS, it seems to be the only way to make it work...
+        versionDataDir.getChildFile("Abstractions").copyDirectoryTo(homeDir.getChildFile("Abstractions"));
+        versionDataDir.getChildFile("Documentation").copyDirectoryTo(homeDir.getChildFile("Documentation"));
+        versionDataDir.getChildFile("Extra").copyDirectoryTo(homeDir.getChildFile("Extra"));
 #else
-    versionDataDir.getChildFile("Abstractions").createSymbolicLink(homeDir.getChildFile("Abstractions"), true);
-    versionDataDir.getChildFile("Documentation").createSymbolicLink(homeDir.getChildFile("Documentation"), true);
-    versionDataDir.getChildFile("Extra").createSymbolicLink(homeDir.getChildFile("Extra"), true);
+        versionDataDir.getChildFile("Abstractions").createSymbolicLink(homeDir.getChildFile("Abstractions"), true);
+        versionDataDir.getChildFile("Documentation").createSymbolicLink(homeDir.getChildFile("Documentation"), true);
+        versionDataDir.getChildFile("Extra").createSymbolicLink(homeDir.getChildFile("Extra"), true);
 #endif
+    }
+
+    // Decoded SF3 samples are cached here, so soundfonts load much faster the second time
+    // Shared by all instances and by sfont~, so we only set it up once
+    static bool const soundfontCacheIsSet = [&homeDir]() {
+        auto soundfontCache = homeDir.getChildFile("Cache").getChildFile("Soundfonts");
+        if (!soundfontCache.createDirectory())
+            return false;
+
+        fluid_synth_set_sample_cache_dir(soundfontCache.getFullPathName().toRawUTF8());
+        return true;
+    }();
+    ignoreUnused(soundfontCacheIsSet);
 
     internalSynth->extractSoundfont();
 }
@@ -439,7 +571,7 @@ void PluginProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     statusbarSource->setBufferSize(samplesPerBlock);
     statusbarSource->prepareToPlay(getTotalNumOutputChannels());
 
-    limiter.prepare({ sampleRate, static_cast<uint32>(samplesPerBlock), std::max(1u, static_cast<uint32>(maxChannels)) });
+    outputStage.prepare(sampleRate, samplesPerBlock, maxChannels);
 
     smoothedGain.reset(AudioProcessor::getSampleRate(), 0.02);
 }
@@ -506,15 +638,30 @@ void PluginProcessor::settingsFileReloaded()
     objectLibrary->updateLibrary();
 }
 
+void PluginProcessor::propertyChanged(String const& name, var const& value)
+{
+    if (name == "parallel_voices") {
+        voiceActivity.setParallelRendering(static_cast<bool>(value));
+    }
+}
+
 
 void PluginProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
     ScopedNoDenormals noDenormals;
     AudioProcessLoadMeasurer::ScopedTimer cpuTimer(cpuLoadMeasurer, buffer.getNumSamples());
 
+    // Output silence while the DAW is restoring our state, the patches are only partially loaded
+    if (restoringState) {
+        buffer.clear();
+        midiMessages.clear();
+        return;
+    }
+
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
+    audioLock.setAudioThread();
     setThis();
     sendPlayhead();
     sendParameters();
@@ -572,11 +719,14 @@ void PluginProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiM
 
     // apply smoothing to the main volume control
     smoothedGain.setTargetValue(mappedTargetGain);
-    smoothedGain.applyGain(buffer, buffer.getNumSamples());
 
     statusbarSource->process(hasMidiInEvents, hasMidiOutEvents, totalNumOutputChannels);
     statusbarSource->setCPUUsage(cpuLoadMeasurer.getLoadAsPercentage());
-    statusbarSource->peakBuffer.write(buffer);
+
+    // Volume, metering, and in protected mode, taking out inf and NaN values and limiting, all in one pass over the buffer
+    // This only applies to the output of Pd, the internal synth is mixed in afterwards
+    outputStage.process(buffer, smoothedGain, protectedMode);
+    statusbarSource->peakBuffer.write(outputStage.getPeaks(), outputStage.getRMS(), buffer.getNumChannels());
 
     if (ProjectInfo::isStandalone) {
         for (auto bufferIterator : midiMessages) {
@@ -594,31 +744,16 @@ void PluginProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiM
         }
 
         // If the internalSynth is enabled and loaded, let it process the midi
+        // None of these block or allocate: the synth gets created and deleted on its own thread
         if (enableInternalSynth && internalSynth->isReady()) {
             internalSynth->process(buffer, midiBufferInternalSynth);
         } else if (!enableInternalSynth && internalSynth->isReady()) {
             internalSynth->unprepare();
         } else if (enableInternalSynth && !internalSynth->isReady()) {
-            internalSynth->prepare(getSampleRate(), AudioProcessor::getBlockSize(), std::max(totalNumInputChannels, totalNumOutputChannels));
+            internalSynth->prepare(getSampleRate(), std::max(AudioProcessor::getBlockSize(), buffer.getNumSamples()), std::max(totalNumInputChannels, totalNumOutputChannels));
         }
         midiBufferInternalSynth.clear();
     }
-
-    if (protectedMode && buffer.getNumChannels() > 0) {
-
-        // Take out inf and NaN values
-        auto* const* writePtr = buffer.getArrayOfWritePointers();
-        for (int ch = 0; ch < buffer.getNumChannels(); ch++) {
-            for (int n = 0; n < buffer.getNumSamples(); n++) {
-                if (!std::isfinite(writePtr[ch][n])) {
-                    writePtr[ch][n] = 0.0f;
-                }
-            }
-        }
-
-        auto block = dsp::AudioBlock<float>(buffer);
-        limiter.process(block);
-    }
 }
 
 
@@ -940,49 +1075,20 @@ void PluginProcessor::getStateInformation(MemoryBlock& destData)
 
     savePatchTabPositions();
 
-    // Store pure-data and parameter state
-    MemoryOutputStream ostream(destData, false);
-
-    ostream.writeInt(patches.size());
+    // Hosts call this on every autosave, so we only hold the audio lock long enough to copy the patch contents
+    // Hashing, deduplicating and compressing happens on the copy
+    std::vector<SessionState::Patch> sessionPatches;
 
-    // Save path and content for patch
     lockAudioThread();
-
-    auto presetDir = ProjectInfo::appDataDir.getChildFile("Extra").getChildFile("Presets");
-
-    auto patchesTree = new XmlElement("Patches");
-
     for (auto const& patch : patches) {
-
-        auto content = patch->getCanvasContent();
-        auto patchFile = patch->getCurrentFile().getFullPathName();
-
-        // Write legacy format
-        ostream.writeString(content);
-        ostream.writeString(patchFile);
-
-        auto* patchTree = new XmlElement("Patch");
-        // Write new format
-        patchTree->setAttribute("Content", content);
-        patchTree->setAttribute("Location", patchFile);
-        patchTree->setAttribute("PluginMode", patch->openInPluginMode);
-        patchTree->setAttribute("SplitIndex", patch->splitViewIndex);
-
-        patchesTree->addChildElement(patchTree);
+        sessionPatches.push_back({ patch->getCanvasContent(), patch->getCurrentFile().getFullPathName(), patch->openInPluginMode, patch->splitViewIndex });
     }
     unlockAudioThread();
 
-    ostream.writeInt(getLatencySamples());
-    ostream.writeInt(oversampling);
-    ostream.writeFloat(getValue<float>(tailLength));
-
     auto xml = XmlElement("plugdata_save");
     xml.setAttribute("Version", PLUGDATA_VERSION);
-
-    // In the future, we're gonna load everything from xml, to make it easier to add new properties
-    // By putting this here, we can prepare for making this change without breaking existing DAW saves
     xml.setAttribute("Oversampling", oversampling);
-    xml.setAttribute("Latency", getLatencySamples());
+    xml.setAttribute("Latency", getLatencySamples() - subpatchLatency);
     xml.setAttribute("TailLength", getValue<float>(tailLength));
     xml.setAttribute("Legacy", false);
 
@@ -995,8 +1101,6 @@ void PluginProcessor::getStateInformation(MemoryBlock& destData)
         xml.setAttribute("Height", lastUIHeight);
     }
 
-    xml.addChildElement(patchesTree);
-
     PlugDataParameter::saveStateInformation(xml, getParameters());
 
     // store additional extra-data in DAW session if they exist.
@@ -1008,11 +1112,8 @@ void PluginProcessor::getStateInformation(MemoryBlock& destData)
         }
     }
 
-    MemoryBlock xmlBlock;
-    copyXmlToBinary(xml, xmlBlock);
-
-    ostream.writeInt(static_cast<int>(xmlBlock.getSize()));
-    ostream.write(xmlBlock.getData(), xmlBlock.getSize());
+    MemoryOutputStream ostream(destData, false);
+    SessionState::write(ostream, xml, sessionPatches);
 
     // then detach extraData XmlElement from temporary tree xml for later re-use
     if (extraDataStored) {
@@ -1020,16 +1121,39 @@ void PluginProcessor::getStateInformation(MemoryBlock& destData)
     }
 }
 
+// Reads the abstractions that a patch uses from its own directory, so that Pd will find them in the OS file cache when it instantiates the patch
+// Called from a worker thread while restoring state, so it may not touch Pd
+static void prefetchAbstractions(String const& content, File const& directory, std::set<String>& visited, int depth = 0)
+{
+    if (!directory.isDirectory() || depth > 8)
+        return;
+
+    for (auto const& line : StringArray::fromTokens(content, ";", "")) {
+        auto tokens = StringArray::fromTokens(line.trim(), true);
+        if (tokens.size() < 5 || tokens[0] != "#X" || tokens[1] != "obj")
+            continue;
+
+        auto abstraction = directory.getChildFile(tokens[4] + ".pd");
+        if (visited.count(abstraction.getFullPathName()) || !abstraction.existsAsFile())
+            continue;
+
+        visited.insert(abstraction.getFullPathName());
+        prefetchAbstractions(abstraction.loadFileAsString(), abstraction.getParentDirectory(), visited, depth + 1);
+    }
+}
+
 void PluginProcessor::setStateInformation(void const* data, int sizeInBytes)
 {
     if (sizeInBytes == 0)
         return;
 
-    // By calling this asynchronously on the message thread and also suspending processing on the audio thread, we can make sure this is safe
-    // The DAW can call this function from basically any thread, hence the need for this
-    // Audio will only be reactivated once this action is completed
+    // The DAW can call this function from basically any thread
+    // To keep project loading fast, we restore in stages: first we parse the state and read all patch files in parallel, without holding the audio lock
+    // Then we only lock the audio thread to instantiate the patches. Canvases are created afterwards on the message thread, and only for editors that are actually open
+    // Until the restore is complete, processBlock will output silence
+    restoringState = true;
 
-    MemoryInputStream istream(data, sizeInBytes, false);
+    auto restoreStart = Time::getMillisecondCounterHiRes();
 
     // Close any opened patches
     MessageManager::callAsync([this]() {
@@ -1041,103 +1165,173 @@ void PluginProcessor::setStateInformation(void const* data, int sizeInBytes)
         }
     });
 
-    lockAudioThread();
+    struct RestoredPatch {
+        String content;
+        File location;
+        bool pluginMode = false;
+        int splitIndex = 0;
 
-    setThis();
-    patches.clear();
+        File fileToOpen; // The file that Pd should open, this might be a temporary file if the patch was never saved
+        bool isTemporary = false;
+        bool fileChanged = false;
+    };
 
-    int numPatches = istream.readInt();
+    std::vector<RestoredPatch> restoredPatches;
+    std::unique_ptr<XmlElement> xmlState;
 
-    Array<std::pair<String, File>> patches;
+    int legacyLatency = 0;
+    int legacyOversampling = 0;
+    float legacyTail = 0.0f;
 
-    for (int i = 0; i < numPatches; i++) {
-        auto state = istream.readString();
-        auto path = istream.readString();
+    std::vector<SessionState::Patch> sessionPatches;
+    if (SessionState::read(data, sizeInBytes, xmlState, sessionPatches)) {
+        if (!xmlState) {
+            logError("Couldn't restore state, it was saved by a newer version of plugdata");
+            restoringState = false;
+            return;
+        }
+
+        auto presetDir = ProjectInfo::versionDataDir.getChildFile("Extra").getChildFile("Presets");
+        for (auto& patch : sessionPatches) {
+            auto location = File(patch.location.replace("${PRESET_DIR}", presetDir.getFullPathName()));
+            restoredPatches.push_back({ patch.content, location, patch.pluginMode, patch.splitIndex });
+            restoredPatches.back().fileChanged = patch.fileChanged;
+        }
+    }
+    // Otherwise, read the format that older versions wrote
+    else {
+        MemoryInputStream istream(data, sizeInBytes, false);
 
-        auto presetDir = ProjectInfo::appDataDir.getChildFile("Extra").getChildFile("Presets");
-        path = path.replace("${PRESET_DIR}", presetDir.getFullPathName());
+        int numPatches = istream.readInt();
 
-        auto location = File(path);
+        std::vector<RestoredPatch> legacyPatches;
+        for (int i = 0; i < numPatches; i++) {
+            auto state = istream.readString();
+            auto path = istream.readString();
 
-        patches.add({ state, location });
-    }
+            auto presetDir = ProjectInfo::appDataDir.getChildFile("Extra").getChildFile("Presets");
+            path = path.replace("${PRESET_DIR}", presetDir.getFullPathName());
 
-    auto legacyLatency = istream.readInt();
-    auto legacyOversampling = istream.readInt();
-    auto legacyTail = istream.readFloat();
+            legacyPatches.push_back({ state, File(path) });
+        }
 
-    auto xmlSize = istream.readInt();
+        legacyLatency = istream.readInt();
+        legacyOversampling = istream.readInt();
+        legacyTail = istream.readFloat();
 
-    auto* xmlData = new char[xmlSize];
-    istream.read(xmlData, xmlSize);
+        auto xmlSize = istream.readInt();
 
-    std::unique_ptr<XmlElement> xmlState(getXmlFromBinary(xmlData, xmlSize));
+        HeapBlock<char> xmlData(xmlSize);
+        istream.read(xmlData, xmlSize);
 
-    auto openPatch = [this](String const& content, File const& location, bool pluginMode = false, int splitIndex = 0) {
-        if (location.getFullPathName().isNotEmpty() && location.existsAsFile()) {
-            auto patch = loadPatch(location, openedEditors[0], splitIndex);
-            if (patch) {
-                patch->setTitle(location.getFileName());
-                patch->openInPluginMode = pluginMode;
-            }
-        } else {
-            if (location.getParentDirectory().exists()) {
-                auto parentPath = location.getParentDirectory().getFullPathName();
-                libpd_add_to_search_path(parentPath.toRawUTF8());
+        xmlState = getXmlFromBinary(xmlData, xmlSize);
+
+        if (xmlState) {
+            // If xmltree contains new patch format, use that
+            if (auto* patchTree = xmlState->getChildByName("Patches")) {
+                for (auto p : patchTree->getChildWithTagNameIterator("Patch")) {
+                    auto content = p->getStringAttribute("Content");
+                    auto location = p->getStringAttribute("Location");
+                    auto pluginMode = p->getBoolAttribute("PluginMode");
+
+                    int splitIndex = 0;
+                    if (p->hasAttribute("SplitIndex")) {
+                        splitIndex = p->getIntAttribute("SplitIndex");
+                    }
+
+                    auto presetDir = ProjectInfo::versionDataDir.getChildFile("Extra").getChildFile("Presets");
+                    location = location.replace("${PRESET_DIR}", presetDir.getFullPathName());
+
+                    restoredPatches.push_back({ content, File(location), pluginMode, splitIndex });
+                }
             }
-            auto patch = loadPatch(content, openedEditors[0], splitIndex);
-            if (patch && ((location.exists() && location.getParentDirectory() == File::getSpecialLocation(File::tempDirectory)) || !location.exists())) {
-                patch->setTitle("Untitled Patcher");
-                patch->openInPluginMode = pluginMode;
-                patch->splitViewIndex = splitIndex;
-            } else if (patch && location.existsAsFile()) {
-                patch->setCurrentFile(location);
-                patch->setTitle(location.getFileName());
-                patch->openInPluginMode = pluginMode;
-                patch->splitViewIndex = splitIndex;
+            // Otherwise, load from legacy format
+            else {
+                restoredPatches = std::move(legacyPatches);
             }
         }
-    };
+    }
 
-    if (xmlState) {
-        // If xmltree contains new patch format, use that
-        if (auto* patchTree = xmlState->getChildByName("Patches")) {
-            for (auto p : patchTree->getChildWithTagNameIterator("Patch")) {
-                auto content = p->getStringAttribute("Content");
-                auto location = p->getStringAttribute("Location");
-                auto pluginMode = p->getBoolAttribute("PluginMode");
-
-                int splitIndex = 0;
-                if (p->hasAttribute("SplitIndex")) {
-                    splitIndex = p->getIntAttribute("SplitIndex");
-                }
+    auto parseEnd = Time::getMillisecondCounterHiRes();
 
-                auto presetDir = ProjectInfo::versionDataDir.getChildFile("Extra").getChildFile("Presets");
-                location = location.replace("${PRESET_DIR}", presetDir.getFullPathName());
+    // Decide which file Pd should open for every patch, and read the patch and its abstractions, so that instantiating it will hit the file cache
+    // Patches that were never saved, or whose file changed since the state was stored, are written to a temporary file, since Pd can only open patches from disk
+    {
+        std::vector<std::future<void>> jobs;
+        for (auto& restored : restoredPatches) {
+            jobs.push_back(std::async(std::launch::async, [&restored]() {
+                if (restored.location.getFullPathName().isNotEmpty() && restored.location.existsAsFile() && !restored.fileChanged) {
+                    restored.fileToOpen = restored.location;
+                    std::set<String> visited;
+                    prefetchAbstractions(restored.location.loadFileAsString(), restored.location.getParentDirectory(), visited);
+                } else {
+                    auto content = restored.content.isEmpty() ? String(pd::Instance::defaultPatch) : restored.content;
+                    restored.fileToOpen = File::createTempFile(".pd");
+                    restored.fileToOpen.replaceWithText(content);
+                    restored.isTemporary = true;
 
-                openPatch(content, location, pluginMode, splitIndex);
-            }
+                    std::set<String> visited;
+                    prefetchAbstractions(content, restored.location.getParentDirectory(), visited);
+                }
+            }));
         }
-        // Otherwise, load from legacy format
-        else {
-            for (auto& [content, location] : patches) {
-                openPatch(content, location);
-            }
+
+        for (auto& job : jobs) {
+            job.wait();
         }
+    }
+
+    auto readEnd = Time::getMillisecondCounterHiRes();
+
+    lockAudioThread();
+
+    setThis();
+    patches.clear();
+
+    for (auto& restored : restoredPatches) {
+        auto const& location = restored.location;
+
+        if (restored.isTemporary && location.getParentDirectory().exists()) {
+            auto parentPath = location.getParentDirectory().getFullPathName();
+            libpd_add_to_search_path(parentPath.toRawUTF8());
+        }
+
+        // Don't pass an editor here, we'll create all canvases at once when we're done
+        auto patch = loadPatch(restored.fileToOpen, nullptr, restored.splitIndex);
+
+        // Pd has read the temporary file, and the patch doesn't refer to it anymore
+        if (restored.isTemporary)
+            restored.fileToOpen.deleteFile();
+
+        if (!patch)
+            continue;
 
-        jassert(xmlState);
+        patch->openInPluginMode = restored.pluginMode;
+        patch->splitViewIndex = restored.splitIndex;
 
+        if (!restored.isTemporary) {
+            patch->setTitle(location.getFileName());
+        } else if ((location.exists() && location.getParentDirectory() == File::getSpecialLocation(File::tempDirectory)) || !location.exists()) {
+            patch->setCurrentFile(File());
+            patch->setTitle("Untitled Patcher");
+        } else {
+            patch->setCurrentFile(location);
+            patch->setTitle(location.getFileName());
+        }
+    }
+
+    if (xmlState) {
         PlugDataParameter::loadStateInformation(*xmlState, getParameters());
 
         auto versionString = String("0.6.1"); // latest version that didn't have version inside the daw state
 
         if (!xmlState->hasAttribute("Legacy") || xmlState->getBoolAttribute("Legacy")) {
-            setLatencySamples(legacyLatency);
+            setLatencySamples(legacyLatency + subpatchLatency);
             setOversampling(legacyOversampling);
             tailLength = legacyTail;
         } else {
             setOversampling(xmlState->getDoubleAttribute("Oversampling"));
-            setLatencySamples(xmlState->getDoubleAttribute("Latency"));
+            setLatencySamples(xmlState->getIntAttribute("Latency") + subpatchLatency);
             tailLength = xmlState->getDoubleAttribute("TailLength");
         }
 
@@ -1166,16 +1360,45 @@ void PluginProcessor::setStateInformation(void const* data, int sizeInBytes)
 
     unlockAudioThread();
 
-    delete[] xmlData;
+    restoringState = false;
+
+    auto instantiateEnd = Time::getMillisecondCounterHiRes();
+
+    // If no editor is open, the canvases will be created when the editor opens
+    MessageManager::callAsync([this, restoreStart, parseEnd, readEnd, instantiateEnd]() {
+        auto canvasStart = Time::getMillisecondCounterHiRes();
 
-    MessageManager::callAsync([this]() {
         for (auto* editor : getEditors()) {
+            // There are some subroutines that get called when we create a canvas, that will lock the audio thread
+            // By locking it around the whole loop, we can prevent slowdowns from constantly locking/unlocking the audio thread
+            lockAudioThread();
+            Array<Canvas*> newCanvases;
+            for (auto const& patch : patches) {
+                // The editor might have been opened after the restore, in which case it already created this canvas
+                auto alreadyOpen = std::any_of(editor->canvases.begin(), editor->canvases.end(), [&patch](Canvas* cnv) { return cnv->patch == *patch; });
+                if (alreadyOpen)
+                    continue;
+
+                newCanvases.add(editor->canvases.add(new Canvas(editor, *patch, nullptr)));
+            }
+            unlockAudioThread();
+
+            for (auto* cnv : newCanvases) {
+                editor->addTab(cnv, cnv->patch.splitViewIndex);
+            }
+
             editor->sidebar->updateAutomationParameters();
 
             if (editor->pluginMode && !editor->pd->isInPluginMode()) {
                 editor->pluginMode->closePluginMode();
             }
         }
+
+        auto canvasEnd = Time::getMillisecondCounterHiRes();
+
+        logMessage("Restored " + String(patches.size()) + " patch(es) in " + String(canvasEnd - restoreStart, 1) + "ms (parse: "
+            + String(parseEnd - restoreStart, 1) + "ms, read: " + String(readEnd - parseEnd, 1) + "ms, instantiate: "
+            + String(instantiateEnd - readEnd, 1) + "ms, canvases: " + String(canvasEnd - canvasStart, 1) + "ms)");
     });
 }
 
@@ -1694,6 +1917,12 @@ void PluginProcessor::reloadAbstractions(File changedPatch, t_glist* except)
     isPerformingGlobalSync = false;
 }
 
+void PluginProcessor::oversamplingLatencyChanged(int latency)
+{
+    setLatencySamples(getLatencySamples() - subpatchLatency + latency);
+    subpatchLatency = latency;
+}
+
 void PluginProcessor::titleChanged()
 {
     for (auto* editor : getEditors()) {
@@ -10,23 +10,26 @@
 #include <juce_dsp/juce_dsp.h>
 
 #include "Utility/Config.h"
-#include "Utility/Limiter.h"
+#include "Utility/OutputStage.h"
 #include "Utility/SettingsFile.h"
 #include <Utility/AudioMidiFifo.h>
 
 #include "Pd/Instance.h"
 #include "Pd/Patch.h"
+#include "Pd/SearchIndex.h"
 
 namespace pd {
 class Library;
 }
 
 class InternalSynth;
+class SubpatchCompiler;
 class SettingsFile;
 class StatusbarSource;
 struct PlugDataLook;
 class PluginEditor;
 class ConnectionMessageDisplay;
+class AutosaveJournals;
 class PluginProcessor : public AudioProcessor
     , public pd::Instance, public SettingsFileListener {
 public:
@@ -100,6 +103,7 @@ public:
     void updatePatchUndoRedoState();
         
     void settingsFileReloaded() override;
+    void propertyChanged(String const& name, var const& value) override;
 
     void initialiseFilesystem();
     void updateSearchPaths();
@@ -124,6 +128,8 @@ public:
 
     void titleChanged() override;
 
+    void oversamplingLatencyChanged(int latency) override;
+
     void setTheme(String themeToUse, bool force = false);
 
     Colour getForegroundColour() override;
@@ -162,12 +168,26 @@ public:
 
     // Zero means no oversampling
     std::atomic<int> oversampling = 0;
+
+    // Part of the latency we report, on top of the latency set by the user. Never saved, the patch brings its oversampled subpatches along
+    int subpatchLatency = 0;
+
+    // Set while setStateInformation is restoring patches, the audio thread will output silence until it's done
+    std::atomic<bool> restoringState = false;
     int lastLeftTab = -1;
     int lastRightTab = -1;
 
     std::unique_ptr<InternalSynth> internalSynth;
     std::atomic<bool> enableInternalSynth = false;
 
+    std::unique_ptr<SubpatchCompiler> subpatchCompiler;
+
+    // Shared by the search panels of all editors
+    pd::SearchIndex searchIndex { this };
+
+    // Shared with the other plugin instances, the last instance that is deleted waits for the autosaves that are still being written
+    SharedResourcePointer<AutosaveJournals> autosaveJournals;
+
     OwnedArray<PluginEditor> openedEditors;
     Component::SafePointer<ConnectionMessageDisplay> connectionListener;
 
@@ -200,7 +220,7 @@ private:
 
     int lastSetProgram = 0;
 
-    Limiter limiter;
+    OutputStage outputStage;
     std::unique_ptr<dsp::Oversampling<float>> oversampler;
 
     std::map<unsigned long, std::unique_ptr<Component>> textEditorDialogs;
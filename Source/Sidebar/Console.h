@@ -7,6 +7,7 @@
 #pragma once
 #include <utility>
 #include "Components/BouncingViewport.h"
+#include "Components/SearchEditor.h"
 #include "Object.h"
 
 class ConsoleSettings : public Component {
@@ -100,6 +101,16 @@ public:
 
         addAndMakeVisible(viewport);
 
+        searchInput.setBackgroundColour(PlugDataColour::sidebarActiveBackgroundColourId);
+        searchInput.setTextToShowWhenEmpty("Search in console", findColour(PlugDataColour::sidebarTextColourId).withAlpha(0.5f));
+        searchInput.setJustification(Justification::centredLeft);
+        searchInput.setBorder({ 1, 8, 5, 1 });
+        searchInput.onTextChange = [this]() {
+            console->setFilter(searchInput.getText());
+            update();
+        };
+        addAndMakeVisible(searchInput);
+
         for (auto& settingsValue : settingsValues) {
             settingsValue.addListener(this);
         }
@@ -125,10 +136,18 @@ public:
         }
     }
 
+    void lookAndFeelChanged() override
+    {
+        searchInput.setColour(TextEditor::backgroundColourId, Colours::transparentBlack);
+        searchInput.setColour(TextEditor::outlineColourId, Colours::transparentBlack);
+        searchInput.setColour(TextEditor::textColourId, findColour(PlugDataColour::sidebarTextColourId));
+    }
+
     void resized() override
     {
         auto bounds = getLocalBounds();
 
+        searchInput.setBounds(bounds.removeFromTop(34).reduced(5, 4));
         viewport.setBounds(bounds);
 
         auto width = viewport.canScrollVertically() ? viewport.getWidth() - 5.0f : viewport.getWidth();
@@ -149,132 +168,36 @@ public:
 
     void deselect()
     {
-        console->selectedItems.clear();
+        console->selectedMessages.clear();
         repaint();
     }
 
-    class ConsoleComponent : public Component {
-        class ConsoleMessage : public Component {
-
-            ConsoleComponent& console;
+    // Virtualised list of console messages: we only keep track of the position of every row, and only paint the rows that are visible
+    // New messages are appended to the layout, so the cost of an update doesn't depend on the size of the history
+    class ConsoleComponent : public Component
+        , private Timer {
 
-        public:
-            int idx;
-
-            ConsoleMessage(int index, ConsoleComponent& parent)
-                : console(parent)
-                , idx(index)
-            {
-                parent.addAndMakeVisible(this);
-            }
-
-            void mouseDown(MouseEvent const& e)
-            {
-                if (!e.mods.isShiftDown() && !e.mods.isCommandDown()) {
-                    console.selectedItems.clear();
-                }
-
-                auto& [object, message, type, length, repeats] = console.pd->getConsoleMessages()[idx];
-                if (e.mods.isPopupMenu()) {
-                    
-                    
-                    PopupMenu menu;
-                    menu.addItem("Copy", [this]() { console.copySelectionToClipboard(); });
-                    menu.addItem("Show origin", object != nullptr, false, [this, target = object]() {
-                        auto* editor = findParentComponentOfClass<PluginEditor>();
-                        editor->highlightSearchTarget(target, true);
-                    });
-                    menu.showMenuAsync(PopupMenu::Options());
-                }
-
-                console.selectedItems.addIfNotAlreadyThere(SafePointer(this));
-                console.repaint();
-            }
-            
-            void paint(Graphics& g)
-            {
-                auto isSelected = console.selectedItems.contains(this);
-                auto showMessages = getValue<bool>(console.settingsValues[2]);
-                auto showErrors = getValue<bool>(console.settingsValues[3]);
-
-                if (isSelected) {
-                    // Draw selected background
-                    g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
-                    PlugDataLook::fillSmoothedRectangle(g, getLocalBounds().reduced(0, 1).toFloat().withTrimmedTop(0.5f), Corners::defaultCornerRadius);
-
-                    for (auto& item : console.selectedItems) {
-
-                        if (!item.getComponent())
-                            return;
-                        // Draw connected on top
-                        if (item->idx == idx - 1) {
-                            g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
-                            g.fillRect(getLocalBounds().toFloat().withTrimmedBottom(5));
-
-                            g.setColour(findColour(PlugDataColour::outlineColourId));
-                            g.drawLine(10, 0, getWidth() - 10, 0);
-                        }
-
-                        // Draw connected on bottom
-                        if (item->idx == idx + 1) {
-                            g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
-                            g.fillRect(getLocalBounds().toFloat().withTrimmedTop(5));
-                        }
-                    }
-                }
-
-                // Get console message
-                auto& [object, message, type, length, repeats] = console.pd->getConsoleMessages()[idx];
-
-                // Check if message type should be visible
-                if ((type == 0 && !showMessages) || (type == 1 && !showErrors)) {
-                    return;
-                }
-
-                // Approximate number of lines from string length and current width
-                auto totalLength = length + calculateRepeatOffset(repeats);
-                auto numLines = StringUtils::getNumLines(console.getWidth(), totalLength);
-
-                auto textColour = findColour(isSelected ? PlugDataColour::sidebarActiveTextColourId : PlugDataColour::sidebarTextColourId);
-
-                if (type == 1)
-                    textColour = Colours::orange;
-                else if (type == 2)
-                    textColour = Colours::red;
-
-                auto bounds = getLocalBounds().reduced(8, 2);
-                if (repeats > 1) {
-
-                    auto repeatIndicatorBounds = bounds.removeFromLeft(calculateRepeatOffset(repeats)).toFloat().translated(-4, 0.25);
-                    repeatIndicatorBounds = repeatIndicatorBounds.withSizeKeepingCentre(repeatIndicatorBounds.getWidth(), 21);
-
-                    auto circleColour = findColour(PlugDataColour::sidebarActiveBackgroundColourId);
-                    auto backgroundColour = findColour(PlugDataColour::sidebarBackgroundColourId);
-                    auto contrast = isSelected ? 1.5f : 0.5f;
-
-                    circleColour = Colour(circleColour.getRed() + (circleColour.getRed() - backgroundColour.getRed()) * contrast,
-                        circleColour.getGreen() + (circleColour.getGreen() - backgroundColour.getGreen()) * contrast,
-                        circleColour.getBlue() + (circleColour.getBlue() - backgroundColour.getBlue()) * contrast);
-
-                    g.setColour(circleColour);
-                    auto circleBounds = repeatIndicatorBounds.reduced(2);
-                    g.fillRoundedRectangle(circleBounds, circleBounds.getHeight() / 2.0f);
-
-                    Fonts::drawText(g, String(repeats), repeatIndicatorBounds, findColour(PlugDataColour::sidebarTextColourId), 12, Justification::centred);
-                }
-
-                // Draw text
-                Fonts::drawFittedText(g, message, bounds.translated(0, -1), textColour, numLines, 0.9f, 14);
-            }
+        struct Row {
+            uint64 index; // Index of the message in the console store
+            int64 y;
+            int height;
         };
 
         std::array<Value, 5>& settingsValues;
         Viewport& viewport;
 
         pd::Instance* pd; // instance to get console messages from
+
+        std::deque<Row> rows;
+        uint64 layoutStart = 0; // First message that we considered for the current layout
+        uint64 layoutEnd = 0;   // One past the last message that we considered for the current layout
+        int layoutWidth = 0;
+        bool showMessages = true;
+        bool showErrors = true;
+        String filter;
+
     public:
-        std::deque<std::unique_ptr<ConsoleMessage>> messages;
-        Array<SafePointer<ConsoleMessage>> selectedItems;
+        std::set<uint64> selectedMessages;
 
         ConsoleComponent(pd::Instance* instance, std::array<Value, 5>& b, Viewport& v)
             : settingsValues(b)
@@ -287,17 +210,36 @@ public:
 
         void focusLost(FocusChangeType cause) override
         {
-            selectedItems.clear();
+            selectedMessages.clear();
             repaint();
         }
 
+        void setFilter(String const& newFilter)
+        {
+            if (newFilter == filter)
+                return;
+
+            // Typing more of a search term only hides rows, so we can drop rows from the current layout instead of measuring the whole history again
+            auto const narrowed = newFilter.containsIgnoreCase(filter);
+            filter = newFilter;
+
+            if (narrowed) {
+                removeHiddenRows();
+            } else {
+                // Erasing characters can show rows that aren't in the layout, wait until typing pauses before rebuilding it
+                startTimer(150);
+            }
+        }
+
         void copySelectionToClipboard()
         {
+            auto& messages = pd->getConsoleMessages();
+
             String textToCopy;
-            for (auto& item : selectedItems) {
-                if (!item.getComponent())
+            for (auto index : selectedMessages) {
+                if (index < messages.getStart() || index >= messages.getEnd())
                     continue;
-                textToCopy += std::get<1>(pd->getConsoleMessages()[item->idx]) + "\n";
+                textToCopy += messages[index].text + "\n";
             }
 
             SystemClipboard::copyTextToClipboard(textToCopy.trimEnd());
@@ -316,60 +258,61 @@ public:
 
         void update()
         {
-            while (messages.size() > pd->getConsoleMessages().size() || messages.size() >= 800) {
-                messages.pop_front();
+            auto& messages = pd->getConsoleMessages();
+
+            auto newShowMessages = getValue<bool>(settingsValues[2]);
+            auto newShowErrors = getValue<bool>(settingsValues[3]);
 
-                // Make sure we don't trigger a repaint for all messages when the console is full
-                for (auto const& message : messages) {
-                    message->idx--;
+            // The visible range grew at the start (restore), or the filtering changed
+            if (messages.getStart() < layoutStart || newShowMessages != showMessages || newShowErrors != showErrors) {
+                showMessages = newShowMessages;
+                showErrors = newShowErrors;
+                rebuildLayout();
+            } else {
+                // Forget about messages that were cleared, or pushed out of the history
+                while (!rows.empty() && rows.front().index < messages.getStart()) {
+                    rows.pop_front();
                 }
-            }
+                layoutStart = messages.getStart();
+                layoutEnd = std::max(layoutEnd, layoutStart);
 
-            while (messages.size() < pd->getConsoleMessages().size()) {
-                messages.push_back(std::make_unique<ConsoleMessage>(messages.size(), *this));
+                // The last message might have been repeated since, which changes its size
+                if (!rows.empty()) {
+                    rows.back().height = getRowHeight(messages[rows.back().index]);
+                }
+
+                appendRows();
             }
 
             setSize(getWidth(), std::max<int>(getTotalHeight(), viewport.getHeight()));
-            resized();
 
             if (getValue<bool>(settingsValues[4])) {
                 viewport.setViewPositionProportionately(0.0f, 1.0f);
             }
+
+            repaint();
         }
 
         void clear()
         {
-            pd->getConsoleHistory().insert(pd->getConsoleHistory().end(), pd->getConsoleMessages().begin(), pd->getConsoleMessages().end());
             pd->getConsoleMessages().clear();
+            selectedMessages.clear();
             update();
         }
 
         void restore()
         {
-            pd->getConsoleMessages().insert(pd->getConsoleMessages().begin(), pd->getConsoleHistory().begin(), pd->getConsoleHistory().end());
-            pd->getConsoleHistory().clear();
+            pd->getConsoleMessages().restore();
             update();
         }
 
         // Get total height of messages, also taking multi-line messages into account
-        int getTotalHeight()
+        int getTotalHeight() const
         {
-            auto showMessages = getValue<bool>(settingsValues[2]);
-            auto showErrors = getValue<bool>(settingsValues[3]);
-            auto totalHeight = 0;
+            if (rows.empty())
+                return 8;
 
-            for (auto& [object, message, type, length, repeats] : pd->getConsoleMessages()) {
-                auto totalLength = length + calculateRepeatOffset(repeats);
-                auto numLines = StringUtils::getNumLines(getWidth(), totalLength);
-                auto height = numLines * 13 + 12;
-
-                if ((type == 0 && !showMessages) || (type == 1 && !showErrors))
-                    continue;
-
-                totalHeight += std::max(0, height);
-            }
-
-            return totalHeight + 8;
+            return static_cast<int>(rows.back().y + rows.back().height - rows.front().y) + 8;
         }
 
         static int calculateRepeatOffset(int numRepeats)
@@ -383,34 +326,217 @@ public:
 
         void mouseDown(MouseEvent const& e) override
         {
-            selectedItems.clear();
+            auto rowIndex = getRowAt(e.y);
+            if (rowIndex < 0) {
+                selectedMessages.clear();
+                repaint();
+                return;
+            }
+
+            if (!e.mods.isShiftDown() && !e.mods.isCommandDown()) {
+                selectedMessages.clear();
+            }
+
+            auto messageIndex = rows[rowIndex].index;
+            selectedMessages.insert(messageIndex);
+
+            if (e.mods.isPopupMenu()) {
+                auto* object = pd->getConsoleMessages()[messageIndex].object;
+
+                PopupMenu menu;
+                menu.addItem("Copy", [this]() { copySelectionToClipboard(); });
+                menu.addItem("Show origin", object != nullptr, false, [this, target = object]() {
+                    auto* editor = findParentComponentOfClass<PluginEditor>();
+                    editor->highlightSearchTarget(target, true);
+                });
+                menu.showMenuAsync(PopupMenu::Options());
+            }
+
             repaint();
         }
 
         void resized() override
         {
-            auto showMessages = getValue<bool>(settingsValues[2]);
-            auto showErrors = getValue<bool>(settingsValues[3]);
+            if (getWidth() != layoutWidth)
+                rebuildLayout();
+        }
+
+        void paint(Graphics& g) override
+        {
+            if (rows.empty())
+                return;
+
+            auto& messages = pd->getConsoleMessages();
+            auto clip = g.getClipBounds();
 
-            int totalHeight = 4;
-            for (int row = 0; row < static_cast<int>(pd->getConsoleMessages().size()); row++) {
-                if (row >= messages.size())
+            for (auto row = std::max(getRowAt(clip.getY()), 0); row < static_cast<int>(rows.size()); row++) {
+                auto bounds = getRowBounds(row);
+                if (bounds.getY() > clip.getBottom())
                     break;
 
-                auto& [object, message, type, length, repeats] = pd->getConsoleMessages()[row];
+                auto const index = rows[row].index;
+                if (index < messages.getStart())
+                    continue;
+
+                auto isSelected = selectedMessages.count(index) > 0;
+                auto previousSelected = row > 0 && selectedMessages.count(rows[row - 1].index);
+                auto nextSelected = row < static_cast<int>(rows.size()) - 1 && selectedMessages.count(rows[row + 1].index);
+
+                paintRow(g, messages[index], bounds, isSelected, previousSelected, nextSelected);
+            }
+        }
+
+    private:
+        bool isShown(pd::ConsoleStore::Message const& message) const
+        {
+            if ((message.type == 0 && !showMessages) || (message.type == 1 && !showErrors))
+                return false;
 
-                auto totalLength = length + calculateRepeatOffset(repeats);
-                auto numLines = StringUtils::getNumLines(getWidth(), totalLength);
-                auto height = numLines * 13 + 12;
+            return filter.isEmpty() || message.text.containsIgnoreCase(filter);
+        }
+
+        int getRowHeight(pd::ConsoleStore::Message const& message) const
+        {
+            auto totalLength = message.width + calculateRepeatOffset(message.repeats);
+            auto numLines = StringUtils::getNumLines(getWidth(), totalLength);
+            return std::max(0, numLines * 13 + 12);
+        }
+
+        void timerCallback() override
+        {
+            stopTimer();
+            rebuildLayout();
+            setSize(getWidth(), std::max<int>(getTotalHeight(), viewport.getHeight()));
+        }
 
-                if ((type == 0 && !showMessages) || (type == 1 && !showErrors))
+        void removeHiddenRows()
+        {
+            auto& messages = pd->getConsoleMessages();
+
+            std::deque<Row> shownRows;
+            for (auto const& row : rows) {
+                if (!isShown(messages[row.index]))
                     continue;
 
-                int rightMargin = viewport.canScrollVertically() ? 13 : 11;
-                messages[row]->setBounds(6, totalHeight, getWidth() - rightMargin, height);
+                auto y = shownRows.empty() ? 0 : shownRows.back().y + shownRows.back().height;
+                shownRows.push_back({ row.index, y, row.height });
+            }
+
+            rows = std::move(shownRows);
+            repaint();
+        }
+
+        void rebuildLayout()
+        {
+            stopTimer();
+
+            auto& messages = pd->getConsoleMessages();
+
+            rows.clear();
+            layoutWidth = getWidth();
+            layoutStart = messages.getStart();
+            layoutEnd = layoutStart;
+
+            appendRows();
+            repaint();
+        }
+
+        void appendRows()
+        {
+            auto& messages = pd->getConsoleMessages();
 
-                totalHeight += height;
+            for (; layoutEnd < messages.getEnd(); layoutEnd++) {
+                auto& message = messages[layoutEnd];
+                if (!isShown(message))
+                    continue;
+
+                auto y = rows.empty() ? 0 : rows.back().y + rows.back().height;
+                rows.push_back({ layoutEnd, y, getRowHeight(message) });
+            }
+        }
+
+        Rectangle<int> getRowBounds(int row) const
+        {
+            int rightMargin = viewport.canScrollVertically() ? 13 : 11;
+            auto y = static_cast<int>(rows[row].y - rows.front().y) + 4;
+            return { 6, y, getWidth() - rightMargin, rows[row].height };
+        }
+
+        // Binary search for the row at a y position, returns -1 if there is none
+        int getRowAt(int y) const
+        {
+            if (rows.empty())
+                return -1;
+
+            auto target = rows.front().y + y - 4;
+            auto it = std::upper_bound(rows.begin(), rows.end(), target, [](int64 value, Row const& row) {
+                return value < row.y + row.height;
+            });
+
+            if (it == rows.end() || target < it->y)
+                return -1;
+
+            return static_cast<int>(std::distance(rows.begin(), it));
+        }
+
+        void paintRow(Graphics& g, pd::ConsoleStore::Message const& consoleMessage, Rectangle<int> rowBounds, bool isSelected, bool previousSelected, bool nextSelected)
+        {
+            auto& [object, message, type, length, repeats] = consoleMessage;
+
+            if (isSelected) {
+                // Draw selected background
+                g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
+                PlugDataLook::fillSmoothedRectangle(g, rowBounds.reduced(0, 1).toFloat().withTrimmedTop(0.5f), Corners::defaultCornerRadius);
+
+                // Draw connected on top
+                if (previousSelected) {
+                    g.fillRect(rowBounds.toFloat().withTrimmedBottom(5));
+
+                    g.setColour(findColour(PlugDataColour::outlineColourId));
+                    g.drawLine(rowBounds.getX() + 10, rowBounds.getY(), rowBounds.getRight() - 10, rowBounds.getY());
+                    g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
+                }
+
+                // Draw connected on bottom
+                if (nextSelected) {
+                    g.fillRect(rowBounds.toFloat().withTrimmedTop(5));
+                }
+            }
+
+            // Approximate number of lines from string length and current width
+            auto totalLength = length + calculateRepeatOffset(repeats);
+            auto numLines = StringUtils::getNumLines(getWidth(), totalLength);
+
+            auto textColour = findColour(isSelected ? PlugDataColour::sidebarActiveTextColourId : PlugDataColour::sidebarTextColourId);
+
+            if (type == 1)
+                textColour = Colours::orange;
+            else if (type == 2)
+                textColour = Colours::red;
+
+            auto bounds = rowBounds.reduced(8, 2);
+            if (repeats > 1) {
+
+                auto repeatIndicatorBounds = bounds.removeFromLeft(calculateRepeatOffset(repeats)).toFloat().translated(-4, 0.25);
+                repeatIndicatorBounds = repeatIndicatorBounds.withSizeKeepingCentre(repeatIndicatorBounds.getWidth(), 21);
+
+                auto circleColour = findColour(PlugDataColour::sidebarActiveBackgroundColourId);
+                auto backgroundColour = findColour(PlugDataColour::sidebarBackgroundColourId);
+                auto contrast = isSelected ? 1.5f : 0.5f;
+
+                circleColour = Colour(circleColour.getRed() + (circleColour.getRed() - backgroundColour.getRed()) * contrast,
+                    circleColour.getGreen() + (circleColour.getGreen() - backgroundColour.getGreen()) * contrast,
+                    circleColour.getBlue() + (circleColour.getBlue() - backgroundColour.getBlue()) * contrast);
+
+                g.setColour(circleColour);
+                auto circleBounds = repeatIndicatorBounds.reduced(2);
+                g.fillRoundedRectangle(circleBounds, circleBounds.getHeight() / 2.0f);
+
+                Fonts::drawText(g, String(repeats), repeatIndicatorBounds, findColour(PlugDataColour::sidebarTextColourId), 12, Justification::centred);
             }
+
+            // Draw text
+            Fonts::drawFittedText(g, message, bounds.translated(0, -1), textColour, numLines, 0.9f, 14);
         }
 
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConsoleComponent)
@@ -435,4 +561,5 @@ private:
     std::array<Value, 5> settingsValues;
     ConsoleComponent* console;
     BouncingViewport viewport;
+    SearchEditor searchInput;
 };
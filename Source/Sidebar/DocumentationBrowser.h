@@ -13,6 +13,7 @@
 #include "Utility/OSUtils.h"
 #include "Utility/Autosave.h"
 #include "Utility/ValueTreeViewer.h"
+#include "DocumentationIndex.h"
 #include "Object.h"
 
 class DocumentBrowserSettings : public Component {
@@ -94,7 +95,7 @@ public:
         searchInput.setBackgroundColour(PlugDataColour::sidebarActiveBackgroundColourId);
         searchInput.addKeyListener(this);
         searchInput.onTextChange = [this]() {
-            fileList.setFilterString(searchInput.getText());
+            updateSearchResults();
         };
         
         fsWatcher.addListener(this);
@@ -163,6 +164,12 @@ public:
    }
 
     
+    void fileChanged(File const file, FileSystemWatcher::FileSystemEvent event) override
+    {
+        documentationIndex.markChanged(file);
+        FileSystemWatcher::Listener::fileChanged(file, event);
+    }
+    
     void filesystemChanged() override
     {
         if(isVisible())
@@ -228,76 +235,64 @@ public:
        repaint();
    }
     
+    // Shows what we knew from last time straight away, then brings the index up to date with what's on disk
     void run() override
     {
-        auto tree = generateDirectoryValueTree(File(pd->settingsFile->getProperty<String>("browser_path")));
-        MessageManager::callAsync([this, tree](){
-            fileTree = tree;
-            fileList.setValueTree(tree);
-        });
-    }
-    
-    ValueTree generateDirectoryValueTree(const File& directory) {
-        
-        static File versionDataDir = ProjectInfo::appDataDir.getChildFile("Versions");
-        static File toolchainDir = ProjectInfo::appDataDir.getChildFile("Toolchain");
+        auto location = File(pd->settingsFile->getProperty<String>("browser_path"));
         
-        if (threadShouldExit() || !directory.exists() || !directory.isDirectory() || directory == versionDataDir || directory == toolchainDir)
+        if(!indexLoaded)
         {
-            return ValueTree();
+            documentationIndex.load(location);
+            indexLoaded = true;
+            publishIndex();
         }
         
-        ValueTree rootNode("Folder");
-        rootNode.setProperty("Name", directory.getFileName(), nullptr);
-        rootNode.setProperty("Path", directory.getFullPathName(), nullptr);
-        rootNode.setProperty("Icon", Icons::Folder, nullptr);
+        // Changes that came in while we were updating would otherwise wait for the next one
+        do {
+            if(documentationIndex.update(location, [this](){ return threadShouldExit(); }))
+            {
+                documentationIndex.save();
+                publishIndex();
+            }
+        } while(!threadShouldExit() && documentationIndex.hasPendingChanges());
+    }
+    
+    void publishIndex()
+    {
+        auto tree = documentationIndex.createTree();
+        auto documents = std::make_shared<std::vector<DocumentationIndex::SearchableDocument> const>(documentationIndex.getSearchableDocuments());
         
-        // visitedDirectories keeps track of dirs we've already processed to prevent infinite loops
-        static Array<File> visitedDirectories = {};
+        MessageManager::callAsync([_this = SafePointer(this), tree, documents](){
+            if(!_this) return;
+            
+            _this->fileTree = tree;
+            _this->searchableDocuments = documents;
+            _this->updateSearchResults();
+        });
+    }
     
-        // Protect against symlink loops!
-        if (!visitedDirectories.contains(directory)) {
-            for (const auto& subDirectory : OSUtils::iterateDirectory(directory, false, false)) {
-                visitedDirectories.add(directory);
-                
-                if(subDirectory.isDirectory() && subDirectory != directory) {
-                    ValueTree childNode = generateDirectoryValueTree(subDirectory);
-                    if(childNode.isValid()) rootNode.appendChild(childNode, nullptr);
-                }
-                
-                visitedDirectories.removeLast();
-            }
+    // Searches the names, objects and comments of all documents, and shows the matches as a flat list
+    void updateSearchResults()
+    {
+        auto query = searchInput.getText().trim();
+        if(query.isEmpty() || !searchableDocuments)
+        {
+            fileList.setValueTree(fileTree);
+            return;
         }
         
-        for (const auto& file : OSUtils::iterateDirectory(directory, false, true)) {
-            if(file.getFileName().startsWith(".") || file.isDirectory()) continue;
-            
+        ValueTree results("Folder");
+        for(auto* document : DocumentationIndex::search(*searchableDocuments, query))
+        {
             ValueTree childNode("File");
-            childNode.setProperty("Name", file.getFileName(), nullptr);
-            childNode.setProperty("Path", file.getFullPathName(), nullptr);
+            childNode.setProperty("Name", document->name, nullptr);
+            childNode.setProperty("Path", document->path, nullptr);
             childNode.setProperty("Icon", Icons::File, nullptr);
-
-            rootNode.appendChild(childNode, nullptr);
+            childNode.setProperty("RightText", document->folder, nullptr);
+            results.appendChild(childNode, nullptr);
         }
         
-        struct {
-            int compareElements (const ValueTree& first, const ValueTree& second)
-            {
-                if(first.getProperty("Icon") == Icons::File && second.getProperty("Icon") == Icons::Folder)
-                {
-                    return 1;
-                }
-                if(first.getProperty("Icon") == Icons::Folder && second.getProperty("Icon") == Icons::File)
-                {
-                    return -1;
-                }
-                
-                return first.getProperty("Name").toString().compareNatural(second.getProperty("Name").toString());
-            }
-        } valueTreeSorter;
-        
-        rootNode.sort(valueTreeSorter, nullptr, false);
-        return rootNode;
+        fileList.setValueTree(results);
     }
 
     bool isSearching()
@@ -397,7 +392,11 @@ private:
     TextButton resetFolderButton = TextButton(Icons::Restore);
     TextButton settingsCalloutButton = TextButton();
     
+    DocumentationIndex documentationIndex = DocumentationIndex(ProjectInfo::appDataDir.getChildFile(".documentation_index"));
+    bool indexLoaded = false;
+    
     ValueTree fileTree;
+    std::shared_ptr<std::vector<DocumentationIndex::SearchableDocument> const> searchableDocuments;
     ValueTreeViewerComponent fileList;
     SearchEditor searchInput;
     
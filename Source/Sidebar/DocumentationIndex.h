@@ -0,0 +1,381 @@
+/*
+ // Copyright (c) 2021-2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#pragma once
+
+#include "Utility/OSUtils.h"
+
+// Every folder and file under the documentation browser's location, with the object names and comments of each patch, so searches can look at what's inside the help files
+// The index is saved to disk. A folder is only listed again when its modification time changed, or when the file system watcher told us something in it changed
+// Not thread safe, except for markChanged: the browser only touches it from its background thread, and sends copies of the results to the message thread
+class DocumentationIndex {
+    struct Document {
+        String name;
+        int64 modified = 0;
+        String objects;
+        String comments;
+    };
+
+    struct Folder {
+        int64 modified = 0;
+        StringArray subfolders;
+        std::vector<Document> documents;
+    };
+
+public:
+    struct SearchableDocument {
+        String name;
+        String path;
+        String folder;
+        String searchText; // Lowercase name, object names and comments
+    };
+
+    explicit DocumentationIndex(File cacheFile)
+        : cache(std::move(cacheFile))
+    {
+    }
+
+    // Can be called from any thread, the folder will be listed again on the next update
+    // Hidden files and our own index are ignored, otherwise saving the index would make us list the folder again, and save again
+    void markChanged(File const& file)
+    {
+        if (file.getFileName().startsWith(".") || isIndexFile(file))
+            return;
+
+        ScopedLock lock(changedLock);
+        changedFolders.insert(file.getParentDirectory().getFullPathName());
+        changedFolders.insert(file.getFullPathName());
+    }
+
+    bool hasPendingChanges() const
+    {
+        ScopedLock lock(changedLock);
+        return !changedFolders.empty();
+    }
+
+    // Loads the index saved by an earlier session, if it was for the same location. Until the next update, it might not match what is on disk anymore
+    void load(File const& root)
+    {
+        FileInputStream stream(cache);
+        if (!stream.openedOk())
+            return;
+
+        auto tree = ValueTree::readFromStream(stream);
+        if (!tree.hasType("DocumentationIndex") || static_cast<int>(tree.getProperty("Version")) != version || tree.getProperty("Root").toString() != root.getFullPathName())
+            return;
+
+        rootPath = root.getFullPathName();
+        for (auto folderTree : tree) {
+            auto& folder = folders[folderTree.getProperty("Path").toString()];
+            folder.modified = static_cast<int64>(folderTree.getProperty("Modified"));
+
+            for (auto child : folderTree) {
+                if (child.hasType("Subfolder")) {
+                    folder.subfolders.add(child.getProperty("Name").toString());
+                } else {
+                    folder.documents.push_back({ child.getProperty("Name").toString(), static_cast<int64>(child.getProperty("Modified")), child.getProperty("Objects").toString(), child.getProperty("Comments").toString() });
+                }
+            }
+        }
+
+        // Files might have changed while we weren't running, so the first update checks all of them
+        needsFullCheck = true;
+    }
+
+    void save() const
+    {
+        ValueTree tree("DocumentationIndex");
+        tree.setProperty("Version", version, nullptr);
+        tree.setProperty("Root", rootPath, nullptr);
+
+        for (auto const& [path, folder] : folders) {
+            ValueTree folderTree("Folder");
+            folderTree.setProperty("Path", path, nullptr);
+            folderTree.setProperty("Modified", folder.modified, nullptr);
+
+            for (auto const& subfolder : folder.subfolders) {
+                ValueTree subfolderTree("Subfolder");
+                subfolderTree.setProperty("Name", subfolder, nullptr);
+                folderTree.appendChild(subfolderTree, nullptr);
+            }
+
+            for (auto const& document : folder.documents) {
+                ValueTree documentTree("Document");
+                documentTree.setProperty("Name", document.name, nullptr);
+                documentTree.setProperty("Modified", document.modified, nullptr);
+                documentTree.setProperty("Objects", document.objects, nullptr);
+                documentTree.setProperty("Comments", document.comments, nullptr);
+                folderTree.appendChild(documentTree, nullptr);
+            }
+
+            tree.appendChild(folderTree, nullptr);
+        }
+
+        // Write to a temporary file first, so another instance never reads a half written index
+        TemporaryFile temporaryFile(cache);
+        if (auto stream = temporaryFile.getFile().createOutputStream()) {
+            tree.writeToStream(*stream);
+            stream.reset();
+            temporaryFile.overwriteTargetFileWithTemporary();
+        }
+    }
+
+    // Lists the folders that changed, and reads the patches that changed. Returns true if anything was different
+    bool update(File const& root, std::function<bool()> const& shouldExit)
+    {
+        std::set<String> changed;
+        {
+            ScopedLock lock(changedLock);
+            std::swap(changed, changedFolders);
+        }
+
+        auto modified = false;
+        if (rootPath != root.getFullPathName()) {
+            rootPath = root.getFullPathName();
+            folders.clear();
+            modified = true;
+        }
+
+        std::set<String> visited;
+        Array<File> parents;
+        modified = updateFolder(root, changed, visited, parents, shouldExit) || modified;
+
+        if (shouldExit()) {
+            // Try again next time
+            ScopedLock lock(changedLock);
+            changedFolders.insert(changed.begin(), changed.end());
+            return modified;
+        }
+
+        needsFullCheck = false;
+
+        // Whatever we didn't come across anymore was deleted
+        for (auto it = folders.begin(); it != folders.end();) {
+            if (!visited.count(it->first)) {
+                it = folders.erase(it);
+                modified = true;
+            } else {
+                ++it;
+            }
+        }
+
+        return modified;
+    }
+
+    // The layout that the browser's tree view expects, with folders first
+    ValueTree createTree() const
+    {
+        return createTree(File(rootPath));
+    }
+
+    std::vector<SearchableDocument> getSearchableDocuments() const
+    {
+        std::vector<SearchableDocument> documents;
+        for (auto const& [path, folder] : folders) {
+            auto const directory = File(path);
+            for (auto const& document : folder.documents) {
+                auto searchText = (document.name + " " + document.objects + " " + document.comments).toLowerCase();
+                documents.push_back({ document.name, directory.getChildFile(document.name).getFullPathName(), directory.getFileName(), searchText });
+            }
+        }
+
+        return documents;
+    }
+
+    // Documents that contain all words of the query, in their name, objects or comments. Matching names come first
+    static std::vector<SearchableDocument const*> search(std::vector<SearchableDocument> const& documents, String const& query, int maxResults = 200)
+    {
+        auto const words = StringArray::fromTokens(query.toLowerCase(), true);
+
+        std::vector<std::pair<int, SearchableDocument const*>> matches;
+        for (auto const& document : documents) {
+            auto score = 0;
+            for (auto const& word : words) {
+                if (!document.searchText.contains(word)) {
+                    score = -1;
+                    break;
+                }
+                score += document.name.containsIgnoreCase(word) ? 2 : 1;
+            }
+
+            if (score > 0)
+                matches.emplace_back(score, &document);
+        }
+
+        std::sort(matches.begin(), matches.end(), [](auto const& a, auto const& b) {
+            if (a.first != b.first)
+                return a.first > b.first;
+            return a.second->name.compareNatural(b.second->name) < 0;
+        });
+
+        std::vector<SearchableDocument const*> results;
+        for (int i = 0; i < std::min<int>(maxResults, matches.size()); i++)
+            results.push_back(matches[i].second);
+
+        return results;
+    }
+
+private:
+    // The index itself, or the temporary file that it's written to before it replaces the index
+    bool isIndexFile(File const& file) const
+    {
+        return file == cache || (file.getParentDirectory() == cache.getParentDirectory() && file.getFileName().startsWith(cache.getFileNameWithoutExtension() + "_temp") && file.getFileExtension() == cache.getFileExtension());
+    }
+
+    bool updateFolder(File const& directory, std::set<String> const& changed, std::set<String>& visited, Array<File>& parents, std::function<bool()> const& shouldExit)
+    {
+        static File versionDataDir = ProjectInfo::appDataDir.getChildFile("Versions");
+        static File toolchainDir = ProjectInfo::appDataDir.getChildFile("Toolchain");
+
+        if (shouldExit() || !directory.isDirectory() || directory == versionDataDir || directory == toolchainDir)
+            return false;
+
+        // Protect against symlink loops!
+        auto target = directory.isSymbolicLink() ? directory.getLinkedTarget() : directory;
+        if (parents.contains(target))
+            return false;
+
+        auto const path = directory.getFullPathName();
+        visited.insert(path);
+
+        auto modified = false;
+        auto const lastModified = directory.getLastModificationTime().toMilliseconds();
+        auto it = folders.find(path);
+
+        if (it == folders.end() || it->second.modified != lastModified || changed.count(path)) {
+            auto const isNew = it == folders.end();
+            auto& folder = folders[path];
+            StringArray subfolders;
+            std::vector<Document> documents;
+
+            for (auto const& file : OSUtils::iterateDirectory(directory, false, false)) {
+                if (file.isDirectory()) {
+                    subfolders.add(file.getFileName());
+                } else if (!file.getFileName().startsWith(".") && !isIndexFile(file)) {
+                    documents.push_back(updateDocument(file, folder.documents));
+                }
+            }
+
+            // A new modification time alone doesn't mean that anything we show is different
+            auto const isSameDocument = [](Document const& a, Document const& b) { return a.name == b.name && a.modified == b.modified; };
+            modified = isNew || subfolders != folder.subfolders || !std::equal(documents.begin(), documents.end(), folder.documents.begin(), folder.documents.end(), isSameDocument);
+
+            folder.subfolders = std::move(subfolders);
+            folder.documents = std::move(documents);
+            folder.modified = lastModified;
+        } else if (needsFullCheck) {
+            // Editing a patch doesn't change the modification time of its folder
+            for (auto& document : it->second.documents) {
+                auto updated = updateDocument(directory.getChildFile(document.name), it->second.documents);
+                modified = modified || updated.modified != document.modified;
+                document = std::move(updated);
+            }
+        }
+
+        parents.add(target);
+        for (auto const& subfolder : StringArray(folders[path].subfolders)) {
+            modified = updateFolder(directory.getChildFile(subfolder), changed, visited, parents, shouldExit) || modified;
+        }
+        parents.removeLast();
+
+        return modified;
+    }
+
+    // Reuses what we knew about the file if it wasn't modified since
+    static Document updateDocument(File const& file, std::vector<Document> const& known)
+    {
+        Document document;
+        document.name = file.getFileName();
+        document.modified = file.getLastModificationTime().toMilliseconds();
+
+        for (auto const& knownDocument : known) {
+            if (knownDocument.name == document.name && knownDocument.modified == document.modified)
+                return knownDocument;
+        }
+
+        if (file.hasFileExtension("pd"))
+            readPatch(file, document);
+
+        return document;
+    }
+
+    static void readPatch(File const& file, Document& document)
+    {
+        // Help patches are small, anything this big is probably not documentation
+        if (file.getSize() > 1024 * 1024)
+            return;
+
+        StringArray objects, comments;
+        auto messages = StringArray::fromTokens(file.loadFileAsString().replace("\\;", ""), ";", "");
+
+        for (auto const& message : messages) {
+            auto tokens = StringArray::fromTokens(message, true);
+            if (tokens.size() < 5 || tokens[0] != "#X")
+                continue;
+
+            if (tokens[1] == "obj") {
+                objects.addIfNotAlreadyThere(tokens[4]);
+            } else if (tokens[1] == "text") {
+                tokens.removeRange(0, 4);
+                // Pd saves the width of a comment at the end
+                if (tokens.size() >= 3 && tokens[tokens.size() - 3] == "\\," && tokens[tokens.size() - 2] == "f")
+                    tokens.removeRange(tokens.size() - 3, 3);
+
+                comments.add(tokens.joinIntoString(" ").removeCharacters("\\"));
+            }
+        }
+
+        document.objects = objects.joinIntoString(" ");
+        document.comments = comments.joinIntoString(" ").substring(0, 4000);
+    }
+
+    ValueTree createTree(File const& directory) const
+    {
+        auto it = folders.find(directory.getFullPathName());
+        if (it == folders.end())
+            return {};
+
+        ValueTree rootNode("Folder");
+        rootNode.setProperty("Name", directory.getFileName(), nullptr);
+        rootNode.setProperty("Path", directory.getFullPathName(), nullptr);
+        rootNode.setProperty("Icon", Icons::Folder, nullptr);
+
+        StringArray subfolders = it->second.subfolders;
+        subfolders.sortNatural();
+        for (auto const& subfolder : subfolders) {
+            auto childNode = createTree(directory.getChildFile(subfolder));
+            if (childNode.isValid())
+                rootNode.appendChild(childNode, nullptr);
+        }
+
+        std::vector<String> names;
+        for (auto const& document : it->second.documents)
+            names.push_back(document.name);
+
+        std::sort(names.begin(), names.end(), [](String const& a, String const& b) { return a.compareNatural(b) < 0; });
+
+        for (auto const& name : names) {
+            ValueTree childNode("File");
+            childNode.setProperty("Name", name, nullptr);
+            childNode.setProperty("Path", directory.getChildFile(name).getFullPathName(), nullptr);
+            childNode.setProperty("Icon", Icons::File, nullptr);
+            rootNode.appendChild(childNode, nullptr);
+        }
+
+        return rootNode;
+    }
+
+    // Increase when the format or the contents of the index change
+    static constexpr int version = 1;
+
+    File cache;
+    String rootPath;
+    std::map<String, Folder> folders;
+    bool needsFullCheck = false;
+
+    CriticalSection changedLock;
+    std::set<String> changedFolders;
+};
@@ -184,11 +184,16 @@ public:
 
         items.clear();
 
+        StringArray patches;
         for (auto item : paletteTree) {
             auto paletteItem = new PaletteItem(editor, this, item);
             addAndMakeVisible(items.add(paletteItem));
+            patches.add(paletteItem->getObjectString());
         }
 
+        // Make sure dragging a palette item doesn't have to wait for its drag image
+        editor->offlineRenderer.prerenderPatches(patches, 3.0f);
+
         resized();
     }
 
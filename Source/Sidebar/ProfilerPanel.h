@@ -0,0 +1,590 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#pragma once
+
+#include "Object.h"
+#include "Pd/DSPProfiler.h"
+#include "Dialogs/Dialogs.h"
+
+extern "C" {
+t_glist* clone_get_instance(t_gobj*, int);
+int clone_get_n(t_gobj*);
+}
+
+// Shows which call sites hold the audio lock, and how long the audio thread had to wait for them
+class LockContentionView : public Component
+    , public TableListBoxModel
+    , public SettableTooltipClient
+    , public Timer {
+
+    enum Columns {
+        LocationColumn = 1,
+        CountColumn,
+        HoldColumn,
+        MaxHoldColumn,
+        WaitColumn
+    };
+
+public:
+    explicit LockContentionView(pd::Instance* instance)
+        : pd(instance)
+    {
+        table.setModel(this);
+        table.setRowHeight(24);
+        table.setOutlineThickness(0);
+        table.setColour(ListBox::backgroundColourId, Colours::transparentBlack);
+
+        auto& header = table.getHeader();
+        header.addColumn("Lock call site", LocationColumn, 110, 50, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("n", CountColumn, 40, 30, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("ms", HoldColumn, 45, 30, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("max", MaxHoldColumn, 45, 30, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("wait", WaitColumn, 45, 30, -1, TableHeaderComponent::defaultFlags);
+        header.setSortColumnId(WaitColumn, false);
+        header.setStretchToFitActive(true);
+        addAndMakeVisible(table);
+
+        resetButton.setTooltip("Reset lock statistics");
+        resetButton.onClick = [this]() {
+            pd->audioLock.resetStatistics();
+            timerCallback();
+        };
+        addAndMakeVisible(resetButton);
+
+        saveButton.setTooltip("Save lock report");
+        saveButton.onClick = [this]() {
+            Dialogs::showSaveDialog([_this = SafePointer(this)](File& result) {
+                if (_this && result.getFullPathName().isNotEmpty()) {
+                    _this->pd->audioLock.dumpToFile(result.withFileExtension(".txt"));
+                }
+            },
+                "*.txt", "LockReport");
+        };
+        addAndMakeVisible(saveButton);
+    }
+
+    void visibilityChanged() override
+    {
+        if (isVisible()) {
+            timerCallback();
+            startTimer(1000);
+        } else {
+            stopTimer();
+        }
+    }
+
+    void timerCallback() override
+    {
+        statistics = pd->audioLock.getStatistics();
+        waitHistogram = pd->audioLock.getAudioWaitHistogram();
+        sortRows();
+        table.updateContent();
+        repaint();
+    }
+
+    int getNumRows() override
+    {
+        return static_cast<int>(statistics.size());
+    }
+
+    void paintRowBackground(Graphics& g, int rowNumber, int width, int height, bool rowIsSelected) override
+    {
+    }
+
+    void paintCell(Graphics& g, int rowNumber, int columnId, int width, int height, bool rowIsSelected) override
+    {
+        if (!isPositiveAndBelow(rowNumber, statistics.size()))
+            return;
+
+        auto& callSite = statistics[rowNumber];
+
+        String text;
+        switch (columnId) {
+        case LocationColumn:
+            text = callSite.location;
+            break;
+        case CountColumn:
+            text = String(callSite.numLocks);
+            break;
+        case HoldColumn:
+            text = String(callSite.totalHoldMs, 1);
+            break;
+        case MaxHoldColumn:
+            text = String(callSite.maxHoldMs, 2);
+            break;
+        case WaitColumn:
+            text = String(callSite.audioWaitMs, 2);
+            break;
+        }
+
+        Fonts::drawFittedText(g, text, Rectangle<int>(6, 0, width - 8, height), findColour(PlugDataColour::sidebarTextColourId), 1, 0.9f, 13);
+    }
+
+    String getCellTooltip(int rowNumber, int columnId) override
+    {
+        return isPositiveAndBelow(rowNumber, statistics.size()) ? statistics[rowNumber].location : String();
+    }
+
+    void sortOrderChanged(int newSortColumnId, bool isForwards) override
+    {
+        sortRows();
+        table.updateContent();
+    }
+
+    void paint(Graphics& g) override
+    {
+        auto textColour = findColour(PlugDataColour::sidebarTextColourId);
+
+        g.setColour(findColour(PlugDataColour::toolbarOutlineColourId));
+        g.drawHorizontalLine(0, 0, getWidth());
+
+        Fonts::drawStyledText(g, "Audio thread lock waits", Rectangle<int>(8, 2, getWidth() - 64, 24), textColour, Semibold, 13);
+
+        // Histogram of how long the audio thread had to wait for the lock, on a log scale
+        auto histogramBounds = getLocalBounds().removeFromTop(histogramHeight + 28).withTrimmedTop(28).reduced(8, 2).toFloat();
+        auto barWidth = histogramBounds.getWidth() / pd::AudioLock::numBuckets;
+        auto maxCount = std::max<uint32>(1, *std::max_element(waitHistogram.begin(), waitHistogram.end()));
+
+        for (int i = 0; i < pd::AudioLock::numBuckets; i++) {
+            auto level = std::log10(1.0f + waitHistogram[i]) / std::log10(1.0f + maxCount);
+            auto bar = Rectangle<float>(histogramBounds.getX() + i * barWidth, histogramBounds.getY(), barWidth - 1.0f, histogramBounds.getHeight());
+            g.setColour(i < 8 ? textColour.withAlpha(0.4f) : Colours::red.withAlpha(0.7f));
+            g.fillRect(bar.withTop(bar.getBottom() - bar.getHeight() * level));
+        }
+    }
+
+    void mouseMove(MouseEvent const& e) override
+    {
+        auto histogramBounds = getLocalBounds().removeFromTop(histogramHeight + 28).withTrimmedTop(28).reduced(8, 2);
+        if (histogramBounds.contains(e.getPosition())) {
+            auto bucket = jlimit(0, pd::AudioLock::numBuckets - 1, (e.x - histogramBounds.getX()) * pd::AudioLock::numBuckets / std::max(histogramBounds.getWidth(), 1));
+            setTooltip(pd::AudioLock::getBucketName(bucket) + ": " + String(waitHistogram[bucket]));
+        }
+    }
+
+    void resized() override
+    {
+        auto bounds = getLocalBounds();
+        auto titleBar = bounds.removeFromTop(28);
+        saveButton.setBounds(titleBar.removeFromRight(28));
+        resetButton.setBounds(titleBar.removeFromRight(28));
+        bounds.removeFromTop(histogramHeight);
+        table.setBounds(bounds);
+    }
+
+private:
+    void sortRows()
+    {
+        auto& header = table.getHeader();
+        auto column = header.getSortColumnId();
+        auto forwards = header.isSortedForwards();
+
+        auto lessThan = [column](auto const& a, auto const& b) {
+            switch (column) {
+            case LocationColumn:
+                return a.location.compareNatural(b.location) < 0;
+            case CountColumn:
+                return a.numLocks < b.numLocks;
+            case HoldColumn:
+                return a.totalHoldMs < b.totalHoldMs;
+            case MaxHoldColumn:
+                return a.maxHoldMs < b.maxHoldMs;
+            default:
+                return a.audioWaitMs < b.audioWaitMs;
+            }
+        };
+
+        std::sort(statistics.begin(), statistics.end(), [lessThan, forwards](auto const& a, auto const& b) {
+            return forwards ? lessThan(a, b) : lessThan(b, a);
+        });
+    }
+
+    static constexpr int histogramHeight = 36;
+
+    pd::Instance* pd;
+    TableListBox table;
+    SmallIconButton resetButton = SmallIconButton(Icons::Clear);
+    SmallIconButton saveButton = SmallIconButton(Icons::Save);
+
+    std::vector<pd::AudioLock::CallSiteStatistics> statistics;
+    std::array<uint32, pd::AudioLock::numBuckets> waitHistogram = {};
+};
+
+// Shows the results of the DSP profiler as a sortable table, and as a heat overlay on the objects in all open canvases
+class ProfilerPanel : public Component
+    , public TableListBoxModel
+    , public Timer {
+
+    struct ObjectInfo {
+        String name;
+        String parentName;
+        std::vector<void*> ancestors; // Subpatches this object lives in, so they can show the total load of their content
+        bool isVoice = false;         // Instance of a [clone], which gets a row with the total load of its content
+        int voiceIndex = -1;
+    };
+
+    struct Row {
+        void* object;
+        String name;
+        String parentName;
+        double microseconds;
+        float load;
+    };
+
+    enum Columns {
+        NameColumn = 1,
+        PatchColumn,
+        TimeColumn,
+        LoadColumn
+    };
+
+public:
+    ProfilerPanel(PluginProcessor* processor, PluginEditor* pluginEditor)
+        : pd(processor)
+        , editor(pluginEditor)
+        , lockContentionView(processor)
+    {
+        table.setModel(this);
+        table.setRowHeight(24);
+        table.setOutlineThickness(0);
+        table.setColour(ListBox::backgroundColourId, Colours::transparentBlack);
+
+        auto& header = table.getHeader();
+        header.addColumn("Object", NameColumn, 110, 50, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("Patch", PatchColumn, 70, 40, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("us", TimeColumn, 50, 40, -1, TableHeaderComponent::defaultFlags);
+        header.addColumn("%", LoadColumn, 40, 30, -1, TableHeaderComponent::defaultFlags);
+        header.setSortColumnId(TimeColumn, false);
+        header.setStretchToFitActive(true);
+
+        addAndMakeVisible(table);
+        addAndMakeVisible(lockContentionView);
+    }
+
+    ~ProfilerPanel() override
+    {
+        setProfilingEnabled(false);
+    }
+
+    void setProfilingEnabled(bool shouldProfile)
+    {
+        pd->dspProfiler.setEnabled(shouldProfile);
+
+        if (shouldProfile) {
+            objectInfo.clear();
+            updateCounter = 0;
+            startTimer(250);
+        } else {
+            stopTimer();
+            rows.clear();
+            table.updateContent();
+            updateObjectOverlays({});
+        }
+
+        repaint();
+    }
+
+    bool isProfilingEnabled() const
+    {
+        return pd->dspProfiler.isEnabled();
+    }
+
+    void timerCallback() override
+    {
+        // Re-scan the patch structure every few seconds, in case objects got created or deleted
+        if (updateCounter++ % 8 == 0) {
+            updateObjectInfo();
+        }
+
+        std::vector<pd::DSPProfiler::Entry> entries;
+        auto numBlocks = pd->dspProfiler.getMeasurements(entries);
+        if (!numBlocks)
+            return;
+
+        std::unordered_map<void*, int64> selfTicks;
+        int64 totalTicks = 0;
+        int64 unattributedTicks = 0;
+
+        for (auto& entry : entries) {
+            totalTicks += entry.ticks;
+
+            void* owner = nullptr;
+            for (int i = 0; i < entry.numArgs; i++) {
+                auto* arg = reinterpret_cast<void*>(entry.args[i]);
+                if (objectInfo.count(arg)) {
+                    owner = arg;
+                    break;
+                }
+            }
+
+            if (owner)
+                selfTicks[owner] += entry.ticks;
+            else
+                unattributedTicks += entry.ticks;
+        }
+
+        if (totalTicks <= 0)
+            return;
+
+        std::unordered_map<void*, int64> totalTicksPerObject;
+
+        rows.clear();
+        for (auto& [object, ticks] : selfTicks) {
+            auto& info = objectInfo[object];
+            if (!info.isVoice)
+                rows.push_back({ object, info.name, info.parentName, pd::DSPProfiler::ticksToMicroseconds(ticks) / numBlocks, static_cast<float>(ticks) / totalTicks });
+
+            totalTicksPerObject[object] += ticks;
+            for (auto* ancestor : info.ancestors) {
+                totalTicksPerObject[ancestor] += ticks;
+            }
+        }
+
+        // Voices that run on a chain of their own are measured as a whole, the clone's row shows the time it took to render all of them
+        // Voices that Pd runs as part of the clone have their objects in the main chain, so those show the total of everything inside them
+        for (auto& [object, info] : objectInfo) {
+            if (!info.isVoice)
+                continue;
+
+            int64 ticksPerBlock = 0;
+            if (pd->voiceActivity.getVoiceTicks(info.ancestors.back(), info.voiceIndex, ticksPerBlock)) {
+                rows.push_back({ object, info.name, info.parentName, pd::DSPProfiler::ticksToMicroseconds(ticksPerBlock), static_cast<float>(ticksPerBlock * numBlocks) / totalTicks });
+                continue;
+            }
+
+            if (!totalTicksPerObject.count(object))
+                continue;
+
+            auto ticks = totalTicksPerObject[object];
+            rows.push_back({ object, info.name, info.parentName, pd::DSPProfiler::ticksToMicroseconds(ticks) / numBlocks, static_cast<float>(ticks) / totalTicks });
+        }
+
+        if (unattributedTicks > 0) {
+            rows.push_back({ nullptr, "(other)", "", pd::DSPProfiler::ticksToMicroseconds(unattributedTicks) / numBlocks, static_cast<float>(unattributedTicks) / totalTicks });
+        }
+
+        sortRows();
+        table.updateContent();
+        table.repaint();
+
+        // Normalise to the hottest object, so hotspots stand out even when the total load is low
+        std::unordered_map<void*, float> heat;
+        int64 maxTicks = 1;
+        for (auto& [object, ticks] : totalTicksPerObject) {
+            maxTicks = std::max(maxTicks, ticks);
+        }
+        for (auto& [object, ticks] : totalTicksPerObject) {
+            heat[object] = static_cast<float>(ticks) / maxTicks;
+        }
+
+        updateObjectOverlays(heat);
+    }
+
+    int getNumRows() override
+    {
+        return static_cast<int>(rows.size());
+    }
+
+    void paintRowBackground(Graphics& g, int rowNumber, int width, int height, bool rowIsSelected) override
+    {
+        if (rowIsSelected) {
+            g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
+            PlugDataLook::fillSmoothedRectangle(g, Rectangle<float>(3, 1, width - 6, height - 2), Corners::defaultCornerRadius);
+        }
+    }
+
+    void paintCell(Graphics& g, int rowNumber, int columnId, int width, int height, bool rowIsSelected) override
+    {
+        if (!isPositiveAndBelow(rowNumber, rows.size()))
+            return;
+
+        auto& row = rows[rowNumber];
+        auto colour = findColour(PlugDataColour::sidebarTextColourId);
+
+        String text;
+        switch (columnId) {
+        case NameColumn:
+            text = row.name;
+            break;
+        case PatchColumn:
+            text = row.parentName;
+            break;
+        case TimeColumn:
+            text = String(row.microseconds, 1);
+            break;
+        case LoadColumn:
+            text = String(row.load * 100.0f, 1);
+            break;
+        }
+
+        Fonts::drawFittedText(g, text, Rectangle<int>(6, 0, width - 8, height), colour, 1, 0.9f, 13);
+    }
+
+    void sortOrderChanged(int newSortColumnId, bool isForwards) override
+    {
+        sortRows();
+        table.updateContent();
+    }
+
+    void cellClicked(int rowNumber, int columnId, MouseEvent const& e) override
+    {
+        if (!isPositiveAndBelow(rowNumber, rows.size()) || !rows[rowNumber].object)
+            return;
+
+        auto* object = rows[rowNumber].object;
+        if (!e.mods.isPopupMenu()) {
+            editor->highlightSearchTarget(object, true);
+            return;
+        }
+
+        // Voices that aren't playing can be skipped, the clone is the last subpatch that the voice lives in
+        auto it = objectInfo.find(object);
+        if (it == objectInfo.end() || !it->second.isVoice || it->second.ancestors.empty())
+            return;
+
+        auto* clone = it->second.ancestors.back();
+        auto const voice = it->second.voiceIndex;
+        auto const isActive = pd->voiceActivity.isVoiceActive(clone, voice);
+
+        PopupMenu menu;
+        menu.addItem("Skip DSP of this voice", true, !isActive, [this, clone, voice, isActive]() {
+            pd->voiceActivity.setVoiceActive(clone, voice, !isActive);
+            updateObjectInfo();
+        });
+        menu.showMenuAsync(PopupMenu::Options().withMousePosition());
+    }
+
+    void paint(Graphics& g) override
+    {
+        g.setColour(findColour(PlugDataColour::sidebarBackgroundColourId));
+        g.fillRect(getLocalBounds());
+
+        if (!isProfilingEnabled()) {
+            Fonts::drawFittedText(g, "Enable profiling to measure the DSP load of each object", table.getBounds().reduced(12), findColour(PlugDataColour::sidebarTextColourId).withAlpha(0.6f), 3, 0.9f, 14, Justification::centred);
+        }
+    }
+
+    void resized() override
+    {
+        auto bounds = getLocalBounds();
+        lockContentionView.setBounds(bounds.removeFromBottom(bounds.getHeight() * 0.4f));
+        table.setBounds(bounds);
+    }
+
+    std::unique_ptr<Component> getExtraSettingsComponent()
+    {
+        auto* enableButton = new SmallIconButton(Icons::Power);
+        enableButton->setTooltip("Enable DSP profiling");
+        enableButton->setConnectedEdges(12);
+        enableButton->setClickingTogglesState(true);
+        enableButton->setToggleState(isProfilingEnabled(), dontSendNotification);
+        enableButton->onClick = [this, enableButton]() {
+            setProfilingEnabled(enableButton->getToggleState());
+        };
+
+        return std::unique_ptr<TextButton>(enableButton);
+    }
+
+private:
+    void sortRows()
+    {
+        auto& header = table.getHeader();
+        auto column = header.getSortColumnId();
+        auto forwards = header.isSortedForwards();
+
+        auto lessThan = [column](Row const& a, Row const& b) {
+            switch (column) {
+            case NameColumn:
+                return a.name.compareNatural(b.name) < 0;
+            case PatchColumn:
+                return a.parentName.compareNatural(b.parentName) < 0;
+            default:
+                return a.microseconds < b.microseconds;
+            }
+        };
+
+        // Swap the arguments to sort backwards, negating the result wouldn't be a strict weak ordering
+        std::sort(rows.begin(), rows.end(), [lessThan, forwards](Row const& a, Row const& b) {
+            return forwards ? lessThan(a, b) : lessThan(b, a);
+        });
+    }
+
+    void updateObjectOverlays(std::unordered_map<void*, float> const& heat)
+    {
+        for (auto* cnv : editor->canvases) {
+            for (auto* object : cnv->objects) {
+                auto it = heat.find(object->getPointer());
+                object->setProfilerLoad(it != heat.end() ? it->second : 0.0f);
+            }
+        }
+    }
+
+    void updateObjectInfo()
+    {
+        objectInfo.clear();
+
+        pd->lockAudioThread();
+        for (auto& patch : pd->patches) {
+            collectObjectInfo(patch, patch->getTitle(), {});
+        }
+        pd->unlockAudioThread();
+    }
+
+    void collectObjectInfo(pd::Patch::Ptr patch, String const& patchName, std::vector<void*> const& ancestors)
+    {
+        for (auto objectPtr : patch->getObjects()) {
+            auto object = objectPtr.get<t_pd>();
+            if (!object)
+                continue;
+
+            auto* checkedObject = pd::Interface::checkObject(object.get());
+            if (!checkedObject)
+                continue;
+
+            char* objectText;
+            int len;
+            pd::Interface::getObjectText(checkedObject, &objectText, &len);
+            auto text = String::fromUTF8(objectText, len);
+            freebytes(static_cast<void*>(objectText), static_cast<size_t>(len) * sizeof(char));
+
+            objectInfo[object.get()] = { text, patchName, ancestors };
+
+            String const type = pd::Interface::getObjectClassName(object.get());
+            if (type == "canvas" || type == "graph") {
+                auto subpatchAncestors = ancestors;
+                subpatchAncestors.push_back(object.get());
+
+                pd::Patch::Ptr subpatch = new pd::Patch(objectPtr, pd, false);
+                collectObjectInfo(subpatch, text.upToFirstOccurrenceOf(" ", false, false) == "pd" ? text.fromFirstOccurrenceOf(" ", false, false) : text, subpatchAncestors);
+            } else if (type == "clone") {
+                for (int i = 0; i < clone_get_n(object.cast<t_gobj>()); i++) {
+                    auto* voice = clone_get_instance(object.cast<t_gobj>(), i);
+                    auto voiceName = text + " #" + String(i);
+                    if (!pd->voiceActivity.isVoiceActive(object.get(), i))
+                        voiceName += " (inactive)";
+
+                    auto voiceAncestors = ancestors;
+                    voiceAncestors.push_back(object.get());
+                    objectInfo[voice] = { voiceName, patchName, voiceAncestors, true, i };
+
+                    voiceAncestors.push_back(voice);
+                    pd::Patch::Ptr voicePatch = new pd::Patch(pd::WeakReference(voice, pd), pd, false);
+                    collectObjectInfo(voicePatch, voiceName, voiceAncestors);
+                }
+            }
+        }
+    }
+
+    PluginProcessor* pd;
+    PluginEditor* editor;
+
+    TableListBox table;
+    LockContentionView lockContentionView;
+    std::vector<Row> rows;
+    std::unordered_map<void*, ObjectInfo> objectInfo;
+    int updateCounter = 0;
+};
@@ -9,8 +9,19 @@
 #include <m_pd.h>
 #include <m_imp.h>
 
-class SearchPanel : public Component, public KeyListener, public Timer
+// Shows the objects in the current patch as a tree, or the results of a search through all open patches as a list
+// Both come from the search index, which only reads canvases from Pd after they were edited
+// A search goes through a few canvases at a time, so the first results show up while the rest is still being searched
+class SearchPanel : public Component, public KeyListener, public Timer, public ListBoxModel
 {
+    struct Result {
+        void* object;
+        void* topLevel;
+        String name;
+        String location;
+        String icon;
+    };
+
 public:
     explicit SearchPanel(PluginEditor* pluginEditor) : editor(pluginEditor)
     {
@@ -18,7 +29,7 @@ public:
         input.setTextToShowWhenEmpty("Type to search in patch", findColour(PlugDataColour::sidebarTextColourId).withAlpha(0.5f));
 
         input.onTextChange = [this]() {
-            patchTree.setFilterString(input.getText());
+            startSearch();
         };
 
         input.addKeyListener(this);
@@ -34,7 +45,13 @@ public:
             editor->highlightSearchTarget(ptr, false);
         };
 
+        resultList.setModel(this);
+        resultList.setRowHeight(25);
+        resultList.setOutlineThickness(0);
+        resultList.setColour(ListBox::backgroundColourId, Colours::transparentBlack);
+
         addAndMakeVisible(patchTree);
+        addChildComponent(resultList);
         addAndMakeVisible(input);
 
         input.setJustification(Justification::centredLeft);
@@ -44,18 +61,45 @@ public:
     
     bool keyPressed(KeyPress const& key, Component* originatingComponent) override
     {
+        // Go from the search input to the results
+        if(originatingComponent == &input && key.getKeyCode() == KeyPress::downKey && resultList.isVisible() && getNumRows() > 0)
+        {
+            resultList.selectRow(0);
+            resultList.grabKeyboardFocus();
+            return true;
+        }
+        
         return false;
     }
     
     void timerCallback() override
     {
+        auto& searchIndex = editor->pd->searchIndex;
+        
+        // The index only locks Pd when this list changed or a canvas was edited
+        Array<pd::Patch*> patches;
+        for(auto& patch : editor->pd->patches)
+        {
+            patches.add(patch.get());
+        }
+        
+        searchIndex.update(patches);
+        
         auto* cnv = editor->getCurrentCanvas();
-        if(currentCanvas.getComponent() != cnv || (cnv && cnv->needsSearchUpdate))
+        if(currentCanvas.getComponent() != cnv || treeVersion != searchIndex.getVersion())
         {
             currentCanvas = cnv;
-            currentCanvas->needsSearchUpdate = false;
             updateResults();
         }
+        
+        // The results we have might point to objects that were deleted, so start over
+        if(!query.isEmpty() && searchVersion != searchIndex.getVersion())
+        {
+            startSearch();
+            return;
+        }
+        
+        continueSearch();
     }
     
     void visibilityChanged() override
@@ -100,11 +144,108 @@ public:
     
     void updateResults()
     {
-        auto* cnv = editor->getCurrentCanvas();
-        if(cnv) {
-            auto tree = generatePatchTree(cnv->refCountedPatch);
-            patchTree.setValueTree(tree);
+        auto& searchIndex = editor->pd->searchIndex;
+        treeVersion = searchIndex.getVersion();
+        
+        if(auto* cnv = currentCanvas.getComponent()) {
+            patchTree.setValueTree(searchIndex.createTree(cnv->patch.getPointer().get()));
+        }
+    }
+    
+    void startSearch()
+    {
+        auto& searchIndex = editor->pd->searchIndex;
+        
+        query = pd::SearchIndex::Query(input.getText());
+        searchVersion = searchIndex.getVersion();
+        searchOrder = query.isEmpty() ? Array<t_glist*>() : searchIndex.getSearchOrder();
+        searchPosition = 0;
+        results.clear();
+        
+        resultList.updateContent();
+        resultList.deselectAllRows();
+        resultList.setVisible(!query.isEmpty());
+        patchTree.setVisible(query.isEmpty());
+        
+        continueSearch();
+    }
+    
+    void continueSearch()
+    {
+        if(searchPosition >= searchOrder.size())
+            return;
+        
+        auto& searchIndex = editor->pd->searchIndex;
+        auto const numResults = results.size();
+        auto const startTime = Time::getMillisecondCounterHiRes();
+        
+        while(searchPosition < searchOrder.size() && Time::getMillisecondCounterHiRes() - startTime < 4.0)
+        {
+            auto const* glist = searchIndex.find(searchOrder[searchPosition++]);
+            if(!glist) continue;
+            
+            for(auto const& entry : glist->entries)
+            {
+                if(!query.matches(entry)) continue;
+                
+                auto location = glist->location + " (" + String(entry.position.x) + ":" + String(entry.position.y) + ")";
+                auto icon = entry.isAbstraction ? Icons::File : Icons::Object;
+                results.push_back({ entry.object, entry.topLevel, entry.text, location, icon });
+            }
+        }
+        
+        if(results.size() != numResults)
+            resultList.updateContent();
+        
+        // Come back soon for the rest, and slow down again when we're done
+        if(isVisible())
+            startTimer(searchPosition < searchOrder.size() ? 10 : 100);
+    }
+    
+    int getNumRows() override
+    {
+        return static_cast<int>(results.size());
+    }
+    
+    void paintListBoxItem(int row, Graphics& g, int width, int height, bool rowIsSelected) override
+    {
+        if(!isPositiveAndBelow(row, results.size())) return;
+        
+        auto const& result = results[row];
+        
+        if(rowIsSelected) {
+            g.setColour(findColour(PlugDataColour::sidebarActiveBackgroundColourId));
+            g.fillRoundedRectangle(Rectangle<float>(0, 0, width, height).reduced(4.0f, 2.0f), Corners::defaultCornerRadius);
+        }
+        
+        auto colour = findColour(rowIsSelected ? PlugDataColour::sidebarActiveTextColourId : PlugDataColour::sidebarTextColourId);
+        auto itemBounds = Rectangle<int>(0, 0, width, height).reduced(6, 0);
+        
+        Fonts::drawIcon(g, result.icon, itemBounds.removeFromLeft(22).reduced(2), colour, 12, false);
+        
+        auto locationWidth = Font(15).getStringWidth(result.location) + 4;
+        if(Font(15).getStringWidth(result.name) + locationWidth < itemBounds.getWidth() - 16) {
+            Fonts::drawFittedText(g, result.location, itemBounds.removeFromRight(locationWidth), colour.withAlpha(0.5f));
         }
+        
+        Fonts::drawFittedText(g, result.name, itemBounds, colour);
+    }
+    
+    void selectedRowsChanged(int lastRowSelected) override
+    {
+        if(isPositiveAndBelow(lastRowSelected, results.size()))
+            editor->highlightSearchTarget(results[lastRowSelected].topLevel, false);
+    }
+    
+    void listBoxItemDoubleClicked(int row, MouseEvent const&) override
+    {
+        returnKeyPressed(row);
+    }
+    
+    void returnKeyPressed(int row) override
+    {
+        if(isPositiveAndBelow(row, results.size()))
+            editor->highlightSearchTarget(results[row].object, true);
     }
     
     void grabFocus()
@@ -121,57 +262,19 @@ public:
 
         input.setBounds(inputBounds.reduced(5, 4));
         patchTree.setBounds(tableBounds);
-    }
-    
-    ValueTree generatePatchTree(pd::Patch::Ptr patch, void* topLevel = nullptr)
-    {
-        ValueTree patchTree("Patch");
-        for (auto objectPtr : patch->getObjects()) {
-            if (auto object = objectPtr.get<t_pd>()) {
-                auto* top = topLevel ? topLevel : object.get();
-                String type = pd::Interface::getObjectClassName(object.get());
-                
-                if(!pd::Interface::checkObject(object.get())) continue;
-                
-                char* objectText;
-                int len;
-                pd::Interface::getObjectText(object.cast<t_text>(), &objectText, &len);
-                
-                int x, y, w, h;
-                pd::Interface::getObjectBounds(patch->getPointer().get(), object.cast<t_gobj>(), &x, &y, &w, &h);
-                
-                auto name = String::fromUTF8(objectText, len);
-                auto positionText = " (" + String(x) + ":" + String(y) + ")";
-                
-                ValueTree element("Object");
-                if (type == "canvas" || type == "graph") {
-                    pd::Patch::Ptr subpatch = new pd::Patch(objectPtr, editor->pd, false);
-                    ValueTree subpatchTree = generatePatchTree(subpatch, top);
-                    element.copyPropertiesAndChildrenFrom(subpatchTree, nullptr);
-                    
-                    element.setProperty("Name", name, nullptr);
-                    element.setProperty("RightText", positionText, nullptr);
-                    element.setProperty("Icon", canvas_isabstraction(subpatch->getPointer().get()) ? Icons::File : Icons::Object, nullptr);
-                    element.setProperty("Object", reinterpret_cast<int64>(object.cast<void>()), nullptr);
-                    element.setProperty("TopLevel", reinterpret_cast<int64>(top), nullptr);
-                }
-                else {
-                    element.setProperty("Name", name.upToFirstOccurrenceOf(" ", false, false), nullptr);
-                    element.setProperty("RightText", positionText, nullptr);
-                    element.setProperty("Icon", Icons::Object, nullptr);
-                    element.setProperty("Object", reinterpret_cast<int64>(object.cast<void>()), nullptr);
-                    element.setProperty("TopLevel", reinterpret_cast<int64>(top), nullptr);
-                }
-                
-                patchTree.appendChild(element, nullptr);
-            }
-        }
-
-        return patchTree;
+        resultList.setBounds(tableBounds);
     }
      
     SafePointer<Canvas> currentCanvas;
     PluginEditor* editor;
     ValueTreeViewerComponent patchTree;
+    ListBox resultList;
     SearchEditor input;
+    
+    pd::SearchIndex::Query query = pd::SearchIndex::Query("");
+    Array<t_glist*> searchOrder;
+    int searchPosition = 0;
+    int searchVersion = -1;
+    int treeVersion = -1;
+    std::vector<Result> results;
 };
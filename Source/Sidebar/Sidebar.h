@@ -15,6 +15,7 @@ class Inspector;
 class DocumentationBrowser;
 class AutomationPanel;
 class SearchPanel;
+class ProfilerPanel;
 class PluginProcessor;
 
 namespace pd {
@@ -131,6 +132,7 @@ private:
     SidebarSelectorButton browserButton = SidebarSelectorButton(Icons::Documentation);
     SidebarSelectorButton automationButton = SidebarSelectorButton(Icons::Parameters);
     SidebarSelectorButton searchButton = SidebarSelectorButton(Icons::Search);
+    SidebarSelectorButton profilerButton = SidebarSelectorButton(Icons::CPU);
 
     std::unique_ptr<Component> extraSettingsButton;
     SmallIconButton panelPinButton = SmallIconButton(Icons::Pin);
@@ -140,8 +142,9 @@ private:
     std::unique_ptr<DocumentationBrowser> browser;
     std::unique_ptr<AutomationPanel> automationPanel;
     std::unique_ptr<SearchPanel> searchPanel;
+    std::unique_ptr<ProfilerPanel> profilerPanel;
 
-    StringArray panelNames = { "Console", "Documentation Browser", "Automation Parameters", "Search" };
+    StringArray panelNames = { "Console", "Documentation Browser", "Automation Parameters", "Search", "DSP Profiler" };
     int currentPanel = 0;
 
     int dragStartWidth = 0;
@@ -15,12 +15,38 @@
 // InternalSynth is an internal General MIDI synthesizer that can be used as a MIDI output device
 // The goal is to get something similar to the "AU DLS Synth" in Max/MSP on macOS, but cross-platform
 // Since fluidsynth is alraedy included for the sfont~ object, we can reuse it here to read a GM soundfont
+// Everything the audio thread needs to run fluidsynth. Engines are only ever created and deleted on the background thread,
+// the audio thread swaps them in and hands them back without touching the allocator
+struct InternalSynth::Engine {
+    ~Engine()
+    {
+#ifdef PLUGDATA_STANDALONE
+        if (synth)
+            delete_fluid_synth(synth);
+        if (settings)
+            delete_fluid_settings(settings);
+#endif
+    }
+
+    bool matches(int otherSampleRate, int otherBlockSize, int otherNumChannels) const
+    {
+        return sampleRate == otherSampleRate && blockSize == otherBlockSize && numChannels == otherNumChannels;
+    }
+
+    FluidSynth* synth = nullptr;
+    FluidSettings* settings = nullptr;
+    AudioBuffer<float> buffer;
+
+    int sampleRate = 0;
+    int blockSize = 0;
+    int numChannels = 0;
+};
+
 InternalSynth::InternalSynth()
     : Thread("InternalSynthInit")
 {
-#ifndef PLUGDATA_STANDALONE
-    ignoreUnused(synth);
-    ignoreUnused(settings);
+#ifdef PLUGDATA_STANDALONE
+    startThread();
 #endif
 }
 
@@ -28,14 +54,14 @@ InternalSynth::~InternalSynth()
 {
 #ifdef PLUGDATA_STANDALONE
     stopThread(6000);
-
-    if (ready) {
-        if (synth)
-            delete_fluid_synth(synth);
-        if (settings)
-            delete_fluid_settings(settings);
-    }
 #endif
+
+    Engine* engine;
+    while (retiredEngines.try_dequeue(engine))
+        delete engine;
+
+    delete pendingEngine.exchange(nullptr);
+    delete activeEngine;
 }
 
 void InternalSynth::extractSoundfont()
@@ -51,86 +77,101 @@ void InternalSynth::extractSoundfont()
 #endif
 }
 
-// Initialise fluidsynth on another thread, because it takes a while
+// Creates and deletes fluidsynth instances on another thread, because it takes a while
 void InternalSynth::run()
 {
 #ifdef PLUGDATA_STANDALONE
+    while (!threadShouldExit()) {
+        Engine* retired;
+        while (retiredEngines.try_dequeue(retired)) {
+            if (retired == latestEngine)
+                latestEngine = nullptr;
 
-    unprepareLock.lock();
-
-    // Fluidlite does not like setups with <2 channels
-    internalBuffer.setSize(std::max(2, lastNumChannels.load()), lastBlockSize);
-    internalBuffer.clear();
-
-    // Check if soundfont exists to prevent crashing
-    if (soundFont.existsAsFile()) {
-        auto pathName = soundFont.getFullPathName();
-
-        // Initialise fluidsynth
-        settings = new_fluid_settings();
-        fluid_settings_setint(settings, "synth.ladspa.active", 0);
-        fluid_settings_setint(settings, "synth.midi-channels", 16);
-        fluid_settings_setnum(settings, "synth.gain", 0.9f);
-        fluid_settings_setnum(settings, "synth.audio-channels", lastNumChannels);
-        fluid_settings_setnum(settings, "synth.sample-rate", lastSampleRate);
-        synth = new_fluid_synth(settings); // Create fluidsynth instance:
-
-        // Load the soundfont
-        int ret = fluid_synth_sfload(synth, pathName.toRawUTF8(), 0);
-
-        if (ret >= 0) {
-            fluid_synth_program_reset(synth);
+            delete retired;
         }
 
-        ready = true;
-    }
+        auto const sampleRate = lastSampleRate.load();
+        auto const blockSize = lastBlockSize.load();
+        auto const numChannels = lastNumChannels.load();
+
+        auto const needsEngine = shouldBeLoaded && sampleRate > 0 && blockSize > 0 && (!latestEngine || !latestEngine->matches(sampleRate, blockSize, numChannels));
 
-    unprepareLock.unlock();
+        // Check if soundfont exists to prevent crashing
+        if (needsEngine && soundFont.existsAsFile()) {
+            latestEngine = createEngine(sampleRate, blockSize, numChannels);
 
+            // If the audio thread never picked up the previous engine, nobody else is going to delete it
+            delete pendingEngine.exchange(latestEngine);
+        }
+
+        // The audio thread can't wake us up without risking a lock, so we also check back regularly
+        wait(100);
+    }
 #endif
 }
 
-void InternalSynth::unprepare()
+InternalSynth::Engine* InternalSynth::createEngine(int sampleRate, int blockSize, int numChannels)
 {
-#ifdef PLUGDATA_STANDALONE
+    auto* engine = new Engine();
+    engine->sampleRate = sampleRate;
+    engine->blockSize = blockSize;
+    engine->numChannels = numChannels;
 
-    unprepareLock.lock();
-
-    if (ready) {
-        if (synth)
-            delete_fluid_synth(synth);
-        if (settings)
-            delete_fluid_settings(settings);
+    // Fluidlite does not like setups with <2 channels
+    engine->buffer.setSize(std::max(2, numChannels), blockSize);
+    engine->buffer.clear();
 
-        lastSampleRate = 0;
-        lastBlockSize = 0;
-        lastNumChannels = 0;
+#ifdef PLUGDATA_STANDALONE
+    auto pathName = soundFont.getFullPathName();
+
+    // Initialise fluidsynth
+    engine->settings = new_fluid_settings();
+    fluid_settings_setint(engine->settings, "synth.ladspa.active", 0);
+    fluid_settings_setint(engine->settings, "synth.midi-channels", 16);
+    fluid_settings_setnum(engine->settings, "synth.gain", 0.9f);
+    fluid_settings_setnum(engine->settings, "synth.audio-channels", numChannels);
+    fluid_settings_setnum(engine->settings, "synth.sample-rate", sampleRate);
+    engine->synth = new_fluid_synth(engine->settings); // Create fluidsynth instance:
+
+    // Load the soundfont
+    int ret = fluid_synth_sfload(engine->synth, pathName.toRawUTF8(), 0);
+
+    if (ret >= 0) {
+        fluid_synth_program_reset(engine->synth);
+    }
+#endif
 
-        ready = false;
+    return engine;
+}
 
-        synth = nullptr;
-        settings = nullptr;
-    }
+void InternalSynth::retire(Engine* engine)
+{
+    // The queue only fills up if the background thread got stuck. Leaking the engine is still better than freeing it here
+    if (engine && !retiredEngines.try_enqueue(engine))
+        jassertfalse;
+}
 
-    unprepareLock.unlock();
+void InternalSynth::unprepare()
+{
+#ifdef PLUGDATA_STANDALONE
+    shouldBeLoaded = false;
 
+    retire(pendingEngine.exchange(nullptr));
+    retire(std::exchange(activeEngine, nullptr));
 #endif
 }
 
 void InternalSynth::prepare(int sampleRate, int blockSize, int numChannels)
 {
 #ifdef PLUGDATA_STANDALONE
-
-    if (ready && !isThreadRunning() && sampleRate == lastSampleRate && blockSize == lastBlockSize && numChannels == lastNumChannels) {
-        return;
-    } else {
-        lastSampleRate = sampleRate;
-        lastBlockSize = blockSize;
-        lastNumChannels = numChannels;
-
-        startThread();
-    }
-
+    lastSampleRate = sampleRate;
+    lastBlockSize = blockSize;
+    lastNumChannels = numChannels;
+    shouldBeLoaded = true;
+
+    // Only wake up the background thread from the message thread, signalling it could block the audio thread
+    if (MessageManager::existsAndIsCurrentThread())
+        notify();
 #endif
 }
 
@@ -138,11 +179,24 @@ void InternalSynth::process(AudioBuffer<float>& buffer, MidiBuffer& midiMessages
 {
 #ifdef PLUGDATA_STANDALONE
 
-    if (buffer.getNumChannels() != lastNumChannels || buffer.getNumSamples() > lastBlockSize) {
-        unprepare();
+    if (auto* engine = pendingEngine.exchange(nullptr)) {
+        retire(activeEngine);
+        activeEngine = engine;
+    }
+
+    if (!activeEngine)
+        return;
+
+    // Stay quiet until the background thread has created an engine that fits this buffer
+    if (buffer.getNumChannels() != activeEngine->numChannels || buffer.getNumSamples() > activeEngine->blockSize) {
+        prepare(activeEngine->sampleRate, std::max(activeEngine->blockSize, buffer.getNumSamples()), buffer.getNumChannels());
+        retire(std::exchange(activeEngine, nullptr));
         return;
     }
 
+    auto* synth = activeEngine->synth;
+    auto& internalBuffer = activeEngine->buffer;
+
     // Pass MIDI messages to fluidsynth
     for (auto const& event : midiMessages) {
         auto const message = event.getMessage();
@@ -190,6 +244,6 @@ bool InternalSynth::isReady()
 #ifndef PLUGDATA_STANDALONE
     return false;
 #else
-    return ready;
+    return activeEngine || pendingEngine.load();
 #endif
 }
@@ -11,6 +11,7 @@
 #include <juce_events/juce_events.h>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include "Utility/Config.h"
+#include <readerwriterqueue.h>
 
 typedef struct _fluid_synth_t FluidSynth;
 typedef struct _fluid_hashtable_t FluidSettings;
@@ -24,30 +25,46 @@ public:
 
     void extractSoundfont();
 
-    // Initialise fluidsynth on another thread, because it takes a while
+    // Creates and deletes fluidsynth instances on another thread, because that takes a while and allocates
     void run() override;
 
+    // Asks for the synth to be unloaded. Audio thread only, never blocks
     void unprepare();
 
+    // Asks for a synth with this setup to be loaded. Safe to call from the audio thread, never blocks
     void prepare(int sampleRate, int blockSize, int numChannels);
 
+    // Audio thread only
     void process(AudioBuffer<float>& buffer, MidiBuffer& midiMessages);
 
+    // Audio thread only
     bool isReady();
 
 private:
+    // A fluidsynth instance, along with the setup it was created for
+    struct Engine;
+
+    Engine* createEngine(int sampleRate, int blockSize, int numChannels);
+
+    // Hands an engine back to the background thread to be deleted. Audio thread only
+    void retire(Engine* engine);
+
     File soundFont = ProjectInfo::versionDataDir.getChildFile("Extra").getChildFile("GS").getChildFile("GeneralUser_GS.sf3");
 
-    // Fluidsynth state
-    FluidSynth* synth = nullptr;
-    FluidSettings* settings = nullptr;
+    // Owned by the audio thread
+    Engine* activeEngine = nullptr;
 
-    std::atomic<bool> ready = false;
-    std::mutex unprepareLock;
+    // Created by the background thread, waiting for the audio thread to pick it up
+    std::atomic<Engine*> pendingEngine = nullptr;
 
+    // Engines that the audio thread is done with. Preallocated, so retiring an engine doesn't allocate
+    moodycamel::ReaderWriterQueue<Engine*> retiredEngines = moodycamel::ReaderWriterQueue<Engine*>(16);
+
+    // The last engine the background thread created, until it comes back retired. Background thread only
+    Engine* latestEngine = nullptr;
+
+    std::atomic<bool> shouldBeLoaded = false;
     std::atomic<int> lastSampleRate = 0;
     std::atomic<int> lastBlockSize = 0;
     std::atomic<int> lastNumChannels = 0;
-
-    AudioBuffer<float> internalBuffer;
 };
@@ -518,8 +518,11 @@ class CPUMeter : public Component
     , public Timer
     , public SettableTooltipClient {
 
+    PluginProcessor* pd;
+
 public:
-    CPUMeter()
+    explicit CPUMeter(PluginProcessor* processor)
+        : pd(processor)
     {
         startTimer(1000);
         setTooltip("CPU usage");
@@ -544,6 +547,17 @@ public:
         cpuUsageToDraw = round(lastCpuUsage);
         cpuUsageLongHistory.push(lastCpuUsage);
         updateCPUGraphLong();
+
+        // Compare subpatches that were compiled in place to running them in Pd
+        String tooltip = "CPU usage";
+        for (auto const& load : pd->compiledSubpatches.getLoads()) {
+            tooltip << "\n"
+                    << load.name << ": " << String(load.interpreted, 1) << "% in Pd";
+            if (load.isCompiled)
+                tooltip << ", " << String(load.compiled, 1) << "% compiled";
+        }
+        setTooltip(tooltip);
+
         repaint();
     }
 
@@ -617,7 +631,7 @@ Statusbar::Statusbar(PluginProcessor* processor)
     : pd(processor)
 {
     levelMeter = std::make_unique<LevelMeter>();
-    cpuMeter = std::make_unique<CPUMeter>();
+    cpuMeter = std::make_unique<CPUMeter>(pd);
     midiBlinker = std::make_unique<MIDIBlinker>();
     volumeSlider = std::make_unique<VolumeSlider>();
     oversampleSelector = std::make_unique<OversampleSelector>(processor);
@@ -646,12 +660,14 @@ Statusbar::Statusbar(PluginProcessor* processor)
     debugButton.getToggleStateValue().referTo(SettingsFile::getInstance()->getPropertyAsValue("debug_connections"));
     debugButton.onClick = [this]() {
         set_plugdata_debugging_enabled(debugButton.getToggleState());
+        pd->messageTracer.setEnabled(debugButton.getToggleState());
         // Recreate the DSP graph with the new optimisations
         pd->lockAudioThread();
         canvas_update_dsp();
         pd->unlockAudioThread();
     };
     set_plugdata_debugging_enabled(debugButton.getToggleState());
+    pd->messageTracer.setEnabled(debugButton.getToggleState());
     addAndMakeVisible(debugButton);
 
     powerButton.setTooltip("Enable/disable DSP");
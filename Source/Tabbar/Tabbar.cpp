@@ -559,7 +559,6 @@ void TabComponent::onTabChange(int tabIndex)
     if (!cnv || tabIndex == -1 || editor->pd->isPerformingGlobalSync)
         return;
 
-    cnv->needsSearchUpdate = true;
     cnv->grabKeyboardFocus();
 
     for (auto* split : editor->splitView.splits) {
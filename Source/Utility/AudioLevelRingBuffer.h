@@ -0,0 +1,94 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+
+// Levels of the blocks we've recently sent out, so the meter can show the part of the output that's being heard right now
+// The output stage already measures the peak and RMS of every block, so all the audio thread has to do is store a few numbers. Writing never blocks or allocates
+class AudioLevelRingBuffer {
+    struct Block {
+        std::atomic<float> peak[2] = {};
+        std::atomic<float> rms[2] = {};
+        std::atomic<double> time = 0.0;
+    };
+
+public:
+    // The meter only shows the first two channels
+    static constexpr int numMeteredChannels = 2;
+
+    AudioLevelRingBuffer()
+    {
+    }
+
+    void reset(double sourceSampleRate, int sourceBufferSize, int numChannels)
+    {
+        sampleRate = sourceSampleRate;
+        mainBufferSize = sourceBufferSize;
+        numChannelsToMeter = jlimit(0, numMeteredChannels, numChannels);
+
+        for (auto& block : blocks)
+            block.time.store(0.0, std::memory_order_relaxed);
+    }
+
+    // Audio thread only
+    void write(float const* peaks, float const* rms, int numChannels)
+    {
+        auto& block = blocks[writeIndex];
+        for (int ch = 0; ch < numMeteredChannels; ch++) {
+            block.peak[ch].store(ch < numChannels ? peaks[ch] : 0.0f, std::memory_order_relaxed);
+            block.rms[ch].store(ch < numChannels ? rms[ch] : 0.0f, std::memory_order_relaxed);
+        }
+        block.time.store(Time::getMillisecondCounterHiRes(), std::memory_order_release);
+
+        writeIndex = (writeIndex + 1) % numBlocks;
+    }
+
+    Array<float> getPeak() const
+    {
+        return getLevels(&Block::peak);
+    }
+
+    // On the same scale as the peak
+    Array<float> getRMS() const
+    {
+        return getLevels(&Block::rms);
+    }
+
+private:
+    Array<float> getLevels(std::atomic<float> (Block::*levels)[2]) const
+    {
+        if (sampleRate <= 0 || numChannelsToMeter == 0)
+            return { 0.0f, 0.0f };
+
+        // Look at the blocks that were written one buffer ago, over a window as long as one frame on a 60Hz display
+        // Blocks are written once per buffer, so the window also reaches back one buffer to include the block that was playing when it started
+        auto const bufferLengthMs = 1000.0 * mainBufferSize / sampleRate;
+        auto const windowEnd = Time::getMillisecondCounterHiRes() - bufferLengthMs;
+        auto const windowStart = windowEnd - 1000.0 / 60.0 - bufferLengthMs;
+
+        float result[numMeteredChannels] = {};
+        for (auto const& block : blocks) {
+            auto const time = block.time.load(std::memory_order_acquire);
+            if (time <= windowStart || time > windowEnd)
+                continue;
+
+            for (int ch = 0; ch < numChannelsToMeter; ch++)
+                result[ch] = std::max(result[ch], (block.*levels)[ch].load(std::memory_order_relaxed));
+        }
+
+        Array<float> level;
+        for (int ch = 0; ch < numMeteredChannels; ch++) {
+            level.add(std::sqrt(result[ch]));
+        }
+        return level;
+    }
+
+    // Enough for a window's worth of blocks at the smallest buffer sizes and highest sample rates
+    static constexpr int numBlocks = 1024;
+    Block blocks[numBlocks];
+    int writeIndex = 0;
+
+    int mainBufferSize = 0;
+    double sampleRate = 0;
+    int numChannelsToMeter = 0;
+};
@@ -1,33 +1,275 @@
 #pragma once
-#include <readerwriterqueue.h>
+#include <concurrentqueue.h>
 #include "Dialogs/Dialogs.h"
 
+// Append-only journal of the autosaved states of a single patch
+// Instead of rewriting the whole patch on every autosave, we only append the range of lines that changed since the previous autosave
+// Once the appended edits outgrow the last snapshot, the journal gets compacted into a new snapshot
+// Every record is prefixed with its size, so a record that was only partially written when we crashed is simply ignored
+// This is not a journal of undo steps: Pd's undo actions can't be serialised on their own, so every autosave still serialises the whole patch with getCanvasContent, and we diff that against the previous autosave
+// What it saves is disk traffic, which now grows with the size of the edit instead of with the size of all autosaved patches
+class AutosaveJournal {
+    enum RecordType {
+        Snapshot = 1,
+        Edit = 2
+    };
+
+public:
+    explicit AutosaveJournal(File journalFile)
+        : file(std::move(journalFile))
+    {
+    }
+
+    // Reads back the latest state of the patch, returns false if the journal doesn't contain a valid snapshot
+    bool replay(String& path, String& content, int64& lastModified)
+    {
+        loaded = true;
+        lines.clear();
+        snapshotSize = 0;
+        editsSize = 0;
+
+        FileInputStream input(file);
+        if (!input.openedOk())
+            return false;
+
+        bool hasSnapshot = false;
+        while (!input.isExhausted()) {
+            auto size = input.readInt();
+            if (size <= 0 || size > input.getNumBytesRemaining())
+                break;
+
+            MemoryBlock data;
+            input.readIntoMemoryBlock(data, size);
+            MemoryInputStream record(data, false);
+
+            auto type = record.readByte();
+            auto time = record.readInt64();
+
+            if (type == Snapshot) {
+                patchPath = record.readString();
+                lines = splitLines(record.readString());
+                snapshotSize = size;
+                editsSize = 0;
+                hasSnapshot = true;
+            } else if (type == Edit && hasSnapshot) {
+                auto start = record.readInt();
+                auto numRemoved = record.readInt();
+                auto numInserted = record.readInt();
+                if (start < 0 || numRemoved < 0 || start + numRemoved > lines.size())
+                    break;
+
+                lines.removeRange(start, numRemoved);
+                for (int i = 0; i < numInserted; i++) {
+                    lines.insert(start + i, record.readString());
+                }
+                editsSize += size;
+            } else {
+                break;
+            }
+
+            lastModified = time;
+        }
+
+        path = patchPath;
+        content = lines.joinIntoString("\n");
+        return hasSnapshot;
+    }
+
+    // Appends the changes between the last autosave and content, returns false if nothing changed
+    bool append(String const& path, String const& content, int64 time)
+    {
+        if (!loaded) {
+            String ignoredPath, ignoredContent;
+            int64 ignoredTime;
+            if (!replay(ignoredPath, ignoredContent, ignoredTime))
+                snapshotSize = 0;
+        }
+
+        auto newLines = splitLines(content);
+
+        // Find the range of lines that changed, edits in Pd usually only touch a few lines
+        int prefix = 0;
+        auto maxCommon = std::min(lines.size(), newLines.size());
+        while (prefix < maxCommon && lines[prefix] == newLines[prefix])
+            prefix++;
+
+        int suffix = 0;
+        while (suffix < maxCommon - prefix && lines[lines.size() - 1 - suffix] == newLines[newLines.size() - 1 - suffix])
+            suffix++;
+
+        auto numRemoved = lines.size() - prefix - suffix;
+        auto numInserted = newLines.size() - prefix - suffix;
+
+        if (snapshotSize > 0 && path == patchPath && numRemoved == 0 && numInserted == 0)
+            return false;
+
+        if (snapshotSize == 0 || path != patchPath)
+            return writeSnapshot(path, newLines, time);
+
+        MemoryOutputStream record;
+        record.writeByte(Edit);
+        record.writeInt64(time);
+        record.writeInt(prefix);
+        record.writeInt(numRemoved);
+        record.writeInt(numInserted);
+        for (int i = prefix; i < prefix + numInserted; i++) {
+            record.writeString(newLines[i]);
+        }
+
+        // Compact when replaying the edits would cost more than reading a new snapshot
+        if (editsSize + static_cast<int64>(record.getDataSize()) > snapshotSize) {
+            return writeSnapshot(path, newLines, time);
+        }
+
+        FileOutputStream output(file);
+        if (!output.openedOk())
+            return false;
+
+        output.writeInt(static_cast<int>(record.getDataSize()));
+        output.write(record.getData(), record.getDataSize());
+        output.flush();
+
+        editsSize += static_cast<int64>(record.getDataSize());
+        lines = std::move(newLines);
+        return true;
+    }
+
+private:
+    bool writeSnapshot(String const& path, StringArray newLines, int64 time)
+    {
+        MemoryOutputStream record;
+        record.writeByte(Snapshot);
+        record.writeInt64(time);
+        record.writeString(path);
+        record.writeString(newLines.joinIntoString("\n"));
+
+        // Write to a temporary file first, so we never end up without a valid journal
+        TemporaryFile temporaryFile(file);
+        {
+            FileOutputStream output(temporaryFile.getFile());
+            if (!output.openedOk())
+                return false;
+
+            output.writeInt(static_cast<int>(record.getDataSize()));
+            output.write(record.getData(), record.getDataSize());
+            output.flush();
+        }
+
+        if (!temporaryFile.overwriteTargetFileWithTemporary())
+            return false;
+
+        patchPath = path;
+        lines = std::move(newLines);
+        snapshotSize = static_cast<int64>(record.getDataSize());
+        editsSize = 0;
+        return true;
+    }
+
+    static StringArray splitLines(String const& text)
+    {
+        StringArray result;
+        result.addTokens(text, "\n", "");
+        return result;
+    }
+
+    File file;
+    String patchPath;
+    StringArray lines;
+
+    bool loaded = false;
+    int64 snapshotSize = 0;
+    int64 editsSize = 0;
+};
+
+// The journals of all autosaved patches, and the thread that writes them. All journal file access happens on this thread, so autosaving never blocks the message thread or Pd
+// Shared by all plugin instances through a SharedResourcePointer, so two instances never write to the same journal
+// The first instance reads the journals back into the autosave history, the last one waits for the pending writes before it's freed
+// Autosaves come in from Pd, which only pushes them onto a lock-free queue. The message thread hands them to the journal thread
+class AutosaveJournals : private AsyncUpdater {
+public:
+    static inline File const journalDirectory = ProjectInfo::appDataDir.getChildFile(".autosave_journal");
+    static constexpr int maxAutoSaves = 15;
+
+    AutosaveJournals();
+
+    ~AutosaveJournals() override
+    {
+        handleUpdateNowIfNeeded();
+        journalThread.removeAllJobs(true, -1);
+    }
+
+    // Appends the changes to the journal of this patch on the journal thread, and then updates the autosave history on the message thread
+    // Can be called from any thread, also from Pd
+    void write(String const& path, String const& content, int64 time = Time::currentTimeMillis())
+    {
+        pendingWrites.enqueue({ path, content, time });
+        triggerAsyncUpdate();
+    }
+
+private:
+    struct PendingWrite {
+        String path;
+        String content;
+        int64 time;
+    };
+
+    void handleAsyncUpdate() override
+    {
+        PendingWrite pendingWrite;
+        while (pendingWrites.try_dequeue(pendingWrite)) {
+            addJob(pendingWrite.path, pendingWrite.content, pendingWrite.time);
+        }
+    }
+
+    void addJob(String const& path, String const& content, int64 time);
+
+    static File getJournalFile(String const& path)
+    {
+        return journalDirectory.getChildFile(String::toHexString(path.hashCode64()) + ".journal");
+    }
+
+    // Keeps the journals of the patches that were autosaved most recently, the same ones that the history keeps
+    void removeOldJournals()
+    {
+        auto journalFiles = journalDirectory.findChildFiles(File::findFiles, false, "*.journal");
+        if (journalFiles.size() <= maxAutoSaves)
+            return;
+
+        std::sort(journalFiles.begin(), journalFiles.end(), [](File const& a, File const& b) {
+            return a.getLastModificationTime() > b.getLastModificationTime();
+        });
+
+        for (int i = maxAutoSaves; i < journalFiles.size(); i++) {
+            for (auto it = journals.begin(); it != journals.end(); ++it) {
+                if (getJournalFile(it->first) == journalFiles[i]) {
+                    journals.erase(it);
+                    break;
+                }
+            }
+            journalFiles[i].deleteFile();
+        }
+    }
+
+    moodycamel::ConcurrentQueue<PendingWrite> pendingWrites;
+    ThreadPool journalThread = ThreadPool(1);
+    std::map<String, std::unique_ptr<AutosaveJournal>> journals; // Only accessed from the journal thread
+};
+
 class Autosave : public Timer
-    , public AsyncUpdater
     , public Value::Listener {
 
-    static inline File const autoSaveFile = ProjectInfo::appDataDir.getChildFile(".autosave");
+    static inline File const legacyAutoSaveFile = ProjectInfo::appDataDir.getChildFile(".autosave");
     static inline ValueTree autoSaveTree = ValueTree("Autosave");
+
     Value autosaveInterval;
     Value autosaveEnabled;
 
     PluginProcessor* pd;
-    moodycamel::ReaderWriterQueue<std::pair<String, String>> autoSaveQueue;
 
 public:
     Autosave(PluginProcessor* procesor)
         : pd(procesor)
     {
-        if (!autoSaveFile.existsAsFile()) {
-            autoSaveFile.create();
-        } else {
-            FileInputStream istream(autoSaveFile);
-            autoSaveTree = ValueTree::readFromStream(istream);
-            // In case something went wrong
-            if (!autoSaveTree.isValid())
-                autoSaveTree = ValueTree("Autosave");
-        }
-
         autosaveEnabled.referTo(SettingsFile::getInstance()->getPropertyAsValue("autosave_enabled"));
 
         // autosave timer trigger
@@ -52,10 +294,7 @@ public:
             Dialogs::showOkayCancelDialog(
                 &editor->openedDialog, editor, "Restore autosave? (last autosave is " + String(minutesDifference) + " minutes newer)", [lastAutoSavedPatch, patchPath, callback](bool useAutosaved) {
                     if (useAutosaved) {
-                        MemoryOutputStream ostream;
-                        Base64::convertFromBase64(ostream, lastAutoSavedPatch.getProperty("Patch").toString());
-                        auto autosavedPatch = String::fromUTF8((const char*)ostream.getData(), ostream.getDataSize());
-                        patchPath.replaceWithText(autosavedPatch);
+                        patchPath.replaceWithText(lastAutoSavedPatch.getProperty("Patch").toString());
                         // TODO: instead of replacing, it would be better to load it as a string, (but also with the correct patch path)
                     }
 
@@ -107,11 +346,9 @@ private:
 
             // Simple way to filter out plugdata default patches which we don't want to save.
             if (!isInternalPatch(patchFile)) {
-                autoSaveQueue.enqueue({ patchFile.getFullPathName(), patch->getCanvasContent() });
+                pd->autosaveJournals->write(patchFile.getFullPathName(), patch->getCanvasContent());
             }
         }
-
-        triggerAsyncUpdate();
     }
 
     bool isInternalPatch(File const& patch)
@@ -120,63 +357,116 @@ private:
         return pathName.contains("Documents/plugdata/Abstractions") || pathName.contains("Documents\\plugdata\\Abstractions") || pathName.contains("Documents/plugdata/Documentation") || pathName.contains("Documents\\plugdata\\Documentation") || pathName.contains("Documents/plugdata/Extra") || pathName.contains("Documents\\plugdata\\Extra") || patch.getParentDirectory() == File::getSpecialLocation(File::tempDirectory);
     }
 
-    void handleAsyncUpdate() override
+    static void updateHistory(String const& path, String const& content, int64 time)
     {
-        std::pair<String, String> pathAndContent;
-        while (autoSaveQueue.try_dequeue(pathAndContent)) {
-            auto& [path, content] = pathAndContent;
+        auto existingPatch = autoSaveTree.getChildWithProperty("Path", path);
+
+        if (existingPatch.isValid()) {
+            existingPatch.setProperty("Patch", content, nullptr);
+            existingPatch.setProperty("LastModified", time, nullptr);
+            return;
+        }
 
-            // Make sure we get current time in the correct format used by the OS for file modification time
-            auto tempFile = File::createTempFile("temp_time_test");
-            tempFile.create();
-            auto time = tempFile.getCreationTime().toMilliseconds();
-            tempFile.deleteFile();
+        ValueTree newAutoSave = ValueTree("Save");
+        newAutoSave.setProperty("Path", path, nullptr);
+        newAutoSave.setProperty("Patch", content, nullptr);
+        newAutoSave.setProperty("LastModified", time, nullptr);
+        autoSaveTree.addChild(newAutoSave, 0, nullptr);
 
-            auto existingPatch = autoSaveTree.getChildWithProperty("Path", path);
+        if (autoSaveTree.getNumChildren() <= AutosaveJournals::maxAutoSaves)
+            return;
+
+        int64 oldestTime = std::numeric_limits<int64>::max();
+        int oldestIdx = -1;
+        int currentIdx = 0;
+        for (auto autoSave : autoSaveTree) {
+            auto modifiedTime = static_cast<int64>(autoSave.getProperty("LastModified"));
+            if (modifiedTime < oldestTime) {
+                oldestTime = modifiedTime;
+                oldestIdx = currentIdx;
+            }
+            currentIdx++;
+        }
 
-            if (existingPatch.isValid()) {
-                existingPatch.setProperty("Patch", Base64::toBase64(content), nullptr);
-                existingPatch.setProperty("LastModified", (int64)time, nullptr);
+        // The journal thread removes the journal itself
+        if (oldestIdx >= 0)
+            autoSaveTree.removeChild(oldestIdx, nullptr);
+    }
+
+    // Replays all journals to recover the autosave history, and converts the autosave file that older versions wrote
+    static void loadJournals(AutosaveJournals& journals)
+    {
+        for (auto const& journalFile : AutosaveJournals::journalDirectory.findChildFiles(File::findFiles, false, "*.journal")) {
+            String path, content;
+            int64 lastModified = 0;
+            if (AutosaveJournal(journalFile).replay(path, content, lastModified)) {
+                ValueTree autoSave = ValueTree("Save");
+                autoSave.setProperty("Path", path, nullptr);
+                autoSave.setProperty("Patch", content, nullptr);
+                autoSave.setProperty("LastModified", lastModified, nullptr);
+                autoSaveTree.appendChild(autoSave, nullptr);
             } else {
-                ValueTree newAutoSave = ValueTree("Save");
-                newAutoSave.setProperty("Path", path, nullptr);
-                newAutoSave.setProperty("Patch", Base64::toBase64(content), nullptr);
-                newAutoSave.setProperty("LastModified", (int64)time, nullptr);
-                autoSaveTree.addChild(newAutoSave, 0, nullptr);
-
-                if (autoSaveTree.getNumChildren() > 15) {
-                    int64 oldestTime = std::numeric_limits<int64>::max();
-                    int oldestIdx = -1;
-                    int currentIdx = 0;
-                    for (auto autoSave : autoSaveTree) {
-                        auto modifiedTime = static_cast<int64>(autoSave.getProperty("LastModified"));
-                        if (modifiedTime < oldestTime) {
-                            oldestTime = modifiedTime;
-                            oldestIdx = currentIdx;
-                        }
-                        currentIdx++;
-                    }
-                    if (oldestIdx >= 0) {
-                        autoSaveTree.removeChild(oldestIdx, nullptr);
-                    }
-                }
+                journalFile.deleteFile();
             }
         }
 
-        autoSaveFile.replaceWithText("");
-        FileOutputStream ostream(autoSaveFile);
-        autoSaveTree.writeToStream(ostream);
+        if (legacyAutoSaveFile.existsAsFile()) {
+            FileInputStream istream(legacyAutoSaveFile);
+            auto legacyTree = ValueTree::readFromStream(istream);
+
+            for (auto legacyAutoSave : legacyTree) {
+                auto path = legacyAutoSave.getProperty("Path").toString();
+                if (autoSaveTree.getChildWithProperty("Path", path).isValid())
+                    continue;
+
+                MemoryOutputStream ostream;
+                Base64::convertFromBase64(ostream, legacyAutoSave.getProperty("Patch").toString());
+
+                auto content = ostream.toUTF8();
+                auto lastModified = static_cast<int64>(legacyAutoSave.getProperty("LastModified"));
+                updateHistory(path, content, lastModified);
+                journals.write(path, content, lastModified);
+            }
+
+            legacyAutoSaveFile.deleteFile();
+        }
     }
 
+    friend class AutosaveJournals;
     friend class AutosaveHistoryComponent;
 };
 
+inline AutosaveJournals::AutosaveJournals()
+{
+    Autosave::loadJournals(*this);
+}
+
+inline void AutosaveJournals::addJob(String const& path, String const& content, int64 time)
+{
+    journalThread.addJob([this, path, content, time]() {
+        auto& journal = journals[path];
+        if (!journal) {
+            journalDirectory.createDirectory();
+            journal = std::make_unique<AutosaveJournal>(getJournalFile(path));
+        }
+
+        if (!journal->append(path, content, time))
+            return;
+
+        removeOldJournals();
+
+        MessageManager::callAsync([path, content, time]() {
+            Autosave::updateHistory(path, content, time);
+        });
+    });
+}
+
 class AutosaveHistoryComponent : public Component {
     struct AutoSaveHistory : public Component {
         AutoSaveHistory(PluginEditor* editor, ValueTree autoSaveTree)
         {
             patchPath = autoSaveTree.getProperty("Path").toString();
-            patch = autoSaveTree.getProperty("Patch").toString();
+            patchContent = autoSaveTree.getProperty("Patch").toString();
 
             addAndMakeVisible(openPatch);
 
@@ -185,9 +475,7 @@ class AutosaveHistoryComponent : public Component {
             openPatch.setColour(TextButton::buttonOnColourId, backgroundColour.contrasting(0.1f));
             openPatch.setColour(ComboBox::outlineColourId, Colours::transparentBlack);
             openPatch.onClick = [this, editor]() {
-                MemoryOutputStream ostream;
-                Base64::convertFromBase64(ostream, patch);
-                auto patch = editor->pd->loadPatch(String::fromUTF8(static_cast<const char*>(ostream.getData()), ostream.getDataSize()), editor);
+                auto patch = editor->pd->loadPatch(patchContent, editor);
                 patch->setTitle(patchPath.fromLastOccurrenceOf("/", false, false));
                 patch->setCurrentFile(File(patchPath));
 
@@ -229,7 +517,7 @@ class AutosaveHistoryComponent : public Component {
         }
 
         String patchPath;
-        String patch;
+        String patchContent;
         TextButton openPatch = TextButton("Open");
     };
 
@@ -28,7 +28,11 @@ OfflineObjectRenderer::OfflineObjectRenderer(pd::Instance* instance)
     offlineCnv = static_cast<t_canvas*>(pd::Interface::createCanvas(file, dir));
 }
 
-OfflineObjectRenderer::~OfflineObjectRenderer() = default;
+OfflineObjectRenderer::~OfflineObjectRenderer()
+{
+    cancelPendingUpdate();
+    prerenderPool.removeAllJobs(true, 5000);
+}
 
 OfflineObjectRenderer* OfflineObjectRenderer::findParentOfflineObjectRendererFor(Component* childComponent)
 {
@@ -37,50 +41,115 @@ OfflineObjectRenderer* OfflineObjectRenderer::findParentOfflineObjectRendererFor
 
 ImageWithOffset OfflineObjectRenderer::patchToMaskedImage(String const& patch, float scale, bool makeInvalidImage)
 {
-    auto image = patchToTempImage(patch, scale);
-    auto width = image.image.getWidth();
-    auto height = image.image.getHeight();
-    auto output = Image(Image::ARGB, width, height, true);
+    auto const patchSHA256 = SHA256(patch.getCharPointer()).toHexString();
+    auto const backgroundColour = LookAndFeel::getDefaultLookAndFeel().findColour(PlugDataColour::objectSelectedOutlineColourId).withAlpha(0.3f);
+    auto const key = getImageCacheKey(patchSHA256, scale, backgroundColour, makeInvalidImage);
 
-    Graphics g(output);
-    g.reduceClipRegion(image.image, AffineTransform());
-    auto backgroundColour = LookAndFeel::getDefaultLookAndFeel().findColour(PlugDataColour::objectSelectedOutlineColourId).withAlpha(0.3f);
-    g.fillAll(backgroundColour);
+    ImageWithOffset output;
+    if (getCachedImage(key, output))
+        return output;
 
-    if (makeInvalidImage) {
-        AffineTransform rotate;
-        rotate = rotate.rotated(MathConstants<float>::pi / 4.0f);
-        g.addTransform(rotate);
-        float diagonalLength = std::sqrt(width * width + height * height);
-        g.setColour(backgroundColour.darker(3.0f));
-        auto stripeWidth = 20.0f;
-        for (float x = -diagonalLength; x < diagonalLength; x += (stripeWidth * 2)) {
-            g.fillRect(x, -diagonalLength, stripeWidth, diagonalLength * 2);
-        }
-        g.addTransform(rotate.inverted());
-    }
+    output = renderMaskedImage(getPatchGeometry(patch, patchSHA256), scale, backgroundColour, makeInvalidImage);
+    addCachedImage(key, output);
+    return output;
+}
 
-    return ImageWithOffset(output, image.offset);
+void OfflineObjectRenderer::prerenderPatches(StringArray const& patches, float scale)
+{
+    // Look up the theme colour here, the LookAndFeel should only be accessed from the message thread
+    prerenderBackgroundColour = LookAndFeel::getDefaultLookAndFeel().findColour(PlugDataColour::objectSelectedOutlineColourId).withAlpha(0.3f);
+    prerenderScale = scale;
+    patchesToPrerender = patches;
+    triggerAsyncUpdate();
 }
 
-ImageWithOffset OfflineObjectRenderer::patchToTempImage(String const& patch, float scale)
+// Pd objects are only created on the message thread, one patch per callback, so the audio thread is never locked for long and the UI stays responsive
+// Only the drawing happens on the prerender thread
+void OfflineObjectRenderer::handleAsyncUpdate()
 {
-    static std::unordered_map<String, ImageWithOffset> patchImageCache;
+    if (patchesToPrerender.isEmpty())
+        return;
+
+    auto const patch = patchesToPrerender[0];
+    patchesToPrerender.remove(0);
+
+    if (!patchesToPrerender.isEmpty())
+        triggerAsyncUpdate();
 
     auto const patchSHA256 = SHA256(patch.getCharPointer()).toHexString();
-    if (patchImageCache.contains(patchSHA256)) {
-        return patchImageCache[patchSHA256];
+    auto const geometry = getPatchGeometry(patch, patchSHA256);
+
+    prerenderPool.addJob([this, geometry, patchSHA256, scale = prerenderScale, backgroundColour = prerenderBackgroundColour]() {
+        for (auto makeInvalidImage : { false, true }) {
+            auto const key = getImageCacheKey(patchSHA256, scale, backgroundColour, makeInvalidImage);
+
+            ImageWithOffset image;
+            if (getCachedImage(key, image))
+                continue;
+
+            addCachedImage(key, renderMaskedImage(geometry, scale, backgroundColour, makeInvalidImage));
+        }
+    });
+}
+
+String OfflineObjectRenderer::getImageCacheKey(String const& patchHash, float scale, Colour backgroundColour, bool makeInvalidImage)
+{
+    return patchHash + ":" + String(scale) + ":" + backgroundColour.toString() + (makeInvalidImage ? ":invalid" : "");
+}
+
+bool OfflineObjectRenderer::getCachedImage(String const& key, ImageWithOffset& result)
+{
+    ScopedLock lock(cacheLock);
+
+    auto it = imageCache.find(key);
+    if (it == imageCache.end())
+        return false;
+
+    // Mark as most recently used
+    imageCacheLRU.splice(imageCacheLRU.begin(), imageCacheLRU, it->second.lruPosition);
+    result = it->second.image;
+    return true;
+}
+
+void OfflineObjectRenderer::addCachedImage(String const& key, ImageWithOffset const& image)
+{
+    ScopedLock lock(cacheLock);
+
+    if (imageCache.contains(key))
+        return;
+
+    auto numBytes = static_cast<size_t>(image.image.getWidth()) * image.image.getHeight() * 4;
+
+    // Evict least recently used images until the new one fits
+    while (!imageCacheLRU.empty() && imageCacheSize + numBytes > imageCacheBudget) {
+        auto& oldest = imageCache[imageCacheLRU.back()];
+        imageCacheSize -= oldest.numBytes;
+        imageCache.erase(imageCacheLRU.back());
+        imageCacheLRU.pop_back();
     }
 
-    pd->setThis();
+    imageCacheLRU.push_front(key);
+    imageCache[key] = { image, numBytes, imageCacheLRU.begin() };
+    imageCacheSize += numBytes;
+}
 
-    sys_lock();
+OfflineObjectRenderer::PatchGeometry OfflineObjectRenderer::getPatchGeometry(String const& patch, String const& patchHash)
+{
+    {
+        ScopedLock lock(cacheLock);
+        auto it = geometryCache.find(patchHash);
+        if (it != geometryCache.end())
+            return it->second;
+    }
+
+    PatchGeometry geometry;
+
+    pd->lockAudioThread();
+    pd->setThis();
     pd->muteConsole(true);
 
     canvas_create_editor(offlineCnv);
 
-    objectRects.clear();
-    totalSize.setBounds(0, 0, 0, 0);
     int obj_x, obj_y, obj_w, obj_h;
     auto rect = Rectangle<int>();
     pd::Interface::paste(offlineCnv, stripConnections(patch).toRawUTF8());
@@ -96,8 +165,8 @@ ImageWithOffset OfflineObjectRenderer::patchToTempImage(String const& patch, flo
         rect.setBounds(obj_x, obj_y, maxSize, obj_h);
 
         // put the object bounds into the rect list, and also calculate the total size of all objects
-        objectRects.add(rect);
-        totalSize = totalSize.getUnion(rect);
+        geometry.objectRects.add(rect);
+        geometry.totalSize = geometry.totalSize.getUnion(rect);
 
         // save the pointer to the next object
         auto nextObject = object->g_next;
@@ -108,24 +177,63 @@ ImageWithOffset OfflineObjectRenderer::patchToTempImage(String const& patch, flo
     }
 
     pd->muteConsole(false);
-    sys_unlock();
+    pd->unlockAudioThread();
 
     // apply the top left offset to all rects
-    for (auto& rect : objectRects) {
-        rect.translate(-totalSize.getX(), -totalSize.getY());
+    for (auto& objectRect : geometry.objectRects) {
+        objectRect.translate(-geometry.totalSize.getX(), -geometry.totalSize.getY());
     }
-    auto size = Point<int>(totalSize.getWidth(), totalSize.getHeight());
-    Image image(Image::ARGB, totalSize.getWidth() * scale, totalSize.getHeight() * scale, true);
-    Graphics g(image);
-    g.addTransform(AffineTransform::scale(scale));
-    g.setColour(Colours::white);
-    for (auto& rect : objectRects) {
-        g.fillRoundedRectangle(rect.toFloat(), 5.0f);
+
+    ScopedLock lock(cacheLock);
+
+    // Geometry is small, but patches can come from anywhere, so don't let this grow forever
+    if (geometryCache.size() > 2048)
+        geometryCache.clear();
+
+    geometryCache[patchHash] = geometry;
+    return geometry;
+}
+
+// Doesn't touch any state, so this is safe to call from the prerender thread
+ImageWithOffset OfflineObjectRenderer::renderMaskedImage(PatchGeometry const& geometry, float scale, Colour backgroundColour, bool makeInvalidImage)
+{
+    auto const& totalSize = geometry.totalSize;
+    auto width = static_cast<int>(totalSize.getWidth() * scale);
+    auto height = static_cast<int>(totalSize.getHeight() * scale);
+
+    if (width <= 0 || height <= 0)
+        return ImageWithOffset(Image(), Point<int>(totalSize.getWidth(), totalSize.getHeight()));
+
+    Image mask(Image::ARGB, width, height, true, SoftwareImageType());
+    {
+        Graphics g(mask);
+        g.addTransform(AffineTransform::scale(scale));
+        g.setColour(Colours::white);
+        for (auto& rect : geometry.objectRects) {
+            g.fillRoundedRectangle(rect.toFloat(), 5.0f);
+        }
     }
 
-    auto output = ImageWithOffset(image, size);
-    patchImageCache.emplace(patchSHA256, output);
-    return output;
+    auto output = Image(Image::ARGB, width, height, true, SoftwareImageType());
+
+    Graphics g(output);
+    g.reduceClipRegion(mask, AffineTransform());
+    g.fillAll(backgroundColour);
+
+    if (makeInvalidImage) {
+        AffineTransform rotate;
+        rotate = rotate.rotated(MathConstants<float>::pi / 4.0f);
+        g.addTransform(rotate);
+        float diagonalLength = std::sqrt(width * width + height * height);
+        g.setColour(backgroundColour.darker(3.0f));
+        auto stripeWidth = 20.0f;
+        for (float x = -diagonalLength; x < diagonalLength; x += (stripeWidth * 2)) {
+            g.fillRect(x, -diagonalLength, stripeWidth, diagonalLength * 2);
+        }
+        g.addTransform(rotate.inverted());
+    }
+
+    return ImageWithOffset(output, Point<int>(totalSize.getWidth(), totalSize.getHeight()));
 }
 
 bool OfflineObjectRenderer::checkIfPatchIsValid(String const& patch)
@@ -21,7 +21,7 @@ public:
     Point<int> offset;
 };
 
-class OfflineObjectRenderer {
+class OfflineObjectRenderer : private AsyncUpdater {
 public:
     OfflineObjectRenderer(pd::Instance* pd);
     virtual ~OfflineObjectRenderer();
@@ -30,17 +30,53 @@ public:
 
     ImageWithOffset patchToMaskedImage(String const& patch, float scale, bool makeInvalidImage = false);
 
+    // Renders the drag images for these patches in the background, so they are ready when the user starts dragging. Replaces the patches that weren't prerendered yet
+    void prerenderPatches(StringArray const& patches, float scale);
+
     bool checkIfPatchIsValid(String const& patch);
 
     std::pair<std::vector<bool>, std::vector<bool>> countIolets(String const& patch);
 
+    // Maximum amount of image memory the drag image cache may use
+    static constexpr size_t imageCacheBudget = 32 * 1024 * 1024;
+
 private:
+    // Size and position of all objects in a patch, which doesn't depend on scale or theme
+    struct PatchGeometry {
+        Array<Rectangle<int>> objectRects;
+        Rectangle<int> totalSize;
+    };
+
+    struct CachedImage {
+        ImageWithOffset image;
+        size_t numBytes;
+        std::list<String>::iterator lruPosition;
+    };
+
+    void handleAsyncUpdate() override;
+
     String stripConnections(String const& patch);
 
-    ImageWithOffset patchToTempImage(String const& patch, float scale);
+    PatchGeometry getPatchGeometry(String const& patch, String const& patchHash);
+
+    ImageWithOffset renderMaskedImage(PatchGeometry const& geometry, float scale, Colour backgroundColour, bool makeInvalidImage);
+
+    static String getImageCacheKey(String const& patchHash, float scale, Colour backgroundColour, bool makeInvalidImage);
+
+    bool getCachedImage(String const& key, ImageWithOffset& result);
+    void addCachedImage(String const& key, ImageWithOffset const& image);
+
+    CriticalSection cacheLock;
+    std::unordered_map<String, PatchGeometry> geometryCache;
+    std::unordered_map<String, CachedImage> imageCache;
+    std::list<String> imageCacheLRU; // Most recently used at the front
+    size_t imageCacheSize = 0;
+
+    StringArray patchesToPrerender;
+    float prerenderScale = 1.0f;
+    Colour prerenderBackgroundColour;
+    ThreadPool prerenderPool = ThreadPool(1);
 
-    Array<Rectangle<int>> objectRects;
-    Rectangle<int> totalSize;
     t_glist* offlineCnv = nullptr;
     pd::Instance* pd;
 };
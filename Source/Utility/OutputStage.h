@@ -0,0 +1,213 @@
+/*
+ // Copyright (c) 2021-2023 Timothy Schoen and Alex Mitchell
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#pragma once
+
+// The last step before our output reaches the host: applies the main volume, measures the levels for the meter, and in protected mode takes out inf and NaN values and limits the output
+// These used to be separate passes over the whole buffer. Now every sample is loaded and stored only once, which adds up with many output channels and small blocks
+// The limiter's envelopes depend on the previous sample, so we can't vectorise over time. Instead, each SIMD lane runs a different channel
+class OutputStage {
+    using Vec = dsp::SIMDRegister<float>;
+    static constexpr int numLanes = static_cast<int>(Vec::SIMDNumElements);
+
+    // Same behaviour as dsp::Compressor with a peak envelope, which is what the limiter used to be built from
+    struct Compressor {
+        void prepare(double sampleRate, float thresholddB, float ratio, float attackMs, float releaseMs)
+        {
+            auto const expFactor = -2.0 * MathConstants<double>::pi * 1000.0 / sampleRate;
+            auto const calculateCte = [expFactor](float timeMs) {
+                return timeMs < 1.0e-3f ? 0.0f : static_cast<float>(std::exp(expFactor / timeMs));
+            };
+
+            threshold = Decibels::decibelsToGain(thresholddB, -200.0f);
+            thresholdInverse = 1.0f / threshold;
+            exponent = 1.0f / ratio - 1.0f;
+            attack = calculateCte(attackMs);
+            release = calculateCte(releaseMs);
+        }
+
+        Vec process(Vec input, Vec& envelope) const noexcept
+        {
+            auto const level = Vec::abs(input);
+            auto const rising = Vec::greaterThan(level, envelope);
+            auto const cte = (Vec::expand(attack) & rising) + (Vec::expand(release) & ~rising);
+            envelope = level + cte * (envelope - level);
+
+            // Below the threshold the gain is 1, which is the common case. Only work out the gain if one of the channels needs it
+            if (Vec::lessThan(envelope, Vec::expand(threshold)) == Vec::vMaskType::expand(~0u))
+                return input;
+
+            alignas(Vec::SIMDRegisterSize) float gain[numLanes];
+            envelope.copyToRawArray(gain);
+            for (auto& g : gain)
+                g = g < threshold ? 1.0f : std::pow(g * thresholdInverse, exponent);
+
+            return input * Vec::fromRawArray(gain);
+        }
+
+        float threshold = 1.0f;
+        float thresholdInverse = 1.0f;
+        float exponent = 0.0f;
+        float attack = 0.0f;
+        float release = 0.0f;
+    };
+
+public:
+    OutputStage() = default;
+
+    void prepare(double sampleRate, int maximumBlockSize, int numChannels)
+    {
+        jassert(sampleRate > 0);
+        jassert(maximumBlockSize > 0);
+
+        blockSize = std::max(1, maximumBlockSize);
+        numPreparedChannels = std::max(1, numChannels);
+
+        firstStage.prepare(sampleRate, -8.0f, 4.0f, 2.0f, 200.0f);
+        secondStage.prepare(sampleRate, -6.0f, 1000.0f, 0.001f, releaseTime);
+
+        auto const numPaddedChannels = (numPreparedChannels + numLanes - 1) / numLanes * numLanes;
+        firstEnvelopes.resize(numPaddedChannels);
+        secondEnvelopes.resize(numPaddedChannels);
+        peaks.resize(numPaddedChannels);
+        rms.resize(numPaddedChannels);
+
+        gains.resize(blockSize);
+        unusedLane.resize(blockSize);
+
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(firstEnvelopes.begin(), firstEnvelopes.end(), 0.0f);
+        std::fill(secondEnvelopes.begin(), secondEnvelopes.end(), 0.0f);
+        std::fill(peaks.begin(), peaks.end(), 0.0f);
+        std::fill(rms.begin(), rms.end(), 0.0f);
+    }
+
+    // Applies the smoothed gain to the buffer and measures the levels. If protect is set, non-finite values get replaced with zero, and the output gets limited and clipped to [-1, 1]
+    void process(AudioBuffer<float>& buffer, SmoothedValue<float, ValueSmoothingTypes::Linear>& gain, bool protect) noexcept
+    {
+        auto const numChannels = std::min(buffer.getNumChannels(), numPreparedChannels);
+        auto const numSamples = buffer.getNumSamples();
+        jassert(buffer.getNumChannels() <= numPreparedChannels);
+
+        if (numChannels <= 0 || numSamples <= 0)
+            return;
+
+        std::fill(peaks.begin(), peaks.end(), 0.0f);
+        std::fill(rms.begin(), rms.end(), 0.0f);
+
+        // Hosts aren't supposed to send us more than the block size we prepared for, but if they do we'll do it in parts
+        for (int start = 0; start < numSamples; start += blockSize) {
+            auto const length = std::min(blockSize, numSamples - start);
+
+            for (int i = 0; i < length; i++)
+                gains[i] = gain.getNextValue();
+
+            for (int channel = 0; channel < numChannels; channel += numLanes) {
+                if (protect)
+                    processChannels<true>(buffer, channel, start, length);
+                else
+                    processChannels<false>(buffer, channel, start, length);
+            }
+        }
+
+        for (int channel = 0; channel < numChannels; channel++)
+            rms[channel] = std::sqrt(rms[channel] / static_cast<float>(numSamples));
+    }
+
+    // Peak and RMS of each channel in the last processed block, measured after the gain and before limiting
+    float const* getPeaks() const noexcept
+    {
+        return peaks.data();
+    }
+
+    float const* getRMS() const noexcept
+    {
+        return rms.data();
+    }
+
+private:
+    template<bool Protect>
+    void processChannels(AudioBuffer<float>& buffer, int firstChannel, int start, int length) noexcept
+    {
+        // Lanes without a channel get to work on a scratch buffer
+        float* channels[numLanes];
+        for (int lane = 0; lane < numLanes; lane++) {
+            auto const channel = firstChannel + lane;
+            channels[lane] = channel < buffer.getNumChannels() && channel < numPreparedChannels ? buffer.getWritePointer(channel, start) : unusedLane.data();
+        }
+
+        alignas(Vec::SIMDRegisterSize) float lanes[numLanes];
+        auto const loadLanes = [&lanes](float const* source) {
+            std::copy(source, source + numLanes, lanes);
+            return Vec::fromRawArray(lanes);
+        };
+
+        auto firstEnvelope = loadLanes(firstEnvelopes.data() + firstChannel);
+        auto secondEnvelope = loadLanes(secondEnvelopes.data() + firstChannel);
+        auto peak = loadLanes(peaks.data() + firstChannel);
+        auto sumOfSquares = loadLanes(rms.data() + firstChannel);
+
+        auto const infinity = Vec::expand(std::numeric_limits<float>::infinity());
+        auto const minusOne = Vec::expand(-1.0f);
+        auto const one = Vec::expand(1.0f);
+
+        for (int i = 0; i < length; i++) {
+            for (int lane = 0; lane < numLanes; lane++)
+                lanes[lane] = channels[lane][i];
+
+            auto sample = Vec::fromRawArray(lanes);
+
+            // Comparisons with NaN are always false, so this catches both inf and NaN
+            if constexpr (Protect)
+                sample = sample & Vec::lessThan(Vec::abs(sample), infinity);
+
+            sample = sample * Vec::expand(gains[i]);
+
+            peak = Vec::max(peak, Vec::abs(sample));
+            sumOfSquares = sumOfSquares + sample * sample;
+
+            if constexpr (Protect) {
+                sample = firstStage.process(sample, firstEnvelope);
+                sample = secondStage.process(sample, secondEnvelope);
+                sample = Vec::min(Vec::max(sample, minusOne), one);
+            }
+
+            sample.copyToRawArray(lanes);
+            for (int lane = 0; lane < numLanes; lane++)
+                channels[lane][i] = lanes[lane];
+        }
+
+        auto const storeLanes = [&lanes](Vec value, float* destination) {
+            value.copyToRawArray(lanes);
+            std::copy(lanes, lanes + numLanes, destination);
+        };
+
+        storeLanes(firstEnvelope, firstEnvelopes.data() + firstChannel);
+        storeLanes(secondEnvelope, secondEnvelopes.data() + firstChannel);
+        storeLanes(peak, peaks.data() + firstChannel);
+        storeLanes(sumOfSquares, rms.data() + firstChannel);
+    }
+
+    Compressor firstStage, secondStage;
+
+    int blockSize = 0;
+    int numPreparedChannels = 0;
+
+    // One entry per channel, rounded up to a whole number of SIMD registers
+    std::vector<float> firstEnvelopes;
+    std::vector<float> secondEnvelopes;
+    std::vector<float> peaks;
+    std::vector<float> rms;
+
+    std::vector<float> gains;
+    std::vector<float> unusedLane;
+
+    float releaseTime = 100.0;
+};
@@ -0,0 +1,156 @@
+/*
+ // Copyright (c) 2023 Timothy Schoen.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+#pragma once
+
+// Binary format for the state that we store in the DAW session
+// Every unique patch content is stored once. Patches that are unchanged since they were saved to disk also get the hash of their file
+// On restore, those are opened from disk again, unless the file was changed in the meantime, in which case we fall back to the stored content
+// The payload is compressed when it gets large. States written by older versions of plugdata use a different layout, which setStateInformation still reads
+struct SessionState {
+    // Negative, so that it can never be mistaken for the number of patches at the start of the legacy format
+    static constexpr int magic = -0x50445354;
+    static constexpr int currentVersion = 1;
+
+    // Smaller states are not worth the time it takes to compress them
+    static constexpr size_t compressionThreshold = 16384;
+
+    struct Patch {
+        String content;
+        String location; // Might contain placeholders, like ${PRESET_DIR}
+        bool pluginMode = false;
+        int splitIndex = 0;
+        bool fileChanged = false; // The file on disk is not what this patch looked like when it was stored, so it should be restored from its content
+    };
+
+    // Hash of the contents of a file, only read again when the file was modified. getStateInformation can get called often, and shouldn't read every patch each time
+    static int64 getFileHash(File const& file)
+    {
+        struct CachedHash {
+            Time modified;
+            int64 size;
+            int64 hash;
+        };
+
+        static std::mutex cacheLock;
+        static std::map<String, CachedHash> cache;
+
+        auto const path = file.getFullPathName();
+        auto const modified = file.getLastModificationTime();
+        auto const size = file.getSize();
+
+        {
+            std::lock_guard<std::mutex> lock(cacheLock);
+            if (auto it = cache.find(path); it != cache.end() && it->second.modified == modified && it->second.size == size)
+                return it->second.hash;
+        }
+
+        auto const hash = file.loadFileAsString().hashCode64();
+
+        std::lock_guard<std::mutex> lock(cacheLock);
+        cache[path] = { modified, size, hash };
+        return hash;
+    }
+
+    // Writes the settings and patches. The patches are added to the settings tree, so this doesn't need the Pd lock
+    static void write(OutputStream& output, XmlElement& settings, std::vector<Patch> const& patches)
+    {
+        std::vector<String> contents;
+        std::unordered_map<int64, int> contentIndices;
+
+        auto* patchesTree = settings.createNewChildElement("Patches");
+        for (auto const& patch : patches) {
+            auto* patchTree = patchesTree->createNewChildElement("Patch");
+            patchTree->setAttribute("Location", patch.location);
+            patchTree->setAttribute("PluginMode", patch.pluginMode);
+            patchTree->setAttribute("SplitIndex", patch.splitIndex);
+
+            auto hash = patch.content.hashCode64();
+            auto file = File::isAbsolutePath(patch.location) ? File(patch.location) : File();
+            if (file.existsAsFile() && getFileHash(file) == hash)
+                patchTree->setAttribute("FileHash", String::toHexString(hash));
+
+            auto [it, inserted] = contentIndices.try_emplace(hash, static_cast<int>(contents.size()));
+            if (inserted)
+                contents.push_back(patch.content);
+
+            patchTree->setAttribute("ContentIndex", it->second);
+        }
+
+        MemoryOutputStream payload;
+        payload.writeString(settings.toString(XmlElement::TextFormat().singleLine().withoutHeader()));
+        payload.writeInt(static_cast<int>(contents.size()));
+        for (auto const& content : contents) {
+            payload.writeString(content);
+        }
+
+        auto compress = payload.getDataSize() > compressionThreshold;
+
+        output.writeInt(magic);
+        output.writeInt(currentVersion);
+        output.writeBool(compress);
+
+        if (compress) {
+            GZIPCompressorOutputStream compressor(output, 6);
+            compressor.write(payload.getData(), payload.getDataSize());
+            compressor.flush();
+        } else {
+            output.write(payload.getData(), payload.getDataSize());
+        }
+    }
+
+    // Returns false if the data is not in this format, in which case it should be read as a legacy state
+    // If the data was written by a newer version that we can't read, this returns true but leaves settings empty
+    static bool read(void const* data, size_t size, std::unique_ptr<XmlElement>& settings, std::vector<Patch>& patches)
+    {
+        MemoryInputStream input(data, size, false);
+        if (size < 9 || input.readInt() != magic)
+            return false;
+
+        if (input.readInt() > currentVersion)
+            return true;
+
+        MemoryBlock payloadData;
+        if (input.readBool()) {
+            GZIPDecompressorInputStream decompressor(input);
+            decompressor.readIntoMemoryBlock(payloadData);
+        } else {
+            input.readIntoMemoryBlock(payloadData);
+        }
+
+        MemoryInputStream payload(payloadData, false);
+        settings = parseXML(payload.readString());
+
+        std::vector<String> contents(jlimit<int>(0, static_cast<int>(payload.getNumBytesRemaining()), payload.readInt()));
+        for (auto& content : contents) {
+            content = payload.readString();
+        }
+
+        if (!settings)
+            return true;
+
+        if (auto* patchesTree = settings->getChildByName("Patches")) {
+            for (auto* patchTree : patchesTree->getChildWithTagNameIterator("Patch")) {
+                Patch patch;
+                patch.location = patchTree->getStringAttribute("Location");
+                patch.pluginMode = patchTree->getBoolAttribute("PluginMode");
+                patch.splitIndex = patchTree->getIntAttribute("SplitIndex");
+
+                auto contentIndex = patchTree->getIntAttribute("ContentIndex", -1);
+                if (isPositiveAndBelow(contentIndex, contents.size()))
+                    patch.content = contents[contentIndex];
+
+                // Patches with changes that weren't saved to disk have no file hash, and are restored from their content too
+                auto file = File::isAbsolutePath(patch.location) ? File(patch.location) : File();
+                if (file.existsAsFile() && isPositiveAndBelow(contentIndex, contents.size()))
+                    patch.fileChanged = !patchTree->hasAttribute("FileHash") || getFileHash(file) != patchTree->getStringAttribute("FileHash").getHexValue64();
+
+                patches.push_back(patch);
+            }
+        }
+
+        return true;
+    }
+};
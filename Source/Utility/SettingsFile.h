@@ -128,6 +128,7 @@ private:
         { "add_object_menu_pinned", var(false) },
         { "autosave_interval", var(120) },
         { "autosave_enabled", var(1) },
+        { "parallel_voices", var(false) },
         { "macos_buttons",
 #if JUCE_MAC
             var(true)
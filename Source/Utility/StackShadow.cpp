@@ -1,26 +1,86 @@
-
 #include "StackShadow.h"
 #include <melatonin_blur/melatonin_blur.h>
 
+struct StackShadow::CachedShadow
+{
+    juce::uint64 key;
+    juce::Path shape;
+    std::unique_ptr<melatonin::DropShadow> shadow;
+};
+
+// FNV-1a over the path's elements. Paths with the same hash are compared in full before a shadow is reused
+static juce::uint64 hashPath(juce::Path const& path, juce::uint64 hash = 14695981039346656037ull)
+{
+    auto const add = [&hash](void const* data, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ static_cast<juce::uint8 const*>(data)[i]) * 1099511628211ull;
+    };
+    
+    juce::Path::Iterator it(path);
+    while (it.next()) {
+        add(&it.elementType, sizeof(it.elementType));
+        float const points[] = { it.x1, it.y1, it.x2, it.y2, it.x3, it.y3 };
+        add(points, sizeof(points));
+    }
+    
+    return hash;
+}
 
 StackShadow::StackShadow()
 {
-    dropShadow = new melatonin::DropShadow();
 }
 
 StackShadow::~StackShadow()
 {
-    delete dropShadow;
     clearSingletonInstance();
 }
 
+melatonin::DropShadow& StackShadow::getShadow(juce::Path const& shape, juce::Colour color, int radius, juce::Point<int> offset, float scale)
+{
+    juce::int64 const settings[] = { static_cast<juce::int64>(color.getARGB()), radius, offset.x, offset.y, juce::roundToInt(scale * 1000.0f) };
+    auto key = hashPath(shape);
+    for (auto setting : settings)
+        key = (key ^ static_cast<juce::uint64>(setting)) * 1099511628211ull;
+    
+    if (auto it = lookup.find(key); it != lookup.end()) {
+        if (it->second->shape == shape) {
+            shadows.splice(shadows.begin(), shadows, it->second);
+            return *it->second->shadow;
+        }
+        
+        shadows.erase(it->second);
+        lookup.erase(it);
+    }
+    
+    if (shadows.size() >= maxCachedShadows) {
+        lookup.erase(shadows.back().key);
+        shadows.pop_back();
+    }
+    
+    auto shadow = std::make_unique<melatonin::DropShadow>();
+    shadow->setColor(color);
+    shadow->setOffset(offset);
+    shadow->setRadius(radius);
+    
+    shadows.push_front({ key, shape, std::move(shadow) });
+    lookup[key] = shadows.begin();
+    return *shadows.front().shadow;
+}
+
 void StackShadow::renderDropShadow(juce::Graphics& g, juce::Path const& path, juce::Colour color, int const radius, juce::Point<int> const offset, int spread)
 {
-    auto dropShadow = StackShadow::getInstance()->dropShadow;
-    dropShadow->setColor(color);
-    dropShadow->setOffset(offset);
-    dropShadow->setRadius(radius);
-    dropShadow->render(g, path);
+    // Moving a shadow around doesn't need a new blur, so we cache the shape at the origin and move the graphics context instead
+    // Only whole pixels though, so the cached image doesn't get resampled
+    auto const position = path.getBounds().getPosition().toInt().toFloat();
+    auto shape = path;
+    shape.applyTransform(juce::AffineTransform::translation(-position));
+    
+    auto const scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    auto& shadow = StackShadow::getInstance()->getShadow(shape, color, radius, offset, scale);
+    
+    juce::Graphics::ScopedSaveState saveState(g);
+    g.addTransform(juce::AffineTransform::translation(position));
+    shadow.render(g, shape);
 }
 
 JUCE_IMPLEMENT_SINGLETON(StackShadow)
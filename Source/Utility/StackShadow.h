@@ -1,6 +1,8 @@
 #pragma once
 
 #include <juce_gui_basics/juce_gui_basics.h>
+#include <list>
+#include <unordered_map>
 
 // This needs to be defined before using namespace JUCE
 namespace melatonin
@@ -16,7 +18,18 @@ struct StackShadow : public juce::DeletedAtShutdown
     
     static void renderDropShadow(juce::Graphics& g, juce::Path const& path, juce::Colour color, int const radius = 1, juce::Point<int> const offset = { 0, 0 }, int spread = 0);
     
-    melatonin::DropShadow* dropShadow;
+private:
+    // Every shadow we draw gets its own melatonin::DropShadow, which keeps the blurred image around as long as its settings don't change
+    // They are looked up by the shape of the path (not its position), the shadow settings and the display scale, and the least recently used ones are dropped
+    struct CachedShadow;
     
+    melatonin::DropShadow& getShadow(juce::Path const& shape, juce::Colour color, int radius, juce::Point<int> offset, float scale);
+    
+    std::list<CachedShadow> shadows;
+    std::unordered_map<juce::uint64, std::list<CachedShadow>::iterator> lookup;
+    
+    static constexpr int maxCachedShadows = 256;
+    
+public:
     JUCE_DECLARE_SINGLETON(StackShadow, true)
 };
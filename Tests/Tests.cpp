@@ -5,6 +5,11 @@
 #define Rectangle juce::Rectangle
 
 #include <PluginProcessor.h>
+#include <Pd/Library.h>
+#include <Pd/Interface.h>
+#include <FluidLite/include/fluidlite.h>
+#include <Constants.h>
+#include <Sidebar/DocumentationIndex.h>
 
 
 #include <juce_core/system/juce_TargetPlatform.h>
@@ -77,3 +82,407 @@ TEST_CASE("Create and delete objects", "[name]")
     
     StopApplicationAfter(1500);
 }
+
+TEST_CASE("Library data is shared between instances", "[memory]")
+{
+    juce::ScopedJuceInitialiser_GUI gui;
+
+    constexpr int numInstances = 16;
+    std::vector<std::unique_ptr<pd::Library>> libraries;
+    for (int i = 0; i < numInstances; i++) {
+        libraries.push_back(std::make_unique<pd::Library>(nullptr));
+    }
+
+    // Every instance holds a reference to the same shared data, so the documentation is only parsed once
+    SharedResourcePointer<pd::SharedLibraryData> sharedData;
+    CHECK(sharedData.getReferenceCount() == numInstances + 1);
+
+    libraries.pop_back();
+    CHECK(sharedData.getReferenceCount() == numInstances);
+
+    // ValueTree compares by identity, so this fails if an instance made its own copy of the documentation
+    CHECK(libraries.front()->getAllCategories() == libraries.back()->getAllCategories());
+    CHECK(libraries.front()->getObjectInfo("metro").isValid());
+    CHECK(libraries.front()->getObjectInfo("metro") == libraries.back()->getObjectInfo("metro"));
+}
+
+TEST_CASE("Library index can be rebuilt from a previous index", "[library]")
+{
+    juce::ScopedJuceInitialiser_GUI gui;
+    pd::Library library(nullptr);
+
+    auto getObjectInfo = [&library](String const& name) { return library.getObjectInfo(name); };
+
+    StringArray before = { "metro", "osc~", "my-abstraction", "tabread~" };
+    StringArray after = { "metro", "osc~", "other-abstraction", "delay", "tabread~" };
+
+    pd::LibraryIndex previous(before, getObjectInfo);
+    pd::LibraryIndex incremental(after, getObjectInfo, &previous);
+    pd::LibraryIndex fresh(after, getObjectInfo);
+
+    CHECK(incremental.getAllObjects() == fresh.getAllObjects());
+    for (auto const& query : { "metro", "oscillator", "delay", "abstraction", "table", "my" }) {
+        CHECK(incremental.search(query, 20) == fresh.search(query, 20));
+        CHECK(incremental.getDescription(query) == fresh.getDescription(query));
+    }
+}
+
+TEST_CASE("Lazily registered classes are set up when first used", "[startup]")
+{
+    StartApplication;
+
+    MessageManager::callAsync([=]() {
+        // Whether the classes were registered lazily or eagerly, creating one by name or by its prefixed name should give us the real object
+        auto* counter = editor->getCurrentCanvas()->patch.createObject(200, 200, "cyclone/counter");
+        auto* knob = editor->getCurrentCanvas()->patch.createObject(200, 300, "knob");
+
+        CHECK_THAT(pd::Interface::getObjectClassName(&counter->g_pd), Catch::Matchers::Equals("counter"));
+        CHECK_THAT(pd::Interface::getObjectClassName(&knob->g_pd), Catch::Matchers::Equals("knob"));
+
+        editor->getCurrentCanvas()->patch.removeObjects({ counter, knob });
+
+        // Every line of the registry lists the names that one setup function adds
+        auto registry = StringArray::fromLines(ProjectInfo::versionDataDir.getChildFile(".class_registry").loadFileAsString());
+        registry.removeEmptyStrings();
+        REQUIRE(!registry.isEmpty());
+
+        editor->pd->setThis();
+
+        auto getCreator = [](String const& name) {
+            return reinterpret_cast<void*>(zgetfn(&pd_objectmaker, gensym(name.toRawUTF8())));
+        };
+
+        // Until a class is set up, all of its names go to the same placeholder creator
+        std::map<void*, int> numNamesPerCreator;
+        for (auto const& line : registry) {
+            auto tokens = StringArray::fromTokens(line, false);
+            for (int i = 2; i < tokens.size(); i++)
+                numNamesPerCreator[getCreator(tokens[i])]++;
+        }
+
+        auto placeholder = std::max_element(numNamesPerCreator.begin(), numNamesPerCreator.end(), [](auto const& a, auto const& b) { return a.second < b.second; })->first;
+
+        StringArray unusedClasses;
+        for (auto const& line : registry) {
+            auto tokens = StringArray::fromTokens(line, false);
+            if (tokens.size() > 2 && getCreator(tokens[2]) == placeholder)
+                unusedClasses.add(line);
+        }
+
+        // The registry is written by the first run, which sets up every class straight away
+        if (unusedClasses.size() < 2) {
+            WARN("No lazily registered classes, the class registry was probably just created");
+            return;
+        }
+
+        // Setup functions that share a name are set up together, so the other class can't share any
+        auto names = StringArray::fromTokens(unusedClasses[0], false);
+        String otherName;
+        for (int i = 1; i < unusedClasses.size() && otherName.isEmpty(); i++) {
+            auto otherNames = StringArray::fromTokens(unusedClasses[i], false);
+            otherNames.removeRange(0, 2);
+            if (std::none_of(otherNames.begin(), otherNames.end(), [&names](auto const& name) { return names.indexOf(name) >= 2; }))
+                otherName = otherNames[0];
+        }
+        REQUIRE(otherName.isNotEmpty());
+
+        auto& patch = editor->getCurrentCanvas()->patch;
+        auto createStart = Time::getMillisecondCounterHiRes();
+        auto* object = patch.createObject(200, 200, names[2]);
+        auto createTime = Time::getMillisecondCounterHiRes() - createStart;
+
+        INFO("Creating the first " << names[2] << " took " << createTime << " ms, including its setup");
+        REQUIRE(object != nullptr);
+        patch.removeObjects({ object });
+
+        // The real creators replaced the placeholders of every name that the setup function added, and nothing else was set up
+        for (int i = 2; i < names.size(); i++)
+            CHECK(getCreator(names[i]) != placeholder);
+
+        CHECK(getCreator(otherName) == placeholder);
+
+        // Now that the class is set up, creating it by name goes straight to its own creator
+        object = patch.createObject(200, 200, names[2]);
+        CHECK(object != nullptr);
+        if (object)
+            patch.removeObjects({ object });
+    });
+
+    StopApplicationAfter(1500);
+}
+
+// Renders a second of chords from a looped noise sample, with every channel pitched differently so the interpolators hit all table rows
+static std::vector<float> renderSoundfont(bool useSIMD, int interpolation)
+{
+    constexpr int numFrames = 44100;
+    std::vector<short> data(4096);
+    juce::Random random(1234);
+    for (int i = 0; i < data.size(); i++) {
+        data[i] = static_cast<short>(random.nextInt({ -16384, 16384 }) + 8000 * std::sin(i * 0.05));
+    }
+
+    fluid_synth_set_simd(useSIMD);
+
+    auto* settings = new_fluid_settings();
+    auto* synth = new_fluid_synth(settings);
+    auto* sfont = fluid_ramsfont_create_sfont();
+    auto* ramsfont = static_cast<fluid_ramsfont_t*>(sfont->data);
+    auto* sample = new_fluid_ramsample();
+
+    fluid_sample_set_sound_data(sample, data.data(), static_cast<unsigned int>(data.size()), 1, 60);
+    fluid_ramsfont_add_izone(ramsfont, 0, 0, sample, 0, 127);
+    fluid_ramsfont_izone_set_loop(ramsfont, 0, 0, sample, 1, 100, -100);
+    fluid_synth_add_sfont(synth, sfont);
+    fluid_synth_set_interp_method(synth, -1, interpolation);
+
+    for (int channel = 0; channel < 4; channel++) {
+        fluid_synth_program_select(synth, channel, fluid_sfont_get_id(sfont), 0, 0);
+        fluid_synth_pitch_bend(synth, channel, 8192 + channel * 700);
+    }
+    for (int note = 0; note < 24; note++) {
+        fluid_synth_noteon(synth, note % 4, 36 + note * 3, 60 + note);
+    }
+
+    std::vector<float> output(numFrames * 2);
+    fluid_synth_write_float(synth, numFrames, output.data(), 0, 1, output.data() + numFrames, 0, 1);
+
+    // Deleting the synth deletes the soundfont and its samples as well
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+
+    return output;
+}
+
+TEST_CASE("Vectorised soundfont rendering matches the scalar kernels", "[fluidlite]")
+{
+    for (auto interpolation : { FLUID_INTERP_NONE, FLUID_INTERP_LINEAR, FLUID_INTERP_4THORDER, FLUID_INTERP_7THORDER }) {
+        auto reference = renderSoundfont(false, interpolation);
+        auto vectorised = renderSoundfont(true, interpolation);
+
+        float maxDifference = 0.0f;
+        float peak = 0.0f;
+        for (int i = 0; i < reference.size(); i++) {
+            maxDifference = std::max(maxDifference, std::abs(reference[i] - vectorised[i]));
+            peak = std::max(peak, std::abs(reference[i]));
+        }
+
+        // The vectorised kernels ramp the amplitude differently, so they match within rounding, not bit for bit
+        INFO("Interpolation " << interpolation << ": peak " << peak << ", largest difference " << maxDifference);
+        CHECK(peak > 0.01f);
+        CHECK(maxDifference < 1e-5f);
+    }
+
+    fluid_synth_set_simd(true);
+}
+
+TEST_CASE("Fused output stage matches the separate passes", "[audio]")
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 7;
+    constexpr int blockSize = 256;
+
+    OutputStage outputStage;
+    outputStage.prepare(sampleRate, blockSize, numChannels);
+
+    // This is how the output used to be processed: one pass for each step, with the limiter built from two dsp::Compressors
+    dsp::ProcessSpec spec { sampleRate, blockSize, numChannels };
+    dsp::Compressor<float> firstStage, secondStage;
+    firstStage.prepare(spec);
+    firstStage.setThreshold(-8.0f);
+    firstStage.setRatio(4.0f);
+    firstStage.setAttack(2.0f);
+    firstStage.setRelease(200.0f);
+    secondStage.prepare(spec);
+    secondStage.setThreshold(-6.0f);
+    secondStage.setRatio(1000.0f);
+    secondStage.setAttack(0.001f);
+    secondStage.setRelease(100.0f);
+
+    SmoothedValue<float, ValueSmoothingTypes::Linear> referenceGain, fusedGain;
+    referenceGain.reset(sampleRate, 0.02);
+    fusedGain.reset(sampleRate, 0.02);
+
+    juce::Random random(4321);
+    float maxDifference = 0.0f;
+    float maxPeakDifference = 0.0f;
+
+    for (int block = 0; block < 200; block++) {
+        auto const numSamples = block % 5 == 4 ? 100 : blockSize;
+        auto const protect = block % 100 < 80;
+
+        AudioBuffer<float> reference(numChannels, numSamples);
+        for (int ch = 0; ch < numChannels; ch++) {
+            for (int i = 0; i < numSamples; i++) {
+                auto sample = (random.nextFloat() * 2.0f - 1.0f) * (block % 40 < 20 ? 0.3f : 3.0f);
+                if (random.nextInt(1000) == 0)
+                    sample = std::numeric_limits<float>::quiet_NaN();
+                else if (random.nextInt(1000) == 0)
+                    sample = std::numeric_limits<float>::infinity();
+                reference.setSample(ch, i, sample);
+            }
+        }
+        AudioBuffer<float> fused(reference);
+
+        auto const gain = block % 30 < 15 ? 0.5f : 1.7f;
+        referenceGain.setTargetValue(gain);
+        fusedGain.setTargetValue(gain);
+
+        referenceGain.applyGain(reference, numSamples);
+
+        float referencePeaks[numChannels] = {};
+        for (int ch = 0; ch < numChannels; ch++) {
+            for (int i = 0; i < numSamples; i++) {
+                auto const sample = reference.getSample(ch, i);
+                if (std::isfinite(sample))
+                    referencePeaks[ch] = std::max(referencePeaks[ch], std::abs(sample));
+            }
+        }
+
+        if (protect) {
+            for (int ch = 0; ch < numChannels; ch++) {
+                for (int i = 0; i < numSamples; i++) {
+                    if (!std::isfinite(reference.getSample(ch, i)))
+                        reference.setSample(ch, i, 0.0f);
+                }
+            }
+
+            auto audioBlock = dsp::AudioBlock<float>(reference);
+            firstStage.process(dsp::ProcessContextReplacing<float>(audioBlock));
+            secondStage.process(dsp::ProcessContextReplacing<float>(audioBlock));
+            for (int ch = 0; ch < numChannels; ch++) {
+                FloatVectorOperations::clip(reference.getWritePointer(ch), reference.getReadPointer(ch), -1.0f, 1.0f, numSamples);
+            }
+        }
+
+        outputStage.process(fused, fusedGain, protect);
+
+        for (int ch = 0; ch < numChannels; ch++) {
+            for (int i = 0; i < numSamples; i++) {
+                auto const expected = reference.getSample(ch, i);
+                auto const actual = fused.getSample(ch, i);
+                if (std::isfinite(expected) || std::isfinite(actual))
+                    maxDifference = std::max(maxDifference, std::abs(expected - actual));
+            }
+
+            if (protect)
+                maxPeakDifference = std::max(maxPeakDifference, std::abs(referencePeaks[ch] - outputStage.getPeaks()[ch]));
+        }
+    }
+
+    INFO("Largest difference " << maxDifference << ", largest peak difference " << maxPeakDifference);
+    CHECK(maxDifference < 1e-5f);
+    CHECK(maxPeakDifference < 1e-5f);
+}
+
+TEST_CASE("Documentation index finds help patches by their contents", "[documentation]")
+{
+    auto root = File::createTempFile("");
+    root.getChildFile("filters").createDirectory();
+    root.getChildFile("filters").getChildFile("lop~-help.pd").replaceWithText("#N canvas 0 50 450 300 12;\n#X obj 30 30 lop~ 1000;\n#X text 30 60 one-pole lowpass filter \\, f 40;\n");
+
+    auto cache = File::createTempFile("");
+    auto update = [&root](DocumentationIndex& index) {
+        return index.update(root, []() { return false; });
+    };
+    auto search = [](DocumentationIndex const& index, String const& query) {
+        auto documents = index.getSearchableDocuments();
+        StringArray names;
+        for (auto* document : DocumentationIndex::search(documents, query))
+            names.add(document->name);
+        return names;
+    };
+
+    DocumentationIndex index(cache);
+    CHECK(update(index));
+    CHECK(search(index, "lop~") == StringArray { "lop~-help.pd" });
+    CHECK(search(index, "pole lowpass") == StringArray { "lop~-help.pd" });
+    CHECK(search(index, "highpass").isEmpty());
+
+    // Nothing changed, so nothing has to be read again
+    CHECK_FALSE(update(index));
+    index.save();
+
+    // A new session picks up the saved index, and notices files that were added in the meantime
+    root.getChildFile("filters").getChildFile("hip~-help.pd").replaceWithText("#N canvas 0 50 450 300 12;\n#X obj 30 30 hip~ 10;\n#X text 30 60 one-pole highpass filter;\n");
+
+    DocumentationIndex reloaded(cache);
+    reloaded.load(root);
+    reloaded.markChanged(root.getChildFile("filters").getChildFile("hip~-help.pd"));
+    CHECK(search(reloaded, "lowpass") == StringArray { "lop~-help.pd" });
+    CHECK(update(reloaded));
+    CHECK(search(reloaded, "highpass") == StringArray { "hip~-help.pd" });
+
+    root.deleteRecursively();
+    cache.deleteFile();
+}
+
+TEST_CASE("Skipped and parallel clone voices sound exactly like Pd's clone", "[audio]")
+{
+    StartApplication;
+
+    auto directory = File::createTempFile("");
+    directory.createDirectory();
+
+    // Every voice plays its own frequency, voice 3 is silent and reports itself inactive
+    String const voice = "#N canvas 0 0 450 300 12;\n"
+                         "#X obj 10 10 loadbang;\n"
+                         "#X obj 10 40 f \\$1;\n"
+                         "#X obj 10 70 * 110;\n"
+                         "#X obj 10 100 + 110;\n"
+                         "#X obj 10 130 osc~;\n"
+                         "#X obj 120 130 != 3;\n"
+                         "#X obj 10 160 *~ 0;\n"
+                         "#X obj 10 190 outlet~;\n"
+                         "#X obj 220 70 sel 3;\n"
+                         "#X msg 220 100 list \\$0 0;\n"
+                         "#X obj 220 130 s plugdata-voice-activity;\n"
+                         "#X connect 0 0 1 0;\n#X connect 1 0 2 0;\n#X connect 2 0 3 0;\n#X connect 3 0 4 0;\n#X connect 1 0 5 0;\n"
+                         "#X connect 4 0 6 0;\n#X connect 5 0 6 1;\n#X connect 6 0 7 0;\n#X connect 1 0 8 0;\n#X connect 8 0 9 0;\n#X connect 9 0 10 0;\n";
+
+    // The same voice with a block~ object, which makes us leave the clone to Pd
+    directory.getChildFile("voice_own_chain.pd").replaceWithText(voice);
+    directory.getChildFile("voice_pd_chain.pd").replaceWithText(voice + "#X obj 300 10 block~ 64;\n");
+
+    auto patchFile = directory.getChildFile("voices.pd");
+    patchFile.replaceWithText("#N canvas 0 0 450 300 12;\n"
+                              "#X obj 10 10 clone voice_own_chain 8;\n"
+                              "#X obj 200 10 clone voice_pd_chain 8;\n"
+                              "#X obj 10 60 dac~ 1 2;\n"
+                              "#X connect 0 0 2 0;\n#X connect 1 0 2 1;\n");
+
+    MessageManager::callAsync([=]() {
+        auto* pd = editor->pd;
+        pd->voiceActivity.setParallelRendering(true);
+
+        REQUIRE(pd->loadPatch(patchFile, editor) != nullptr);
+
+        constexpr int blockSize = 64;
+        std::vector<float> inputs(blockSize * 2, 0.0f);
+        std::vector<float> outputs(blockSize * 2, 0.0f);
+
+        pd->lockAudioThread();
+        pd->prepareDSP(0, 2, 44100.0, blockSize);
+        pd->setThis();
+        pd->startDSP();
+
+        int numDifferentSamples = 0;
+        float peak = 0.0f;
+        for (int block = 0; block < 32; block++) {
+            pd->performDSP(inputs.data(), outputs.data());
+            for (int i = 0; i < blockSize; i++) {
+                numDifferentSamples += outputs[i] != outputs[blockSize + i];
+                peak = std::max(peak, std::abs(outputs[blockSize + i]));
+            }
+        }
+
+        pd->releaseDSP();
+        pd->unlockAudioThread();
+
+        CHECK(peak > 0.0f);
+        CHECK(numDifferentSamples == 0);
+
+        directory.deleteRecursively();
+    });
+
+    StopApplicationAfter(2000);
+}